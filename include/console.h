@@ -0,0 +1,43 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// Serial command console.
+//
+// Type a line into the serial monitor and press enter:
+//
+//   list                 show every tunable, its value and bounds
+//   get <name>           show one tunable
+//   set <name> <value>   change a tunable, takes effect on the next loop
+//   save                 keep the current tunables in flash across reboots
+//   defaults             go back to the compiled-in tunables
+//   dump                 print the flight recorder
+//   arm                  clear the flight recorder and start recording again
+//   trig [<what>...]     show (or set) what freezes the flight recorder:
+//                        lonely, touch, fault, or none
+//   lat [reset]          show (or clear) touch-to-light latency
+//   stats                show touch / near counts, hour by hour
+//   mem                  show SRAM use: heap, deepest stack, headroom
+//   dist                 show the finger's distance and the calibration curve
+//   dist cal <mm>        hold a finger <mm> away, then this puts it on the curve
+//   dist save            keep the curve in flash;  dist defaults  start over
+//   lock                 show the secret knock patterns and the last knock
+//   lock rec <n> <what>  the next knock becomes pattern n, doing <what>:
+//                        unlock, effect, debug or none
+//   lock clear <n>       forget pattern n;  lock save  keep them in flash
+//   health [clear]       show the sensor health checks (or clear a fault)
+//   prox                 show the proximity tracker: where and how fast
+//   prof [reset]         show (or clear) loop timings, profiling builds only
+//   help                 show the commands
+//
+// The console never waits for input.  Each call to consolePoll() takes at
+// most CONSOLE_BYTES_PER_POLL characters that have already arrived, and
+// the line is parsed in place in a fixed buffer - no String, no malloc.
+
+#define CONSOLE_LINE_LENGTH 48  // Longest command line we accept.
+#define CONSOLE_BYTES_PER_POLL 16 // Upper bound on the work done per loop.
+#define CONSOLE_MAX_ARGS 4        // Words in a line, command included.
+
+// Call once per loop.
+void consolePoll();
+
+#endif
@@ -0,0 +1,487 @@
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdint.h>
+#include "gesture.h"
+#include "proximity.h"
+#include "water_film.h"
+
+// The detection and lighting code, one reading at a time: keep the
+// baseline, tell water from a finger, decide touched and near, and work
+// out what the light should do about it.
+//
+// loop() in main.cpp runs this on the board, and the PC tools run the
+// very same code - thousands of copies at once, over recorded and made up
+// traces (see src/host/pipeline_model.h).  So everything it remembers is
+// in a DetectState rather than in globals and statics, and the tunables
+// come in as a DetectParams.  The parts that only mean something on the
+// board - the sensor health checks, the serial port, the secret knock and
+// the pins - stay in loop(), around it.
+//
+// A reading goes through two steps, with loop()'s own work in between:
+//
+//   detectSample()  the baseline, the water, touched and near, the
+//                   proximity tracker, and when the last touch was;
+//   detectLight()   the gestures, and the light: full on after a touch,
+//                   throbbing at the end of that, or glowing with a
+//                   finger near.  It only works the light out - state.pwm
+//                   - and leaves writing it to the pin to the caller.
+//
+// It is written once for any kind of number.  The board uses int: the
+// baseline and the near average are running totals divided down with the
+// remainder thrown away, and so are the brightnesses.  The reference
+// model (src/host/reference_model.h) uses double, to see what that costs.
+// The water detector and the proximity tracker work in whole counts
+// either way.
+
+#define DETECT_NUM_BASELINE 5000 // Readings averaged for the baseline.
+#define DETECT_NUM_MEAS 50       // Readings averaged for the near light.
+#define DETECT_START_BASE 725    // Where the baseline starts, before it
+                                 // has seen a reading.
+#define DETECT_BASELINE_TIME 5000 // Number of milliseconds to take baseline
+                                  // readings before starting to do anything.
+#define DETECT_LIGHT_THROB_TIME 10000 // Number of milliseconds to keep the
+                                      // throbbing after the on-light period.
+#define DETECT_CLEAR_TIME 30000 // The last touch starts out this long ago,
+                                // so the first one always registers.
+#define DETECT_MAXIMUM_BRIGHTNESS 255 // The LEDs can be *very* bright.  This
+                                      // allows some amount of max control.
+#define DETECT_MINIMUM_BRIGHTNESS 10  // The bottom of the throb.
+#define DETECT_APPROACH_WINDOW 500 // Milliseconds.  A real finger passes
+                                   // through "near" on its way to a touch.
+                                   // A touch with no near reading this
+                                   // recently is suspicious.
+#define DETECT_NEAR_READINGS 3 // Readings in a row over (or not over)
+                               // minOver before near starts (or ends).
+                               // One noisy reading over it is no finger.
+
+// The tunables the detection uses (see params.h).
+struct DetectParams
+{
+  int spread;
+  int minOver;
+  int debounceMs;
+  int lightOnMs;
+  int lightSteps;
+  bool gestures;
+  bool tracker;
+  int trackAccel;
+  GestureTiming gestureTiming;
+};
+
+// The tunables as they are right now.
+DetectParams detectParams();
+
+// Everything the detection remembers between readings.  The two averages'
+// rings are the caller's, so the board can keep them in plain arrays, and
+// so is the proximity tracker, which the console shows.
+template <typename Number> struct DetectStateOf
+{
+  // A constexpr constructor, so the board's copy is filled in before the
+  // startup code runs anything - there is nothing to forget to call.
+  constexpr DetectStateOf(int *baseReadings, int numBaseline, int *measSet, int numMeas, ProximityTracker *tracker)
+      : baseReadings(baseReadings), numBaseline(numBaseline), baseCount(0), baseSum(0), base(DETECT_START_BASE),
+        water(), tracker(tracker), measSet(measSet), numMeas(numMeas), measCount(0), measSum(0), avg(0), measured(-1),
+        lastLightMeasure(0), steps(0), direction(true), started(false), touchTime(0), touchLit(true), stayLit(false),
+        warmedUp(false), wasTouched(false), near(false), nearRun(0), lastNearTime(0), gesture(), pwm(0)
+  {
+  }
+
+  // The baseline: the last numBaseline readings in a ring, and their total.
+  int *baseReadings;
+  int numBaseline;
+  uint32_t baseCount; // Counts every reading.  Unsigned, because at 100
+                      // readings a second an int runs out after 248 days
+                      // and baseCount % numBaseline would go negative.
+  Number baseSum;     // Always the total of everything in baseReadings.
+  Number base;
+  WaterFilm water;
+  ProximityTracker *tracker;
+
+  // The near light's average, kept the same way.
+  int *measSet;
+  int numMeas;
+  uint32_t measCount;
+  Number measSum;
+  Number avg;
+  int measured; // What this reading added to the average, or -1.
+  Number lastLightMeasure;
+
+  // The throb.
+  int steps;
+  bool direction;
+
+  bool started;
+  uint32_t touchTime; // When the last touched reading was.
+  // Whether the light still belongs to touchTime.  "now - touchTime" is
+  // right across the 49.7 day millis() wrap, but it can't tell a touch 40
+  // seconds ago from one 49.7 days and 40 seconds ago - so without this a
+  // box nobody touches for 49.7 days lights up by itself.  Starts true for
+  // the little throb after the baseline time at power on.
+  bool touchLit;
+  bool stayLit;  // Held: keep the light on until the next tap.
+  bool warmedUp; // Past DETECT_BASELINE_TIME, for good.
+  bool wasTouched;
+  bool near;    // In a near phase - or touched, which ends in one.
+  int nearRun;  // Readings in a row that disagree with near.
+  uint32_t lastNearTime;
+  GestureChannel gesture;
+  Number pwm; // The light, as the detection last set it.
+};
+
+typedef DetectStateOf<int> DetectState;
+
+// What one reading was judged to be.
+struct DetectReading
+{
+  WaterVerdict water;
+  bool faulty;      // As passed to detectSample().
+  bool ignored;     // Water, or a fault: the reading isn't looked at.
+  bool touched;
+  bool near;        // A finger near, not touching.  It takes
+                    // DETECT_NEAR_READINGS readings to start or end.
+  bool touchStart;  // First touched reading of a touch.
+  bool nearStart;   // First near reading, not on the way off a touch.
+  bool lonelyTouch; // A touch start with no near reading in the last
+                    // DETECT_APPROACH_WINDOW.
+  bool registered;  // A touch that counts as a new one: the first after at
+                    // least debounceMs with no touched reading.
+
+  // Filled in by detectLight().
+  Gesture gesture;
+  bool warmedUp;     // Past DETECT_BASELINE_TIME.  Until then the light is
+                     // left alone.
+  bool lightChanged; // state.pwm was set, and should go out to the pin.
+  bool glowStart;    // The near light came on from off.
+};
+
+// This is the function that averages in a new base reading.
+// Readings will float based on a number of factors.  Moisture
+// in the air (a.k.a. the dialectric), temperature, and the
+// physical properties of the sensor and even radio energy
+// both emitted and absorbed by nearby metals.  So, we need
+// to constantly update the base value.
+// This is the heart of the "adaptive" or "learning" part.
+template <typename Number> Number detectBaseAvg(DetectStateOf<Number> &state, int reading)
+{
+  state.baseCount++;
+
+  // By using MODULO, we can keep the array index within the
+  // bounds of the array. Treating it as a circular buffer.
+  int slot = state.baseCount % state.numBaseline;
+
+  // Rather than adding up all 5000 readings every time, keep a running
+  // total: take out the reading we are about to overwrite and put in the
+  // new one.  Same answer, two additions instead of five thousand.
+  state.baseSum += reading - state.baseReadings[slot];
+  state.baseReadings[slot] = reading;
+
+  state.base = state.baseSum / state.numBaseline;
+  return state.base;
+}
+
+// Start the baseline again from `value`, as if every reading it averages
+// had been that.
+template <typename Number> void detectFillBaseline(DetectStateOf<Number> &state, int value)
+{
+  for (int i = 0; i < state.numBaseline; i++)
+  {
+    state.baseReadings[i] = value;
+  }
+  state.baseSum = (Number)value * state.numBaseline;
+  state.base = value;
+}
+
+// Average in a measurement for the near light, and return the average.
+template <typename Number> Number detectAddMeasurement(DetectStateOf<Number> &state, int measurement)
+{
+  state.measured = measurement;
+  state.measCount++;
+  int slot = state.measCount % state.numMeas;
+  state.measSum += measurement - state.measSet[slot];
+  state.measSet[slot] = measurement;
+  state.avg = state.measSum / state.numMeas;
+  return state.avg;
+}
+
+// The purpose of this function is to set a light value to corresponds
+// to how "close" the user's finger is to the box.
+// The closer the finger, the higher the light value.  But, we have
+// to be careful because it needs to be within the range of the
+// detection threshold which is always shifting a little.
+// Returns whether it set state.pwm.
+template <typename Number> bool detectAtNear(DetectStateOf<Number> &state, const DetectParams &params, int measurement)
+{
+  // The tracker needs no fading: it follows the finger out as quickly as
+  // it followed it in.  It does follow the noise more closely than the
+  // average, though, so it has to clear the noise as well before the
+  // light comes on.
+  if (params.tracker)
+  {
+    Number over = measurement == 0 ? 0 : proximityLevel(*state.tracker) - state.base;
+    int bar = params.minOver + PROXIMITY_LIGHT_NOISE * state.tracker->noise / 16;
+    state.pwm = over > bar ? (over < DETECT_MAXIMUM_BRIGHTNESS ? over : DETECT_MAXIMUM_BRIGHTNESS) : 0;
+    return true;
+  }
+
+  // This checks to see if we like the measurement for "near".
+  if (measurement > state.base + params.minOver)
+  {
+    // We have a good measurement.  So, we want to set the light
+    // to the value that corresponds to how close the finger is.
+    Number avgMeasure = detectAddMeasurement(state, measurement);
+
+    // Slight adjustment to the light value to make it more
+    // visible.
+    state.lastLightMeasure = avgMeasure - state.base;
+
+    // Check to make sure the light value is within the range "on average"
+    if (avgMeasure > state.base + params.minOver)
+    {
+      state.pwm = state.lastLightMeasure;
+      return true;
+    }
+    return false;
+  }
+
+  // This is the case where the user's finger is not close enough
+  // to the sensor to be detected.  We want to semi-slowly fade the
+  // light down to zero.
+  Number avgMeasure = detectAddMeasurement(state, 0);
+
+  Number closingValue = avgMeasure - state.base;
+  if (closingValue > state.lastLightMeasure)
+  {
+    closingValue = state.lastLightMeasure;
+  }
+
+  // Without this check the light will go negative and the LED will
+  // turn on because the value is interpreted as a very large number.
+  if (closingValue < 0)
+  {
+    closingValue = 0;
+  }
+
+  // Check to see if there is still enough value here to have it on.
+  // Otherwise, turn it off completely.
+  state.pwm = avgMeasure > state.base - params.minOver ? closingValue : 0;
+  return true;
+}
+
+// lightSteps (see NUM_LIGHT_STEPS) determines how many changes in
+// the light output there are.  The higher the number, the more gradual
+// and longer it will take to get to the minumum or maximum
+// brightness. When it reaches the minumum or maximum brightness
+// it will reverse direction.  `reset` simply restarts the throb.
+// Returns whether it set state.pwm.
+template <typename Number> bool detectAtStep(DetectStateOf<Number> &state, const DetectParams &params, bool reset)
+{
+  if (reset)
+  {
+    state.direction = true;
+    state.steps = 0;
+    return false;
+  }
+
+  if (state.steps >= params.lightSteps)
+  {
+    state.direction = false;
+  }
+
+  if (state.steps <= 0)
+  {
+    state.direction = true;
+  }
+
+  state.steps += state.direction ? 1 : -1;
+  state.pwm = (Number)(255 - DETECT_MINIMUM_BRIGHTNESS) * state.steps / params.lightSteps + DETECT_MINIMUM_BRIGHTNESS;
+  return true;
+}
+
+// The first part of detectSample(): the baseline, and water on the pad.
+// Neither depends on the tunables, only on the readings, so the sweep
+// tools can work them out once for many settings at a time (see
+// src/host/pipeline_batch.h).
+template <typename Number> WaterVerdict detectBaseline(DetectStateOf<Number> &state, uint32_t now, int raw, bool faulty)
+{
+  // Stash a reading... always - this is averaged over the 5000 or so
+  // readings for maintaining the baseline.  With a faulty sensor the
+  // baseline is left where it was.
+  if (faulty)
+  {
+    state.baseCount++; // Still counted, for the things that go by it.
+    return WATER_CLEAR;
+  }
+  detectBaseAvg(state, raw);
+
+  // Is that water on the pad rather than a finger (see water_film.h)?
+  // While we wait to be sure the reading is ignored; once we are, the
+  // baseline jumps to the water so the box works on top of it.
+  WaterVerdict verdict = waterFilmSample(state.water, now, raw, (int)state.base);
+  if (verdict == WATER_REBASE)
+    detectFillBaseline(state, state.water.level); // Moved, not lost - not a reset.
+  return verdict;
+}
+
+// Near is only minOver above the base, inside the noise of a noisy
+// pad, so one reading over it means nothing.  A near phase starts once
+// DETECT_NEAR_READINGS readings in a row are `over`, and ends once as
+// many in a row aren't; `run` counts them.  A touch counts as near, so
+// the finger leaving a touch is the end of that near phase rather than
+// the start of a new one.  Returns whether this is a near reading.  The
+// quality tool runs it for other thresholds (see src/host/tools).
+inline bool detectNearDebounce(bool &near, int &run, bool over, bool touched)
+{
+  if (touched || over == near)
+    run = 0;
+  else if (++run >= DETECT_NEAR_READINGS)
+  {
+    near = over;
+    run = 0;
+  }
+  if (touched)
+    near = true;
+  return near && !touched;
+}
+
+// Take a reading, `raw`, at `now` in milliseconds.  `faulty` is what the
+// sensor health checks make of the sensor (see sensor_health.h): a broken
+// wire or a shorted pad gives readings that mean nothing, so while it is
+// faulty they are kept away from everything here.
+template <typename Number>
+DetectReading detectSample(DetectStateOf<Number> &state, const DetectParams &params, uint32_t now, int raw, bool faulty)
+{
+  DetectReading reading = {};
+  reading.faulty = faulty;
+  if (!state.started)
+  {
+    state.touchTime = now - DETECT_CLEAR_TIME; // Start in a "clearable" state.
+    state.started = true;
+  }
+
+  reading.water = detectBaseline(state, now, raw, faulty);
+  reading.ignored = reading.water == WATER_SUSPECT || faulty;
+
+  // This is the check to see if the sensor is being touched.
+  // If the reading is spread above the base, then we belive a finger
+  // was needed to get it there.
+  reading.touched = !reading.ignored && raw >= state.base + params.spread;
+
+  // Is a finger near?  Not on one reading alone.
+  bool over = !reading.ignored && raw > state.base + params.minOver;
+  bool wasNear = state.near;
+  reading.near = detectNearDebounce(state.near, state.nearRun, over, reading.touched);
+
+  // Follow the finger, and learn the noise while nobody is near (see
+  // proximity.h).  Ignored readings would only teach it the water.
+  if (!reading.ignored)
+    proximitySample(*state.tracker, now, raw, (int)state.base, !reading.near && !reading.touched, params.trackAccel);
+
+  // Work out where touches and near phases begin, and whether a touch
+  // came the normal way - through near first - or out of nowhere.
+  reading.touchStart = reading.touched && !state.wasTouched;
+  reading.nearStart = reading.near && !wasNear;
+  if (reading.near)
+    state.lastNearTime = now;
+  reading.lonelyTouch =
+      reading.touchStart && (state.lastNearTime == 0 || now - state.lastNearTime > DETECT_APPROACH_WINDOW);
+  state.wasTouched = reading.touched;
+
+  // Sometimes a finger still sits on the pad between touches, or
+  // bounces on the threshold - a touch only registers once the finger
+  // has been away for debounceMs.
+  reading.registered = reading.touched && now - state.touchTime > (uint32_t)params.debounceMs;
+  if (reading.touched)
+  {
+    state.touchTime = now; // Record the timestamp of the touch, and use it later.
+    state.touchLit = true;
+  }
+  return reading;
+}
+
+// Skip straight to the throb at the end of a touch's light, as one of the
+// secret knocks can ask for (see tap_lock.h).
+template <typename Number> void detectSkipToThrob(DetectStateOf<Number> &state, const DetectParams &params, uint32_t now)
+{
+  state.touchTime = now - (params.lightOnMs - DETECT_LIGHT_THROB_TIME);
+  state.touchLit = true;
+}
+
+// What the light does about the reading detectSample() judged.
+template <typename Number>
+void detectLight(DetectStateOf<Number> &state, const DetectParams &params, uint32_t now, int raw,
+                 DetectReading &reading)
+{
+  // What kind of touch was that (see gesture.h)?  The light only takes
+  // any notice with the "gestures" tunable on.
+  reading.gesture = gestureSample(state.gesture, params.gestureTiming, now, reading.touched);
+  if (params.gestures)
+  {
+    switch (reading.gesture)
+    {
+    case GESTURE_TAP:
+      state.stayLit = false;
+      break;
+    case GESTURE_LONG_PRESS:
+      state.stayLit = false;
+      state.touchLit = false; // Off now, rather than in lightOnMs.
+      break;
+    case GESTURE_HOLD:
+      state.stayLit = true;
+      break;
+    default:
+      break;
+    }
+  }
+  else
+    state.stayLit = false;
+  if (state.stayLit)
+  {
+    state.touchTime = now;
+    state.touchLit = true;
+  }
+
+  // For the first 5 seconds... just take readings and don't do anything.
+  // Only once - millis() comes back round to 0 every 49.7 days.
+  state.measured = -1;
+  reading.lightChanged = false;
+  reading.glowStart = false;
+  reading.warmedUp = state.warmedUp || now >= DETECT_BASELINE_TIME;
+  state.warmedUp = reading.warmedUp;
+  if (!reading.warmedUp || reading.faulty)
+    return; // A faulty sensor's light blinks out what is wrong instead.
+
+  // Assuming a touch occurred in the last lightOnMs milliseconds...
+  // If we are the main lightOnMs interval the light will either be
+  // full on, or in the last DETECT_LIGHT_THROB_TIME interval it will throb.
+  // Note - if no touch has occurred in the last lightOnMs milliseconds
+  // then we check to see if the user is NEAR and light based on that nearness.
+  if (state.touchLit && now - state.touchTime < (uint32_t)params.lightOnMs)
+  {
+    if (now - state.touchTime > (uint32_t)(params.lightOnMs - DETECT_LIGHT_THROB_TIME))
+    {
+      // This is the last part of the "ON" time.  It lets the user
+      // know its about to shut off.
+      reading.lightChanged = detectAtStep(state, params, false);
+    }
+    else
+    {
+      // We just turn it on if we are in the "main" "on" portion of the light
+      // touch cycle.
+      state.pwm = DETECT_MAXIMUM_BRIGHTNESS;
+      detectAtStep(state, params, true);
+      reading.lightChanged = true;
+    }
+  }
+  else
+  {
+    state.touchLit = false; // That touch is over, however long ago it was.
+    // The light is bright in proportion to how close the user's finger is
+    // to the sensor.  0 fades the light, as when nobody is near.
+    bool wasDark = state.pwm == 0;
+    reading.lightChanged = detectAtNear(state, params, reading.ignored ? 0 : raw);
+    reading.glowStart = wasDark && state.pwm > 0;
+  }
+}
+
+#endif
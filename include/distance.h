@@ -0,0 +1,86 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <stdint.h>
+
+// How far away the finger is, in millimetres.
+//
+// lightAtNear() turns avgMeasure - qt_base straight into brightness, but
+// that number doesn't go up in step with the finger coming closer: the
+// extra capacitance grows roughly as the inverse square of the distance,
+// so it hardly moves from 40mm to 20mm and then shoots up over the last
+// few millimetres.  To know how far away the finger really is we need the
+// curve for this particular box - pad size, enclosure and wiring all
+// change it - so it is kept as a short table of (counts over the
+// baseline, millimetres) points, with straight lines between them.
+//
+// The table comes with a curve worked out for a typical box and can be
+// calibrated over the serial console ("dist cal 20" with a finger held
+// 20mm away, see console.h), then saved in flash next to the tunables.
+//
+// distanceMm() runs every loop, so it costs the same whatever the
+// reading: it always looks at every point, with no early exit, and the
+// slope of each line is worked out when the table changes rather than
+// dividing on every call - the Cortex-M0+ has no divide instruction.
+
+#define DISTANCE_POINTS 8       // Points in the table.
+#define DISTANCE_FAR 255        // Further away than the table reaches.
+#define DISTANCE_SLOPE_SHIFT 8  // Slopes are millimetres per count, times 256.
+#define DISTANCE_SMOOTH_SHIFT 2 // Each reading moves the estimate a quarter of the way.
+
+// The bands effects can key off.  Closer than each edge puts the finger
+// in that band.
+#define DISTANCE_CLOSE_MM 10
+#define DISTANCE_NEAR_MM 25
+enum DistanceBand
+{
+  DISTANCE_BAND_FAR = 0,      // Nobody there, or beyond the table.
+  DISTANCE_BAND_APPROACH = 1, // Somewhere between the table's end and DISTANCE_NEAR_MM.
+  DISTANCE_BAND_NEAR = 2,     // Closer than DISTANCE_NEAR_MM.
+  DISTANCE_BAND_CLOSE = 3,    // Closer than DISTANCE_CLOSE_MM - about to touch.
+  DISTANCE_BAND_TOUCH = 4,
+};
+
+// One point on the curve.  Counts go up and millimetres go down along
+// the table.
+struct DistancePoint
+{
+  int16_t counts; // Over the baseline.
+  int16_t mm;
+};
+
+// Millimetres for a finger adding `counts` over the baseline, or
+// DISTANCE_FAR if that is less than the table's first point.
+int distanceMm(int counts);
+
+DistanceBand distanceBand(int mm);
+
+// Call once per loop with how far the reading is over the baseline.
+// lightAtNear()'s average is no good for this - it averages in zeros to
+// fade the light out - so the readings are smoothed here instead, just
+// enough to take the edge off the noise: at 35mm one count is 4mm.
+void distanceSample(int counts, bool touched);
+
+// The finger's distance as of the last distanceSample(), its band, and
+// the smoothed counts over the baseline they came from.  distance_mm is 0
+// while touching.
+extern int distance_mm;
+extern DistanceBand distance_band;
+extern int distance_counts;
+
+const DistancePoint &distancePointAt(int index);
+
+// Put `counts` on the curve at `mm`, in place of the point whose
+// distance is nearest.  Refuses, changing nothing, if that would leave
+// the table out of order.
+bool distanceCalibrate(int counts, int mm);
+
+// Back to the curve for a typical box.
+void distanceDefaults();
+
+// Load the saved curve, or save the current one.  The store must have
+// been started with storeBegin() first.
+bool loadDistance();
+bool saveDistance();
+
+#endif
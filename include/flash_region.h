@@ -0,0 +1,37 @@
+#ifndef FLASH_REGION_H
+#define FLASH_REGION_H
+
+#include <stdint.h>
+
+// A small region of flash set aside for settings.
+//
+// Flash is not like RAM.  Erasing sets every bit in a whole row to 1, and
+// writing can only turn 1s into 0s, one page at a time.  Each row also
+// wears out after some tens of thousands of erases.  This is the minimum
+// the store (see store.h) needs to live with those rules.
+//
+// On the board this is the last 8KB of the SAMD21's 256KB flash, well
+// past the end of the sketch.  The linker doesn't know about it, so the
+// board checks the end of the sketch against it instead: a sketch big
+// enough to reach it gets a store that is always empty and never saves.
+// Uploading erases it too - bossac is run with --erase, which clears
+// everything after the bootloader - so saved settings don't survive a
+// reflash.  On a PC the same functions are provided by a simulator
+// (src/host/flash_sim.cpp) so the store can be exercised without
+// hardware.
+
+#define FLASH_REGION_SIZE 8192 // Bytes reserved for the store.
+#define FLASH_REGION_PAGE 64   // Smallest unit we can write.
+#define FLASH_REGION_ROW 256   // Smallest unit we can erase (4 pages).
+
+// Copy `length` bytes starting `offset` bytes into the region.
+void flashRead(uint32_t offset, void *data, uint32_t length);
+
+// Write one FLASH_REGION_PAGE sized page.  `offset` must be page aligned
+// and the page should have been erased since it was last written.
+bool flashProgramPage(uint32_t offset, const void *data);
+
+// Erase the row containing `offset` back to all 0xFF.
+bool flashEraseRow(uint32_t offset);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+
+// Flight recorder.
+//
+// Keeps the last few seconds of what the sensor saw (raw qt1, the learned
+// qt_base and the PWM value we sent to the LED) in a small ring in SRAM.
+// When something odd happens - a "touch" that was never preceded by a
+// finger coming near, for instance - the recorder keeps going for a short
+// while and then freezes, so the moments around the event survive until
+// someone plugs in a laptop and asks for a dump.
+//
+// To keep it small, samples are stored as deltas from the previous sample,
+// one signed byte each, in blocks that start with a full "key" sample.  A
+// touch jumps qt1 and the PWM by more than a byte holds, so a sample like
+// that takes two slots instead: an escape, then qt1's change as 16 bits
+// and the PWM value itself.  Only the rarer jumps - the baseline being
+// reset, or a gap of more than 255ms - start a new block, so a burst of
+// touches costs a few bytes each rather than pushing the history out.
+// Recording a sample is a handful of subtractions, compares and byte
+// stores.
+
+#define FLIGHT_RECORDER_BLOCKS 16         // Ring size.  Each block is 140 bytes,
+                                          // so 16 blocks is a bit over 2KB.
+#define FLIGHT_RECORDER_BLOCK_SAMPLES 32  // Delta samples per block.  At the
+                                          // ~11ms loop rate 16 blocks hold
+                                          // roughly 6 seconds.
+#define FLIGHT_RECORDER_POST_TRIGGER 100  // Samples to keep recording after a
+                                          // trigger before freezing.
+
+// Trigger reasons.  These are bits so they can be combined into a mask
+// which selects what freezes the recorder.  FLIGHT_RECORDER_TRIGGERS is
+// the mask the box boots with; "trig" on the serial console changes it.
+#define FR_TRIGGER_TOUCH_WITHOUT_NEAR 0x01 // Touch with no preceding near phase.
+#define FR_TRIGGER_ANY_TOUCH 0x02          // Every touch.  Handy on the bench.
+#define FR_TRIGGER_SENSOR_FAULT 0x04       // The sensor went wrong (sensor_health.h).
+#define FR_TRIGGER_MANUAL 0x80             // Asked for over serial.
+#ifndef FLIGHT_RECORDER_TRIGGERS
+#define FLIGHT_RECORDER_TRIGGERS (FR_TRIGGER_TOUCH_WITHOUT_NEAR | FR_TRIGGER_SENSOR_FAULT)
+#endif
+
+// Call once per loop with the current sample.
+void recorderSample(uint32_t now, int qt1, int base, int pwm);
+
+// Start the post-trigger countdown if `reason` is enabled in the mask.
+// Manual triggers are always honoured.  loop() calls this on every
+// touch, and on touches that came without an approach.
+void recorderTrigger(uint8_t reason);
+
+// The trigger mask.  It is not saved; a reboot goes back to
+// FLIGHT_RECORDER_TRIGGERS.
+void recorderSetTriggers(uint8_t mask);
+uint8_t recorderTriggers();
+
+// Throw away the frozen history and start recording again.
+void recorderArm();
+
+bool recorderFrozen();
+
+// Print the recorded history, oldest first, as CSV over serial.
+void recorderDump();
+
+#endif
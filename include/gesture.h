@@ -0,0 +1,67 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+
+// Touch gestures.
+//
+// Any touch used to do one thing: light the box for LIGHT_ON_TIME.  This
+// watches when touches start and end and says what kind of touch it was:
+//
+//   tap          a quick touch, with no second one straight after
+//   double tap   two quick touches, the second starting within double_gap
+//                of the first ending
+//   long press   let go after long_press, but before hold
+//   hold         still touching after hold - said while it is still down
+//
+// A touch between tap_max and long_press is too long for a tap and too
+// short for a long press, and says nothing.  A tap can't be told apart
+// from the first half of a double tap until double_gap has gone by, so
+// taps are only reported then.
+//
+// The touched signal can drop out for a reading or two in the middle of
+// a touch, so a gap shorter than GESTURE_RELEASE_MS doesn't end it.
+//
+// The timings are tunables (see params.h).  All the state for one sensor
+// is in a GestureChannel - a few bytes that never grow - so a box with
+// more than one pad keeps one per pad.
+
+#define GESTURE_RELEASE_MS 40
+
+enum Gesture
+{
+  GESTURE_NONE = 0,
+  GESTURE_TAP = 1,
+  GESTURE_DOUBLE_TAP = 2,
+  GESTURE_LONG_PRESS = 3,
+  GESTURE_HOLD = 4,
+};
+
+struct GestureTiming
+{
+  uint32_t tapMaxMs;
+  uint32_t doubleGapMs;
+  uint32_t longPressMs;
+  uint32_t holdMs;
+};
+
+struct GestureChannel
+{
+  uint8_t state;
+  bool releasing; // Let go, but not for GESTURE_RELEASE_MS yet.
+  uint32_t downMs; // When the touch in progress started.
+  uint32_t upMs;   // When the last one ended.
+};
+
+void gestureReset(GestureChannel &channel);
+
+// Call once per reading with whether the pad is touched.  Returns the
+// gesture that has just finished, or GESTURE_NONE.
+Gesture gestureSample(GestureChannel &channel, const GestureTiming &timing, uint32_t now, bool touched);
+
+// The timings from the tunables.
+GestureTiming gestureTiming();
+
+const char *gestureName(Gesture gesture);
+
+#endif
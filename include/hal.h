@@ -0,0 +1,54 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include "flash_region.h" // Storage is part of the HAL too.
+
+// Hardware abstraction layer.
+//
+// Everything the firmware needs from the outside world - time, the touch
+// sensor, the LED, the serial port and flash - goes through these few
+// functions.  On the board they are thin wrappers around the Arduino API
+// and the FreeTouch library (hal_arduino.cpp).  On a PC they are
+// simulated (host/hal_sim.cpp), which lets the very same detection and
+// lighting code run in tests, benchmarks and replays on a laptop.
+//
+// Which version gets linked in is picked by build_src_filter in
+// platformio.ini, so there is no #ifdef in the firmware itself.
+
+// ---- Clock ----
+// Times are 32 bits everywhere, as on the board, so arithmetic across a
+// wrap works the same on a PC (where unsigned long is 64 bits).
+uint32_t halMillis(); // Wraps after about 49 days, just like millis().
+uint32_t halMicros(); // Wraps after about 71 minutes.
+void halDelay(uint32_t ms);
+
+// ---- Touch sensor ----
+bool halTouchBegin();
+int halTouchMeasure(); // Same units as Adafruit_FreeTouch::measure().
+
+// ---- LED and pins ----
+void halPinOutput(int pin);
+void halDigitalWrite(int pin, bool high);
+void halPwmWrite(int pin, int value); // 0 is off, 255 is full on.
+
+// ---- Serial ----
+void halSerialBegin(unsigned long baud);
+int halSerialRead(); // Next character, or -1 if nothing has arrived.
+void halPrint(const char *text);
+void halPrint(long value);
+void halPrint(unsigned long value);
+void halNewline();
+
+inline void halPrint(int value) { halPrint((long)value); }
+inline void halPrint(unsigned int value) { halPrint((unsigned long)value); }
+
+template <typename T>
+inline void halPrintln(T value)
+{
+  halPrint(value);
+  halNewline();
+}
+inline void halPrintln() { halNewline(); }
+
+#endif
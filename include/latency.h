@@ -0,0 +1,43 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include "run_stats.h"
+
+// Touch-to-light latency.
+//
+// What makes the box feel magic is how quickly it reacts.  This notes the
+// time of the sample where a near phase or a touch starts (see
+// DetectReading in detect.h - near takes a few readings in a row, so
+// noise doesn't start one), and the time of the first LED write that
+// answers it:
+//
+//  - near: the first write brighter than the light was when the finger
+//    arrived.  This includes the settling time of the averaging in
+//    lightAtNear(), which is most of the delay.  A finger that comes near
+//    while the light is already full on can't be answered, so it isn't
+//    timed.
+//  - touch: the first write at full brightness.
+//
+// If the finger goes away before the light answers, the attempt is
+// counted as unanswered rather than timed.
+//
+// Nothing in here talks to the hardware, so the same code measures
+// latency when traces are replayed on a PC.
+
+#define LATENCY_FULL_PWM 255
+
+// Call once per sample with the time the sample was taken.
+void latencySample(uint32_t nowUs, bool near, bool touch);
+
+// Call on every LED write.
+void latencyLight(uint32_t nowUs, int pwm);
+
+const RunStats &latencyNear();
+const RunStats &latencyTouch();
+unsigned long latencyUnanswered();
+
+void latencyReset();
+void latencyReport();
+
+#endif
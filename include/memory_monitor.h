@@ -0,0 +1,38 @@
+#ifndef MEMORY_MONITOR_H
+#define MEMORY_MONITOR_H
+
+// SRAM watchdog.
+//
+// The SAMD21 has 32KB of SRAM and base_readings[] alone takes 20KB of it.
+// Static variables sit at the bottom, the heap (String temporaries, USB
+// buffers) grows up from there, and the stack grows down from the top.
+// If the two meet the board crashes in confusing ways, so we keep an eye
+// on how close they come.
+//
+// At boot the free space between the heap and the stack is painted with
+// a known pattern.  Anything the stack ever touches overwrites it, so
+// scanning for where the paint stops tells us the deepest the stack has
+// been.  Heap use comes from the C library's malloc bookkeeping.
+//
+// For which variables take up the static part, and how deep the stack can
+// possibly get, look at the report scripts/budget_report.py prints after
+// every build.
+
+#define MEMORY_PAINT 0xC0FFEE55UL // Unlikely to show up by accident.
+#define MEMORY_PAINT_MARGIN 64    // Bytes below the stack pointer we leave
+                                  // alone while painting.
+#define MEMORY_CHECK_LOOPS 100    // Scan about once a second.
+
+// Call first thing in setup(), while the stack is still shallow.
+void memoryPaint();
+
+// Rescan the paint and update the high-water marks.
+void memoryCheck();
+
+// Print a summary over serial.
+void memoryReport();
+
+// Smallest gap between the heap and the deepest stack seen so far.
+unsigned long memoryHeadroom();
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+// Tunables that can be changed at runtime.
+//
+// These used to be plain #defines, which meant reflashing every box to
+// try a new value.  The #defines are still here - they are the defaults
+// the box boots with - but the code reads the variables below, so a new
+// value set over the serial console takes effect on the very next pass
+// through loop().
+
+#define SPREAD 63 // The range of values between the base and the threshold
+                  // that seems to be the most stable for devices I've
+                  // tested.  This is a magic number that may need to be
+                  // adjusted for different devices.
+#define MIN_OVER_THRESHOLD 3 // How far over the base a reading has to be
+                             // before we call it "near".
+#define LIGHT_ON_TIME 40000 // Number of milliseconds to keep the light on
+                            // after the user touches the sensor.  Note, light
+                            // throb time is "in" this.
+#define NUM_LIGHT_STEPS 150 // How many changes in the light output there are
+                            // in one direction of the throb.
+#define TOUCH_TIME_DEBOUNCE 300 // Tunable.  How fast do we allow for registering
+                                // touches.  This is in milliseconds.
+#define GESTURES 0 // 1 to let gestures work the light (see gesture.h): a
+                   // double tap dims it a step, a long press turns it off
+                   // and a hold keeps it on until the next tap.  Off, a
+                   // touch is just a touch, as the sweep model expects.
+#define TAP_MAX_TIME 250       // Longest touch that is still a tap.
+#define DOUBLE_TAP_GAP 300     // Longest gap between the taps of a double tap.
+#define LONG_PRESS_TIME 800     // Shortest long press.
+#define HOLD_TIME 2000          // A touch this long is a hold.
+#define TRACKER 0 // 1 to light "near" from the proximity tracker (see
+                  // proximity.h) rather than the 50 reading average.
+                  // Quicker, but not what the sweep model expects.
+#define TRACK_ACCEL 500 // How suddenly a finger changes speed, in counts a
+                         // second per second.  Higher follows faster and
+                         // smooths less.
+
+extern int spread;
+extern int min_over_threshold;
+extern int light_on_time;
+extern int num_light_steps;
+extern int touch_time_debounce;
+extern int gestures;
+extern int gesture_tap_max;
+extern int gesture_double_gap;
+extern int gesture_long_press;
+extern int gesture_hold;
+extern int tracker;
+extern int track_accel;
+
+// One row of the parameter table.  `value` points at the live variable.
+struct Param
+{
+  const char *name;
+  int *value;
+  int defaultValue;
+  int min;
+  int max;
+};
+
+int paramCount();
+const Param &paramAt(int index);
+const Param *findParam(const char *name); // nullptr if there is no such name.
+
+// Set a parameter, refusing values outside its bounds or that don't fit
+// with the others (min_over below spread, and tap_max, long_press and
+// hold in that order).
+bool setParam(const Param &param, long value);
+
+// Why setParam() would refuse `value`, or nullptr if it wouldn't.
+const char *paramProblem(const Param &param, long value);
+
+// Put every parameter back to its compiled-in default.
+void resetParams();
+
+// Load the saved values from flash, or save the current ones.  The store
+// must have been started with storeBegin() first.  A saved set whose
+// values don't fit together is refused as a whole, leaving the defaults.
+bool loadParams();
+bool saveParams();
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Loop profiler.
+//
+// The M0+ has no cycle counter, but it does have SysTick - the timer that
+// drives millis().  It counts CPU clocks down from 47999 to 0 once every
+// millisecond, so millis() plus where SysTick is in its count gives us a
+// clock that ticks once per CPU cycle.
+//
+// Build the "seeed_xiao_profile" environment (which defines FAIRY_PROFILE)
+// to turn it on, then type "prof" into the serial monitor.  In a normal
+// build PROFILE_BEGIN and PROFILE_END turn into nothing at all.
+
+#ifdef FAIRY_PROFILE
+
+#include <stdint.h>
+
+enum ProfileStage
+{
+  PROFILE_LOOP,     // All of loop() except the delay at the end.
+  PROFILE_MEASURE,  // qt_1.measure()
+  PROFILE_DETECT,   // detectSample(): baseline, water, touched, near.
+  PROFILE_LIGHT,    // detectLight(): gestures, then the light.
+  PROFILE_PRINT,    // Debug printing.
+  PROFILE_RECORDER, // Flight recorder.
+  PROFILE_CONSOLE,  // Serial console.
+  PROFILE_STAGES
+};
+
+uint32_t profileNow(); // CPU cycles, wraps about every 89 seconds.
+void profileRecord(ProfileStage stage, uint32_t cycles);
+void profileDump();
+void profileReset();
+
+#define PROFILE_BEGIN(stage) uint32_t profileStart_##stage = profileNow()
+#define PROFILE_END(stage) profileRecord(stage, profileNow() - profileStart_##stage)
+
+#else
+
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+
+#endif
+
+#endif
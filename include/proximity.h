@@ -0,0 +1,105 @@
+#ifndef PROXIMITY_H
+#define PROXIMITY_H
+
+#include <stdint.h>
+
+// Where the finger is, and how fast it is coming.
+//
+// lightAtNear() smooths the readings with addMeasurement(), a plain
+// average of the last 50.  That is steady, but an average of the last
+// half second describes where the finger was a quarter of a second ago:
+// a finger on its way in is always further away in the average than it
+// really is.
+//
+// This tracker keeps two numbers instead - the reading, and how fast it
+// is changing - and every reading it predicts the next one from both,
+// then moves each towards what actually came by a fixed fraction of the
+// miss (alpha for the reading, beta for its rate).  Because it knows the
+// rate, a finger moving steadily is followed with no lag at all.  It is
+// an alpha-beta filter, which is what a two-state Kalman filter settles
+// into once it has run for a while, so the fractions come from the same
+// sum a Kalman filter would do:
+//
+//   - how noisy the readings are.  Measured, from the changes between
+//     readings while nobody is near (their average size is 1.13 times
+//     the noise's standard deviation), over PROXIMITY_NOISE_WINDOW
+//     readings at a time.
+//   - how suddenly a finger can change speed - the "track_accel" tunable
+//     in params.h, in counts a second per second.
+//
+// Quiet readings and a lively finger make it follow closely; noisy
+// readings and a lazy finger make it smooth harder.  The sum needs a
+// square root, so it is only done when the noise measurement or the
+// tunable changes, a few times a minute; each reading costs two
+// multiplies and some adds.
+//
+// A reading that misses the prediction by more than PROXIMITY_GATE is a
+// spike, and is left out - unless the next one misses too, in which case
+// the reading really has jumped (a finger landing on the pad, or
+// leaving it) and the tracker jumps with it.
+//
+// With "tracker" set to 1 (see params.h) lightAtNear() uses it for the
+// brightness instead of the average, once it is PROXIMITY_LIGHT_NOISE
+// standard deviations of noise clear of min_over_threshold - it wobbles
+// with the noise a little more than the average does.  Either way it runs every loop, and
+// "prox" on the serial console shows what it sees.
+
+#define PROXIMITY_SHIFT 12        // The tracked reading and rate are in
+                                  // 4096ths of a count.
+#define PROXIMITY_GAIN_SHIFT 16   // alpha and beta are in 65536ths.
+#define PROXIMITY_GATE 40         // Counts.  A bigger miss is a spike or a jump.
+#define PROXIMITY_NOISE_WINDOW 256 // Quiet readings per noise measurement.
+#define PROXIMITY_NOISE_CLIP 16   // Changes are counted up to this size, so
+                                  // a spike can't pass for noise.
+#define PROXIMITY_NOISE_START 16  // Sixteenths of a count: 1 count, until
+                                  // the first measurement.
+#define PROXIMITY_NOISE_MIN 4     // A quarter of a count.  Quieter than that
+                                  // is the ADC's rounding, not the signal.
+#define PROXIMITY_LOOP_START 10   // Milliseconds between readings, until measured.
+#define PROXIMITY_LIGHT_NOISE 3   // Standard deviations of noise, on top of
+                                  // min_over_threshold, before lightAtNear()
+                                  // lights from the tracker.
+
+struct ProximityTracker
+{
+  bool started;
+  bool gated;        // The last reading was left out.
+  int32_t level;     // The reading, in 4096ths of a count.
+  int32_t rate;      // Its change per reading, in 4096ths of a count.
+  int32_t alpha;     // Gains, in 65536ths.
+  int32_t beta;
+  int accel;         // The track_accel the gains are for.
+  int noise;         // The noise's standard deviation, in 16ths of a count.
+  int previous;      // Last reading, and whether it was quiet.
+  bool previousQuiet;
+  uint32_t noiseSum; // Of the quiet changes so far this window.
+  uint16_t noiseCount;
+  uint32_t lastMs;
+  int32_t loopTime;  // Between readings, in 16ths of a ms, smoothed.
+  int base;          // The baseline at the last reading, for showing.
+};
+
+// Start again.  A tracker that is all zeros, "= {}", is reset already.
+void proximityReset(ProximityTracker &tracker);
+
+// Call once per loop with the reading and the baseline.  `quiet` says
+// nobody is near, so the reading is only noise; `accel` is the
+// track_accel tunable.
+void proximitySample(ProximityTracker &tracker, uint32_t now, int raw, int base, bool quiet, int accel);
+
+// The tracked reading, in counts.  Subtract the baseline for how far over
+// it a finger is.
+int proximityLevel(const ProximityTracker &tracker);
+
+// How fast the reading is changing, in counts a second.  Positive is a
+// finger coming closer.  This one divides, so it is for showing rather
+// than for every loop.
+int proximityVelocity(const ProximityTracker &tracker);
+
+// Print what the tracker sees.
+void proximityReport(const ProximityTracker &tracker);
+
+// The firmware's own tracker, fed by loop().
+extern ProximityTracker proximity_tracker;
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdint.h>
+
+// Running min / max / mean plus a log2 histogram of a stream of numbers.
+// Bucket N counts values from 2^(N-1) up to 2^N - 1 (bucket 0 is zero),
+// which is coarse but needs no setup and covers any range in 33 words.
+
+#define RUN_STATS_BUCKETS 33
+
+struct RunStats
+{
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t histogram[RUN_STATS_BUCKETS];
+};
+
+void runStatsReset(RunStats &stats);
+void runStatsAdd(RunStats &stats, uint32_t value);
+
+// Print one summary line and the non-empty histogram buckets over serial.
+void runStatsPrint(const char *name, const RunStats &stats, const char *unit);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <stdint.h>
+
+// Is the sensor itself still sound?
+//
+// Everything else in the firmware trusts the readings.  If the wire to A0
+// breaks, or the pad ends up touching the (metal) enclosure, the readings
+// turn to nonsense - but the loop carries on averaging them into the
+// baseline and comparing them with it, so the box either goes dead or
+// lights up at random, and nothing says why.  These checks watch for the
+// ways a broken sensor looks different from a working one:
+//
+//   PINNED    the reading sits on 0 or 1023 - the ADC has run out of
+//             range.  Nothing real does that for HEALTH_PINNED_MS.
+//   FLAT      the reading suddenly stops moving.  A working pad always
+//             has a count or two of noise; a dead input or a stuck
+//             measurement does not.  Measured as the total of the changes
+//             from one reading to the next over HEALTH_WINDOW readings.
+//             How little noise a sound pad can have hasn't been measured
+//             on enough boards to trust a still reading on its own, so it
+//             only counts when the pad was moving like a working one just
+//             before - a pad that has always been still (a very steady
+//             board, or the simulator's constant reading) is left alone.
+//   OPEN      the reading drops well below the baseline and stays there.
+//             Fingers and water only ever add to the reading, and moving
+//             the box only shifts it by a few tens of counts, so a fall
+//             of HEALTH_OPEN_STEP is the pad coming off - a broken wire.
+//   SHORT     the reading jumps well above the baseline and stays there
+//             far longer than anyone keeps a finger on it - the pad has
+//             met something big, like the enclosure.
+//   BASELINE  the baseline has wandered outside the band any real pad
+//             sits in.
+//
+// On a fault the readings are kept out of the baseline, nothing counts as
+// a touch, and the light blinks the fault's number (1 for PINNED up to 5
+// for BASELINE) over and over so you can tell what is wrong without a
+// serial cable.  It clears itself once the readings look right again for
+// HEALTH_RECOVER_MS - for OPEN and SHORT that means back by the baseline
+// they left - and the baseline restarts from there.  "health clear" over
+// serial clears it by hand, for a box that has been repaired somewhere
+// new.
+//
+// All of this is a few comparisons and one addition a reading, with the
+// timing done on the clock rather than by counting.
+
+#define HEALTH_RAIL_LOW 3         // At or below this, the reading is pinned...
+#define HEALTH_RAIL_HIGH 1020     // ...and at or above this.
+#define HEALTH_PINNED_MS 1000     // For this long is a fault.
+#define HEALTH_WINDOW 256         // Readings in one activity window.
+#define HEALTH_MIN_ACTIVITY 8     // Less change than this in a window is flat.
+                                  // A quiet pad manages 200 or more.
+#define HEALTH_FLAT_WINDOWS 4     // Flat windows in a row for a fault, about
+                                  // 10 seconds...
+#define HEALTH_LIVELY_ACTIVITY 64 // ...straight after a window with at least
+                                  // this much change.
+#define HEALTH_OPEN_STEP 100      // Counts below the baseline...
+#define HEALTH_OPEN_MS 2000       // ...for this long.
+#define HEALTH_SHORT_STEP 200     // Counts above the baseline - a finger flat
+                                  // on the pad gives 140 to 260...
+#define HEALTH_SHORT_MS 60000     // ...but not for a minute.
+#define HEALTH_BASE_LOW 200       // A working pad's baseline is in here.
+#define HEALTH_BASE_HIGH 1000
+#define HEALTH_RECOVER_MS 5000    // Looking right for this long clears a fault.
+#define HEALTH_SMOOTH_SHIFT 2     // The level the baseline restarts from.
+
+#define HEALTH_BLINK_LEVEL 64     // Brightness of the fault blinks.
+#define HEALTH_BLINK_ON_MS 150
+#define HEALTH_BLINK_OFF_MS 250
+#define HEALTH_BLINK_PAUSE_MS 1500 // Between one number and the next.
+
+enum SensorFault
+{
+  SENSOR_OK = 0,
+  SENSOR_PINNED = 1,
+  SENSOR_FLAT = 2,
+  SENSOR_OPEN = 3,
+  SENSOR_SHORT = 4,
+  SENSOR_BASELINE = 5,
+};
+
+enum HealthVerdict
+{
+  HEALTH_OK = 0,        // Use the reading.
+  HEALTH_RECOVERED = 1, // The fault has cleared.  Restart the baseline
+                        // from sensorHealthLevel(), then use the reading.
+  HEALTH_FAULTY = 2,    // Ignore the reading.
+  HEALTH_NEW_FAULT = 3, // Ignore the reading - and it has only just gone
+                        // wrong.
+};
+
+// Call once per loop with the reading and the baseline before it is
+// added in.
+HealthVerdict sensorHealthSample(uint32_t now, int raw, int base);
+
+SensorFault sensorFault();
+
+// The reading smoothed a little, to restart the baseline from.
+int sensorHealthLevel();
+
+// Faults since boot.
+unsigned long sensorHealthFaults();
+
+// Brightness for the light while there is a fault: the blink code.
+int sensorHealthLight(uint32_t now);
+
+// Forget the fault, and whatever the checks had seen so far.
+void sensorHealthClear();
+
+const char *sensorFaultName(SensorFault fault);
+
+// Print the state and what each check can currently see.
+void sensorHealthReport();
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Field health counters.
+//
+// A box that lights up by itself all day, or whose baseline wanders all
+// over the place, is telling us something about where it lives.  These
+// counters keep track of what the detection code has been doing, hour by
+// hour for the last day, plus running totals since the box was first
+// switched on.  The totals are saved to flash (see store.h) once an hour,
+// so they survive power cuts - at the cost of losing up to an hour.
+
+#define STATS_HOURS 24             // Hourly buckets kept in RAM.
+#define STATS_HOUR_MS 3600000UL
+
+// One hour of counts.  16 bits is plenty for an hour of anything a
+// person does; something gone wrong could still count faster than that,
+// so they stop at 65535 rather than wrap round to look quiet.
+struct StatsHour
+{
+  uint16_t touches;
+  uint16_t nears;         // Near phases, as DetectReading::nearStart.
+  uint16_t lonelyTouches; // Touches with no approach first.  Likely false.
+  uint16_t baselineResets;
+  uint16_t sensorFaults;  // See sensor_health.h.
+  uint16_t litSeconds;
+  uint16_t baseMin;
+  uint16_t baseMax;
+};
+
+// Totals since the box was first switched on.
+struct StatsTotals
+{
+  uint32_t hours;
+  uint32_t touches;
+  uint32_t nears;
+  uint32_t lonelyTouches;
+  uint32_t baselineResets;
+  uint32_t sensorFaults;
+  uint32_t litSeconds;
+  uint16_t baseMin;
+  uint16_t baseMax;
+};
+
+// Load the saved totals.  The store must have been started first.
+void statsBegin();
+
+// Call once per loop.  The flags are edges: true only on the sample
+// where a touch or a near phase begins.  Near phases are debounced (see
+// DETECT_NEAR_READINGS), so noise on the pad doesn't count as one.
+void statsSample(uint32_t now, int base, bool nearStart, bool touchStart, bool lonelyTouch, bool lit);
+
+void statsBaselineReset();
+void statsSensorFault();
+
+const StatsTotals &statsTotals();
+
+// The hour in progress.  Its counts are added to the totals when it ends,
+// so totals plus this is everything so far.
+const StatsHour &statsCurrentHour();
+
+// Print the totals and the hourly buckets, newest first.
+void statsReport();
+
+#endif
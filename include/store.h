@@ -0,0 +1,48 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+
+// Settings store in flash.
+//
+// The store is a log.  Every save appends a new record - a full copy of
+// the settings, tagged with a type, a schema version, a sequence number
+// and a CRC - to the next blank page.  Nothing is ever rewritten in
+// place, which spreads the wear over the whole region instead of
+// hammering one row.
+//
+// The region is split into two halves.  When the active half fills up
+// the other half is erased, the newest record of every type is copied
+// across, and writing carries on there.  The old half is left alone
+// until the next swap, so losing power part way through never loses
+// the last good copy.
+//
+// At boot storeBegin() reads every page once and remembers where the
+// newest valid record of each type lives.  A record with a bad CRC, from
+// a write interrupted by a power cut for instance, is simply skipped.
+
+#define STORE_PAYLOAD_SIZE 52 // Bytes of settings per record.
+#define STORE_MAX_TYPES 4
+
+// Record types.  Never renumber these - they are in flash on every box.
+#define STORE_TYPE_PARAMS 1
+#define STORE_TYPE_STATS 2
+#define STORE_TYPE_DISTANCE 3
+#define STORE_TYPE_LOCK 4
+
+// Scan the region.  Call once in setup() before any load.
+void storeBegin();
+
+// Copy the newest record of `type` into `payload`.  Returns the number of
+// payload bytes in the record (older schema versions may have fewer) and
+// sets `version`, or -1 if there is no valid record of that type.
+int storeLoad(uint8_t type, void *payload, int maxLength, uint8_t *version);
+
+// Append a new record.  Returns false if the flash refused the write.
+bool storeSave(uint8_t type, uint8_t version, const void *payload, int length);
+
+// Number of half swaps since boot.  Each one costs an erase of every row
+// in one half, so this is the number to watch for wear.
+unsigned long storeSwaps();
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef TAP_LOCK_H
+#define TAP_LOCK_H
+
+#include <stdint.h>
+
+// A secret knock.
+//
+// checkDebug() only counts touches; this listens to their rhythm.  Every
+// touch becomes a symbol: whether it was a quick tap or a hold, and how
+// long after the touch before it it began.  That gap is measured in
+// half-beats, where a beat is the gap between the first two touches - so
+// the same rhythm knocked out faster or slower gives the same symbols.
+//
+// A rhythm ends when nobody has touched the box for TAP_END_MS.  It is
+// compared with each stored pattern using dynamic time warping, which
+// lets a knock that drags or rushes in places, or has a touch too many or
+// too few, still line up with the pattern.  A close enough match fires
+// that pattern's action.
+//
+// The warping is worked out one row at a time as each touch ends, against
+// patterns of at most TAP_MAX_SYMBOLS, and only TAP_BAND cells either
+// side of the diagonal - so a touch costs at most TAP_PATTERNS *
+// (2 * TAP_BAND + 1) little sums, however long the knock goes on, and
+// nothing at all between touches.
+//
+// Patterns are set up over the serial console ("lock rec 1 unlock", then
+// knock) and saved in flash.  A fresh box has two:
+//
+//   tap tap hold                     unlock
+//   shave and a haircut, two bits    debug mode on or off
+//
+// which never touch the light, so they can't change what the sweep model
+// (src/host/pipeline_model.h) expects the light to do.
+
+#define TAP_PATTERNS 3
+#define TAP_MAX_SYMBOLS 10  // Longest pattern.  Longer knocks never match.
+#define TAP_BAND 2          // How far the warping may stray from one-for-one.
+#define TAP_HOLD_MS 400     // A touch this long is a hold, not a tap.
+#define TAP_RELEASE_MS 60   // A gap shorter than this doesn't end a touch.
+#define TAP_END_MS 1500     // This long with no touch ends the knock.
+#define TAP_MAX_HALF_BEATS 15
+#define TAP_KIND_COST 4     // A tap where the pattern has a hold costs this
+                            // much, against 1 per half-beat for timing.
+#define TAP_MATCH_COST 3    // Most a knock can cost and still open the lock.
+#define TAP_UNLOCK_PIN 5    // Goes high for TAP_UNLOCK_MS on "unlock".
+#define TAP_UNLOCK_MS 3000
+
+// What a pattern does when it is knocked.
+enum TapAction
+{
+  TAP_ACTION_NONE = 0,
+  TAP_ACTION_UNLOCK = 1, // Pulse TAP_UNLOCK_PIN.
+  TAP_ACTION_EFFECT = 2, // Throb the light, as after a touch.
+  TAP_ACTION_DEBUG = 3,  // Turn debugging on or off.
+};
+
+// One symbol: bit 0 is set for a hold, the rest is the gap before it in
+// half-beats (0 for the first touch).
+#define TAP_SYMBOL(halfBeats, hold) (uint8_t)(((halfBeats) << 1) | ((hold) ? 1 : 0))
+
+struct TapPattern
+{
+  uint8_t length; // 0 for an empty slot.
+  uint8_t action; // TapAction.
+  uint8_t symbols[TAP_MAX_SYMBOLS];
+};
+
+// Set up the unlock pin and load the saved patterns.  The store must have
+// been started with storeBegin() first.  Returns true if there were some.
+bool tapLockBegin();
+
+// Call once per loop.  Returns the action of a pattern that has just been
+// knocked, or TAP_ACTION_NONE.  Unlocking is handled in here; the other
+// actions are up to the caller.
+TapAction tapLockSample(uint32_t now, bool touched);
+
+// The next knock is stored in `slot` with `action`, instead of matched.
+void tapLockRecord(int slot, TapAction action);
+bool tapLockRecording();
+
+const TapPattern &tapLockPattern(int slot);
+void tapLockClear(int slot);
+bool tapLockSave();
+
+// Print the patterns, and what the last knock looked like.
+void tapLockReport();
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef WATER_FILM_H
+#define WATER_FILM_H
+
+#include <stdint.h>
+
+// Water on the pad.
+//
+// Condensation - a box by the kettle, or under a plant that gets watered -
+// lays a film of water over the pad, and water raises the reading just
+// like a hand hovering over it.  The baseline follows it in the end, but
+// it averages the last 50 seconds, so while the film is growing the
+// baseline lags behind it: a film that grows a count every two seconds
+// keeps the near light glowing, and one that grows fast enough can get
+// all the way to a "touch".
+//
+// What gives the water away is how it gets there.  A finger on its way
+// to the pad raises the reading by several counts in well under a
+// second - the approach ramp.  A film creeps up over minutes with no
+// ramp at all, then sits there.  So, a slow copy of the reading follows
+// it, never moving faster than WATER_CREEP counts a second.  Water it
+// keeps up with; a finger leaves it behind.
+//
+// Not having left it behind yet proves nothing, though: a finger far
+// away only adds a count or two a second, and it is several counts over
+// the baseline before it gets close enough to leave the slow copy
+// behind.  What a finger on its way never does is sit still.  So the
+// reading has to have stayed within WATER_STEADY_BAND of one level for
+// WATER_STEADY_MS as well - the film's plateau.  When the reading is
+// more than WATER_MIN_EXCESS above the baseline, has held steady there,
+// and the slow copy was never left more than WATER_RAMP behind on the
+// way, it is treated as water:
+//
+//   - the reading is ignored - no touch, no near glow - while we wait to
+//     be sure (WATER_CONFIRM_MS);
+//   - then the baseline is moved straight to where the reading has got
+//     to, and the box carries on as normal on top of the film.  A finger
+//     touching the wet pad still gives its ramp and still counts.
+//
+// A film that grows faster than WATER_CREEP looks like a finger and is
+// left to the baseline, as before.  One that keeps on growing at more
+// than a count every two seconds - as fast as a finger a few
+// centimetres off - is only caught each time it stops, and can glow
+// faintly until then.  A finger that hovers so far away it adds less
+// than WATER_RAMP, and holds still there, gets taken for water - but it
+// is too faint to light anything anyway.
+//
+// Water only ever adds to the reading, so only a rise is taken for it.
+// A film drying off, the room getting drier, or a hand that rested on
+// the box long enough to be learned into the baseline and then left all
+// lower the reading, and all are left to the baseline as before - below
+// the baseline nothing lights anyway.  A rebase isn't a baseline reset
+// either: the box has not lost track of the sensor, so the stats don't
+// count it as one.
+//
+// None of the thresholds depend on the tunables in params.h, so the
+// baseline still only depends on the readings, as the sweep tools need
+// (see src/host/pipeline_batch.h).  All the state is in a WaterFilm so
+// that they can keep one each, too.
+
+#define WATER_SMOOTH_SHIFT 2    // Readings are smoothed by a quarter each.
+#define WATER_CREEP 2           // Counts a second.  Faster is a ramp...
+#define WATER_RAMP 6            // ...once the slow copy is this far behind.
+                                // Noise alone never gets it past 3.
+#define WATER_MIN_EXCESS 4      // How far above the baseline the reading
+                                // must be before it counts as water...
+#define WATER_STEADY_BAND 2     // Counts either way, and held for...
+#define WATER_STEADY_MS 2000    // ...this long, is a plateau.  The smoothed
+                                // reading's noise stays inside the band.
+#define WATER_CONFIRM_MS 1000   // Then ignored for this long.  It is over
+                                // once the reading is back within half of
+                                // WATER_MIN_EXCESS.
+
+enum WaterVerdict
+{
+  WATER_CLEAR = 0,   // Nothing strange.  Use the reading.
+  WATER_SUSPECT = 1, // Looks like water.  Ignore the reading.
+  WATER_REBASE = 2,  // It is water.  Move the baseline to film.level.
+};
+
+struct WaterFilm
+{
+  bool started;
+  bool ramped;       // Left the slow copy behind since the reading was
+                     // last by the baseline.
+  bool away;         // Off the baseline, since awayMs.
+  int32_t smooth;    // The reading, times 1 << WATER_SMOOTH_SHIFT.
+  int level;         // The smoothed reading.
+  int steadyLevel;   // Where level has stayed within WATER_STEADY_BAND
+  uint32_t steadyMs; // of, since steadyMs.
+  int32_t slowMilli; // The slow copy, in thousandths of a count.
+  uint32_t lastMs;
+  uint32_t awayMs;
+};
+
+void waterFilmReset(WaterFilm &film);
+
+// Call once per loop with the reading and the baseline it is being
+// compared with.
+WaterVerdict waterFilmSample(WaterFilm &film, uint32_t now, int raw, int base);
+
+#endif
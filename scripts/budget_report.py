@@ -0,0 +1,523 @@
+"""Check where the flash, SRAM and stack go after every firmware build.
+
+base_readings[] alone takes 20KB of the SAMD21's 32KB of SRAM, so every
+new feature eats into a small margin.  After linking this prints:
+
+  * flash and RAM per translation unit, from the linker map,
+  * the biggest flash and RAM symbols, from the symbol table,
+  * the deepest the stack can get below loop() and below each interrupt
+    handler, from the -fstack-usage (.su) files and the calls found by
+    disassembling firmware.elf,
+
+and flags any of them that is over its budget.  The budgets are custom
+options of the environment in platformio.ini:
+
+    custom_flash_budget = 65536   ; bytes of flash
+    custom_ram_budget = 28672     ; bytes of static RAM (.data + .bss)
+    custom_stack_budget = 2048    ; worst-case stack, loop() plus interrupts
+    custom_budget_fail = yes      ; fail the build when one is over
+
+Left out, a budget is simply not checked - except that static RAM plus the
+worst-case stack must always fit in the SRAM.  Without custom_budget_fail
+the report only warns.
+
+The map and .su parsing was checked against GNU ld 2.40 and gcc 12 output
+for this firmware, linked with the same memory regions and sections as
+the board's linker script: the totals came out within 0.2% of the section
+sizes readelf gives (merged string sections print a few bytes larger
+than they end up).  That build was for the PC, so the disassembly below
+is only checked against the Thumb formats objdump documents.
+
+PlatformIO runs it through extra_scripts.  It has to be a "pre:" script so
+it can add -fstack-usage and the map file to the flags before anything is
+compiled.  It also runs on its own against a finished build directory:
+
+    python scripts/budget_report.py .pio/build/seeed_xiao [--ram-budget N] [--fail]
+
+The stack figure is an estimate, but a safe one:
+
+  * Each function's own frame comes from the compiler.  Library code built
+    without -fstack-usage has no .su file and is counted as UNKNOWN_FRAME.
+  * Calls through a pointer (blx) can't be followed.  Functions that make
+    them are listed so a person can check what they might call.
+  * Recursion has no bound.  The cycle is listed and counted once.
+  * An interrupt only preempts one of lower priority, and the Cortex-M0+
+    has PRIORITY_LEVELS of them, so at most that many handlers are ever
+    stacked on top of loop().  The deepest handler at each level is added
+    on top of the worst loop() chain, each with the EXCEPTION_FRAME the
+    hardware pushes.  A handler not in ISR_PRIORITIES might be at any
+    level, so it may take the place of any of those.
+  * Reset_Handler is where main() is called from, not an interrupt, and
+    the fault handlers and Dummy_Handler only run once the firmware has
+    already gone wrong and never return to it, so none of them count.
+"""
+
+import glob
+import os
+import re
+import subprocess
+import sys
+
+SRAM_SIZE = 32 * 1024
+RAM_ORIGIN = 0x20000000
+TOP_SYMBOLS = 15
+TOP_UNITS = 15
+
+# nm type letters for things that live in RAM: initialised data (d/D) and
+# zeroed data (b/B).  Code and constant data (t/T/r/R) live in flash.
+RAM_TYPES = "bBdD"
+FLASH_TYPES = "tTrRwW"
+
+# Cortex-M0+ pushes r0-r3, r12, lr, pc and xpsr on interrupt entry.
+EXCEPTION_FRAME = 32
+# Frame assumed for functions with no .su entry (the core and libc).
+UNKNOWN_FRAME = 64
+
+# Where the stack chains start: the sketch itself, and every vector table
+# handler that can interrupt it.  Arduino's main() calls setup() and
+# loop(), so starting from main covers both.
+MAIN_ROOT = "main"
+ISR_PATTERN = re.compile(r"_Handler$")
+NOT_NESTING = {"Reset_Handler", "NMI_Handler", "HardFault_Handler", "Dummy_Handler"}
+
+# The SAMD21 has two priority bits.  The levels the Arduino core gives the
+# handlers it installs (wiring.c, USBCore.cpp, SERCOM.cpp, WInterrupts.c);
+# 0 is the most urgent.
+PRIORITY_LEVELS = 4
+ISR_PRIORITIES = {
+    "USB_Handler": 0,
+    "EIC_Handler": 0,
+    "SysTick_Handler": 2,
+    "SERCOM0_Handler": 3,
+    "SERCOM1_Handler": 3,
+    "SERCOM2_Handler": 3,
+    "SERCOM3_Handler": 3,
+    "SERCOM4_Handler": 3,
+    "SERCOM5_Handler": 3,
+}
+
+
+def sizes_of(nm, elf, types):
+    output = subprocess.run(
+        [nm, "--print-size", "--size-sort", "--reverse-sort", "--radix=d", "--demangle", elf],
+        check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in output.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) == 4 and parts[2] in types:
+            symbols.append((int(parts[1]), parts[3]))
+    return symbols
+
+
+# The linker map ---------------------------------------------------------
+#
+# The part after "Linker script and memory map" lists every output section
+# and, under it, the input sections that went into it with the object file
+# they came from:
+#
+#   .relocate       0x20000000       0x64 load address 0x00008f30
+#    .data.spread   0x20000008        0x4 .pio/build/seeed_xiao/src/params.cpp.o
+#   .bss            0x20000068     0x5a3c
+#    .bss._ZL5hours
+#                   0x20000068      0x150 .pio/build/seeed_xiao/src/stats.cpp.o
+#
+# (a long input section name pushes the numbers onto the next line).  An
+# output section in RAM with a load address is initialised data: it takes
+# room in both.  Except that ld prints a load address for .bss as well,
+# when it follows .relocate - so what decides is the input section:
+# .bss* and COMMON are zeroed at startup and take no flash.  The *fill*
+# the linker pads with for alignment goes under "(padding)", taking room
+# like the input section before it.  Sections outside every memory
+# region (debug information) take no room on the chip, and the linker
+# script's stack and heap placeholders aren't static data, so neither is
+# counted.
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+load address 0x([0-9a-f]+))?")
+OUTPUT_NAME_ONLY = re.compile(r"^(\.\S+)\s*$")
+ZEROED = re.compile(r"^(\.bss|COMMON\b)")
+FILL = re.compile(r"^ \*fill\*\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)")
+INPUT_SECTION = re.compile(r"^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+INPUT_NAME_ONLY = re.compile(r"^ (\S+)\s*$")
+INPUT_NUMBERS = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+MEMORY_REGION = re.compile(r"^(\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)")
+
+
+def unit_name(path):
+    """A short name for an object file, or archive(member)."""
+    match = re.match(r"(.*?)([^/\\]+\.a)\((.*)\)$", path)
+    if match:
+        return "%s(%s)" % (match.group(2), match.group(3))
+    return path.split("/src/", 1)[-1] if "/src/" in path else os.path.basename(path)
+
+
+def parse_map(path):
+    """Returns ({unit: [flash, ram]}, {region: (origin, length)})."""
+    units = {}
+    regions = {}
+    in_memory = in_layout = False
+    output_ram = output_loaded = output_counted = zeroed = False
+    pending_output = pending_input = None
+    with open(path) as lines:
+        for line in lines:
+            line = line.rstrip("\n")
+            if line.startswith("Memory Configuration"):
+                in_memory = True
+                continue
+            if line.startswith("Linker script and memory map"):
+                in_memory, in_layout = False, True
+                continue
+            if in_memory:
+                match = MEMORY_REGION.match(line)
+                if match and match.group(1) not in ("Name", "*default*"):
+                    regions[match.group(1)] = (int(match.group(2), 16), int(match.group(3), 16))
+                continue
+            if not in_layout:
+                continue
+
+            if pending_output:
+                line = pending_output + " " + line.strip()
+                pending_output = None
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                address = int(match.group(2), 16)
+                output_ram = address >= RAM_ORIGIN
+                output_loaded = match.group(4) is not None
+                zeroed = bool(ZEROED.match(match.group(1)))
+                inside = any(origin <= address < origin + length for origin, length in regions.values())
+                output_counted = (inside if regions else address != 0) and \
+                    not match.group(1).startswith((".stack", ".heap"))
+                continue
+            if OUTPUT_NAME_ONLY.match(line):
+                pending_output = line.strip()
+                continue
+
+            fill = FILL.match(line)
+            if fill:
+                pending_input = None
+                size, unit = int(fill.group(2), 16), "(padding)"
+            elif pending_input:
+                match = INPUT_NUMBERS.match(line)
+                name, pending_input = pending_input, None
+                if not match:
+                    continue
+                size, source = int(match.group(2), 16), match.group(3)
+                unit, zeroed = unit_name(source.strip()), bool(ZEROED.match(name))
+            else:
+                match = INPUT_SECTION.match(line)
+                if not match:
+                    if INPUT_NAME_ONLY.match(line) and not line.strip().startswith("*"):
+                        pending_input = line.strip()
+                    continue
+                size, source = int(match.group(3), 16), match.group(4)
+                unit, zeroed = unit_name(source.strip()), bool(ZEROED.match(match.group(1)))
+            # Symbol lines have an address and a name but no size.
+            if not output_counted or size == 0 or (not fill and source.startswith("0x")):
+                continue
+            counts = units.setdefault(unit, [0, 0])
+            if output_ram:
+                counts[1] += size
+                if output_loaded and not zeroed:
+                    counts[0] += size
+            else:
+                counts[0] += size
+    return units, regions
+
+
+# Stack usage ------------------------------------------------------------
+#
+# -fstack-usage writes a .su file next to every object file, one line per
+# function:
+#
+#   main.cpp:320:6:void loop()    40    static
+#
+# "static" means the frame is fixed; "dynamic" means alloca or a variable
+# length array, which we flag.  The names are demangled and carry the
+# return type, while the disassembly has them without; both are cut down
+# to the bare qualified name, and overloads that then clash share the
+# biggest frame among them.
+
+CLONE_SUFFIX = re.compile(r"\.(constprop|isra|part|cold|lto_priv)(\.\d+)*$")
+
+
+def function_key(name):
+    name = CLONE_SUFFIX.sub("", name.strip())
+    name = re.sub(r"\s*\[with .*\]$", "", name)
+    # Cut the argument list off.  An operator's own name can hold < ( and
+    # spaces, so for those start looking after it.
+    start = 0
+    operator = re.search(r"\boperator\s*(\(\)|[^\w\s(]+|\s\w[\w\s*&:<>]*?(?=\())", name)
+    if operator:
+        start = operator.end()
+    depth = 0
+    for i in range(start, len(name)):
+        ch = name[i]
+        if ch == "<" and not operator:
+            depth += 1
+        elif ch == ">" and not operator:
+            depth -= 1
+        elif ch == "(" and depth == 0:
+            name = name[:i]
+            break
+    # Template arguments: the disassembly shows them, the .su names don't.
+    if name.endswith(">") and not operator:
+        depth = 0
+        for i in range(len(name) - 1, -1, -1):
+            depth += {">": 1, "<": -1}.get(name[i], 0)
+            if depth == 0:
+                name = name[:i]
+                break
+    # Drop the return type: whatever is before the last space outside <>
+    # (and before the operator, whose name may have spaces of its own).
+    end = operator.start() if operator else len(name)
+    depth = 0
+    for i in range(end - 1, -1, -1):
+        ch = name[i]
+        if ch == ">":
+            depth += 1
+        elif ch == "<":
+            depth -= 1
+        elif ch == " " and depth == 0:
+            return name[i + 1:]
+    return name
+
+
+def parse_stack_usage(paths):
+    """Returns ({function: frame}, {function with a dynamic frame})."""
+    frames = {}
+    dynamic = set()
+    for path in paths:
+        with open(path) as lines:
+            for line in lines:
+                parts = line.rstrip("\n").split("\t")
+                if len(parts) != 3:
+                    continue
+                location, size, kind = parts
+                # file:line:column:name, and the name may itself hold colons.
+                name = location.split(":", 3)[-1]
+                key = function_key(name)
+                frames[key] = max(frames.get(key, 0), int(size))
+                if "dynamic" in kind and "bounded" not in kind:
+                    dynamic.add(key)
+    return frames, dynamic
+
+
+# The call graph ---------------------------------------------------------
+#
+# From "objdump -d --demangle":
+#
+#   00002130 <baseAvg(int)>:
+#       2136:	bl	2150 <addMeasurement(int)>
+#       2140:	blx	r3
+#       2150:	b.n	2190 <halMillis()>
+#
+# bl is a call and blx through a register is a call we can't follow.  A
+# plain branch to the start of another function is a tail call, which for
+# the stack is as deep as a call.
+
+FUNCTION_START = re.compile(r"^[0-9a-f]+ <(.+)>:$")
+BRANCH = re.compile(r"^\s+[0-9a-f]+:\s+(bl|b|b\.n|b\.w|blx)\s+([0-9a-f]+)\s+<(.+?)(\+0x[0-9a-f]+)?>\s*$")
+INDIRECT = re.compile(r"^\s+[0-9a-f]+:\s+blx\s+r\d+")
+
+
+def parse_calls(text):
+    """Returns ({function: set of callees}, {function making pointer calls})."""
+    calls = {}
+    indirect = set()
+    current = None
+    for line in text.splitlines():
+        match = FUNCTION_START.match(line)
+        if match:
+            current = function_key(match.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        if INDIRECT.match(line):
+            indirect.add(current)
+            continue
+        match = BRANCH.match(line)
+        if not match:
+            continue
+        op, target, offset = match.group(1), function_key(match.group(3)), match.group(4)
+        if op.startswith("bl"):
+            calls[current].add(target)
+        elif offset is None and target != current:
+            calls[current].add(target)
+    return calls, indirect
+
+
+def interrupt_roots(calls):
+    return sorted(name for name in calls if ISR_PATTERN.search(name) and name not in NOT_NESTING)
+
+
+def nested_interrupts(depths):
+    """The handlers that can be stacked up at once, deepest first, from
+    {handler: depth including its exception frame}."""
+    deepest = {}
+    anywhere = []
+    for handler, depth in depths.items():
+        level = ISR_PRIORITIES.get(handler)
+        if level is None:
+            anywhere.append((depth, handler))
+        elif level not in deepest or depth > deepest[level][0]:
+            deepest[level] = (depth, handler)
+    # One handler a level.  Those of unknown level can fill any level, so
+    # the worst case is simply the deepest PRIORITY_LEVELS candidates.
+    return sorted(list(deepest.values()) + anywhere, reverse=True)[:PRIORITY_LEVELS]
+
+
+class StackWalker:
+    def __init__(self, frames, calls):
+        self.frames = frames
+        self.calls = calls
+        self.memo = {}
+        self.cycles = set()
+        self.unknown = set()
+
+    def frame(self, function):
+        if function not in self.frames:
+            self.unknown.add(function)
+            return UNKNOWN_FRAME
+        return self.frames[function]
+
+    def deepest(self, function, path=()):
+        """(bytes, chain) for the deepest stack below `function`."""
+        if function in self.memo:
+            return self.memo[function]
+        if function in path:
+            self.cycles.add(" -> ".join(path[path.index(function):] + (function,)))
+            return 0, []
+        best, chain = 0, []
+        for callee in sorted(self.calls.get(function, ())):
+            depth, below = self.deepest(callee, path + (function,))
+            if depth > best:
+                best, chain = depth, below
+        result = (self.frame(function) + best, [function] + chain)
+        # Results found while inside a cycle depend on the way in, so only
+        # remember the ones that don't.
+        if not any(function in cycle.split(" -> ") for cycle in self.cycles):
+            self.memo[function] = result
+        return result
+
+
+# The report -------------------------------------------------------------
+
+def report(nm, objdump, elf, map_path, su_paths, budgets, enforce):
+    """Print the report and return the list of broken budgets."""
+    failures = []
+
+    units, regions = parse_map(map_path) if os.path.exists(map_path) else ({}, {})
+    flash_symbols = sizes_of(nm, elf, FLASH_TYPES)
+    ram_symbols = sizes_of(nm, elf, RAM_TYPES)
+    flash_total = sum(flash for flash, _ in units.values()) if units else sum(s for s, _ in flash_symbols)
+    ram_total = sum(ram for _, ram in units.values()) if units else sum(s for s, _ in ram_symbols)
+    sram = next((length for origin, length in regions.values() if origin == RAM_ORIGIN), SRAM_SIZE)
+
+    if units:
+        ranked = sorted(units.items(), key=lambda item: -(item[1][0] + item[1][1]))
+        print("Flash and RAM by translation unit (top %d of %d):" % (min(TOP_UNITS, len(ranked)), len(ranked)))
+        print("  %7s %7s  %s" % ("flash", "ram", "unit"))
+        for name, (flash, ram) in ranked[:TOP_UNITS]:
+            print("  %7d %7d  %s" % (flash, ram, name))
+    else:
+        print("No linker map at %s - per unit sizes skipped." % map_path)
+
+    print("Flash by symbol (top %d of %d):" % (min(TOP_SYMBOLS, len(flash_symbols)), len(flash_symbols)))
+    for size, name in flash_symbols[:TOP_SYMBOLS]:
+        print("  %6d  %s" % (size, name))
+    print("SRAM by symbol (top %d of %d):" % (min(TOP_SYMBOLS, len(ram_symbols)), len(ram_symbols)))
+    for size, name in ram_symbols[:TOP_SYMBOLS]:
+        print("  %6d  %5.1f%%  %s" % (size, 100.0 * size / sram, name))
+
+    frames, dynamic = parse_stack_usage(su_paths)
+    disassembly = subprocess.run([objdump, "-d", "--demangle", "--no-show-raw-insn", elf],
+                                 check=True, capture_output=True, text=True).stdout
+    calls, indirect = parse_calls(disassembly)
+    walker = StackWalker(frames, calls)
+
+    print("Worst-case stack:")
+    main_depth, main_chain = walker.deepest(MAIN_ROOT)
+    print("  %6d  %s" % (main_depth, " -> ".join(main_chain)))
+    depths = {}
+    for handler in interrupt_roots(calls):
+        depth, chain = walker.deepest(handler)
+        depths[handler] = depth + EXCEPTION_FRAME
+        level = ISR_PRIORITIES.get(handler)
+        print("  %6d  %s (+%d exception frame, priority %s)"
+              % (depth, " -> ".join(chain), EXCEPTION_FRAME, "?" if level is None else level))
+    nested = nested_interrupts(depths)
+    stack_total = main_depth + sum(depth for depth, _ in nested)
+    print("  %6d  total, with %s nested on top of loop()"
+          % (stack_total, ", ".join(handler for _, handler in nested) or "no interrupts"))
+
+    reached = set()
+    for chain_root in [MAIN_ROOT] + interrupt_roots(calls):
+        pending = [chain_root]
+        while pending:
+            function = pending.pop()
+            if function not in reached:
+                reached.add(function)
+                pending.extend(calls.get(function, ()))
+    for title, names in (("Calls through pointers (not followed)", indirect & reached),
+                         ("Dynamic stack frames (size not known)", dynamic & reached),
+                         ("Recursion (counted once)", walker.cycles)):
+        if names:
+            print("  %s: %s" % (title, ", ".join(sorted(names))))
+    if walker.unknown & reached:
+        print("  %d functions without .su data counted as %d bytes each"
+              % (len(walker.unknown & reached), UNKNOWN_FRAME))
+
+    print("Totals: flash %d, static RAM %d, stack %d, SRAM %d left after both"
+          % (flash_total, ram_total, stack_total, sram - ram_total - stack_total))
+
+    checks = [("flash", flash_total, budgets.get("flash")),
+              ("static RAM", ram_total, budgets.get("ram")),
+              ("stack", stack_total, budgets.get("stack")),
+              ("static RAM + stack", ram_total + stack_total, sram)]
+    for name, used, budget in checks:
+        if budget is not None and used > budget:
+            failures.append("%s is %d bytes, over its budget of %d by %d" % (name, used, budget, used - budget))
+    for failure in failures:
+        print(("BUDGET EXCEEDED: " if enforce else "Over budget (not enforced): ") + failure)
+    return failures
+
+
+def su_files(build_dir):
+    return glob.glob(os.path.join(build_dir, "**", "*.su"), recursive=True)
+
+
+def after_build(source, target, env):
+    build_dir = env.subst("$BUILD_DIR")
+    tool = env.subst("$CC")
+    budgets = {}
+    for name in ("flash", "ram", "stack"):
+        value = env.GetProjectOption("custom_%s_budget" % name, "")
+        if value:
+            budgets[name] = int(value, 0)
+    enforce = env.GetProjectOption("custom_budget_fail", "no").lower() in ("yes", "true", "1")
+    failures = report(tool.replace("gcc", "nm"), tool.replace("gcc", "objdump"), str(source[0]),
+                      os.path.join(build_dir, "firmware.map"), su_files(build_dir), budgets, enforce)
+    if failures and enforce:
+        env.Exit(1)
+
+
+def main(argv):
+    build_dir = argv[1]
+    budgets = {}
+    args = argv[2:]
+    enforce = "--fail" in args
+    args = [arg for arg in args if arg != "--fail"]
+    for i in range(0, len(args) - 1, 2):
+        budgets[args[i][2:].replace("-budget", "")] = int(args[i + 1], 0)
+    failures = report("arm-none-eabi-nm", "arm-none-eabi-objdump", os.path.join(build_dir, "firmware.elf"),
+                      os.path.join(build_dir, "firmware.map"), su_files(build_dir), budgets, enforce)
+    return 1 if failures and enforce else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    env.Append(CCFLAGS=["-fstack-usage"],  # noqa: F821
+               LINKFLAGS=["-Wl,-Map,${BUILD_DIR}/firmware.map"])
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", after_build)  # noqa: F821
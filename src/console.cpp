@@ -0,0 +1,417 @@
+#include "hal.h"
+#include <stdlib.h>
+#include <string.h>
+#include "console.h"
+#include "distance.h"
+#include "flight_recorder.h"
+#include "latency.h"
+#include "memory_monitor.h"
+#include "params.h"
+#include "profiler.h"
+#include "proximity.h"
+#include "sensor_health.h"
+#include "stats.h"
+#include "tap_lock.h"
+
+static char line[CONSOLE_LINE_LENGTH];
+static int lineLength = 0;
+static bool overflowed = false; // Drop the rest of a line that was too long.
+
+static void printParam(const Param &param)
+{
+  halPrint(param.name);
+  halPrint(" = ");
+  halPrint(*param.value);
+  halPrint(" (default ");
+  halPrint(param.defaultValue);
+  halPrint(", ");
+  halPrint(param.min);
+  halPrint("..");
+  halPrint(param.max);
+  halPrintln(")");
+}
+
+static const Param *lookup(const char *name)
+{
+  const Param *param = findParam(name);
+  if (param == nullptr)
+  {
+    halPrint("Unknown parameter: ");
+    halPrintln(name);
+  }
+  return param;
+}
+
+static void commandHelp(char **args, int count);
+
+static void commandList(char **args, int count)
+{
+  for (int i = 0; i < paramCount(); i++)
+    printParam(paramAt(i));
+}
+
+static void commandGet(char **args, int count)
+{
+  if (count < 2)
+  {
+    halPrintln("Usage: get <name>");
+    return;
+  }
+  const Param *param = lookup(args[1]);
+  if (param != nullptr)
+    printParam(*param);
+}
+
+static void commandSet(char **args, int count)
+{
+  if (count < 3)
+  {
+    halPrintln("Usage: set <name> <value>");
+    return;
+  }
+  const Param *param = lookup(args[1]);
+  if (param == nullptr)
+    return;
+
+  char *end;
+  long value = strtol(args[2], &end, 10);
+  const char *problem = *end != '\0' ? "not a number" : paramProblem(*param, value);
+  if (problem != nullptr)
+  {
+    halPrint("Bad value (");
+    halPrint(problem);
+    halPrint(") for ");
+    printParam(*param);
+    return;
+  }
+  setParam(*param, value);
+  printParam(*param);
+}
+
+static void commandSave(char **args, int count)
+{
+  halPrintln(saveParams() ? "Saved." : "Save failed.");
+}
+
+static void commandDefaults(char **args, int count)
+{
+  resetParams();
+  halPrintln("Defaults restored. Use save to keep them.");
+}
+
+static void commandDump(char **args, int count)
+{
+  recorderDump();
+}
+
+static void commandArm(char **args, int count)
+{
+  recorderArm();
+  halPrintln("Recorder armed.");
+}
+
+// The recorder's triggers, by name.  "manual" isn't here - it can't be
+// turned off.
+struct TriggerName
+{
+  const char *name;
+  uint8_t bit;
+};
+
+static constexpr TriggerName TRIGGER_NAMES[] = {
+    {"lonely", FR_TRIGGER_TOUCH_WITHOUT_NEAR},
+    {"touch", FR_TRIGGER_ANY_TOUCH},
+    {"fault", FR_TRIGGER_SENSOR_FAULT},
+};
+#define NUM_TRIGGER_NAMES (sizeof(TRIGGER_NAMES) / sizeof(TRIGGER_NAMES[0]))
+
+static void commandTrigger(char **args, int count)
+{
+  if (count > 1)
+  {
+    uint8_t mask = 0;
+    for (int i = 1; i < count; i++)
+    {
+      if (strcmp(args[i], "none") == 0)
+        continue;
+      unsigned n = 0;
+      while (n < NUM_TRIGGER_NAMES && strcmp(args[i], TRIGGER_NAMES[n].name) != 0)
+        n++;
+      if (n == NUM_TRIGGER_NAMES)
+      {
+        halPrintln("Usage: trig [lonely] [touch] [fault] | trig none");
+        return;
+      }
+      mask |= TRIGGER_NAMES[n].bit;
+    }
+    recorderSetTriggers(mask);
+  }
+  halPrint("Triggers:");
+  uint8_t mask = recorderTriggers();
+  if (mask == 0)
+    halPrint(" none");
+  for (unsigned n = 0; n < NUM_TRIGGER_NAMES; n++)
+  {
+    if (mask & TRIGGER_NAMES[n].bit)
+    {
+      halPrint(" ");
+      halPrint(TRIGGER_NAMES[n].name);
+    }
+  }
+  halPrintln();
+}
+
+static void commandLatency(char **args, int count)
+{
+  if (count > 1 && strcmp(args[1], "reset") == 0)
+  {
+    latencyReset();
+    halPrintln("Latency cleared.");
+    return;
+  }
+  latencyReport();
+}
+
+static void commandStats(char **args, int count)
+{
+  statsReport();
+}
+
+static void commandHealth(char **args, int count)
+{
+  if (count > 1 && strcmp(args[1], "clear") == 0)
+  {
+    sensorHealthClear();
+    halPrintln("Sensor fault cleared.");
+  }
+  else if (count > 1)
+  {
+    halPrintln("Usage: health [clear]");
+    return;
+  }
+  sensorHealthReport();
+}
+
+static void commandProximity(char **args, int count)
+{
+  proximityReport(proximity_tracker);
+}
+
+static void commandMemory(char **args, int count)
+{
+  memoryReport();
+}
+
+static void commandDistance(char **args, int count)
+{
+  if (count > 2 && strcmp(args[1], "cal") == 0)
+  {
+    char *end;
+    long mm = strtol(args[2], &end, 10);
+    if (*end != '\0' || !distanceCalibrate(distance_counts, mm))
+    {
+      halPrint("Can't put ");
+      halPrint(distance_counts);
+      halPrint(" counts at ");
+      halPrint(args[2]);
+      halPrintln(" mm - the curve would be out of order.");
+      return;
+    }
+  }
+  else if (count > 1 && strcmp(args[1], "save") == 0)
+  {
+    halPrintln(saveDistance() ? "Saved." : "Save failed.");
+    return;
+  }
+  else if (count > 1 && strcmp(args[1], "defaults") == 0)
+    distanceDefaults();
+  else if (count > 1)
+  {
+    halPrintln("Usage: dist [cal <mm> | save | defaults]");
+    return;
+  }
+
+  halPrint("Distance: ");
+  if (distance_mm == DISTANCE_FAR)
+    halPrint("far");
+  else
+  {
+    halPrint(distance_mm);
+    halPrint(" mm");
+  }
+  halPrint(", band ");
+  halPrint((int)distance_band);
+  halPrint(", ");
+  halPrint(distance_counts);
+  halPrintln(" counts");
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+  {
+    const DistancePoint &point = distancePointAt(i);
+    halPrint("  ");
+    halPrint((int)point.counts);
+    halPrint(" counts = ");
+    halPrint((int)point.mm);
+    halPrintln(" mm");
+  }
+}
+
+static void commandLock(char **args, int count)
+{
+  static const char *const ACTIONS[] = {"none", "unlock", "effect", "debug"};
+  if (count > 1 && strcmp(args[1], "save") == 0)
+  {
+    halPrintln(tapLockSave() ? "Saved." : "Save failed.");
+    return;
+  }
+
+  int slot = count > 2 ? atoi(args[2]) : -1;
+  if (count > 2 && (slot < 0 || slot >= TAP_PATTERNS))
+  {
+    halPrintln("No such pattern.");
+    return;
+  }
+  if (count > 3 && strcmp(args[1], "rec") == 0)
+  {
+    for (int action = 0; action < 4; action++)
+    {
+      if (strcmp(args[3], ACTIONS[action]) == 0)
+      {
+        tapLockRecord(slot, (TapAction)action);
+        halPrintln("Knock the pattern, then wait.");
+        return;
+      }
+    }
+    halPrintln("Actions: none unlock effect debug");
+    return;
+  }
+  if (count > 2 && strcmp(args[1], "clear") == 0)
+    tapLockClear(slot);
+  else if (count > 1)
+  {
+    halPrintln("Usage: lock [rec <n> <action> | clear <n> | save]");
+    return;
+  }
+  tapLockReport();
+}
+
+#ifdef FAIRY_PROFILE
+static void commandProfile(char **args, int count)
+{
+  if (count > 1 && strcmp(args[1], "reset") == 0)
+  {
+    profileReset();
+    halPrintln("Profile cleared.");
+    return;
+  }
+  profileDump();
+}
+#endif
+
+// The command table.  Like the parameter table it is constant, so it
+// stays in flash.
+struct Command
+{
+  const char *name;
+  void (*run)(char **args, int count);
+};
+
+static constexpr Command COMMANDS[] = {
+    {"help", commandHelp},
+    {"list", commandList},
+    {"get", commandGet},
+    {"set", commandSet},
+    {"save", commandSave},
+    {"defaults", commandDefaults},
+    {"dump", commandDump},
+    {"arm", commandArm},
+    {"trig", commandTrigger},
+    {"mem", commandMemory},
+    {"stats", commandStats},
+    {"lat", commandLatency},
+    {"dist", commandDistance},
+    {"lock", commandLock},
+    {"health", commandHealth},
+    {"prox", commandProximity},
+#ifdef FAIRY_PROFILE
+    {"prof", commandProfile},
+#endif
+};
+#define NUM_COMMANDS (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+static void commandHelp(char **args, int count)
+{
+  halPrint("Commands:");
+  for (unsigned i = 0; i < NUM_COMMANDS; i++)
+  {
+    halPrint(" ");
+    halPrint(COMMANDS[i].name);
+  }
+  halPrintln();
+}
+
+// Split the line into words by writing '\0' over the spaces.  The words
+// are pointers back into `line`, so nothing is copied.  A line with more
+// than CONSOLE_MAX_ARGS words is refused rather than run on the first few.
+static void runLine()
+{
+  char *args[CONSOLE_MAX_ARGS];
+  int count = 0;
+  char *cursor = line;
+  while (true)
+  {
+    while (*cursor == ' ')
+      *cursor++ = '\0';
+    if (*cursor == '\0')
+      break;
+    if (count == CONSOLE_MAX_ARGS)
+    {
+      halPrintln("Too many arguments.");
+      return;
+    }
+    args[count++] = cursor;
+    while (*cursor != ' ' && *cursor != '\0')
+      cursor++;
+  }
+  if (count == 0)
+    return;
+
+  for (unsigned i = 0; i < NUM_COMMANDS; i++)
+  {
+    if (strcmp(COMMANDS[i].name, args[0]) == 0)
+    {
+      COMMANDS[i].run(args, count);
+      return;
+    }
+  }
+  halPrint("Unknown command: ");
+  halPrintln(args[0]);
+}
+
+void consolePoll()
+{
+  for (int budget = CONSOLE_BYTES_PER_POLL; budget > 0; budget--)
+  {
+    int c = halSerialRead();
+    if (c < 0)
+      return;
+
+    if (c == '\n' || c == '\r')
+    {
+      if (overflowed)
+        halPrintln("Line too long.");
+      else if (lineLength > 0)
+      {
+        line[lineLength] = '\0';
+        runLine();
+      }
+      lineLength = 0;
+      overflowed = false;
+      continue;
+    }
+
+    if (lineLength >= CONSOLE_LINE_LENGTH - 1)
+      overflowed = true;
+    else
+      line[lineLength++] = c;
+  }
+}
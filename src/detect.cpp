@@ -0,0 +1,17 @@
+#include "detect.h"
+#include "params.h"
+
+DetectParams detectParams()
+{
+  DetectParams params;
+  params.spread = spread;
+  params.minOver = min_over_threshold;
+  params.debounceMs = touch_time_debounce;
+  params.lightOnMs = light_on_time;
+  params.lightSteps = num_light_steps;
+  params.gestures = gestures != 0;
+  params.tracker = tracker != 0;
+  params.trackAccel = track_accel;
+  params.gestureTiming = gestureTiming();
+  return params;
+}
@@ -0,0 +1,136 @@
+#include "distance.h"
+#include "store.h"
+
+// Version of the saved layout: the DISTANCE_POINTS points in order, as
+// they are in RAM.
+#define DISTANCE_VERSION 1
+
+// A typical box: a finger flat on the pad adds about 200 counts, and
+// that falls off as (6 / (6 + mm))^2.  Points are closer together where
+// the curve bends hardest.
+static constexpr DistancePoint DEFAULT_POINTS[DISTANCE_POINTS] = {
+    {4, 36}, {6, 29}, {9, 22}, {14, 17}, {25, 11}, {50, 6}, {100, 2}, {200, 0},
+};
+
+static DistancePoint points[DISTANCE_POINTS];
+static int32_t slopes[DISTANCE_POINTS - 1]; // Of the line from each point to the next.
+static int32_t smoothed = 0; // distance_counts, times 1 << DISTANCE_SMOOTH_SHIFT.
+
+int distance_mm = DISTANCE_FAR;
+DistanceBand distance_band = DISTANCE_BAND_FAR;
+int distance_counts = 0;
+
+static void updateSlopes()
+{
+  for (int i = 0; i < DISTANCE_POINTS - 1; i++)
+    slopes[i] = ((int32_t)(points[i + 1].mm - points[i].mm) << DISTANCE_SLOPE_SHIFT) /
+                (points[i + 1].counts - points[i].counts);
+}
+
+// Counts must go up along the table and millimetres must not, or the
+// slopes make no sense.
+static bool inOrder(const DistancePoint *table)
+{
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+  {
+    if (table[i].counts < 1 || table[i].mm < 0 || table[i].mm >= DISTANCE_FAR)
+      return false;
+    if (i > 0 && (table[i].counts <= table[i - 1].counts || table[i].mm > table[i - 1].mm))
+      return false;
+  }
+  return true;
+}
+
+int distanceMm(int counts)
+{
+  if (counts < points[0].counts)
+    return DISTANCE_FAR;
+  if (counts > points[DISTANCE_POINTS - 1].counts)
+    counts = points[DISTANCE_POINTS - 1].counts;
+
+  // Which line the reading is on: count the points it has passed.  Always
+  // the same number of comparisons.
+  int segment = 0;
+  for (int i = 1; i < DISTANCE_POINTS - 1; i++)
+    segment += counts >= points[i].counts;
+
+  return points[segment].mm + (((counts - points[segment].counts) * slopes[segment]) >> DISTANCE_SLOPE_SHIFT);
+}
+
+void distanceSample(int counts, bool touched)
+{
+  smoothed += counts - (smoothed >> DISTANCE_SMOOTH_SHIFT);
+  distance_counts = smoothed >> DISTANCE_SMOOTH_SHIFT;
+  distance_mm = touched ? 0 : distanceMm(distance_counts);
+  distance_band = distanceBand(distance_mm);
+}
+
+DistanceBand distanceBand(int mm)
+{
+  if (mm <= 0)
+    return DISTANCE_BAND_TOUCH;
+  if (mm < DISTANCE_CLOSE_MM)
+    return DISTANCE_BAND_CLOSE;
+  if (mm < DISTANCE_NEAR_MM)
+    return DISTANCE_BAND_NEAR;
+  if (mm < DISTANCE_FAR)
+    return DISTANCE_BAND_APPROACH;
+  return DISTANCE_BAND_FAR;
+}
+
+const DistancePoint &distancePointAt(int index)
+{
+  return points[index];
+}
+
+bool distanceCalibrate(int counts, int mm)
+{
+  int nearest = 0;
+  for (int i = 1; i < DISTANCE_POINTS; i++)
+  {
+    int gap = points[i].mm - mm;
+    int best = points[nearest].mm - mm;
+    if ((gap < 0 ? -gap : gap) < (best < 0 ? -best : best))
+      nearest = i;
+  }
+
+  DistancePoint table[DISTANCE_POINTS];
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+    table[i] = points[i];
+  table[nearest].counts = counts;
+  table[nearest].mm = mm;
+  if (!inOrder(table))
+    return false;
+
+  points[nearest] = table[nearest];
+  updateSlopes();
+  return true;
+}
+
+void distanceDefaults()
+{
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+    points[i] = DEFAULT_POINTS[i];
+  updateSlopes();
+}
+
+bool loadDistance()
+{
+  DistancePoint saved[DISTANCE_POINTS];
+  uint8_t version;
+  distanceDefaults();
+  if (storeLoad(STORE_TYPE_DISTANCE, saved, sizeof(saved), &version) != sizeof(saved) || version != DISTANCE_VERSION)
+    return false;
+  if (!inOrder(saved))
+    return false; // Keep the defaults rather than a curve that makes no sense.
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+    points[i] = saved[i];
+  updateSlopes();
+  return true;
+}
+
+bool saveDistance()
+{
+  static_assert(sizeof(points) <= STORE_PAYLOAD_SIZE, "distance table too big for one store record");
+  return storeSave(STORE_TYPE_DISTANCE, DISTANCE_VERSION, points, sizeof(points));
+}
@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include <string.h>
+#include "flash_region.h"
+
+// The region sits at the very end of flash.  The Arduino bootloader owns
+// the first 8KB and sketches are written right after it, so the sketch
+// would have to grow past 240KB before it bumped into us.
+#define FLASH_REGION_START (FLASH_SIZE - FLASH_REGION_SIZE)
+
+// Where the linker script put the end of the sketch: the code and
+// constants end at __etext, and the starting values of the initialised
+// variables are stored straight after them, to be copied into RAM at boot.
+extern uint32_t __etext;
+extern uint32_t __data_start__;
+extern uint32_t __data_end__;
+
+// Nothing in the core's linker script keeps the sketch out of the region,
+// so check.  A sketch that has grown into it reads the region as blank and
+// refuses to write it, rather than erasing its own code.
+static bool clearOfSketch()
+{
+  uint32_t dataSize = (uint32_t)&__data_end__ - (uint32_t)&__data_start__;
+  return (uint32_t)&__etext + dataSize <= FLASH_REGION_START;
+}
+
+static inline volatile uint32_t *regionAddress(uint32_t offset)
+{
+  return (volatile uint32_t *)(FLASH_REGION_START + offset);
+}
+
+static inline void waitReady()
+{
+  while (NVMCTRL->INTFLAG.bit.READY == 0)
+  {
+  }
+}
+
+// Run one NVM controller command and report whether it went through.
+// The error bits in STATUS are sticky, so clear them first.
+static bool runCommand(uint32_t command)
+{
+  NVMCTRL->STATUS.reg |= NVMCTRL_STATUS_MASK;
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | command;
+  waitReady();
+  return (NVMCTRL->STATUS.reg & (NVMCTRL_STATUS_PROGE | NVMCTRL_STATUS_LOCKE | NVMCTRL_STATUS_NVME)) == 0;
+}
+
+void flashRead(uint32_t offset, void *data, uint32_t length)
+{
+  if (!clearOfSketch())
+  {
+    memset(data, 0xFF, length);
+    return;
+  }
+  // Flash is memory mapped, so reading is just a copy.
+  memcpy(data, (const void *)regionAddress(offset), length);
+}
+
+bool flashProgramPage(uint32_t offset, const void *data)
+{
+  if (offset % FLASH_REGION_PAGE != 0 || offset >= FLASH_REGION_SIZE || !clearOfSketch())
+    return false;
+
+  // Writes go into a page buffer inside the NVM controller, then a
+  // "write page" command burns the buffer into flash.  The buffer only
+  // takes 32 bit writes, so copy a word at a time.
+  NVMCTRL->CTRLB.bit.MANW = 1;
+  if (!runCommand(NVMCTRL_CTRLA_CMD_PBC))
+    return false;
+
+  volatile uint32_t *destination = regionAddress(offset);
+  const uint8_t *source = (const uint8_t *)data;
+  for (int i = 0; i < FLASH_REGION_PAGE / 4; i++)
+  {
+    uint32_t word;
+    memcpy(&word, source + i * 4, 4);
+    destination[i] = word;
+  }
+
+  NVMCTRL->ADDR.reg = (uint32_t)destination / 2;
+  return runCommand(NVMCTRL_CTRLA_CMD_WP);
+}
+
+bool flashEraseRow(uint32_t offset)
+{
+  if (offset >= FLASH_REGION_SIZE || !clearOfSketch())
+    return false;
+
+  // The address register counts 16 bit half-words, hence the divide.
+  NVMCTRL->ADDR.reg = (uint32_t)regionAddress(offset - offset % FLASH_REGION_ROW) / 2;
+  return runCommand(NVMCTRL_CTRLA_CMD_ER);
+}
@@ -0,0 +1,239 @@
+#include "hal.h"
+#include "flight_recorder.h"
+
+// One delta sample.  Each field is the change since the previous sample.
+struct FlightDelta
+{
+  uint8_t dt; // Milliseconds since the previous sample.
+  int8_t dq;  // Change in qt1, or FR_ESCAPE.
+  int8_t db;  // Change in qt_base.
+  int8_t dp;  // Change in PWM.
+};
+
+// A dq of FR_ESCAPE means the slot after this one is a FlightWide rather
+// than a FlightDelta.  The escape itself still holds dt and db.
+#define FR_ESCAPE -128
+
+// The second slot of an escaped sample.  Bytes only, so it shares a
+// FlightDelta's place without any alignment to worry about.
+struct FlightWide
+{
+  uint8_t dqLow;  // Change in qt1, 16 bits.
+  uint8_t dqHigh;
+  uint8_t pwm;    // The PWM value itself, not a change.
+  uint8_t unused;
+};
+
+union FlightSlot
+{
+  FlightDelta delta;
+  FlightWide wide;
+};
+static_assert(sizeof(FlightSlot) == 4, "a slot is four bytes");
+
+// A block starts with one full ("key") sample followed by up to
+// FLIGHT_RECORDER_BLOCK_SAMPLES slots of deltas.  Because every block can
+// be decoded on its own, overwriting the oldest block never corrupts the
+// others.
+struct FlightBlock
+{
+  uint32_t startMs;
+  uint16_t qt1;
+  uint16_t base;
+  uint8_t pwm;
+  uint8_t count;
+  FlightSlot slots[FLIGHT_RECORDER_BLOCK_SAMPLES];
+};
+
+static FlightBlock fr_blocks[FLIGHT_RECORDER_BLOCKS];
+static uint8_t fr_head = 0; // Block currently being filled.
+static uint8_t fr_used = 0; // Number of blocks holding data.
+
+// The previous sample, used to compute deltas.
+static uint32_t fr_lastMs = 0;
+static int fr_lastQt = 0;
+static int fr_lastBase = 0;
+static int fr_lastPwm = 0;
+
+static uint8_t fr_triggers = FLIGHT_RECORDER_TRIGGERS;
+static bool fr_frozen = false;
+static int fr_postCount = -1; // Samples until we freeze. -1 when not triggered.
+static uint8_t fr_reason = 0;
+static uint32_t fr_triggerMs = 0;
+
+// Is `value` a signed byte?  Adding 128 moves the valid range to 0..255,
+// so a single unsigned compare does the job.
+static inline bool fitsByte(int value)
+{
+  return (unsigned)(value + 128) <= 255;
+}
+
+// The same for dq, which gives up -128 to FR_ESCAPE.
+static inline bool fitsDelta(int value)
+{
+  return (unsigned)(value + 127) <= 254;
+}
+
+// And for an escaped qt1 change.
+static inline bool fitsWide(int value)
+{
+  return (unsigned)(value + 32768) <= 65535;
+}
+
+static void startBlock(uint32_t now, int qt1, int base, int pwm)
+{
+  if (fr_used > 0)
+    fr_head = (fr_head + 1) % FLIGHT_RECORDER_BLOCKS;
+  if (fr_used < FLIGHT_RECORDER_BLOCKS)
+    fr_used++;
+
+  FlightBlock &block = fr_blocks[fr_head];
+  block.startMs = now;
+  block.qt1 = qt1;
+  block.base = base;
+  block.pwm = pwm;
+  block.count = 0;
+}
+
+void recorderSample(uint32_t now, int qt1, int base, int pwm)
+{
+  if (fr_frozen)
+    return;
+
+  // PWM values above 255 are clamped by the hardware anyway.
+  if (pwm > 255)
+    pwm = 255;
+  if (pwm < 0)
+    pwm = 0;
+
+  FlightBlock &block = fr_blocks[fr_head];
+  uint32_t dt = now - fr_lastMs;
+  int dq = qt1 - fr_lastQt;
+  int db = base - fr_lastBase;
+  int dp = pwm - fr_lastPwm;
+
+  bool escape = !fitsDelta(dq) || !fitsByte(dp);
+  if (fr_used == 0 || block.count + (escape ? 2 : 1) > FLIGHT_RECORDER_BLOCK_SAMPLES || dt > 255 ||
+      !fitsByte(db) || !fitsWide(dq))
+  {
+    startBlock(now, qt1, base, pwm);
+  }
+  else if (escape)
+  {
+    FlightDelta &delta = block.slots[block.count++].delta;
+    delta.dt = dt;
+    delta.dq = FR_ESCAPE;
+    delta.db = db;
+    delta.dp = 0;
+    FlightWide &wide = block.slots[block.count++].wide;
+    wide.dqLow = (uint16_t)dq & 0xFF;
+    wide.dqHigh = (uint16_t)dq >> 8;
+    wide.pwm = pwm;
+    wide.unused = 0;
+  }
+  else
+  {
+    FlightDelta &delta = block.slots[block.count++].delta;
+    delta.dt = dt;
+    delta.dq = dq;
+    delta.db = db;
+    delta.dp = dp;
+  }
+
+  fr_lastMs = now;
+  fr_lastQt = qt1;
+  fr_lastBase = base;
+  fr_lastPwm = pwm;
+
+  if (fr_postCount > 0)
+    fr_postCount--;
+  if (fr_postCount == 0)
+    fr_frozen = true;
+}
+
+void recorderTrigger(uint8_t reason)
+{
+  if (!(reason & (fr_triggers | FR_TRIGGER_MANUAL)))
+    return;
+  // Only the first trigger counts.  Later ones would push the freeze out
+  // and we could lose the interesting part.
+  if (fr_frozen || fr_postCount >= 0)
+    return;
+
+  fr_reason = reason;
+  fr_triggerMs = fr_lastMs;
+  fr_postCount = FLIGHT_RECORDER_POST_TRIGGER;
+}
+
+void recorderSetTriggers(uint8_t mask)
+{
+  fr_triggers = mask;
+}
+
+uint8_t recorderTriggers()
+{
+  return fr_triggers;
+}
+
+void recorderArm()
+{
+  fr_used = 0;
+  fr_head = 0;
+  fr_postCount = -1;
+  fr_reason = 0;
+  fr_frozen = false;
+}
+
+bool recorderFrozen()
+{
+  return fr_frozen;
+}
+
+void recorderDump()
+{
+  halPrint("# flight recorder frozen=");
+  halPrint(fr_frozen ? 1 : 0);
+  halPrint(" reason=");
+  halPrint(fr_reason);
+  halPrint(" trigger_ms=");
+  halPrintln(fr_triggerMs);
+  halPrintln("t_ms,qt1,qt_base,pwm");
+
+  // The oldest block is the one after the head, once the ring has wrapped.
+  int first = fr_used < FLIGHT_RECORDER_BLOCKS ? 0 : (fr_head + 1) % FLIGHT_RECORDER_BLOCKS;
+  for (int n = 0; n < fr_used; n++)
+  {
+    const FlightBlock &block = fr_blocks[(first + n) % FLIGHT_RECORDER_BLOCKS];
+    uint32_t t = block.startMs;
+    int qt1 = block.qt1;
+    int base = block.base;
+    int pwm = block.pwm;
+    for (int i = -1; i < block.count; i++)
+    {
+      if (i >= 0)
+      {
+        const FlightDelta &delta = block.slots[i].delta;
+        t += delta.dt;
+        base += delta.db;
+        if (delta.dq == FR_ESCAPE)
+        {
+          const FlightWide &wide = block.slots[++i].wide;
+          qt1 += (int16_t)(wide.dqLow | wide.dqHigh << 8);
+          pwm = wide.pwm;
+        }
+        else
+        {
+          qt1 += delta.dq;
+          pwm += delta.dp;
+        }
+      }
+      halPrint(t);
+      halPrint(",");
+      halPrint(qt1);
+      halPrint(",");
+      halPrint(base);
+      halPrint(",");
+      halPrintln(pwm);
+    }
+  }
+}
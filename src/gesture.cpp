@@ -0,0 +1,124 @@
+#include "gesture.h"
+#include "params.h"
+
+// Where a channel has got to.
+enum GestureState
+{
+  STATE_IDLE = 0,       // Nothing going on.
+  STATE_PRESSED,        // First touch down.
+  STATE_WAITING,        // A tap has ended.  Is another coming?
+  STATE_SECOND_PRESS,   // It came: second touch down.
+  STATE_HELD,           // Said "hold" already.  Wait for it to end.
+};
+
+void gestureReset(GestureChannel &channel)
+{
+  channel.state = STATE_IDLE;
+  channel.releasing = false;
+  channel.downMs = 0;
+  channel.upMs = 0;
+}
+
+// A touch has started at `now`.
+static Gesture touchDown(GestureChannel &channel, const GestureTiming &timing, uint32_t now)
+{
+  channel.downMs = now;
+  if (channel.state == STATE_WAITING && now - channel.upMs < timing.doubleGapMs)
+    channel.state = STATE_SECOND_PRESS;
+  else
+    channel.state = STATE_PRESSED;
+  return GESTURE_NONE;
+}
+
+// The touch that started at downMs ended at upMs.
+static Gesture touchUp(GestureChannel &channel, const GestureTiming &timing)
+{
+  uint32_t length = channel.upMs - channel.downMs;
+  uint8_t state = channel.state;
+  channel.state = STATE_IDLE;
+  if (state == STATE_SECOND_PRESS)
+    return GESTURE_DOUBLE_TAP; // Long second touches were made first touches in gestureSample().
+  if (state != STATE_PRESSED)
+    return GESTURE_NONE; // Held - already said.
+  if (length <= timing.tapMaxMs)
+  {
+    channel.state = STATE_WAITING;
+    return GESTURE_NONE;
+  }
+  if (length >= timing.longPressMs)
+    return GESTURE_LONG_PRESS;
+  return GESTURE_NONE; // Neither one thing nor the other.
+}
+
+Gesture gestureSample(GestureChannel &channel, const GestureTiming &timing, uint32_t now, bool touched)
+{
+  bool down = channel.state == STATE_PRESSED || channel.state == STATE_SECOND_PRESS || channel.state == STATE_HELD;
+
+  if (touched)
+  {
+    if (channel.releasing)
+      channel.releasing = false; // Too short a gap to count - still the same touch.
+    else if (!down)
+      return touchDown(channel, timing, now);
+  }
+  else if (down && !channel.releasing)
+  {
+    channel.releasing = true;
+    channel.upMs = now;
+  }
+
+  if (channel.releasing)
+  {
+    if (now - channel.upMs < GESTURE_RELEASE_MS)
+      return GESTURE_NONE;
+    channel.releasing = false;
+    return touchUp(channel, timing);
+  }
+
+  uint32_t held = now - channel.downMs;
+  switch (channel.state)
+  {
+  case STATE_WAITING:
+    if (now - channel.upMs >= timing.doubleGapMs)
+    {
+      channel.state = STATE_IDLE;
+      return GESTURE_TAP;
+    }
+    break;
+  case STATE_SECOND_PRESS:
+    // Too long for the second half of a double tap: the first was a tap
+    // on its own, and this is a new touch of its own.
+    if (held > timing.tapMaxMs)
+    {
+      channel.state = STATE_PRESSED;
+      return GESTURE_TAP;
+    }
+    break;
+  case STATE_PRESSED:
+    if (held >= timing.holdMs)
+    {
+      channel.state = STATE_HELD;
+      return GESTURE_HOLD;
+    }
+    break;
+  default:
+    break;
+  }
+  return GESTURE_NONE;
+}
+
+GestureTiming gestureTiming()
+{
+  GestureTiming timing;
+  timing.tapMaxMs = gesture_tap_max;
+  timing.doubleGapMs = gesture_double_gap;
+  timing.longPressMs = gesture_long_press;
+  timing.holdMs = gesture_hold;
+  return timing;
+}
+
+const char *gestureName(Gesture gesture)
+{
+  static const char *const NAMES[] = {"none", "tap", "double tap", "long press", "hold"};
+  return gesture <= GESTURE_HOLD ? NAMES[gesture] : "?";
+}
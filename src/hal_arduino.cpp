@@ -0,0 +1,104 @@
+#include <Arduino.h>
+#include "Adafruit_FreeTouch.h"  // If you don't know about Adafruit
+                                 // checkout https://adafruit.com
+                                 // it will be your new IOT addiction.
+#include "hal.h"
+
+// This library does the pin assignment and sampling of the
+// capacitance between the pin and ground.  It takes advantage
+// of the analog to digital converter on the board to do the
+// sampling.  Generally it measures how long it takes for the
+// pin voltage to read HIGH as it fills the capacitance of the
+// pin + resitistor combination.  Turns out chips like these have
+// resistors you can dynamically attach to the pins.  So, you can
+// use the pins as capacitive sensors.  This is a very cool feature
+// of the chip.  It is also a very cool feature of the chip that
+// you can use the analog to digital converter to sample the
+// voltage on the pin.  This is what this library does.  It samples
+// the voltage on one of the pins as it turns that pin on and off
+// at a specific frequency.  Since it knows the frequency and what it
+// expects the voltage to be.  The time it takes to reach that voltage
+// is able to be repeatedly measured.  This is the basis of the
+// capacitive touch sensing.  The longer it takes to reach the voltage
+// the more capacitance there is between the pin and ground.  The
+// shorter the time, the less capacitance there is between the pin
+// and ground.  Human fingers modify the capacitance between the
+// pin and ground.  So, by measuring the time it takes to reach
+// the voltage, we can determine if a finger is touching the pin.
+// That A0 - means a specific ANALOG READ pin on the board.  There is a mapping
+// to real pins hidden away in the .h files attached to this code.  In this
+// case A0 is pin 2.  Only some pins have the fancy "analog read" capability.
+Adafruit_FreeTouch qt_1 = Adafruit_FreeTouch(A0, OVERSAMPLE_1, RESISTOR_100K, FREQ_MODE_NONE);
+
+uint32_t halMillis()
+{
+  return millis();
+}
+
+uint32_t halMicros()
+{
+  return micros();
+}
+
+void halDelay(uint32_t ms)
+{
+  delay(ms);
+}
+
+bool halTouchBegin()
+{
+  return qt_1.begin();
+}
+
+int halTouchMeasure()
+{
+  return qt_1.measure();
+}
+
+void halPinOutput(int pin)
+{
+  pinMode(pin, OUTPUT);
+}
+
+void halDigitalWrite(int pin, bool high)
+{
+  digitalWrite(pin, high ? HIGH : LOW);
+}
+
+void halPwmWrite(int pin, int value)
+{
+  analogWrite(pin, value);
+}
+
+void halSerialBegin(unsigned long baud)
+{
+  Serial.begin(baud);
+}
+
+int halSerialRead()
+{
+  // Checking available() first means we never wait for a character.
+  if (Serial.available() <= 0)
+    return -1;
+  return Serial.read();
+}
+
+void halPrint(const char *text)
+{
+  Serial.print(text);
+}
+
+void halPrint(long value)
+{
+  Serial.print(value);
+}
+
+void halPrint(unsigned long value)
+{
+  Serial.print(value);
+}
+
+void halNewline()
+{
+  Serial.println();
+}
@@ -0,0 +1,66 @@
+#include "host/corpus.h"
+#include "host/trace.h"
+
+bool corpusLoad(const char *path, Corpus &corpus)
+{
+  TraceReader reader;
+  if (!reader.open(path))
+    return false;
+  CorpusTrace trace;
+  trace.name = path;
+  TraceSample sample;
+  while (reader.next(sample))
+  {
+    trace.readings.push_back({sample.tUs, sample.raw});
+    trace.baseline.push_back(sample.baseline);
+  }
+  if (!reader.hasTruth() || trace.readings.empty())
+    return false;
+  trace.events = reader.events;
+  trace.endUs = trace.readings.back().tUs;
+  corpus.push_back(std::move(trace));
+  return true;
+}
+
+void corpusSynthetic(int count, double hours, uint64_t seed, const SignalConfig &config, Corpus &corpus)
+{
+  for (int i = 0; i < count; i++)
+  {
+    CorpusTrace trace;
+    trace.name = "synthetic";
+    SignalGenerator generator(config, seed + i);
+    trace.endUs = (uint64_t)(hours * 3600e6);
+    for (;;)
+    {
+      SignalSample sample = generator.next();
+      if (sample.tUs >= trace.endUs)
+        break;
+      trace.readings.push_back({sample.tUs, sample.raw});
+      trace.baseline.push_back(sample.baseline);
+    }
+    trace.events = generator.events;
+    corpus.push_back(std::move(trace));
+  }
+}
+
+size_t corpusReadings(const Corpus &corpus)
+{
+  size_t total = 0;
+  for (const CorpusTrace &trace : corpus)
+    total += trace.readings.size();
+  return total;
+}
+
+Score corpusScore(const Corpus &corpus, const PipelineParams &params)
+{
+  Score total = {};
+  for (const CorpusTrace &trace : corpus)
+  {
+    PipelineModel model(params);
+    Scorer scorer(trace.events, trace.readings, trace.baseline);
+    for (const PipelineReading &reading : trace.readings)
+      scorer.add(model.step(reading.tUs, reading.raw));
+    total.add(scorer.finish(trace.endUs));
+  }
+  return total;
+}
@@ -0,0 +1,36 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdint.h>
+#include <vector>
+#include "host/pipeline_model.h"
+#include "host/score.h"
+#include "host/signal_gen.h"
+
+// A set of labelled traces held in memory, for tools that run the same
+// readings many times over.
+
+struct CorpusTrace
+{
+  const char *name;
+  std::vector<PipelineReading> readings;
+  std::vector<SignalEvent> events;
+  std::vector<float> baseline; // True baseline per reading, if known.
+  uint64_t endUs;
+};
+
+typedef std::vector<CorpusTrace> Corpus;
+
+// Read a trace file (see trace.h).  Returns false if it can't be read or
+// has no ground truth to score against.
+bool corpusLoad(const char *path, Corpus &corpus);
+
+// Add `count` synthetic traces of `hours` each, seeds seed, seed+1, ...
+void corpusSynthetic(int count, double hours, uint64_t seed, const SignalConfig &config, Corpus &corpus);
+
+size_t corpusReadings(const Corpus &corpus);
+
+// Run the model with `params` over every trace and add up the scores.
+Score corpusScore(const Corpus &corpus, const PipelineParams &params);
+
+#endif
@@ -0,0 +1,128 @@
+#include <math.h>
+#include "host/fixedpoint.h"
+#include "host/pipeline_model.h"
+#include "host/reference_model.h"
+
+void FixedpointStage::add(double error, const char *trace, uint64_t tUs)
+{
+  error = fabs(error);
+  if (error > worst)
+  {
+    worst = error;
+    worstTrace = trace;
+    worstS = tUs / 1e6;
+  }
+  squares += error * error;
+  readings++;
+}
+
+double FixedpointStage::rms() const
+{
+  return readings ? sqrt(squares / readings) : 0;
+}
+
+void FixedpointDecision::add(bool fixed, bool reference, const char *trace, uint64_t tUs)
+{
+  bool differ = fixed != reference;
+  if (differ && !apart)
+  {
+    if (flips == 0)
+    {
+      firstTrace = trace;
+      firstS = tUs / 1e6;
+    }
+    flips++;
+    fixedOnly += fixed;
+  }
+  readings += differ;
+  apart = differ;
+}
+
+double FixedpointReport::perHour(const FixedpointDecision &decision) const
+{
+  return hours > 0 ? decision.flips / hours : 0;
+}
+
+bool FixedpointReport::passed() const
+{
+  bool ok = true;
+  for (const FixedpointStage &stage : stages)
+    ok &= stage.passed();
+  for (const FixedpointDecision &decision : decisions)
+    ok &= passed(decision);
+  return ok;
+}
+
+void fixedpointRooms(double hours, uint64_t seed, Corpus &corpus)
+{
+  SignalConfig quiet, noisy, drifting, spiky;
+  noisy.whiteNoise = 2.5;
+  noisy.pinkNoise = 1.5;
+  noisy.humCounts = 1.5;
+  drifting.driftPerDay = 30;
+  drifting.thermalCounts = 10;
+  drifting.humidityCounts = 8;
+  spiky.spikesPerHour = 6;
+  const SignalConfig *configs[] = {&quiet, &noisy, &drifting, &spiky};
+  const char *names[] = {"quiet", "noisy", "drifting", "spiky"};
+  for (int i = 0; i < 4; i++)
+  {
+    corpusSynthetic(1, hours, seed + i, *configs[i], corpus);
+    corpus.back().name = names[i];
+  }
+}
+
+FixedpointReport fixedpointCompare(const Corpus &corpus)
+{
+  FixedpointReport report = {{{"baseline", FIXEDPOINT_BASE_MAX, FIXEDPOINT_BASE_RMS},
+                              {"average", FIXEDPOINT_AVG_MAX, FIXEDPOINT_AVG_RMS},
+                              {"envelope", FIXEDPOINT_ENVELOPE_MAX, FIXEDPOINT_ENVELOPE_RMS}},
+                             {{"touched", FIXEDPOINT_TOUCHED_FLIPS},
+                              {"near", FIXEDPOINT_NEAR_FLIPS},
+                              {"registered", FIXEDPOINT_REGISTERED_FLIPS},
+                              {"lit", FIXEDPOINT_LIT_FLIPS}},
+                             0};
+  FixedpointStage *stages = report.stages;
+  FixedpointDecision *decisions = report.decisions;
+
+  for (const CorpusTrace &trace : corpus)
+  {
+    for (FixedpointDecision &decision : report.decisions)
+      decision.apart = false;
+    const char *name = trace.name;
+    PipelineModel fixed(pipelineDefaults());
+    ReferenceModel reference(pipelineDefaults());
+    int numMeas = pipelineDefaults().numMeas;
+    int apart = 0; // addMeasurement() calls until both averages hold the same readings.
+    bool fixedTouch = false, referenceTouch = false;
+    uint64_t fixedTouchUs = 0, referenceTouchUs = 0;
+    for (const PipelineReading &reading : trace.readings)
+    {
+      PipelineOutput a = fixed.step(reading.tUs, reading.raw);
+      ReferenceOutput b = reference.step(reading.tUs, reading.raw);
+      decisions[0].add(a.touched, b.touched, name, a.tUs);
+      decisions[1].add(a.near, b.near, name, a.tUs);
+      decisions[2].add(a.registered, b.registered, name, a.tUs);
+      decisions[3].add(a.pwm > 0, b.lit, name, a.tUs);
+
+      if (a.measured != b.measured)
+        apart = numMeas;
+      else if (a.measured >= 0 && apart > 0)
+        apart--;
+      if (a.touched)
+        fixedTouch = true, fixedTouchUs = a.tUs;
+      if (b.touched)
+        referenceTouch = true, referenceTouchUs = a.tUs;
+      bool inStep = apart == 0 && a.touched == b.touched && a.near == b.near && (a.pwm > 0) == b.lit &&
+                    fixedTouch == referenceTouch && fixedTouchUs == referenceTouchUs;
+
+      stages[0].add(a.base - b.base, name, a.tUs);
+      if (apart == 0)
+        stages[1].add(a.avg - b.avg, name, a.tUs);
+      if (inStep)
+        stages[2].add(a.pwm - b.pwm, name, a.tUs);
+    }
+    report.hours += (trace.endUs - trace.readings.front().tUs) / 3.6e9;
+  }
+  return report;
+}
@@ -0,0 +1,100 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <stdint.h>
+#include "host/corpus.h"
+
+// Is the integer maths changing what the box does?  Replays a corpus
+// through the firmware's fixed point filters (PipelineModel) and through
+// a double precision reference (see reference_model.h), side by side,
+// and compares them on every reading:
+//
+//  - each filter stage - the baseline, the proximity average and the
+//    envelope (the brightness the light is driven at) - for the largest
+//    and the RMS difference, in counts;
+//  - each decision - touched, near, a registered touch, light on - for
+//    flips: runs of readings where the two came out differently.  "fixed"
+//    is how many of those the firmware said yes to.
+//
+// Everything has a budget below.  The fixedpoint tool prints the lot
+// (src/host/tools/fixedpoint.cpp), and test_fixedpoint fails the native
+// tests if anything is over, so a change to the filters that drifts from
+// the maths fails `pio test` as well as the tool.
+//
+// Once a decision flips the two go their separate ways for a while: a
+// near reading one of them saw goes into its proximity average and not
+// the other's, and a touch one of them saw keeps its light on for 40
+// seconds.  Those are counted as flips; the proximity average is only
+// compared while both hold the same readings, and the envelope only
+// while they also agree on touched, near, whether the light is on and
+// when the last touch was.
+
+// Truncating a running total divided by its length is always less than
+// one count out; more than that means a running total went wrong.
+#define FIXEDPOINT_BASE_MAX 1.0
+#define FIXEDPOINT_BASE_RMS 0.6
+#define FIXEDPOINT_AVG_MAX 1.0
+#define FIXEDPOINT_AVG_RMS 0.6
+// avgMeasure - qt_base loses up to a count from each side.
+#define FIXEDPOINT_ENVELOPE_MAX 2.0
+#define FIXEDPOINT_ENVELOPE_RMS 1.0
+// Flips per hour.  Readings are whole numbers, so raw > qt_base + min_over
+// comes out the same whether qt_base was truncated or not, but raw >=
+// qt_base + spread doesn't: a reading exactly spread over the truncated
+// baseline is a touch to the firmware and not to the maths.  Those are
+// rare, and near flips only follow from them.  A registered touch or the
+// light coming on is what someone would notice.
+#define FIXEDPOINT_TOUCHED_FLIPS 2.0
+#define FIXEDPOINT_NEAR_FLIPS 2.0
+#define FIXEDPOINT_REGISTERED_FLIPS 0.5
+#define FIXEDPOINT_LIT_FLIPS 1.0
+
+#define FIXEDPOINT_STAGES 3    // The baseline, the average, the envelope.
+#define FIXEDPOINT_DECISIONS 4 // Touched, near, registered, lit.
+
+struct FixedpointStage
+{
+  const char *name;
+  double maxBudget, rmsBudget;
+  double worst, squares;
+  unsigned long readings;
+  const char *worstTrace;
+  double worstS; // Seconds into that trace.
+
+  void add(double error, const char *trace, uint64_t tUs);
+  double rms() const;
+  bool passed() const { return worst <= maxBudget && rms() <= rmsBudget; }
+};
+
+struct FixedpointDecision
+{
+  const char *name;
+  double budget; // Flips per hour.
+  unsigned long flips, fixedOnly, readings;
+  const char *firstTrace;
+  double firstS;
+  bool apart;
+
+  // A flip is a run of readings the two disagree on.
+  void add(bool fixed, bool reference, const char *trace, uint64_t tUs);
+};
+
+struct FixedpointReport
+{
+  FixedpointStage stages[FIXEDPOINT_STAGES];
+  FixedpointDecision decisions[FIXEDPOINT_DECISIONS];
+  double hours;
+
+  double perHour(const FixedpointDecision &decision) const;
+  bool passed(const FixedpointDecision &decision) const { return perHour(decision) <= decision.budget; }
+  bool passed() const;
+};
+
+// The rooms quality uses too: quiet, noisy, drifting and spiky, `hours`
+// each, named after themselves.
+void fixedpointRooms(double hours, uint64_t seed, Corpus &corpus);
+
+// Run every trace through both, at the firmware's defaults.
+FixedpointReport fixedpointCompare(const Corpus &corpus);
+
+#endif
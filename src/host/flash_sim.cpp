@@ -0,0 +1,88 @@
+#include <string.h>
+#include "flash_region.h"
+#include "flash_sim.h"
+
+static uint8_t memory[FLASH_REGION_SIZE];
+static unsigned long eraseCounts[FLASH_SIM_ROWS];
+static unsigned long programCount = 0;
+static unsigned long cutAfter = 0;
+static bool poweredOff = false;
+
+void flashSimReset(bool erased)
+{
+  memset(memory, erased ? 0xFF : 0x00, sizeof(memory));
+  memset(eraseCounts, 0, sizeof(eraseCounts));
+  programCount = 0;
+  cutAfter = 0;
+  poweredOff = false;
+}
+
+void flashSimCutPowerAfter(unsigned long operations)
+{
+  cutAfter = operations;
+}
+
+void flashSimPowerOn()
+{
+  poweredOff = false;
+}
+
+// Count down to a scheduled power cut.  Returns true on the operation
+// the power dies in.
+static bool powerDiesNow()
+{
+  if (cutAfter == 0)
+    return false;
+  if (--cutAfter == 0)
+  {
+    poweredOff = true;
+    return true;
+  }
+  return false;
+}
+
+unsigned long flashSimEraseCount(int row)
+{
+  return eraseCounts[row];
+}
+
+unsigned long flashSimProgramCount()
+{
+  return programCount;
+}
+
+uint8_t *flashSimData()
+{
+  return memory;
+}
+
+void flashRead(uint32_t offset, void *data, uint32_t length)
+{
+  memcpy(data, memory + offset, length);
+}
+
+bool flashProgramPage(uint32_t offset, const void *data)
+{
+  if (poweredOff || offset % FLASH_REGION_PAGE != 0 || offset >= FLASH_REGION_SIZE)
+    return false;
+
+  int length = powerDiesNow() ? FLASH_REGION_PAGE / 2 : FLASH_REGION_PAGE;
+  const uint8_t *source = (const uint8_t *)data;
+  for (int i = 0; i < length; i++)
+    memory[offset + i] &= source[i]; // Programming can only clear bits.
+  programCount++;
+  return !poweredOff;
+}
+
+bool flashEraseRow(uint32_t offset)
+{
+  if (poweredOff || offset >= FLASH_REGION_SIZE)
+    return false;
+  if (powerDiesNow())
+    return false;
+
+  uint32_t row = offset / FLASH_REGION_ROW;
+  memset(memory + row * FLASH_REGION_ROW, 0xFF, FLASH_REGION_ROW);
+  eraseCounts[row]++;
+  return true;
+}
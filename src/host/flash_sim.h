@@ -0,0 +1,33 @@
+#ifndef FLASH_SIM_H
+#define FLASH_SIM_H
+
+#include <stdint.h>
+#include "flash_region.h"
+
+// Host side stand-in for the flash region (see flash_region.h).
+//
+// It follows the same rules as the real part: erase sets a row to 0xFF,
+// programming can only clear bits, and every erase is counted per row so
+// wear can be checked.  A power cut can be scheduled to land in the
+// middle of a later program or erase to check the store recovers.
+
+#define FLASH_SIM_ROWS (FLASH_REGION_SIZE / FLASH_REGION_ROW)
+
+// Put the region back to factory state: all 0x00 like a freshly flashed
+// image, or all 0xFF like an erased chip.
+void flashSimReset(bool erased);
+
+// Cut the power during the Nth program or erase from now (1 = the next
+// one).  A cut program writes only the first half of the page, a cut
+// erase leaves the row untouched.  Every call after that fails until
+// flashSimPowerOn().  0 disables.
+void flashSimCutPowerAfter(unsigned long operations);
+void flashSimPowerOn();
+
+unsigned long flashSimEraseCount(int row);
+unsigned long flashSimProgramCount();
+
+// Raw access for inspection, e.g. to corrupt a byte on purpose.
+uint8_t *flashSimData();
+
+#endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "host/hal_sim.h"
+
+#define HAL_SIM_PINS 32
+#define HAL_SIM_INPUT 256
+
+static uint64_t now = 0;
+static uint32_t measureTime = 0;
+static HalSimTouchSource touchSource = nullptr;
+static void *touchContext = nullptr;
+static HalSimPwmListener pwmListener = nullptr;
+static void *pwmContext = nullptr;
+static int pwm[HAL_SIM_PINS];
+static char input[HAL_SIM_INPUT];
+static int inputHead = 0;
+static int inputTail = 0;
+static bool muted = false;
+
+void halSimReset(uint64_t startUs)
+{
+  now = startUs;
+  measureTime = 0;
+  touchSource = nullptr;
+  touchContext = nullptr;
+  pwmListener = nullptr;
+  pwmContext = nullptr;
+  memset(pwm, 0, sizeof(pwm));
+  inputHead = inputTail = 0;
+  muted = false;
+}
+
+uint64_t halSimNow()
+{
+  return now;
+}
+
+void halSimAdvance(uint64_t us)
+{
+  now += us;
+}
+
+void halSimSetTime(uint64_t us)
+{
+  if (us > now)
+    now = us;
+}
+
+void halSimSetTouchSource(HalSimTouchSource source, void *context)
+{
+  touchSource = source;
+  touchContext = context;
+}
+
+void halSimSetMeasureTime(uint32_t us)
+{
+  measureTime = us;
+}
+
+void halSimSetPwmListener(HalSimPwmListener listener, void *context)
+{
+  pwmListener = listener;
+  pwmContext = context;
+}
+
+int halSimPwm(int pin)
+{
+  return pin >= 0 && pin < HAL_SIM_PINS ? pwm[pin] : 0;
+}
+
+void halSimSerialInput(const char *text)
+{
+  for (; *text != '\0'; text++)
+  {
+    int next = (inputTail + 1) % HAL_SIM_INPUT;
+    if (next == inputHead)
+      return; // Full, like a real receive buffer.
+    input[inputTail] = *text;
+    inputTail = next;
+  }
+}
+
+void halSimMuteSerial(bool mute)
+{
+  muted = mute;
+}
+
+// ---- hal.h ----
+
+uint32_t halMillis()
+{
+  return (uint32_t)(now / 1000);
+}
+
+uint32_t halMicros()
+{
+  return (uint32_t)now;
+}
+
+void halDelay(uint32_t ms)
+{
+  now += (uint64_t)ms * 1000;
+}
+
+bool halTouchBegin()
+{
+  return true;
+}
+
+int halTouchMeasure()
+{
+  int reading = touchSource != nullptr ? touchSource(now, touchContext) : HAL_SIM_IDLE_READING;
+  now += measureTime;
+  return reading;
+}
+
+void halPinOutput(int pin)
+{
+}
+
+void halDigitalWrite(int pin, bool high)
+{
+  halPwmWrite(pin, high ? 255 : 0);
+}
+
+void halPwmWrite(int pin, int value)
+{
+  if (pin >= 0 && pin < HAL_SIM_PINS)
+    pwm[pin] = value;
+  if (pwmListener != nullptr)
+    pwmListener(now, pin, value, pwmContext);
+}
+
+void halSerialBegin(unsigned long baud)
+{
+}
+
+int halSerialRead()
+{
+  if (inputHead == inputTail)
+    return -1;
+  int c = (unsigned char)input[inputHead];
+  inputHead = (inputHead + 1) % HAL_SIM_INPUT;
+  return c;
+}
+
+void halPrint(const char *text)
+{
+  if (!muted)
+    fputs(text, stdout);
+}
+
+void halPrint(long value)
+{
+  if (!muted)
+    printf("%ld", value);
+}
+
+void halPrint(unsigned long value)
+{
+  if (!muted)
+    printf("%lu", value);
+}
+
+void halNewline()
+{
+  if (!muted)
+    putchar('\n');
+}
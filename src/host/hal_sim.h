@@ -0,0 +1,44 @@
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <stdint.h>
+
+// Controls for the simulated hardware behind hal.h on a PC.
+//
+// Time only moves when something moves it: halDelay() and each touch
+// measurement advance a virtual clock instantly, so hours of firmware
+// time pass in a blink.  Touch readings come from a source function the
+// test or tool installs, and every LED write can be observed.
+
+// Back to power-on: clock at `startUs`, no source, no listeners.
+void halSimReset(uint64_t startUs = 0);
+
+uint64_t halSimNow(); // Virtual microseconds since the simulation began.
+void halSimAdvance(uint64_t us);
+void halSimSetTime(uint64_t us); // Never moves time backwards.
+
+// Where touch readings come from.  Called once per halTouchMeasure()
+// with the current virtual time.  Without a source the sensor reads
+// HAL_SIM_IDLE_READING.
+#define HAL_SIM_IDLE_READING 725
+typedef int (*HalSimTouchSource)(uint64_t nowUs, void *context);
+void halSimSetTouchSource(HalSimTouchSource source, void *context);
+
+// How long one measurement takes.  Real FreeTouch measurements take a
+// few hundred microseconds; the default is 0 to keep the arithmetic
+// simple.
+void halSimSetMeasureTime(uint32_t us);
+
+// Called on every PWM write, to any pin - the light is HAL_SIM_LIGHT_PIN,
+// and digital writes show up here too, as 0 or 255.
+#define HAL_SIM_LIGHT_PIN 4 // NOODLE_PIN in main.cpp.
+typedef void (*HalSimPwmListener)(uint64_t nowUs, int pin, int value, void *context);
+void halSimSetPwmListener(HalSimPwmListener listener, void *context);
+int halSimPwm(int pin); // Last value written to `pin`.
+
+// Serial.  Input is queued and read back by halSerialRead().  Output goes
+// to stdout unless muted, which keeps long runs fast.
+void halSimSerialInput(const char *text);
+void halSimMuteSerial(bool mute);
+
+#endif
@@ -0,0 +1,743 @@
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host/m0_emu.h"
+
+#define M0_RETURN 0xFFFFFFFEu // Where call() leaves LR pointing.
+
+// Peripheral registers (the SAMD21's APB and AHB bridges) and the
+// Cortex-M private bus (SysTick, NVIC, SCB).
+#define M0_PERIPHERAL_BASE 0x40000000u
+#define M0_PERIPHERAL_END 0x60000000u
+#define M0_PRIVATE_BASE 0xE0000000u
+
+// ELF field offsets.  Spelled out rather than taken from <elf.h>, which
+// not every host has.
+#define ELF_MACHINE_ARM 40
+#define ELF_PT_LOAD 1
+#define ELF_SHT_SYMTAB 2
+#define ELF_STT_OBJECT 1
+#define ELF_STT_FUNC 2
+
+static uint32_t little16(const uint8_t *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t little32(const uint8_t *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int32_t signExtend(uint32_t value, int bits)
+{
+  return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+M0Emulator::M0Emulator() : flash(M0_FLASH_SIZE, 0xFF), ram(M0_RAM_SIZE, 0), ramImage(M0_RAM_SIZE, 0) {}
+
+uint8_t *M0Emulator::bytes(uint32_t address, uint32_t length)
+{
+  if (address - M0_FLASH_BASE <= M0_FLASH_SIZE && length <= M0_FLASH_SIZE - (address - M0_FLASH_BASE))
+    return &flash[address - M0_FLASH_BASE];
+  if (address - M0_RAM_BASE <= M0_RAM_SIZE && length <= M0_RAM_SIZE - (address - M0_RAM_BASE))
+    return &ram[address - M0_RAM_BASE];
+  return nullptr;
+}
+
+bool M0Emulator::load(const char *path)
+{
+  error.clear();
+  FILE *in = fopen(path, "rb");
+  if (in == nullptr)
+  {
+    error = std::string("can't open ") + path;
+    return false;
+  }
+  std::vector<uint8_t> file;
+  uint8_t chunk[65536];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), in)) > 0)
+    file.insert(file.end(), chunk, chunk + got);
+  fclose(in);
+
+  const uint8_t *elf = file.data();
+  if (file.size() < 52 || memcmp(elf, "\177ELF", 4) != 0 || elf[4] != 1 || elf[5] != 1 ||
+      little16(elf + 18) != ELF_MACHINE_ARM)
+  {
+    error = std::string(path) + " is not a 32 bit little-endian ARM ELF file";
+    return false;
+  }
+  auto inside = [&](uint64_t offset, uint64_t length) { return offset + length <= file.size(); };
+
+  // Program headers: what goes where in memory.
+  uint32_t phoff = little32(elf + 28), phentsize = little16(elf + 42), phnum = little16(elf + 44);
+  for (uint32_t i = 0; i < phnum; i++)
+  {
+    const uint8_t *ph = elf + phoff + i * phentsize;
+    if (!inside(phoff + i * phentsize, 32) || little32(ph) != ELF_PT_LOAD)
+      continue;
+    uint32_t offset = little32(ph + 4), vaddr = little32(ph + 8), paddr = little32(ph + 12);
+    uint32_t filesz = little32(ph + 16), memsz = little32(ph + 20);
+    if (!inside(offset, filesz) || memsz < filesz)
+    {
+      error = "bad program header";
+      return false;
+    }
+    uint8_t *at = bytes(vaddr, memsz);
+    uint8_t *loadAt = bytes(paddr, filesz);
+    if (at == nullptr || loadAt == nullptr)
+    {
+      char message[80];
+      snprintf(message, sizeof(message), "segment at 0x%08x is outside flash and RAM", vaddr);
+      error = message;
+      return false;
+    }
+    memcpy(loadAt, elf + offset, filesz);
+    memcpy(at, elf + offset, filesz);
+    memset(at + filesz, 0, memsz - filesz);
+  }
+  ramImage = ram;
+
+  // The symbol table, for find().
+  uint32_t shoff = little32(elf + 32), shentsize = little16(elf + 46), shnum = little16(elf + 48);
+  for (uint32_t i = 0; i < shnum; i++)
+  {
+    const uint8_t *sh = elf + shoff + i * shentsize;
+    if (!inside(shoff + i * shentsize, 40) || little32(sh + 4) != ELF_SHT_SYMTAB)
+      continue;
+    uint32_t offset = little32(sh + 16), size = little32(sh + 20), link = little32(sh + 24);
+    const uint8_t *strings = elf + shoff + link * shentsize;
+    if (link >= shnum || !inside(offset, size))
+      continue;
+    uint32_t stroff = little32(strings + 16), strsize = little32(strings + 20);
+    if (!inside(stroff, strsize))
+      continue;
+    for (uint32_t at = offset; at + 16 <= offset + size; at += 16)
+    {
+      const uint8_t *sym = elf + at;
+      uint32_t name = little32(sym), type = sym[12] & 15;
+      if (name >= strsize || (type != ELF_STT_FUNC && type != ELF_STT_OBJECT))
+        continue;
+      const char *mangled = (const char *)elf + stroff + name;
+      if (memchr(mangled, '\0', strsize - name) == nullptr)
+        continue;
+      M0Symbol symbol = {little32(sym + 4), little32(sym + 8), type == ELF_STT_FUNC};
+      if (symbol.function)
+        symbol.address &= ~1u;
+      symbols[mangled] = symbol;
+
+      int status;
+      char *demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+      if (demangled != nullptr)
+      {
+        symbols.emplace(demangled, symbol);
+        char *arguments = strchr(demangled, '(');
+        if (arguments != nullptr)
+          symbols.emplace(std::string(demangled, arguments), symbol);
+        free(demangled);
+      }
+    }
+  }
+  return true;
+}
+
+bool M0Emulator::find(const char *name, M0Symbol &symbol) const
+{
+  auto found = symbols.find(name);
+  if (found == symbols.end())
+    return false;
+  symbol = found->second;
+  return true;
+}
+
+void M0Emulator::reset()
+{
+  ram = ramImage;
+}
+
+void M0Emulator::fault(const char *what, uint32_t address)
+{
+  if (!error.empty())
+    return;
+  char message[120];
+  snprintf(message, sizeof(message), "%s 0x%08x at pc 0x%08x", what, address, pc);
+  error = message;
+}
+
+bool M0Emulator::access(uint32_t address, int size, bool store, uint32_t &value)
+{
+  if (address & (size - 1))
+  {
+    fault("unaligned access to", address);
+    return false;
+  }
+  if ((address >= M0_PERIPHERAL_BASE && address < M0_PERIPHERAL_END) || address >= M0_PRIVATE_BASE)
+  {
+    count.peripherals++;
+    if (!store)
+      value = 0;
+    return true;
+  }
+  uint8_t *p = bytes(address, size);
+  if (p == nullptr || (store && address - M0_FLASH_BASE < M0_FLASH_SIZE))
+  {
+    fault(store ? "bad write to" : "bad read from", address);
+    return false;
+  }
+  if (store)
+  {
+    for (int i = 0; i < size; i++)
+      p[i] = value >> (8 * i);
+  }
+  else
+  {
+    value = 0;
+    for (int i = 0; i < size; i++)
+      value |= (uint32_t)p[i] << (8 * i);
+  }
+  return true;
+}
+
+uint32_t M0Emulator::read(uint32_t address, int size)
+{
+  uint32_t value = 0;
+  access(address, size, false, value);
+  return value;
+}
+
+void M0Emulator::write(uint32_t address, int size, uint32_t value)
+{
+  access(address, size, true, value);
+}
+
+uint16_t M0Emulator::fetch(uint32_t address)
+{
+  uint8_t *p = bytes(address, 2);
+  if (p == nullptr || address - M0_FLASH_BASE >= M0_FLASH_SIZE)
+  {
+    fault("instruction fetch from", address); // The M0+ only runs code from flash here.
+    return 0xDE00;                            // UDF, which stops the run.
+  }
+  return little16(p);
+}
+
+uint32_t M0Emulator::call(uint32_t address, const std::vector<uint32_t> &args)
+{
+  error.clear();
+  count = M0Count();
+  memset(r, 0, sizeof(r));
+  n = z = c = v = false;
+  primask = false;
+
+  // Arguments past the fourth go on the stack, first one lowest.
+  uint32_t top = M0_RAM_BASE + M0_RAM_SIZE;
+  uint32_t sp = top - (args.size() > 4 ? (uint32_t)(args.size() - 4 + 1) / 2 * 8 : 0); // Kept 8 byte aligned.
+  for (size_t i = 0; i < args.size(); i++)
+  {
+    if (i < 4)
+      r[i] = args[i];
+    else
+      write(sp + 4 * (uint32_t)(i - 4), 4, args[i]);
+  }
+  r[13] = sp;
+  r[14] = M0_RETURN | 1;
+  pc = address & ~1u;
+  lowestSp = sp;
+
+  while (pc != M0_RETURN && error.empty())
+  {
+    if (count.instructions >= M0_CALL_LIMIT)
+    {
+      fault("gave up after M0_CALL_LIMIT instructions, last", pc);
+      break;
+    }
+    step();
+    if (r[13] < lowestSp)
+      lowestSp = r[13];
+  }
+  count.stack = top - lowestSp;
+  return r[0];
+}
+
+uint32_t M0Emulator::add(uint32_t a, uint32_t b, uint32_t carry, bool setFlags)
+{
+  uint64_t unsignedSum = (uint64_t)a + b + carry;
+  int64_t signedSum = (int64_t)(int32_t)a + (int32_t)b + carry;
+  uint32_t result = (uint32_t)unsignedSum;
+  if (setFlags)
+  {
+    setNZ(result);
+    c = unsignedSum >> 32;
+    v = (int64_t)(int32_t)result != signedSum;
+  }
+  return result;
+}
+
+void M0Emulator::setNZ(uint32_t result)
+{
+  n = result >> 31;
+  z = result == 0;
+}
+
+void M0Emulator::branch(uint32_t target, int cycles)
+{
+  nextPc = target & ~1u;
+  count.cycles += cycles - 1; // step() has already charged one.
+}
+
+void M0Emulator::step()
+{
+  uint16_t op = fetch(pc);
+  nextPc = pc + 2;
+  count.instructions++;
+  count.cycles++;
+  int rd = op & 7;
+  int rn = (op >> 3) & 7;
+  int rm = (op >> 6) & 7;
+  int imm5 = (op >> 6) & 31;
+  int high = (op >> 8) & 7; // Register in bits 10:8.
+  uint32_t imm8 = op & 0xFF;
+  uint32_t value;
+
+  switch (op >> 11)
+  {
+  case 0x00: // LSLS Rd, Rm, #imm (MOVS Rd, Rm when imm is 0)
+    value = r[rn];
+    if (imm5 != 0)
+    {
+      c = (value >> (32 - imm5)) & 1;
+      value <<= imm5;
+    }
+    r[rd] = value;
+    setNZ(value);
+    break;
+  case 0x01: // LSRS Rd, Rm, #imm (0 means 32)
+    value = r[rn];
+    c = imm5 == 0 ? value >> 31 : (value >> (imm5 - 1)) & 1;
+    r[rd] = imm5 == 0 ? 0 : value >> imm5;
+    setNZ(r[rd]);
+    break;
+  case 0x02: // ASRS Rd, Rm, #imm (0 means 32)
+    value = r[rn];
+    c = imm5 == 0 ? value >> 31 : (value >> (imm5 - 1)) & 1;
+    r[rd] = (uint32_t)((int32_t)value >> (imm5 == 0 ? 31 : imm5));
+    setNZ(r[rd]);
+    break;
+  case 0x03: // ADDS / SUBS, register or 3 bit immediate
+    value = op & 0x400 ? (uint32_t)rm : r[rm];
+    r[rd] = op & 0x200 ? add(r[rn], ~value, 1, true) : add(r[rn], value, 0, true);
+    break;
+  case 0x04: // MOVS Rd, #imm8
+    r[high] = imm8;
+    setNZ(imm8);
+    break;
+  case 0x05: // CMP Rn, #imm8
+    add(r[high], ~imm8, 1, true);
+    break;
+  case 0x06: // ADDS Rdn, #imm8
+    r[high] = add(r[high], imm8, 0, true);
+    break;
+  case 0x07: // SUBS Rdn, #imm8
+    r[high] = add(r[high], ~imm8, 1, true);
+    break;
+  case 0x08:
+    if (op & 0x400)
+      special(op);
+    else
+      dataProcessing(op);
+    break;
+  case 0x09: // LDR Rt, [PC, #imm8 * 4]
+    if (access(((pc + 4) & ~3u) + imm8 * 4, 4, false, value))
+      r[high] = value;
+    count.cycles++;
+    break;
+  case 0x0A:
+  case 0x0B: // Loads and stores with a register offset.
+  {
+    uint32_t address = r[rn] + r[rm];
+    switch ((op >> 9) & 7)
+    {
+    case 0: // STR
+      access(address, 4, true, r[rd]);
+      break;
+    case 1: // STRH
+      access(address, 2, true, r[rd]);
+      break;
+    case 2: // STRB
+      access(address, 1, true, r[rd]);
+      break;
+    case 3: // LDRSB
+      if (access(address, 1, false, value))
+        r[rd] = (uint32_t)signExtend(value, 8);
+      break;
+    case 4: // LDR
+      if (access(address, 4, false, value))
+        r[rd] = value;
+      break;
+    case 5: // LDRH
+      if (access(address, 2, false, value))
+        r[rd] = value;
+      break;
+    case 6: // LDRB
+      if (access(address, 1, false, value))
+        r[rd] = value;
+      break;
+    case 7: // LDRSH
+      if (access(address, 2, false, value))
+        r[rd] = (uint32_t)signExtend(value, 16);
+      break;
+    }
+    count.cycles++;
+    break;
+  }
+  case 0x0C: // STR Rt, [Rn, #imm5 * 4]
+    access(r[rn] + imm5 * 4, 4, true, r[rd]);
+    count.cycles++;
+    break;
+  case 0x0D: // LDR Rt, [Rn, #imm5 * 4]
+    if (access(r[rn] + imm5 * 4, 4, false, value))
+      r[rd] = value;
+    count.cycles++;
+    break;
+  case 0x0E: // STRB Rt, [Rn, #imm5]
+    access(r[rn] + imm5, 1, true, r[rd]);
+    count.cycles++;
+    break;
+  case 0x0F: // LDRB Rt, [Rn, #imm5]
+    if (access(r[rn] + imm5, 1, false, value))
+      r[rd] = value;
+    count.cycles++;
+    break;
+  case 0x10: // STRH Rt, [Rn, #imm5 * 2]
+    access(r[rn] + imm5 * 2, 2, true, r[rd]);
+    count.cycles++;
+    break;
+  case 0x11: // LDRH Rt, [Rn, #imm5 * 2]
+    if (access(r[rn] + imm5 * 2, 2, false, value))
+      r[rd] = value;
+    count.cycles++;
+    break;
+  case 0x12: // STR Rt, [SP, #imm8 * 4]
+    access(r[13] + imm8 * 4, 4, true, r[high]);
+    count.cycles++;
+    break;
+  case 0x13: // LDR Rt, [SP, #imm8 * 4]
+    if (access(r[13] + imm8 * 4, 4, false, value))
+      r[high] = value;
+    count.cycles++;
+    break;
+  case 0x14: // ADR Rd, label
+    r[high] = ((pc + 4) & ~3u) + imm8 * 4;
+    break;
+  case 0x15: // ADD Rd, SP, #imm8 * 4
+    r[high] = r[13] + imm8 * 4;
+    break;
+  case 0x16:
+  case 0x17:
+    miscellaneous(op);
+    break;
+  case 0x18: // STM Rn!, {list}
+  case 0x19: // LDM Rn!, {list} (no writeback when Rn is in the list)
+  {
+    bool load = op & 0x800;
+    uint32_t address = r[high];
+    for (int i = 0; i < 8; i++)
+    {
+      if (!(imm8 & (1 << i)))
+        continue;
+      if (!load)
+        access(address, 4, true, r[i]);
+      else if (access(address, 4, false, value))
+        r[i] = value;
+      address += 4;
+      count.cycles++;
+    }
+    if (!load || !(imm8 & (1 << high)))
+      r[high] = address;
+    break;
+  }
+  case 0x1A:
+  case 0x1B: // B<cond>, UDF, SVC
+  {
+    int cond = (op >> 8) & 15;
+    if (cond >= 14)
+    {
+      fault(cond == 14 ? "undefined instruction" : "SVC", op);
+      break;
+    }
+    bool take;
+    switch (cond >> 1)
+    {
+    case 0: take = z; break;
+    case 1: take = c; break;
+    case 2: take = n; break;
+    case 3: take = v; break;
+    case 4: take = c && !z; break;
+    case 5: take = n == v; break;
+    default: take = n == v && !z; break;
+    }
+    if (cond & 1)
+      take = !take;
+    if (take)
+      branch(pc + 4 + (uint32_t)(signExtend(imm8, 8) * 2), 2);
+    break;
+  }
+  case 0x1C: // B label
+    branch(pc + 4 + (uint32_t)(signExtend(op & 0x7FF, 11) * 2), 2);
+    break;
+  case 0x1E:
+    wide(op);
+    break;
+  default:
+    fault("undefined instruction", op);
+    break;
+  }
+  pc = nextPc;
+}
+
+// The sixteen ALU operations on low registers, all flag setting.
+void M0Emulator::dataProcessing(uint16_t op)
+{
+  int rdn = op & 7;
+  int rm = (op >> 3) & 7;
+  uint32_t a = r[rdn], b = r[rm], result;
+  int shift = b & 0xFF;
+  switch ((op >> 6) & 15)
+  {
+  case 0: // ANDS
+    setNZ(r[rdn] = a & b);
+    break;
+  case 1: // EORS
+    setNZ(r[rdn] = a ^ b);
+    break;
+  case 2: // LSLS Rdn, Rm
+    if (shift == 0)
+      result = a;
+    else if (shift < 32)
+      c = (a >> (32 - shift)) & 1, result = a << shift;
+    else
+      c = shift == 32 ? a & 1 : 0, result = 0;
+    setNZ(r[rdn] = result);
+    break;
+  case 3: // LSRS Rdn, Rm
+    if (shift == 0)
+      result = a;
+    else if (shift < 32)
+      c = (a >> (shift - 1)) & 1, result = a >> shift;
+    else
+      c = shift == 32 ? a >> 31 : 0, result = 0;
+    setNZ(r[rdn] = result);
+    break;
+  case 4: // ASRS Rdn, Rm
+    if (shift == 0)
+      result = a;
+    else if (shift < 32)
+      c = (a >> (shift - 1)) & 1, result = (uint32_t)((int32_t)a >> shift);
+    else
+      c = a >> 31, result = (uint32_t)((int32_t)a >> 31);
+    setNZ(r[rdn] = result);
+    break;
+  case 5: // ADCS
+    r[rdn] = add(a, b, c, true);
+    break;
+  case 6: // SBCS
+    r[rdn] = add(a, ~b, c, true);
+    break;
+  case 7: // RORS
+    result = a;
+    if (shift != 0)
+    {
+      int by = shift & 31;
+      result = by == 0 ? a : a >> by | a << (32 - by);
+      c = result >> 31;
+    }
+    setNZ(r[rdn] = result);
+    break;
+  case 8: // TST
+    setNZ(a & b);
+    break;
+  case 9: // RSBS Rd, Rn, #0
+    r[rdn] = add(~b, 0, 1, true);
+    break;
+  case 10: // CMP
+    add(a, ~b, 1, true);
+    break;
+  case 11: // CMN
+    add(a, b, 0, true);
+    break;
+  case 12: // ORRS
+    setNZ(r[rdn] = a | b);
+    break;
+  case 13: // MULS
+    setNZ(r[rdn] = a * b);
+    break;
+  case 14: // BICS
+    setNZ(r[rdn] = a & ~b);
+    break;
+  case 15: // MVNS
+    setNZ(r[rdn] = ~b);
+    break;
+  }
+}
+
+// ADD, CMP and MOV on any register, and BX / BLX.
+void M0Emulator::special(uint16_t op)
+{
+  int rm = (op >> 3) & 15;
+  int rdn = ((op >> 4) & 8) | (op & 7);
+  uint32_t target;
+  switch ((op >> 8) & 3)
+  {
+  case 0: // ADD Rdn, Rm
+    if (rdn == 15)
+      branch(reg(rdn) + reg(rm), 2);
+    else
+      r[rdn] = reg(rdn) + reg(rm);
+    break;
+  case 1: // CMP Rn, Rm
+    add(reg(rdn), ~reg(rm), 1, true);
+    break;
+  case 2: // MOV Rd, Rm
+    if (rdn == 15)
+      branch(reg(rm), 2);
+    else
+      r[rdn] = reg(rm);
+    break;
+  case 3: // BX Rm / BLX Rm
+    target = reg(rm);
+    if (!(target & 1))
+    {
+      fault("jump to ARM state at", target);
+      break;
+    }
+    if (op & 0x80)
+      r[14] = (pc + 2) | 1;
+    branch(target, 2);
+    break;
+  }
+}
+
+// The 1011 group: SP adjustment, extends, PUSH / POP, REV, CPS, hints.
+void M0Emulator::miscellaneous(uint16_t op)
+{
+  int rd = op & 7;
+  int rm = (op >> 3) & 7;
+  uint32_t value;
+  if ((op & 0xFF00) == 0xB000) // ADD / SUB SP, SP, #imm7 * 4
+  {
+    uint32_t by = (op & 0x7F) * 4;
+    r[13] += op & 0x80 ? -by : by;
+  }
+  else if ((op & 0xFF00) == 0xB200) // SXTH, SXTB, UXTH, UXTB
+  {
+    value = r[rm];
+    switch ((op >> 6) & 3)
+    {
+    case 0: r[rd] = (uint32_t)signExtend(value, 16); break;
+    case 1: r[rd] = (uint32_t)signExtend(value, 8); break;
+    case 2: r[rd] = value & 0xFFFF; break;
+    case 3: r[rd] = value & 0xFF; break;
+    }
+  }
+  else if ((op & 0xFE00) == 0xB400) // PUSH {list, LR}
+  {
+    int registers = __builtin_popcount(op & 0x1FF);
+    uint32_t address = r[13] - 4 * registers;
+    r[13] = address;
+    for (int i = 0; i < 9; i++)
+    {
+      if (!(op & (1 << i)))
+        continue;
+      access(address, 4, true, r[i == 8 ? 14 : i]);
+      address += 4;
+    }
+    count.cycles += registers;
+  }
+  else if ((op & 0xFE00) == 0xBC00) // POP {list, PC}
+  {
+    uint32_t address = r[13];
+    for (int i = 0; i < 8; i++)
+    {
+      if (!(op & (1 << i)))
+        continue;
+      if (access(address, 4, false, value))
+        r[i] = value;
+      address += 4;
+      count.cycles++;
+    }
+    if (op & 0x100)
+    {
+      access(address, 4, false, value);
+      address += 4;
+      r[13] = address;
+      if (!(value & 1))
+        fault("return to ARM state at", value);
+      else
+        branch(value, 3);
+    }
+    r[13] = address;
+  }
+  else if ((op & 0xFFEF) == 0xB662) // CPSIE i / CPSID i
+    primask = op & 0x10;
+  else if ((op & 0xFF00) == 0xBA00 && ((op >> 6) & 3) != 2) // REV, REV16, REVSH
+  {
+    value = r[rm];
+    switch ((op >> 6) & 3)
+    {
+    case 0: r[rd] = __builtin_bswap32(value); break;
+    case 1: r[rd] = (value & 0xFF00FF00) >> 8 | (value & 0x00FF00FF) << 8; break;
+    case 3: r[rd] = (uint32_t)signExtend((value & 0xFF) << 8 | (value >> 8 & 0xFF), 16); break;
+    }
+  }
+  else if ((op & 0xFF00) == 0xBF00 && (op & 0x0F) == 0) // NOP, YIELD, WFE, WFI, SEV
+    ;
+  else
+    fault((op & 0xFF00) == 0xBE00 ? "BKPT" : "undefined instruction", op);
+}
+
+// The 32 bit instructions: BL, MSR, MRS and the barriers.
+void M0Emulator::wide(uint16_t op)
+{
+  uint16_t op2 = fetch(pc + 2);
+  nextPc = pc + 4;
+  if ((op2 & 0xD000) == 0xD000) // BL
+  {
+    uint32_t s = (op >> 10) & 1;
+    uint32_t i1 = !(((op2 >> 13) & 1) ^ s);
+    uint32_t i2 = !(((op2 >> 11) & 1) ^ s);
+    uint32_t offset = s << 24 | i1 << 23 | i2 << 22 | (op & 0x3FF) << 12 | (op2 & 0x7FF) << 1;
+    r[14] = (pc + 4) | 1;
+    branch(pc + 4 + (uint32_t)signExtend(offset, 25), 3);
+  }
+  else if ((op & 0xFFE0) == 0xF3E0 && (op2 & 0xD000) == 0x8000) // MRS Rd, spec_reg
+  {
+    int sysm = op2 & 0xFF;
+    uint32_t value = 0;
+    if (sysm <= 7) // APSR and friends; IPSR is 0 outside a handler.
+      value = (uint32_t)n << 31 | (uint32_t)z << 30 | (uint32_t)c << 29 | (uint32_t)v << 28;
+    else if (sysm == 8 || sysm == 9)
+      value = r[13];
+    else if (sysm == 16)
+      value = primask;
+    r[(op2 >> 8) & 15] = value;
+    count.cycles += 2;
+  }
+  else if ((op & 0xFFE0) == 0xF380 && (op2 & 0xFF00) == 0x8800) // MSR spec_reg, Rn
+  {
+    int sysm = op2 & 0xFF;
+    uint32_t value = r[op & 15];
+    if (sysm <= 3)
+      n = value >> 31, z = (value >> 30) & 1, c = (value >> 29) & 1, v = (value >> 28) & 1;
+    else if (sysm == 8 || sysm == 9)
+      r[13] = value & ~3u;
+    else if (sysm == 16)
+      primask = value & 1;
+    count.cycles += 2;
+  }
+  else if (op == 0xF3BF && (op2 & 0xFF00) == 0x8F00) // DSB, DMB, ISB
+    count.cycles += 2;
+  else
+    fault("undefined instruction", (uint32_t)op << 16 | op2);
+}
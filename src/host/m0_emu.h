@@ -0,0 +1,116 @@
+#ifndef M0_EMU_H
+#define M0_EMU_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A Cortex-M0+ in software, for counting what the firmware's functions
+// cost on the board without the board.
+//
+// It loads the firmware.elf the board build writes, and calls functions
+// in it with the AAPCS: arguments in r0-r3 then on the stack, the result
+// in r0.  Every ARMv6-M instruction is there (the M0+ has 16 bit Thumb
+// plus BL, MRS, MSR and the barriers), and each is charged the cycles
+// the Cortex-M0+ Technical Reference Manual gives it:
+//
+//   most ALU ops, MULS (the SAMD21 has the one cycle multiplier)   1
+//   loads and stores                                               2
+//   LDM, STM, PUSH, POP                                            1 + N
+//   POP with PC (N not counting the PC)                            3 + N
+//   B taken / not taken                                            2 / 1
+//   BL                                                             3
+//   BX, BLX, writes to PC                                          2
+//   MRS, MSR, DMB, DSB, ISB                                        3
+//
+// Those assume memory with no wait states.  At 48MHz the SAMD21's flash
+// has one, which its cache hides once a loop has run through once, so
+// for the small functions measured here the counts are what the core
+// really does.  There are no interrupts and no peripherals: peripheral
+// addresses read as zero and ignore writes, and are counted, so code
+// that talks to hardware still runs (and shows that it did).  Code that
+// waits for a peripheral bit to come on runs into M0_CALL_LIMIT instead.
+//
+// Anything the real core would fault on - an unaligned access, a jump
+// to ARM state, an undefined instruction - stops the call with an error.
+
+#define M0_FLASH_BASE 0x00000000u
+#define M0_FLASH_SIZE (256 * 1024)
+#define M0_RAM_BASE 0x20000000u
+#define M0_RAM_SIZE (32 * 1024)
+#define M0_CALL_LIMIT 10000000 // Instructions before a call is given up on.
+
+// What one call cost.
+struct M0Count
+{
+  uint64_t instructions;
+  uint64_t cycles;
+  uint32_t stack;       // Deepest the stack went, in bytes.
+  uint32_t peripherals; // Reads and writes of peripheral registers.
+};
+
+struct M0Symbol
+{
+  uint32_t address; // With the Thumb bit cleared for functions.
+  uint32_t size;
+  bool function;
+};
+
+struct M0Emulator
+{
+  M0Emulator();
+
+  // Read an ARM ELF file: its loadable segments go into flash and RAM
+  // (initialised data into both, as the startup code would copy it), and
+  // its symbol table is kept for find().
+  bool load(const char *path);
+
+  // Look up a symbol by its mangled name, its demangled name, or its
+  // demangled name without the argument list ("baseAvg").
+  bool find(const char *name, M0Symbol &symbol) const;
+
+  // Put RAM back the way load() left it.
+  void reset();
+
+  // Call the function at `address` and return r0.  `count` holds what it
+  // cost; failed() says whether it got back at all.
+  uint32_t call(uint32_t address, const std::vector<uint32_t> &args = {});
+  M0Count count;
+
+  bool failed() const { return !error.empty(); }
+  std::string error; // Why the last load() or call() went wrong.
+
+  // Memory as the firmware sees it, for setting up and checking globals.
+  uint32_t read(uint32_t address, int size);
+  void write(uint32_t address, int size, uint32_t value);
+
+private:
+  bool access(uint32_t address, int size, bool store, uint32_t &value);
+  uint8_t *bytes(uint32_t address, uint32_t length);
+  uint16_t fetch(uint32_t address);
+  void fault(const char *what, uint32_t address);
+  void step();
+  void dataProcessing(uint16_t op);
+  void special(uint16_t op);
+  void miscellaneous(uint16_t op);
+  void wide(uint16_t op);
+  uint32_t reg(int n) const { return n == 15 ? pc + 4 : r[n]; }
+  uint32_t add(uint32_t a, uint32_t b, uint32_t carry, bool setFlags);
+  void setNZ(uint32_t result);
+  void branch(uint32_t target, int cycles);
+
+  std::vector<uint8_t> flash;
+  std::vector<uint8_t> ram;
+  std::vector<uint8_t> ramImage;
+  std::unordered_map<std::string, M0Symbol> symbols;
+
+  uint32_t r[16];
+  uint32_t pc; // Address of the instruction being run; r[15] is unused.
+  uint32_t nextPc;
+  bool n, z, c, v;
+  bool primask;
+  uint32_t lowestSp;
+};
+
+#endif
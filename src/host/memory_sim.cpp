@@ -0,0 +1,23 @@
+#include "hal.h"
+#include "memory_monitor.h"
+
+// There is no 32KB SRAM to watch on a PC, so the memory monitor does
+// nothing here.  See memory_monitor.cpp for the real thing.
+
+void memoryPaint()
+{
+}
+
+void memoryCheck()
+{
+}
+
+void memoryReport()
+{
+  halPrintln("Memory monitor is only available on the board.");
+}
+
+unsigned long memoryHeadroom()
+{
+  return 0xFFFFFFFF;
+}
@@ -0,0 +1,30 @@
+#include <stdlib.h>
+#include "host/flash_sim.h"
+#include "host/hal_sim.h"
+
+// Stand-in for the Arduino core's main() on a PC: power on, run setup()
+// and then loop() a number of times against the simulated hardware.
+//
+//   .pio/build/native/program [loops]
+//
+// Unit tests bring their own main(), so this one steps aside when
+// PlatformIO builds them.
+
+#ifndef PIO_UNIT_TESTING
+
+void setup();
+void loop();
+
+int main(int argc, char **argv)
+{
+  long loops = argc > 1 ? atol(argv[1]) : 1000;
+
+  flashSimReset(true);
+  halSimReset();
+  setup();
+  for (long i = 0; i < loops; i++)
+    loop();
+  return 0;
+}
+
+#endif
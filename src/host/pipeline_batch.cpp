@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <map>
+#include <utility>
+#include "host/pipeline_batch.h"
+#include "host/work_pool.h"
+
+#define BATCH_LOOP_DELAY_US 10000 // loop()'s halDelay(10).
+
+// a / b for 0 <= a < 2^24 and 0 < b <= 1000, with `scale` = 1 / b, without
+// an integer divide (which has no SIMD instruction).  For quotients up to
+// about 1000 the float answer is within 1.2e-4 of the true one, and a
+// quotient that isn't whole is at least 1/b = 1e-3 away from the next
+// whole number, so the nudge puts whole quotients that came out a hair
+// low back on the right side without moving any other.
+static inline int divide(int a, float scale)
+{
+  return (int)(a * scale + 5e-4f);
+}
+
+// `mask` ? a : b, for a mask of all ones or all zeros.  Written out like
+// this because the compiler won't turn a ?: with a float conversion in it
+// into a SIMD blend (the conversion might trap, so it stays behind a
+// branch).
+static inline int pick(int mask, int a, int b)
+{
+  return (a & mask) | (b & ~mask);
+}
+
+PipelineBatch::PipelineBatch(const std::vector<PipelineParams> &sets)
+    : lanes((int)sets.size()), numBaseline(sets[0].numBaseline), numMeas(sets[0].numMeas),
+      baseReadings(numBaseline), shared(baseReadings.data(), numBaseline, nullptr, 0, nullptr)
+{
+  for (const PipelineParams &p : sets)
+  {
+    spread.push_back(p.spread);
+    minOver.push_back(p.minOver);
+    debounce.push_back(p.debounceMs);
+    lightOn.push_back(p.lightOnMs);
+    lightSteps.push_back(p.lightSteps);
+    stepScale.push_back(1.0f / p.lightSteps);
+  }
+  touchTime.resize(lanes);
+  touchLit.resize(lanes);
+  steps.resize(lanes);
+  direction.resize(lanes);
+  pwm.resize(lanes);
+  lastLightMeasure.resize(lanes);
+  measSum.resize(lanes);
+  measLag.resize(lanes);
+  measMissed.resize(lanes);
+  registered.resize(lanes);
+  glowStart.resize(lanes);
+  nearMode.resize(lanes);
+  nearReading.resize(lanes);
+  meas.resize((size_t)lanes * numMeas);
+}
+
+void PipelineBatch::reset()
+{
+  clockUs = 0;
+  started = false;
+  warmedUp = false;
+  shared = DetectState(baseReadings.data(), numBaseline, nullptr, 0, nullptr);
+  detectFillBaseline(shared, DETECT_START_BASE);
+  std::fill(touchLit.begin(), touchLit.end(), 1);
+  std::fill(steps.begin(), steps.end(), 0);
+  std::fill(direction.begin(), direction.end(), 1);
+  std::fill(pwm.begin(), pwm.end(), 0);
+  std::fill(lastLightMeasure.begin(), lastLightMeasure.end(), 0);
+  std::fill(measSum.begin(), measSum.end(), 0);
+  std::fill(measLag.begin(), measLag.end(), 0);
+  std::fill(measMissed.begin(), measMissed.end(), 0);
+  measSlot = 0;
+  std::fill(meas.begin(), meas.end(), 0);
+}
+
+// The per-lane steps.  They are separate functions, with every array
+// passed in as its own __restrict pointer, so the compiler can see that
+// no store into one array changes another - without that it won't
+// vectorize them.  They must not be inlined: the compiler forgets the
+// __restrict promises when it does.
+
+// Thresholds, touch edges, and the light while it is on after a touch.
+__attribute__((noinline)) static void laneTouchAndThrob(int lanes, int raw, int base, uint32_t now, int lighting, int wet, const int *__restrict spread,
+                              const int *__restrict minOver, const int *__restrict debounce,
+                              const int *__restrict lightOn, const int *__restrict lightSteps,
+                              const float *__restrict stepScale, uint32_t *__restrict touchTime,
+                              int *__restrict touchLit, int *__restrict steps, int *__restrict direction, int *__restrict pwm,
+                              int *__restrict registered, int *__restrict nearMode, int *__restrict nearReading)
+{
+  for (int k = 0; k < lanes; k++)
+  {
+    int touched = !wet & (raw >= base + spread[k]);
+    registered[k] = touched & (now - touchTime[k] > (uint32_t)debounce[k]);
+    touchTime[k] = touched ? now : touchTime[k];
+    nearReading[k] = !wet & (raw > base + minOver[k]);
+
+    uint32_t since = now - touchTime[k];
+    int lit = touched | touchLit[k];
+    int on = lighting & lit & (since < (uint32_t)lightOn[k]);
+    touchLit[k] = lighting ? on : lit;
+    int throb = on & (since > (uint32_t)(lightOn[k] - DETECT_LIGHT_THROB_TIME));
+    int full = on & !throb;
+    nearMode[k] = lighting & !on;
+
+    // lightAtStep(): reset while full, one step while throbbing.
+    int s = steps[k];
+    int d = direction[k];
+    d = s >= lightSteps[k] ? 0 : d;
+    d = s <= 0 ? 1 : d;
+    int stepped = s + (d ? 1 : -1);
+    steps[k] = full ? 0 : throb ? stepped : s;
+    direction[k] = full ? 1 : throb ? d : direction[k];
+    int throbPwm = divide((255 - DETECT_MINIMUM_BRIGHTNESS) * stepped, stepScale[k]) + DETECT_MINIMUM_BRIGHTNESS;
+    pwm[k] = pick(-full, DETECT_MAXIMUM_BRIGHTNESS, pick(-throb, throbPwm, pwm[k]));
+  }
+}
+
+// lightAtNear() and its averaging ring, for the lanes in near mode.
+// `ring` is the shared slot of every lane's ring.
+__attribute__((noinline)) static void laneNear(int lanes, int raw, int base, int ringSize, float ringScale, const int *__restrict minOver,
+                     const int *__restrict nearMode, const int *__restrict nearReading, int *__restrict ring,
+                     int *__restrict sum, int *__restrict missed, int *__restrict lastLightMeasure,
+                     int *__restrict pwm, int *__restrict glowStart)
+{
+  for (int k = 0; k < lanes; k++)
+  {
+    int active = nearMode[k];
+    int reading = nearReading[k];
+    int skipped = missed[k] + 1;
+    missed[k] = active ? missed[k] : skipped == ringSize ? 0 : skipped;
+
+    int measurement = reading ? raw : 0;
+    int old = ring[k];
+    ring[k] = active ? measurement : old;
+    sum[k] += active ? measurement - old : 0;
+    int level = divide(sum[k], ringScale) - base;
+
+    int closing = std::max(std::min(level, lastLightMeasure[k]), 0);
+    int before = pwm[k];
+    int rising = pick(-(level > minOver[k]), level, before);
+    int falling = pick(-(level > -minOver[k]), closing, 0);
+    int after = pick(-active, pick(-reading, rising, falling), before);
+    lastLightMeasure[k] = pick(-(active & reading), level, lastLightMeasure[k]);
+    pwm[k] = after;
+    glowStart[k] = active & (before == 0) & (after > 0);
+  }
+}
+
+template <typename Report> void PipelineBatch::step(uint64_t tUs, int raw, Report report)
+{
+  if (tUs > clockUs)
+    clockUs = tUs;
+  uint32_t now = (uint32_t)(clockUs / 1000);
+  if (!started)
+  {
+    std::fill(touchTime.begin(), touchTime.end(), now - DETECT_CLEAR_TIME);
+    started = true;
+  }
+
+  // The baseline and the water, once for everybody.
+  int wet = detectBaseline(shared, now, raw, false) == WATER_SUSPECT;
+  int base = shared.base;
+  warmedUp |= now >= DETECT_BASELINE_TIME;
+  int lighting = warmedUp;
+
+  laneTouchAndThrob(lanes, raw, base, now, lighting, wet, spread.data(), minOver.data(), debounce.data(), lightOn.data(),
+                    lightSteps.data(), stepScale.data(), touchTime.data(), touchLit.data(), steps.data(), direction.data(), pwm.data(),
+                    registered.data(), nearMode.data(), nearReading.data());
+
+  // Bring the rings of lanes that have just come back to near mode up to
+  // date, then lightAtNear() for every lane in near mode.
+  measSlot = measSlot + 1 == numMeas ? 0 : measSlot + 1;
+  int behind = 0;
+  for (int k = 0; k < lanes; k++)
+    behind |= nearMode[k] & (measMissed[k] != measLag[k]);
+  if (behind)
+    for (int k = 0; k < lanes; k++)
+      if (nearMode[k] && measMissed[k] != measLag[k])
+        rotate(k);
+  laneNear(lanes, raw, base, numMeas, 1.0f / numMeas, minOver.data(), nearMode.data(), nearReading.data(),
+           &meas[(size_t)measSlot * lanes], measSum.data(), measMissed.data(), lastLightMeasure.data(), pwm.data(),
+           glowStart.data());
+
+  // Almost every reading, no lane has anything to report.
+  int any = 0;
+  for (int k = 0; k < lanes; k++)
+    any |= registered[k] | glowStart[k];
+  if (any)
+    for (int k = 0; k < lanes; k++)
+      if (registered[k] | glowStart[k])
+        report(k, clockUs);
+  clockUs += BATCH_LOOP_DELAY_US;
+}
+
+// The lane sat out some readings while the shared slot kept moving.  Turn
+// its ring so that the slot it would have used next is the shared one.
+void PipelineBatch::rotate(int lane)
+{
+  int by = measMissed[lane] - measLag[lane];
+  if (by < 0)
+    by += numMeas;
+  std::vector<int> old(numMeas);
+  for (int slot = 0; slot < numMeas; slot++)
+    old[slot] = meas[(size_t)slot * lanes + lane];
+  for (int slot = 0; slot < numMeas; slot++)
+    meas[(size_t)((slot + by) % numMeas) * lanes + lane] = old[slot];
+  measLag[lane] = measMissed[lane];
+}
+
+void PipelineBatch::run(const CorpusTrace &trace, std::vector<Score> &scores)
+{
+  reset();
+  std::vector<Scorer> scorers(lanes, Scorer(trace.events, trace.readings, trace.baseline));
+  PipelineOutput out = {};
+  auto report = [&](int k, uint64_t t) {
+    out.tUs = t;
+    out.registered = registered[k];
+    out.glowStart = glowStart[k];
+    scorers[k].add(out);
+  };
+  for (const PipelineReading &reading : trace.readings)
+    step(reading.tUs, reading.raw, report);
+  for (int k = 0; k < lanes; k++)
+    scores[k].add(scorers[k].finish(trace.endUs));
+}
+
+std::vector<Score> pipelineBatchScore(const Corpus &corpus, const std::vector<PipelineParams> &sets, unsigned threads)
+{
+  // Group the sets that can share a baseline, then cut the groups into
+  // batches of at most PIPELINE_BATCH_LANES.  Sets the lanes can't run
+  // get a batch of their own, for the model.
+  std::map<std::pair<int, int>, std::vector<size_t>> groups;
+  std::vector<std::vector<size_t>> batches;
+  for (size_t i = 0; i < sets.size(); i++)
+  {
+    if (sets[i].gestures || sets[i].tracker)
+      batches.push_back({i});
+    else
+      groups[{sets[i].numBaseline, sets[i].numMeas}].push_back(i);
+  }
+  size_t alone = batches.size();
+  for (auto &group : groups)
+    for (size_t first = 0; first < group.second.size(); first += PIPELINE_BATCH_LANES)
+    {
+      size_t last = std::min(first + PIPELINE_BATCH_LANES, group.second.size());
+      batches.emplace_back(group.second.begin() + first, group.second.begin() + last);
+    }
+
+  std::vector<Score> scores(sets.size(), Score());
+  workPoolRun(
+      batches.size(),
+      [&](size_t b) {
+        if (b < alone)
+        {
+          scores[batches[b][0]] = corpusScore(corpus, sets[batches[b][0]]);
+          return;
+        }
+        std::vector<PipelineParams> lanes;
+        for (size_t i : batches[b])
+          lanes.push_back(sets[i]);
+        PipelineBatch batch(lanes);
+        std::vector<Score> laneScores(lanes.size(), Score());
+        for (const CorpusTrace &trace : corpus)
+          batch.run(trace, laneScores);
+        for (size_t k = 0; k < lanes.size(); k++)
+          scores[batches[b][k]] = std::move(laneScores[k]);
+      },
+      threads);
+  return scores;
+}
@@ -0,0 +1,90 @@
+#ifndef PIPELINE_BATCH_H
+#define PIPELINE_BATCH_H
+
+#include <stdint.h>
+#include <vector>
+#include "host/corpus.h"
+#include "host/pipeline_model.h"
+
+// Many copies of PipelineModel run side by side over the same readings.
+//
+// PipelineModel runs the detection code itself (detect.h).  That is a
+// reading at a time, and branches all over, so this is that code written
+// again for many lanes at once - only the baseline and the water, which
+// are shared, are detect.h's own detectBaseline().  The sweep checks the
+// two against each other before it trusts this.
+//
+// Scoring parameter sets one at a time walks every trace once per set.
+// Here a batch of sets - "lanes" - takes each reading together.  The
+// baseline only depends on the readings and its own length, so lanes
+// that share numBaseline share one baseline and it is worked out once per
+// reading, not once per lane - and so does the water detector, whose
+// thresholds aren't tunables (see water_film.h).  Everything else is kept
+// as one array per variable with an entry per lane (structure of arrays),
+// and each step is a plain loop over the lanes with no branches, which
+// the compiler turns into SIMD instructions.
+//
+// The averaging ring in lightAtNear() needs a trick.  A lane only adds
+// to it while its light is in "near" mode, so each lane would be at its
+// own place in its ring, and reading one slot per lane is not something
+// SIMD does well.  Instead the rings are stored slot by slot - slot 0 of
+// every lane, then slot 1 - and every lane uses the same slot, moved on
+// once per reading.  A lane that sits out some readings (its light is on
+// after a touch) has its ring rotated to catch up when it comes back.
+// That is rare, so it costs next to nothing.
+//
+// All lanes in a batch must have the same numBaseline and numMeas, and
+// the "gestures" and "tracker" tunables off - the lanes only light the
+// light the way the box ships.  The results are exactly those of
+// PipelineModel.
+
+#define PIPELINE_BATCH_LANES 256
+
+struct PipelineBatch
+{
+  explicit PipelineBatch(const std::vector<PipelineParams> &lanes);
+
+  // Score every lane over `trace`, adding to `scores` (one per lane).
+  void run(const CorpusTrace &trace, std::vector<Score> &scores);
+
+private:
+  void reset();
+  template <typename Report> void step(uint64_t tUs, int raw, Report report);
+
+  int lanes;
+  int numBaseline;
+  int numMeas;
+
+  // Shared by every lane.
+  uint64_t clockUs;
+  bool started;
+  bool warmedUp;
+  std::vector<int> baseReadings;
+  DetectState shared; // Only its baseline and water are used.
+
+  // One entry per lane.
+  std::vector<int> spread, minOver, debounce, lightOn, lightSteps;
+  std::vector<float> stepScale; // 1 / lightSteps.
+  std::vector<uint32_t> touchTime;
+  std::vector<int> touchLit;
+  std::vector<int> steps, direction, pwm, lastLightMeasure;
+  std::vector<int> measSum;
+  std::vector<int> measLag;    // How far the lane's ring is rotated...
+  std::vector<int> measMissed; // ...and how far it should be: readings
+                               // sat out, modulo numMeas.
+  int measSlot;                // Shared by every lane.
+  std::vector<int> registered, glowStart, nearMode, nearReading; // Flags, but
+                                                                 // int vectorizes
+                                                                 // with the rest.
+  std::vector<int> meas; // numMeas * lanes, slot after slot.
+
+  void rotate(int lane);
+};
+
+// Score every set over the corpus, batching sets that can share a
+// baseline, on all cores.  The same answers as corpusScore() for each:
+// sets with gestures or the tracker on are run one at a time by it.
+std::vector<Score> pipelineBatchScore(const Corpus &corpus, const std::vector<PipelineParams> &sets,
+                                      unsigned threads = 0);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host/pipeline_model.h"
+#include "host/sim.h"
+#include "params.h"
+
+#define MODEL_LOOP_DELAY_US 10000 // loop()'s halDelay(10).
+
+PipelineParams pipelineDefaults()
+{
+  return {SPREAD,
+          MIN_OVER_THRESHOLD,
+          DETECT_NUM_BASELINE,
+          DETECT_NUM_MEAS,
+          TOUCH_TIME_DEBOUNCE,
+          LIGHT_ON_TIME,
+          NUM_LIGHT_STEPS,
+          GESTURES,
+          TRACKER,
+          TRACK_ACCEL,
+          {TAP_MAX_TIME, DOUBLE_TAP_GAP, LONG_PRESS_TIME, HOLD_TIME}};
+}
+
+DetectParams pipelineDetectParams(const PipelineParams &params)
+{
+  DetectParams detect;
+  detect.spread = params.spread;
+  detect.minOver = params.minOver;
+  detect.debounceMs = params.debounceMs;
+  detect.lightOnMs = params.lightOnMs;
+  detect.lightSteps = params.lightSteps;
+  detect.gestures = params.gestures != 0;
+  detect.tracker = params.tracker != 0;
+  detect.trackAccel = params.trackAccel;
+  detect.gestureTiming = params.gestureTiming;
+  return detect;
+}
+
+PipelineModel::PipelineModel(const PipelineParams &params)
+    : params(params), detect(pipelineDetectParams(params)), baseReadings(params.numBaseline),
+      measSet(params.numMeas, 0), state(baseReadings.data(), params.numBaseline, measSet.data(), params.numMeas, &tracker)
+{
+  detectFillBaseline(state, DETECT_START_BASE); // As setup() does.
+}
+
+PipelineOutput PipelineModel::step(uint64_t tUs, int raw)
+{
+  // The firmware's clock never goes backwards, and each loop ends with a
+  // 10ms delay.
+  if (tUs > clockUs)
+    clockUs = tUs;
+  uint32_t now = (uint32_t)(clockUs / 1000);
+
+  DetectReading reading = detectSample(state, detect, now, raw, false);
+  detectLight(state, detect, now, raw, reading);
+
+  PipelineOutput out;
+  out.tUs = clockUs;
+  out.base = state.base;
+  out.avg = state.avg;
+  out.measured = state.measured;
+  out.pwm = state.pwm;
+  out.touched = reading.touched;
+  out.near = reading.near;
+  out.touchStart = reading.touchStart;
+  out.registered = reading.registered;
+  out.glowStart = reading.glowStart;
+  clockUs += MODEL_LOOP_DELAY_US;
+  return out;
+}
+
+// ---- Checking the model against the real thing ----
+
+extern DetectState detector;
+extern int light_pwm;
+
+static int verifyReading;
+
+static int verifySource(uint64_t nowUs, void *context)
+{
+  return verifyReading;
+}
+
+// The firmware in this process, from boot.
+static long verifyHere(const std::vector<PipelineReading> &readings, const PipelineParams &params)
+{
+  SimOptions options;
+  options.measureUs = 0; // The model takes no time to measure.
+  options.source = verifySource;
+  simBoot(options);
+  resetParams();
+  spread = params.spread;
+  min_over_threshold = params.minOver;
+  touch_time_debounce = params.debounceMs;
+  light_on_time = params.lightOnMs;
+  num_light_steps = params.lightSteps;
+  gestures = params.gestures;
+  tracker = params.tracker;
+  track_accel = params.trackAccel;
+  gesture_tap_max = params.gestureTiming.tapMaxMs;
+  gesture_double_gap = params.gestureTiming.doubleGapMs;
+  gesture_long_press = params.gestureTiming.longPressMs;
+  gesture_hold = params.gestureTiming.holdMs;
+
+  PipelineModel model(params);
+  for (size_t i = 0; i < readings.size(); i++)
+  {
+    verifyReading = readings[i].raw;
+    simLoopAt(readings[i].tUs);
+    PipelineOutput out = model.step(readings[i].tUs, readings[i].raw);
+    if (out.pwm != light_pwm || out.base != detector.base)
+      return (long)i;
+  }
+  return -1;
+}
+
+long pipelineVerify(const std::vector<PipelineReading> &readings, const PipelineParams &params)
+{
+  if (params.numBaseline != DETECT_NUM_BASELINE || params.numMeas != DETECT_NUM_MEAS)
+    return 0; // The firmware can't run these.
+
+  // The firmware keeps its state in globals and can only boot once, so
+  // each check gets a process of its own.
+  int fds[2];
+  if (pipe(fds) != 0)
+    return 0;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(fds[0]);
+    long mismatch = verifyHere(readings, params);
+    _exit(write(fds[1], &mismatch, sizeof(mismatch)) == (ssize_t)sizeof(mismatch) ? 0 : 1);
+  }
+  close(fds[1]);
+  long mismatch = 0; // If the child never says, as good as wrong from the start.
+  if (pid < 0 || read(fds[0], &mismatch, sizeof(mismatch)) != (ssize_t)sizeof(mismatch))
+    mismatch = 0;
+  close(fds[0]);
+  if (pid > 0)
+    waitpid(pid, nullptr, 0);
+  return mismatch;
+}
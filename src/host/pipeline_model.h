@@ -0,0 +1,95 @@
+#ifndef PIPELINE_MODEL_H
+#define PIPELINE_MODEL_H
+
+#include <stdint.h>
+#include <vector>
+#include "detect.h"
+
+// The detection and lighting code, as loop() runs it, with all its state
+// in one object and every tunable - even the ones that are array sizes on
+// the board - as a plain number.
+//
+// The firmware keeps its state in globals, which is right for the board
+// but means one process can only run one copy of it.  To try thousands of
+// settings against the same traces, the sweep tools run this model
+// instead.  It is the same code - detectSample() and detectLight() from
+// detect.h - wrapped around a DetectState of its own, so there is nothing
+// to keep in step by hand.  pipelineVerify() still replays a trace through
+// both and checks the LED and the baseline agree on every reading, and the
+// tools run it before trusting the model.
+//
+// What loop() does around the detection code isn't in here: the sensor
+// health checks (see sensor_health.h) - it assumes a working sensor,
+// which every trace the tools make is - and the secret knocks (see
+// tap_lock.h), whose default patterns never touch the light.
+
+struct PipelineParams
+{
+  int spread;
+  int minOver;
+  int numBaseline;
+  int numMeas;
+  int debounceMs;
+  int lightOnMs;
+  int lightSteps;
+  int gestures;
+  int tracker;
+  int trackAccel;
+  GestureTiming gestureTiming;
+};
+
+// The values the firmware is built with.
+PipelineParams pipelineDefaults();
+
+// The tunables detect.h takes, out of `params`.
+DetectParams pipelineDetectParams(const PipelineParams &params);
+
+struct PipelineOutput
+{
+  uint64_t tUs;      // When loop() ran, on the model's clock.
+  int base;
+  int avg;           // addMeasurement()'s latest average.
+  int measured;      // What this loop fed addMeasurement(), or -1.
+  int pwm;           // light_pwm after the loop.
+  bool touched;
+  bool near;
+  bool touchStart;   // First touched reading of a touch.
+  bool registered;   // A touch checkDebug() would count: the first after
+                     // at least debounceMs with no touched reading.
+  bool glowStart;    // lightAtNear() turned the LED on from off.
+};
+
+struct PipelineModel
+{
+  explicit PipelineModel(const PipelineParams &params);
+  // The state points into the model's own rings, so no copies.
+  PipelineModel(const PipelineModel &) = delete;
+  PipelineModel &operator=(const PipelineModel &) = delete;
+
+  // One pass of loop() for a reading taken at `tUs`.
+  PipelineOutput step(uint64_t tUs, int raw);
+
+  PipelineParams params;
+
+private:
+  DetectParams detect;
+  uint64_t clockUs = 0;
+  std::vector<int> baseReadings;
+  std::vector<int> measSet;
+  ProximityTracker tracker = {};
+  DetectState state;
+};
+
+// Replay `readings` (time, raw pairs) through the firmware and the model
+// at `params`, whose numBaseline and numMeas must be the firmware's.
+// Returns the index of the first reading where they disagree, or -1 if
+// they never do.  The firmware runs in a child process, booted afresh
+// each time.
+struct PipelineReading
+{
+  uint64_t tUs;
+  int raw;
+};
+long pipelineVerify(const std::vector<PipelineReading> &readings, const PipelineParams &params = pipelineDefaults());
+
+#endif
@@ -0,0 +1,35 @@
+#include "host/reference_model.h"
+
+#define REFERENCE_LOOP_DELAY_US 10000 // loop()'s halDelay(10).
+
+ReferenceModel::ReferenceModel(const PipelineParams &params)
+    : params(params), detect(pipelineDetectParams(params)), baseReadings(params.numBaseline),
+      measSet(params.numMeas, 0), state(baseReadings.data(), params.numBaseline, measSet.data(), params.numMeas, &tracker)
+{
+  detectFillBaseline(state, DETECT_START_BASE); // As setup() does.
+}
+
+ReferenceOutput ReferenceModel::step(uint64_t tUs, int raw)
+{
+  if (tUs > clockUs)
+    clockUs = tUs;
+  uint32_t now = (uint32_t)(clockUs / 1000);
+
+  // The water detector and the proximity tracker work in whole counts on
+  // the board, so they are given the baseline in whole counts here too.
+  // Given the exact baseline they decide the same way, bar the odd reading.
+  DetectReading reading = detectSample(state, detect, now, raw, false);
+  detectLight(state, detect, now, raw, reading);
+
+  ReferenceOutput out;
+  out.base = state.base;
+  out.avg = state.avg;
+  out.measured = state.measured;
+  out.pwm = state.pwm;
+  out.touched = reading.touched;
+  out.near = reading.near;
+  out.registered = reading.registered;
+  out.lit = state.pwm > 0;
+  clockUs += REFERENCE_LOOP_DELAY_US;
+  return out;
+}
@@ -0,0 +1,56 @@
+#ifndef REFERENCE_MODEL_H
+#define REFERENCE_MODEL_H
+
+#include <stdint.h>
+#include <vector>
+#include "detect.h"
+#include "host/pipeline_model.h"
+
+// What the detection and lighting code means to do, worked out in double
+// precision.
+//
+// The firmware does all its filtering in integers, because the board's
+// Cortex-M0+ has no floating point and no divider: the baseline and the
+// proximity average are running totals divided down with the remainder
+// thrown away, and so are the near light's brightness and the throb after
+// a touch.  This runs the same detection code (detect.h) in doubles, so
+// those three stages come out the way the maths says - exact means,
+// fractional brightness - and the same decisions are made from them, and
+// the fixed point versions can be checked against it (see
+// src/host/tools/fixedpoint.cpp).  It follows PipelineModel step for step;
+// only the arithmetic differs.
+
+struct ReferenceOutput
+{
+  double base;  // Mean of the last numBaseline readings.
+  double avg;   // Mean of the last numMeas measurements lightAtNear() added.
+  int measured; // What this loop fed addMeasurement(), or -1.
+  double pwm;   // The light, before it is rounded to a PWM step.
+  bool touched;
+  bool near;
+  bool registered;
+  bool lit; // pwm > 0.
+};
+
+struct ReferenceModel
+{
+  explicit ReferenceModel(const PipelineParams &params);
+  // The state points into the model's own rings, so no copies.
+  ReferenceModel(const ReferenceModel &) = delete;
+  ReferenceModel &operator=(const ReferenceModel &) = delete;
+
+  // One pass of loop() for a reading taken at `tUs`.
+  ReferenceOutput step(uint64_t tUs, int raw);
+
+  PipelineParams params;
+
+private:
+  DetectParams detect;
+  uint64_t clockUs = 0;
+  std::vector<int> baseReadings;
+  std::vector<int> measSet;
+  ProximityTracker tracker = {};
+  DetectStateOf<double> state;
+};
+
+#endif
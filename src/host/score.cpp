@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <math.h>
+#include "host/score.h"
+
+double Score::percentileLatencyMs(double fraction)
+{
+  if (latencyUs.empty())
+    return 0;
+  std::sort(latencyUs.begin(), latencyUs.end());
+  size_t index = (size_t)(fraction * (latencyUs.size() - 1) + 0.5);
+  return latencyUs[index] / 1000.0;
+}
+
+void Score::add(const Score &other)
+{
+  touches += other.touches;
+  missed += other.missed;
+  falseTouches += other.falseTouches;
+  falseGlows += other.falseGlows;
+  latencyUs.insert(latencyUs.end(), other.latencyUs.begin(), other.latencyUs.end());
+}
+
+Scorer::Scorer(const std::vector<SignalEvent> &events, const std::vector<PipelineReading> &readings,
+               const std::vector<float> &baseline)
+{
+  for (const SignalEvent &event : events)
+    if (event.kind == SIGNAL_FINGER)
+      fingers.push_back(event);
+  std::sort(fingers.begin(), fingers.end(),
+            [](const SignalEvent &a, const SignalEvent &b) { return a.startUs < b.startUs; });
+  found.assign(fingers.size(), false);
+
+  // The first reading of each touching visit that is SCORE_REACH_COUNTS
+  // over the true baseline.  Readings are in time order.
+  reachUs.assign(fingers.size(), 0);
+  size_t i = 0;
+  for (size_t f = 0; f < fingers.size(); f++)
+  {
+    const SignalEvent &finger = fingers[f];
+    reachUs[f] = finger.touchStartUs;
+    if (finger.touchStartUs == 0)
+      continue;
+    while (i < readings.size() && readings[i].tUs < finger.startUs)
+      i++;
+    for (size_t j = i; j < readings.size() && j < baseline.size() && readings[j].tUs <= finger.touchEndUs; j++)
+    {
+      if (isnan(baseline[j]))
+        break;
+      if (readings[j].raw - baseline[j] >= SCORE_REACH_COUNTS)
+      {
+        reachUs[f] = readings[j].tUs;
+        break;
+      }
+    }
+  }
+}
+
+void Scorer::add(const PipelineOutput &out)
+{
+  if (out.tUs < SCORE_SETTLE_US)
+    return;
+
+  if (out.registered)
+  {
+    // Fingers never overlap, so only the first one whose window has not
+    // closed can match.
+    while (touchIndex < fingers.size() &&
+           (fingers[touchIndex].touchStartUs == 0 || fingers[touchIndex].touchEndUs + SCORE_LATE_US < out.tUs))
+      touchIndex++;
+    if (touchIndex < fingers.size() && out.tUs + SCORE_EARLY_US >= fingers[touchIndex].touchStartUs &&
+        !found[touchIndex])
+    {
+      found[touchIndex] = true;
+      score.latencyUs.push_back((int32_t)((int64_t)out.tUs - (int64_t)reachUs[touchIndex]));
+    }
+    else
+      score.falseTouches++;
+  }
+
+  if (out.glowStart)
+  {
+    while (glowIndex < fingers.size() && fingers[glowIndex].endUs + SCORE_GLOW_AFTER_US < out.tUs)
+      glowIndex++;
+    if (glowIndex >= fingers.size() || out.tUs < fingers[glowIndex].startUs)
+      score.falseGlows++;
+  }
+}
+
+Score Scorer::finish(uint64_t endUs)
+{
+  for (size_t i = 0; i < fingers.size(); i++)
+  {
+    const SignalEvent &finger = fingers[i];
+    if (finger.touchStartUs == 0 || finger.touchStartUs < SCORE_SETTLE_US || finger.touchEndUs > endUs)
+      continue;
+    score.touches++;
+    score.missed += !found[i];
+  }
+  return score;
+}
@@ -0,0 +1,73 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include <stdint.h>
+#include <vector>
+#include "host/pipeline_model.h"
+#include "host/signal_gen.h"
+#include "params.h"
+
+// Score what the detection code did against what really happened.
+//
+// The ground truth is the list of events behind a synthetic trace (see
+// signal_gen.h).  For every real touch we want exactly one registered
+// touch, soon after the finger lands; anything else is a mistake:
+//
+//  - missed: a real touch that was never registered.
+//  - false touch: a registered touch with no real touch around it, or a
+//    second one for the same real touch.
+//  - false glow: the near light coming on with no finger anywhere near.
+//
+// Latency is from the moment a perfect detector could have seen the
+// touch - the finger's counts reaching SCORE_REACH_COUNTS over the true
+// baseline - to the touch being registered.  That moment is in the
+// readings and the ground truth, not in anything the firmware does, so
+// a slow baseline or a high spread shows up as latency.  It is not when
+// the finger lands: the approach passes SCORE_REACH_COUNTS a few
+// millimetres out, so measured from the landing nearly every touch came
+// out "early".  A trace with no true baseline falls back to the landing.
+
+#define SCORE_EARLY_US 300000   // A touch registered this long before the
+                                // finger lands still counts.
+#define SCORE_LATE_US 100000    // ...or this long after it lifts.
+#define SCORE_GLOW_AFTER_US 2000000 // The light can still be fading this long
+                                    // after a finger leaves.
+#define SCORE_SETTLE_US 5000000 // Ignore the firmware's first 5 seconds.
+#define SCORE_REACH_COUNTS SPREAD // Fixed at the default, so sweeping
+                                  // spread shows what it costs.
+
+struct Score
+{
+  unsigned long touches;      // Real touches.
+  unsigned long missed;
+  unsigned long falseTouches;
+  unsigned long falseGlows;
+  std::vector<int32_t> latencyUs; // One per touch that was found.
+
+  double percentileLatencyMs(double fraction); // Sorts latencyUs.
+  void add(const Score &other);
+};
+
+struct Scorer
+{
+  // `events` need not be in order.  `baseline` is the true baseline for
+  // each of `readings`, NaN where it isn't known, or empty.
+  Scorer(const std::vector<SignalEvent> &events, const std::vector<PipelineReading> &readings,
+         const std::vector<float> &baseline);
+
+  void add(const PipelineOutput &out);
+
+  // Everything up to `endUs` has been seen: count the touches that were
+  // never found.
+  Score finish(uint64_t endUs);
+
+private:
+  std::vector<SignalEvent> fingers; // Sorted by start.
+  std::vector<uint64_t> reachUs;    // Per finger: where latency starts.
+  std::vector<bool> found;          // Per finger.
+  size_t touchIndex = 0;            // First finger a touch could still match.
+  size_t glowIndex = 0;
+  Score score = {};
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <math.h>
+#include "host/signal_gen.h"
+
+static const double TWO_PI = 6.283185307179586;
+
+double signalPick(SimRandom &random, const SignalRange &range)
+{
+  return random.uniform(range.low, range.high);
+}
+
+// Time until the next event of a Poisson process.
+static uint64_t exponentialUs(SimRandom &random, double perHour)
+{
+  if (perHour <= 0)
+    return UINT64_MAX / 2;
+  return (uint64_t)(-log(1.0 - random.uniform()) * 3600e6 / perHour);
+}
+
+SignalGenerator::SignalGenerator(const SignalConfig &config, uint64_t seed, uint64_t startUs)
+    : config(config), random(seed), startUs(startUs)
+{
+  // Humidity is a random walk that is pulled back towards zero, so it
+  // wanders about humidityCounts either side instead of drifting away.
+  humidityDecay = exp(-1.0 / (config.humidityHours * 3600 * config.sampleRateHz));
+  humidityStep = config.humidityCounts * sqrt(1 - humidityDecay * humidityDecay);
+  nextSpikeUs = startUs + exponentialUs(random, config.spikesPerHour);
+  planVisit(startUs);
+}
+
+// Pink (1/f) noise, Voss-McCartney style: row k is redrawn every 2^k
+// samples, so the slow rows carry the low frequencies.
+double SignalGenerator::pink()
+{
+  const int rows = sizeof(pinkRows) / sizeof(pinkRows[0]);
+  uint64_t n = sampleIndex;
+  int row = 0;
+  while (row < rows - 1 && (n & 1) == 0 && n != 0)
+  {
+    n >>= 1;
+    row++;
+  }
+  pinkSum -= pinkRows[row];
+  pinkRows[row] = random.roughGaussian();
+  pinkSum += pinkRows[row];
+  return pinkSum / sqrt((double)rows);
+}
+
+void SignalGenerator::planVisit(uint64_t after)
+{
+  Visit &v = visit;
+  v.start = after + exponentialUs(random, config.fingersPerHour);
+  v.farMm = signalPick(random, config.farMm);
+  v.touches = random.uniform() < config.touchChance;
+  v.hoverMm = signalPick(random, config.hoverMm);
+  v.touchCounts = signalPick(random, config.touchCounts);
+  double speed = signalPick(random, config.approachMmPerS);
+
+  v.approachEnd = v.start + (uint64_t)((v.farMm - v.hoverMm) / speed * 1e6);
+  v.hoverEnd = v.approachEnd + (uint64_t)(signalPick(random, config.hoverMs) * 1e3);
+  double retreatFrom = v.hoverMm;
+  if (v.touches)
+  {
+    v.touchStart = v.hoverEnd + (uint64_t)(v.hoverMm / speed * 1e6);
+    v.touchEnd = v.touchStart + (uint64_t)(signalPick(random, config.touchMs) * 1e3);
+    retreatFrom = 0;
+  }
+  else
+  {
+    v.touchStart = v.touchEnd = v.hoverEnd;
+  }
+  v.end = v.touchEnd + (uint64_t)((v.farMm - retreatFrom) / speed * 1e6);
+
+  double closest = v.touches ? 0 : v.hoverMm;
+  double ratio = config.fallOffMm / (config.fallOffMm + closest);
+  SignalEvent event = {SIGNAL_FINGER, v.start, v.end, v.touches ? v.touchStart : 0, v.touches ? v.touchEnd : 0,
+                       closest, v.touchCounts * ratio * ratio};
+  events.push_back(event);
+}
+
+double SignalGenerator::fingerDistance(uint64_t t, uint8_t &label) const
+{
+  const Visit &v = visit;
+  label = SIGNAL_IDLE;
+  if (t < v.start || t >= v.end)
+    return -1;
+
+  if (t < v.approachEnd)
+  {
+    label = SIGNAL_APPROACH;
+    return v.farMm + (v.hoverMm - v.farMm) * (double)(t - v.start) / (double)(v.approachEnd - v.start);
+  }
+  if (t < v.hoverEnd)
+  {
+    label = SIGNAL_HOVER;
+    return v.hoverMm;
+  }
+  if (v.touches && t < v.touchStart)
+  {
+    label = SIGNAL_APPROACH;
+    return v.hoverMm * (double)(v.touchStart - t) / (double)(v.touchStart - v.hoverEnd);
+  }
+  if (v.touches && t < v.touchEnd)
+  {
+    label = SIGNAL_TOUCH;
+    return 0;
+  }
+  label = SIGNAL_RETREAT;
+  double from = v.touches ? 0 : v.hoverMm;
+  return from + (v.farMm - from) * (double)(t - v.touchEnd) / (double)(v.end - v.touchEnd);
+}
+
+SignalSample SignalGenerator::next()
+{
+  double period = 1e6 / config.sampleRateHz;
+  double jitter = config.jitterUs * random.roughGaussian();
+  double at = sampleIndex * period + (jitter > -period / 2 ? jitter : 0);
+  return sampleAt(startUs + (uint64_t)(at > 0 ? at : 0));
+}
+
+SignalSample SignalGenerator::sampleAt(uint64_t tUs)
+{
+  SignalSample sample;
+  sample.tUs = tUs;
+  double hours = (sample.tUs - startUs) / 3600e6;
+
+  // The environment: everything that moves the untouched reading.
+  humidity = humidity * humidityDecay + humidityStep * random.roughGaussian();
+  double baseline = config.baseline + config.driftPerDay * hours / 24 +
+                    config.thermalCounts * sin(TWO_PI * hours / config.thermalPeriodHours) + humidity;
+
+  double reading = baseline + config.whiteNoise * random.roughGaussian() + config.pinkNoise * pink() +
+                   config.humCounts * sin(TWO_PI * config.mainsHz * sample.tUs / 1e6);
+
+  if (sample.tUs >= nextSpikeUs)
+  {
+    double size = signalPick(random, config.spikeCounts);
+    reading += size;
+    SignalEvent event = {SIGNAL_SPIKE, sample.tUs, sample.tUs + 1, 0, 0, 0, size};
+    events.push_back(event);
+    nextSpikeUs = sample.tUs + exponentialUs(random, config.spikesPerHour);
+  }
+
+  // The finger.
+  if (sample.tUs >= visit.end)
+    planVisit(visit.end);
+  double distance = fingerDistance(sample.tUs, sample.label);
+  sample.fingerCounts = 0;
+  if (distance >= 0)
+  {
+    double ratio = config.fallOffMm / (config.fallOffMm + distance);
+    sample.fingerCounts = visit.touchCounts * ratio * ratio;
+    reading += sample.fingerCounts;
+  }
+
+  long raw = lround(reading);
+  sample.raw = raw < 0 ? 0 : raw > 1023 ? 1023 : raw;
+  sample.baseline = baseline;
+  sampleIndex++;
+  return sample;
+}
+
+int signalTouchSource(uint64_t nowUs, void *generator)
+{
+  return ((SignalGenerator *)generator)->sampleAt(nowUs).raw;
+}
+
+const char *signalLabelName(uint8_t label)
+{
+  static const char *const names[] = {"idle", "approach", "hover", "touch", "retreat"};
+  return label < sizeof(names) / sizeof(names[0]) ? names[label] : "?";
+}
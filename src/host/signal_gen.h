@@ -0,0 +1,161 @@
+#ifndef SIGNAL_GEN_H
+#define SIGNAL_GEN_H
+
+#include <stdint.h>
+#include <vector>
+#include "host/sim_random.h"
+
+// Synthetic capacitance readings with known ground truth.
+//
+// Real traces never tell you where the finger actually was.  This builds
+// a stream of readings in the same units as qt_1.measure() from parts we
+// control, and remembers what it put in, so a filter's output can be
+// scored against the truth:
+//
+//   reading = baseline                   (the untouched pad, ~725)
+//           + thermal swing              (a slow daily sine)
+//           + humidity wander            (a slow random walk)
+//           + linear drift
+//           + white noise + pink noise   (sensor and environment)
+//           + mains hum                  (aliased by the ~90Hz sampling)
+//           + spikes                     (ESD, a relay clicking nearby)
+//           + finger                     (approach, hover, touch, retreat)
+//
+// The finger adds counts that fall off with distance d in millimetres
+// roughly as touchCounts * (d0 / (d0 + d))^2, so the reading creeps up as
+// the finger gets close and jumps when it lands.
+
+// What the finger is doing at each sample.
+enum SignalLabel
+{
+  SIGNAL_IDLE = 0,
+  SIGNAL_APPROACH = 1,
+  SIGNAL_HOVER = 2,
+  SIGNAL_TOUCH = 3,
+  SIGNAL_RETREAT = 4,
+};
+
+enum SignalEventKind
+{
+  SIGNAL_FINGER, // A whole visit: approach, maybe hover, maybe touch, retreat.
+  SIGNAL_SPIKE,  // One bad sample.
+};
+
+struct SignalEvent
+{
+  SignalEventKind kind;
+  uint64_t startUs;
+  uint64_t endUs;
+  uint64_t touchStartUs; // Both 0 when the finger never touched.
+  uint64_t touchEndUs;
+  double closestMm;      // 0 for a touch.
+  double peakCounts;     // Largest amount added to the reading.
+};
+
+struct SignalSample
+{
+  uint64_t tUs;
+  int raw;           // What measure() would have returned.
+  uint8_t label;     // SignalLabel.
+  float baseline;    // The true untouched level, for scoring baseline tracking.
+  float fingerCounts; // What the finger added.
+};
+
+struct SignalRange
+{
+  double low;
+  double high;
+};
+
+struct SignalConfig
+{
+  double sampleRateHz = 90;    // The firmware loop runs at about 90Hz.
+  double jitterUs = 200;       // Spread in the sample times.
+
+  double baseline = 725;
+  double driftPerDay = 0;
+  double thermalCounts = 4;    // Peak of the daily swing.
+  double thermalPeriodHours = 24;
+  double humidityCounts = 3;   // Typical size of the humidity wander.
+  double humidityHours = 6;    // How quickly it wanders.
+
+  double whiteNoise = 1.0;     // Standard deviations, in counts.
+  double pinkNoise = 0.5;
+  double humCounts = 0.3;
+  double mainsHz = 60;
+
+  double spikesPerHour = 1;
+  SignalRange spikeCounts = {-80, 120};
+
+  double fingersPerHour = 6;
+  double touchChance = 0.5;         // Of a visit ending in a touch.
+  SignalRange farMm = {120, 200};   // Where a visit starts and ends.
+  SignalRange hoverMm = {5, 40};    // Closest point of a visit without touch.
+  SignalRange approachMmPerS = {80, 400};
+  SignalRange hoverMs = {0, 3000};
+  SignalRange touchMs = {150, 1500};
+  SignalRange touchCounts = {140, 260}; // Finger flat on the pad.
+  double fallOffMm = 6;             // d0 in the formula above.
+};
+
+struct SignalGenerator
+{
+  SignalGenerator(const SignalConfig &config, uint64_t seed, uint64_t startUs = 0);
+
+  // The next sample at the configured rate.
+  SignalSample next();
+
+  // A sample taken at `tUs` instead, for when the caller decides when to
+  // measure (see signalTouchSource).  Times must not go backwards.
+  SignalSample sampleAt(uint64_t tUs);
+
+  // Every event planned so far.  A finger visit is planned before its
+  // first sample and a spike during its sample, so the list is not quite
+  // in start order.
+  std::vector<SignalEvent> events;
+
+private:
+  struct Visit
+  {
+    uint64_t start;
+    uint64_t approachEnd;
+    uint64_t hoverEnd;
+    uint64_t touchStart; // Finger lands.
+    uint64_t touchEnd;   // Finger lifts.
+    uint64_t end;
+    double farMm;
+    double hoverMm;
+    double touchCounts;
+    bool touches;
+  };
+
+  double pink();
+  void planVisit(uint64_t after);
+  double fingerDistance(uint64_t t, uint8_t &label) const;
+
+  SignalConfig config;
+  SimRandom random;
+  uint64_t startUs;
+  uint64_t sampleIndex = 0;
+  double humidity = 0;
+  double humidityDecay;
+  double humidityStep;
+  double pinkRows[12] = {};
+  double pinkSum = 0;
+  uint64_t nextSpikeUs;
+  Visit visit;
+};
+
+double signalPick(SimRandom &random, const SignalRange &range);
+
+// A HalSimTouchSource that reads from a SignalGenerator, so the firmware
+// can run against synthetic readings:
+//
+//   SignalGenerator generator(config, seed, options.startMs * 1000);
+//   options.source = signalTouchSource;
+//   options.sourceContext = &generator;
+int signalTouchSource(uint64_t nowUs, void *generator);
+
+const char *signalLabelName(uint8_t label);
+
+#endif
@@ -0,0 +1,45 @@
+#include "host/flash_sim.h"
+#include "host/hal_sim.h"
+#include "host/sim.h"
+
+void setup();
+void loop();
+
+static uint64_t bootUs = 0;
+
+void simBoot(const SimOptions &options)
+{
+  flashSimReset(options.flashErased);
+  bootUs = options.startMs * 1000;
+
+  halSimReset(bootUs);
+  halSimSetTouchSource(options.source, options.sourceContext);
+  halSimSetMeasureTime(options.measureUs);
+  halSimMuteSerial(!options.echoSerial);
+  setup();
+}
+
+uint64_t simRunFor(uint64_t durationMs, SimProbe probe, void *context)
+{
+  uint64_t end = halSimNow() + durationMs * 1000;
+  uint64_t loops = 0;
+  while (halSimNow() < end)
+  {
+    loop();
+    loops++;
+    if (probe != nullptr)
+      probe(halSimNow(), context);
+  }
+  return loops;
+}
+
+void simLoopAt(uint64_t us)
+{
+  halSimSetTime(us);
+  loop();
+}
+
+uint64_t simElapsedMs()
+{
+  return (halSimNow() - bootUs) / 1000;
+}
@@ -0,0 +1,47 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "host/hal_sim.h"
+
+// Run the firmware's setup() and loop() on a PC against simulated time.
+//
+// halDelay() just moves the virtual clock forward, so a month of loop()
+// passes in seconds.  Everything is deterministic: the same options and
+// the same sensor source give the same run, bit for bit.
+//
+// The firmware keeps its state in globals and function statics, exactly
+// as on the board, so each process boots the firmware once.  Run several
+// processes to run several simulations side by side.
+
+struct SimOptions
+{
+  uint64_t seed = 1;         // For sensor sources that want one.
+  uint64_t startMs = 0;      // Where the clock starts.  Just under 2^32
+                             // to see millis() wrap early in the run.
+  uint32_t measureUs = 300;  // How long one touch measurement takes.
+  bool flashErased = true;   // Fresh chip, or zeros like a flashed image.
+  bool echoSerial = false;   // Show the firmware's serial output.
+  HalSimTouchSource source = nullptr; // Where readings come from.  Without
+  void *sourceContext = nullptr;      // one the sensor reads a flat 725.
+};
+
+// Called after every pass through loop().
+typedef void (*SimProbe)(uint64_t nowUs, void *context);
+
+// Power on: clean flash, reset the clock to options.startMs, connect the
+// sensor source and run setup().
+void simBoot(const SimOptions &options);
+
+// Run loop() until `durationMs` of virtual time have gone by.  Returns
+// the number of loops run.
+uint64_t simRunFor(uint64_t durationMs, SimProbe probe = nullptr, void *context = nullptr);
+
+// Move the clock forward to `us` - unless the last loop already ran past
+// it - and run loop() once.  For replaying readings taken at known times.
+void simLoopAt(uint64_t us);
+
+// Virtual milliseconds since simBoot().
+uint64_t simElapsedMs();
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SIM_RANDOM_H
+#define SIM_RANDOM_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Small, fast, seedable random numbers for the simulators.  The same seed
+// always gives the same sequence on every machine, so a run that shows a
+// problem can be repeated exactly.  (splitmix64, see
+// https://prng.di.unimi.it/splitmix64.c)
+struct SimRandom
+{
+  uint64_t state;
+
+  explicit SimRandom(uint64_t seed = 1) : state(seed) {}
+
+  uint64_t next()
+  {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [0, 1).
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  // Uniform in [low, high).
+  double uniform(double low, double high) { return low + (high - low) * uniform(); }
+
+  // Normal with mean 0 and standard deviation 1 (Box-Muller).
+  double gaussian()
+  {
+    double u = uniform();
+    double v = uniform();
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(6.283185307179586 * v);
+  }
+
+  // Close to normal, much cheaper: the sum of four uniforms has the right
+  // mean and spread but no tails past +-3.5.  Good enough for sensor
+  // noise in long runs where gaussian() would dominate the run time.
+  double roughGaussian()
+  {
+    // Four 16 bit uniforms out of one 64 bit number.  Their sum has mean
+    // 2 and variance 1/3.
+    uint64_t bits = next();
+    uint32_t sum = (bits & 0xFFFF) + ((bits >> 16) & 0xFFFF) + ((bits >> 32) & 0xFFFF) + (bits >> 48);
+    return (sum * (1.0 / 65536.0) - 2.0) * 1.7320508075688772;
+  }
+};
+
+#endif
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "detect.h"
+#include "distance.h"
+#include "flight_recorder.h"
+#include "gesture.h"
+#include "host/pipeline_model.h"
+#include "host/signal_gen.h"
+#include "host/sim.h"
+#include "latency.h"
+#include "params.h"
+#include "proximity.h"
+#include "sensor_health.h"
+#include "stats.h"
+#include "tap_lock.h"
+#include "water_film.h"
+
+// Microbenchmarks for the code that runs on every reading.
+//
+//   .pio/build/bench/program [--filter name] [--runs 15] [--warmup 3]
+//       [--scale 1] [--json results.json] [--compare old.json]
+//
+// Each benchmark calls one function a fixed number of times per run, on
+// readings from a synthetic trace, and reports nanoseconds per call: the
+// best run, the median, the mean and the spread.  The median is the
+// number to watch; the best run shows what the code can do when nothing
+// else gets in the way.  Warm-up runs are thrown away.
+//
+// --json writes the results (one benchmark per line, so it diffs well),
+// and --compare prints how far each median has moved since an older
+// file.  Iteration counts never change with the machine, so files from
+// different commits line up.
+//
+// These time the firmware's own functions compiled for this computer.
+// That says nothing about cycles on the board, but it does show when a
+// change makes something slower.
+
+// The firmware's per-reading functions, all in main.cpp.
+extern bool debugging;
+extern DetectState detector;
+int baseAvg(int reading);
+int addMeasurement(int measurement);
+void lightAtNear(int measurement);
+void lightAtStep(bool reset);
+
+#define BENCH_READINGS 65536 // A power of two, so `i & mask` wraps.
+
+static std::vector<int> readings;
+static volatile int sink; // Keeps results from being optimized away.
+
+struct Benchmark
+{
+  const char *name;
+  uint32_t iterations; // Calls per run.
+  void (*run)(uint32_t iterations);
+};
+
+static void benchBaseAvg(uint32_t iterations)
+{
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+    sum += baseAvg(readings[i & (BENCH_READINGS - 1)]);
+  sink = sum;
+}
+
+static void benchAddMeasurement(uint32_t iterations)
+{
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+    sum += addMeasurement(readings[i & (BENCH_READINGS - 1)]);
+  sink = sum;
+}
+
+static void benchLightAtNear(uint32_t iterations)
+{
+  for (uint32_t i = 0; i < iterations; i++)
+    lightAtNear(readings[i & (BENCH_READINGS - 1)]);
+}
+
+static void benchLightAtStep(uint32_t iterations)
+{
+  for (uint32_t i = 0; i < iterations; i++)
+    lightAtStep(false);
+}
+
+// The detection step from loop() (see detect.h), on the firmware's own
+// state and tunables.  The clock carries on from run to run, as millis()
+// would.
+static uint32_t benchNow = 0;
+
+static void benchDetectSample(uint32_t iterations)
+{
+  DetectParams params = detectParams();
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    benchNow += 11;
+    DetectReading reading = detectSample(detector, params, benchNow, readings[i & (BENCH_READINGS - 1)], false);
+    sum += reading.touched + reading.near;
+  }
+  sink = sum;
+}
+
+// Both halves, as loop() runs them.  Take detectSample away for
+// detectLight().
+static void benchDetection(uint32_t iterations)
+{
+  DetectParams params = detectParams();
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    int raw = readings[i & (BENCH_READINGS - 1)];
+    benchNow += 11;
+    DetectReading reading = detectSample(detector, params, benchNow, raw, false);
+    detectLight(detector, params, benchNow, raw, reading);
+    sum += detector.pwm;
+  }
+  sink = sum;
+}
+
+static void benchLatency(uint32_t iterations)
+{
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    bool touched = (i % 50) < (i % 7 + 2);
+    latencySample(i * 11000, !touched && (i % 50) < 12, touched);
+  }
+}
+
+static void benchDistance(uint32_t iterations)
+{
+  for (uint32_t i = 0; i < iterations; i++)
+    distanceSample(readings[i & (BENCH_READINGS - 1)] - detector.base, false);
+  sink = distance_mm;
+}
+
+static void benchTapLock(uint32_t iterations)
+{
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+    sum += tapLockSample(i * 11, (i % 50) < (i % 7 + 2));
+  sink = sum;
+}
+
+static void benchGesture(uint32_t iterations)
+{
+  static GestureChannel channel = {};
+  GestureTiming timing = gestureTiming();
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+    sum += gestureSample(channel, timing, i * 11, (i % 50) < (i % 7 + 2));
+  sink = sum;
+}
+
+static void benchWaterFilm(uint32_t iterations)
+{
+  static WaterFilm film = {};
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+    sum += waterFilmSample(film, i * 11, readings[i & (BENCH_READINGS - 1)], detector.base);
+  sink = sum;
+}
+
+static void benchSensorHealth(uint32_t iterations)
+{
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+    sum += sensorHealthSample(i * 11, readings[i & (BENCH_READINGS - 1)], detector.base);
+  sink = sum;
+}
+
+static void benchProximity(uint32_t iterations)
+{
+  static ProximityTracker tracker = {};
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    int raw = readings[i & (BENCH_READINGS - 1)];
+    proximitySample(tracker, i * 11, raw, detector.base, raw <= detector.base + MIN_OVER_THRESHOLD, TRACK_ACCEL);
+    sum += proximityLevel(tracker);
+  }
+  sink = sum;
+}
+
+static void benchRecorderSample(uint32_t iterations)
+{
+  for (uint32_t i = 0; i < iterations; i++)
+    recorderSample(i * 11, readings[i & (BENCH_READINGS - 1)], detector.base, i & 255);
+}
+
+static void benchStatsSample(uint32_t iterations)
+{
+  for (uint32_t i = 0; i < iterations; i++)
+    statsSample(i * 11, detector.base, false, false, false, i & 1);
+}
+
+// All of loop(), with the simulated hardware.
+static size_t benchReading = 0;
+
+static int benchSource(uint64_t nowUs, void *context)
+{
+  return readings[benchReading++ & (BENCH_READINGS - 1)];
+}
+
+static void benchLoop(uint32_t iterations)
+{
+  simRunFor((uint64_t)iterations * 10, nullptr, nullptr); // 10ms per loop.
+}
+
+static void benchModelStep(uint32_t iterations)
+{
+  static PipelineModel model(pipelineDefaults());
+  static uint64_t t = 0;
+  int sum = 0;
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    t += 11000;
+    sum += model.step(t, readings[i & (BENCH_READINGS - 1)]).pwm;
+  }
+  sink = sum;
+}
+
+static const Benchmark BENCHMARKS[] = {
+    {"baseAvg", 1 << 21, benchBaseAvg},
+    {"addMeasurement", 1 << 21, benchAddMeasurement},
+    {"detectSample", 1 << 21, benchDetectSample},
+    {"detection", 1 << 21, benchDetection},
+    {"latency", 1 << 21, benchLatency},
+    {"lightAtNear", 1 << 21, benchLightAtNear},
+    {"lightAtStep", 1 << 21, benchLightAtStep},
+    {"distance", 1 << 21, benchDistance},
+    {"tapLock", 1 << 21, benchTapLock},
+    {"gesture", 1 << 21, benchGesture},
+    {"waterFilm", 1 << 21, benchWaterFilm},
+    {"sensorHealth", 1 << 21, benchSensorHealth},
+    {"proximity", 1 << 21, benchProximity},
+    {"recorderSample", 1 << 21, benchRecorderSample},
+    {"statsSample", 1 << 21, benchStatsSample},
+    {"loop", 1 << 18, benchLoop},
+    {"model_step", 1 << 21, benchModelStep},
+};
+
+struct Result
+{
+  const char *name;
+  uint32_t iterations;
+  int runs;
+  double min, median, mean, stddev; // Nanoseconds per call.
+};
+
+static Result measure(const Benchmark &benchmark, double scale, int warmup, int runs)
+{
+  uint32_t iterations = (uint32_t)std::max(1.0, benchmark.iterations * scale);
+  std::vector<double> times;
+  for (int run = 0; run < warmup + runs; run++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    benchmark.run(iterations);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (run >= warmup)
+      times.push_back(ns / iterations);
+  }
+
+  std::sort(times.begin(), times.end());
+  Result result = {benchmark.name, iterations, runs, times[0], times[times.size() / 2], 0, 0};
+  for (double t : times)
+    result.mean += t / times.size();
+  for (double t : times)
+    result.stddev += (t - result.mean) * (t - result.mean) / times.size();
+  result.stddev = sqrt(result.stddev);
+  return result;
+}
+
+// Pull the median for `name` out of a file written by --json.
+static bool oldMedian(const char *path, const char *name, double &median)
+{
+  FILE *in = fopen(path, "r");
+  if (in == nullptr)
+    return false;
+  char line[512], key[128];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), in))
+  {
+    const char *at = strstr(line, "\"ns_median\": ");
+    if (strstr(line, key) != nullptr && at != nullptr)
+    {
+      median = atof(at + 13);
+      found = true;
+    }
+  }
+  fclose(in);
+  return found;
+}
+
+int main(int argc, char **argv)
+{
+  const char *filter = nullptr;
+  const char *jsonPath = nullptr;
+  const char *comparePath = nullptr;
+  int runs = 15;
+  int warmup = 3;
+  double scale = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--filter") == 0)
+      filter = value, i++;
+    else if (strcmp(arg, "--json") == 0)
+      jsonPath = value, i++;
+    else if (strcmp(arg, "--compare") == 0)
+      comparePath = value, i++;
+    else if (strcmp(arg, "--runs") == 0)
+      runs = std::max(1, atoi(value)), i++;
+    else if (strcmp(arg, "--warmup") == 0)
+      warmup = atoi(value), i++;
+    else if (strcmp(arg, "--scale") == 0)
+      scale = atof(value), i++;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  // The same readings every time: a quiet sensor with a few fingers.
+  SignalConfig config;
+  config.fingersPerHour = 60;
+  SignalGenerator generator(config, 1);
+  for (int i = 0; i < BENCH_READINGS; i++)
+    readings.push_back(generator.next().raw);
+
+  SimOptions options;
+  options.source = benchSource;
+  simBoot(options);
+  debugging = false; // As on a box nobody is watching.
+
+  std::vector<Result> results;
+  printf("%-16s %10s %10s %10s %10s %8s\n", "benchmark", "min ns", "median ns", "mean ns", "stddev", "change");
+  for (const Benchmark &benchmark : BENCHMARKS)
+  {
+    if (filter != nullptr && strstr(benchmark.name, filter) == nullptr)
+      continue;
+    Result result = measure(benchmark, scale, warmup, runs);
+    results.push_back(result);
+    printf("%-16s %10.2f %10.2f %10.2f %10.2f", result.name, result.min, result.median, result.mean, result.stddev);
+    double old;
+    if (comparePath != nullptr && oldMedian(comparePath, result.name, old) && old > 0)
+      printf(" %+7.1f%%", (result.median - old) / old * 100);
+    printf("\n");
+  }
+
+  if (jsonPath != nullptr)
+  {
+    FILE *out = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+    if (out == nullptr)
+    {
+      perror(jsonPath);
+      return 1;
+    }
+    fprintf(out, "{\n  \"unit\": \"ns_per_call\",\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const Result &r = results[i];
+      fprintf(out,
+              "    {\"name\": \"%s\", \"iterations\": %u, \"runs\": %d, \"ns_min\": %.3f, \"ns_median\": %.3f, "
+              "\"ns_mean\": %.3f, \"ns_stddev\": %.3f}%s\n",
+              r.name, r.iterations, r.runs, r.min, r.median, r.mean, r.stddev, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+      fclose(out);
+  }
+  return 0;
+}
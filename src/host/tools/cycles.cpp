@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "host/m0_emu.h"
+#include "host/signal_gen.h"
+#include "params.h"
+
+// Instruction and cycle counts for the firmware's per-reading functions,
+// as the board's Cortex-M0+ would run them.
+//
+//   pio run -e seeed_xiao
+//   .pio/build/cycles/program [.pio/build/seeed_xiao/firmware.elf]
+//       [--filter name] [--calls 4096] [--json results.json]
+//       [--compare old.json]
+//
+// bench times the same functions compiled for this computer, which has a
+// divider, plenty of registers and a cache; the M0+ has none of those, so
+// something that is free here (a % or a / by a constant) can be the most
+// expensive thing on the board.  This runs the real firmware.elf - the
+// compiler's actual output, with libgcc's division routines - on an
+// emulated M0+ (see src/host/m0_emu.h) and counts exactly.
+//
+// Each function is called on readings from a synthetic trace and the
+// table shows instructions and cycles per call (smallest, mean, biggest -
+// they differ where the code branches), microseconds at 48MHz, the
+// deepest the stack went, and how many peripheral registers were touched
+// (those calls are talking to hardware, which isn't emulated, so treat
+// their counts as a lower bound).  --json and --compare work as in bench,
+// on the mean cycles, and the counts never vary from run to run, so any
+// change at all is real.
+
+#define CYCLES_CLOCK_MHZ 48
+#define CYCLES_DEFAULT_ELF ".pio/build/seeed_xiao/firmware.elf"
+#define CYCLES_START_BASE 725 // What setup() starts the baseline at.
+
+struct Kernel
+{
+  const char *name; // The function, as find() looks it up.
+  uint32_t calls;   // Per run, before --calls scales it.
+  std::vector<uint32_t> (*args)(uint32_t i, int raw);
+};
+
+static const Kernel KERNELS[] = {
+    {"baseAvg", 4096, [](uint32_t i, int raw) { return std::vector<uint32_t>{(uint32_t)raw}; }},
+    {"addMeasurement", 4096, [](uint32_t i, int raw) { return std::vector<uint32_t>{(uint32_t)raw}; }},
+    {"lightAtNear", 4096, [](uint32_t i, int raw) { return std::vector<uint32_t>{(uint32_t)raw}; }},
+    {"lightAtStep", 4096, [](uint32_t i, int raw) { return std::vector<uint32_t>{0}; }},
+    {"latencySample", 4096,
+     [](uint32_t i, int raw) {
+       uint32_t touched = raw >= CYCLES_START_BASE + SPREAD;
+       uint32_t near = !touched && raw > CYCLES_START_BASE + MIN_OVER_THRESHOLD;
+       return std::vector<uint32_t>{i * 11000, near, touched};
+     }},
+    {"recorderSample", 4096,
+     [](uint32_t i, int raw) { return std::vector<uint32_t>{i * 11, (uint32_t)raw, CYCLES_START_BASE, i & 255}; }},
+    {"statsSample", 4096,
+     [](uint32_t i, int raw) { return std::vector<uint32_t>{i * 11, CYCLES_START_BASE, 0, 0, 0, i & 1}; }},
+    {"distanceMm", 4096, [](uint32_t i, int raw) { return std::vector<uint32_t>{(uint32_t)(raw - CYCLES_START_BASE)}; }},
+    {"distanceSample", 4096,
+     [](uint32_t i, int raw) { return std::vector<uint32_t>{(uint32_t)(raw - CYCLES_START_BASE), 0}; }},
+    // A touch every half second: taps, holds, knocks ending.
+    {"tapLockSample", 4096, [](uint32_t i, int raw) { return std::vector<uint32_t>{i * 11, (i % 50) < (i % 7 + 2)}; }},
+    {"sensorHealthSample", 4096,
+     [](uint32_t i, int raw) { return std::vector<uint32_t>{i * 11, (uint32_t)raw, CYCLES_START_BASE}; }},
+    {"resetBaseline", 16, [](uint32_t i, int raw) { return std::vector<uint32_t>{CYCLES_START_BASE}; }},
+};
+
+struct Result
+{
+  const char *name;
+  uint32_t calls;
+  uint64_t minInstructions, maxInstructions;
+  double meanInstructions;
+  uint64_t minCycles, maxCycles;
+  double meanCycles;
+  uint32_t stack;
+  double peripherals;
+};
+
+// Run one function from a freshly started firmware: RAM as it is after
+// the startup code, the baseline and the distance curve filled in as
+// setup() fills them, and nobody watching the serial port.
+static bool measure(M0Emulator &emu, const Kernel &kernel, uint32_t calls, const std::vector<int> &readings,
+                    Result &result)
+{
+  M0Symbol function, symbol;
+  emu.find(kernel.name, function);
+  emu.reset();
+  if (emu.find("debugging", symbol))
+    emu.write(symbol.address, 1, 0);
+  if (emu.find("resetBaseline", symbol))
+    emu.call(symbol.address, {CYCLES_START_BASE});
+  if (emu.find("distanceDefaults", symbol))
+    emu.call(symbol.address);
+
+  result = {kernel.name, calls, UINT64_MAX, 0, 0, UINT64_MAX, 0, 0, 0, 0};
+  for (uint32_t i = 0; i < calls; i++)
+  {
+    emu.call(function.address, kernel.args(i, readings[i % readings.size()]));
+    if (emu.failed())
+    {
+      printf("%-16s stopped on call %u: %s\n", kernel.name, i, emu.error.c_str());
+      return false;
+    }
+    const M0Count &count = emu.count;
+    result.minInstructions = std::min(result.minInstructions, count.instructions);
+    result.maxInstructions = std::max(result.maxInstructions, count.instructions);
+    result.meanInstructions += (double)count.instructions / calls;
+    result.minCycles = std::min(result.minCycles, count.cycles);
+    result.maxCycles = std::max(result.maxCycles, count.cycles);
+    result.meanCycles += (double)count.cycles / calls;
+    result.stack = std::max(result.stack, count.stack);
+    result.peripherals += (double)count.peripherals / calls;
+  }
+  return true;
+}
+
+// Pull the mean cycles for `name` out of a file written by --json.
+static bool oldCycles(const char *path, const char *name, double &cycles)
+{
+  FILE *in = fopen(path, "r");
+  if (in == nullptr)
+    return false;
+  char line[512], key[128];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), in))
+  {
+    const char *at = strstr(line, "\"cycles_mean\": ");
+    if (strstr(line, key) != nullptr && at != nullptr)
+    {
+      cycles = atof(at + 15);
+      found = true;
+    }
+  }
+  fclose(in);
+  return found;
+}
+
+int main(int argc, char **argv)
+{
+  const char *elfPath = CYCLES_DEFAULT_ELF;
+  const char *filter = nullptr;
+  const char *jsonPath = nullptr;
+  const char *comparePath = nullptr;
+  double scale = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--filter") == 0)
+      filter = value, i++;
+    else if (strcmp(arg, "--json") == 0)
+      jsonPath = value, i++;
+    else if (strcmp(arg, "--compare") == 0)
+      comparePath = value, i++;
+    else if (strcmp(arg, "--calls") == 0)
+      scale = atof(value) / KERNELS[0].calls, i++;
+    else if (arg[0] != '-')
+      elfPath = arg;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  M0Emulator emu;
+  if (!emu.load(elfPath))
+  {
+    fprintf(stderr, "%s (build it with: pio run -e seeed_xiao)\n", emu.error.c_str());
+    return 1;
+  }
+
+  // The same readings as bench: a quiet sensor with a few fingers.
+  SignalConfig config;
+  config.fingersPerHour = 60;
+  SignalGenerator generator(config, 1);
+  std::vector<int> readings;
+  for (int i = 0; i < 65536; i++)
+    readings.push_back(generator.next().raw);
+
+  std::vector<Result> results;
+  printf("%-16s %6s %8s %6s %6s %8s %6s %6s %8s %6s %7s %8s\n", "function", "calls", "instr", "min", "max", "cycles",
+         "min", "max", "us", "stack", "periph", "change");
+  bool ok = true;
+  for (const Kernel &kernel : KERNELS)
+  {
+    if (filter != nullptr && strstr(kernel.name, filter) == nullptr)
+      continue;
+    M0Symbol symbol;
+    if (!emu.find(kernel.name, symbol))
+    {
+      printf("%-16s not in the firmware (inlined, or renamed?)\n", kernel.name);
+      continue;
+    }
+    Result r;
+    if (!measure(emu, kernel, std::max<uint32_t>(1, (uint32_t)(kernel.calls * scale)), readings, r))
+    {
+      ok = false;
+      continue;
+    }
+    results.push_back(r);
+    printf("%-16s %6u %8.1f %6llu %6llu %8.1f %6llu %6llu %8.2f %6u %7.1f", r.name, r.calls, r.meanInstructions,
+           (unsigned long long)r.minInstructions, (unsigned long long)r.maxInstructions, r.meanCycles,
+           (unsigned long long)r.minCycles, (unsigned long long)r.maxCycles, r.meanCycles / CYCLES_CLOCK_MHZ, r.stack,
+           r.peripherals);
+    double old;
+    if (comparePath != nullptr && oldCycles(comparePath, r.name, old) && old > 0)
+      printf(" %+7.1f%%", (r.meanCycles - old) / old * 100);
+    printf("\n");
+  }
+
+  if (jsonPath != nullptr)
+  {
+    FILE *out = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+    if (out == nullptr)
+    {
+      perror(jsonPath);
+      return 1;
+    }
+    fprintf(out, "{\n  \"unit\": \"cortex_m0plus_cycles_per_call\",\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const Result &r = results[i];
+      fprintf(out,
+              "    {\"name\": \"%s\", \"calls\": %u, \"instructions_mean\": %.2f, \"cycles_min\": %llu, "
+              "\"cycles_mean\": %.2f, \"cycles_max\": %llu, \"stack_max\": %u, \"peripherals_mean\": %.2f}%s\n",
+              r.name, r.calls, r.meanInstructions, (unsigned long long)r.minCycles, r.meanCycles,
+              (unsigned long long)r.maxCycles, r.stack, r.peripherals, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+      fclose(out);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "host/corpus.h"
+#include "host/fixedpoint.h"
+#include "host/pipeline_model.h"
+
+// Prints how far the firmware's fixed point filters stray from the maths
+// (see src/host/fixedpoint.h for what is compared and the budgets).
+//
+//   .pio/build/fixedpoint/program [traces...] [--hours 6] [--seed 1]
+//
+// With no traces it makes its own quiet, noisy, drifting and spiky rooms,
+// as quality does.  The firmware runs as PipelineModel, after checking
+// the two agree on every reading of the first trace.  It exits nonzero
+// if anything is over budget; test_fixedpoint runs the same comparison
+// under `pio test -e native`.
+
+int main(int argc, char **argv)
+{
+  double hours = 6;
+  uint64_t seed = 1;
+  std::vector<const char *> paths;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--hours") == 0)
+      hours = atof(value), i++;
+    else if (strcmp(arg, "--seed") == 0)
+      seed = strtoull(value, nullptr, 10), i++;
+    else if (arg[0] != '-')
+      paths.push_back(arg);
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  Corpus corpus;
+  for (const char *path : paths)
+  {
+    if (!corpusLoad(path, corpus))
+    {
+      fprintf(stderr, "%s: can't read it, or it has no labels\n", path);
+      return 1;
+    }
+  }
+  if (paths.empty())
+    fixedpointRooms(hours, seed, corpus);
+
+  long mismatch = pipelineVerify(corpus[0].readings);
+  if (mismatch >= 0)
+  {
+    fprintf(stderr, "the model and the firmware disagree at reading %ld of the first trace\n", mismatch);
+    return 1;
+  }
+
+  FixedpointReport report = fixedpointCompare(corpus);
+
+  printf("%-10s %10s %9s %8s %9s %8s  %-22s %s\n", "stage", "readings", "max_err", "budget", "rms_err", "budget",
+         "worst at", "result");
+  for (const FixedpointStage &stage : report.stages)
+  {
+    char at[64] = "-";
+    if (stage.worst > 0)
+      snprintf(at, sizeof(at), "%s %.2fs", stage.worstTrace, stage.worstS);
+    printf("%-10s %10lu %9.3f %8.3f %9.3f %8.3f  %-22s %s\n", stage.name, stage.readings, stage.worst,
+           stage.maxBudget, stage.rms(), stage.rmsBudget, at, stage.passed() ? "pass" : "FAIL");
+  }
+  printf("\n%-10s %10s %9s %9s %8s %9s  %-22s %s\n", "decision", "flips", "fixed", "readings", "per_hr", "budget",
+         "first at", "result");
+  for (const FixedpointDecision &decision : report.decisions)
+  {
+    char at[64] = "-";
+    if (decision.flips > 0)
+      snprintf(at, sizeof(at), "%s %.2fs", decision.firstTrace, decision.firstS);
+    printf("%-10s %10lu %9lu %9lu %8.2f %9.2f  %-22s %s\n", decision.name, decision.flips, decision.fixedOnly,
+           decision.readings, report.perHour(decision), decision.budget, at, report.passed(decision) ? "pass" : "FAIL");
+  }
+  bool ok = report.passed();
+  printf("%s over %.1f hours of readings\n", ok ? "within budget" : "OVER BUDGET", report.hours);
+  return ok ? 0 : 1;
+}
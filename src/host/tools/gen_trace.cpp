@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host/signal_gen.h"
+#include "host/trace.h"
+
+// Write a synthetic sensor trace with its ground truth (see trace.h and
+// signal_gen.h).
+//
+//   .pio/build/gen_trace/program [--hours 1] [--seed 1] [--rate 90]
+//       [--drift counts-per-day] [--thermal counts] [--humidity counts]
+//       [--noise counts] [--pink counts] [--hum counts] [--mains 60]
+//       [--spikes per-hour] [--fingers per-hour] [--touch-chance 0.5]
+//       [--out trace.csv]
+//
+// The trace goes to standard output unless --out is given.
+
+static bool option(const char *arg, const char *name, const char *value, double &target, int &i)
+{
+  if (strcmp(arg, name) != 0)
+    return false;
+  target = atof(value);
+  i++;
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  double hours = 1;
+  uint64_t seed = 1;
+  const char *path = nullptr;
+  SignalConfig config;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--seed") == 0)
+      seed = strtoull(value, nullptr, 0), i++;
+    else if (strcmp(arg, "--out") == 0)
+      path = value, i++;
+    else if (!(option(arg, "--hours", value, hours, i) || option(arg, "--rate", value, config.sampleRateHz, i) ||
+               option(arg, "--drift", value, config.driftPerDay, i) ||
+               option(arg, "--thermal", value, config.thermalCounts, i) ||
+               option(arg, "--humidity", value, config.humidityCounts, i) ||
+               option(arg, "--noise", value, config.whiteNoise, i) ||
+               option(arg, "--pink", value, config.pinkNoise, i) || option(arg, "--hum", value, config.humCounts, i) ||
+               option(arg, "--mains", value, config.mainsHz, i) ||
+               option(arg, "--spikes", value, config.spikesPerHour, i) ||
+               option(arg, "--fingers", value, config.fingersPerHour, i) ||
+               option(arg, "--touch-chance", value, config.touchChance, i)))
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  FILE *out = path ? fopen(path, "w") : stdout;
+  if (!out)
+  {
+    perror(path);
+    return 1;
+  }
+
+  fprintf(out, "# synthetic trace, seed %llu, %.2f hours at %.1f Hz\n", (unsigned long long)seed, hours,
+          config.sampleRateHz);
+  traceWriteHeader(out);
+
+  SignalGenerator generator(config, seed);
+  size_t eventsWritten = 0;
+  uint64_t endUs = (uint64_t)(hours * 3600e6);
+  for (;;)
+  {
+    SignalSample sample = generator.next();
+    if (sample.tUs >= endUs)
+      break;
+    // Events are written as soon as they are planned, which is before
+    // their first reading.
+    while (eventsWritten < generator.events.size())
+      traceWriteEvent(out, generator.events[eventsWritten++]);
+    traceWriteSample(out, sample);
+  }
+
+  int touches = 0;
+  for (const SignalEvent &event : generator.events)
+    touches += event.kind == SIGNAL_FINGER && event.touchStartUs != 0 && event.startUs < endUs;
+  fprintf(stderr, "%zu events, %d touches\n", generator.events.size(), touches);
+
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
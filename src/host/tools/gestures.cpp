@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "gesture.h"
+#include "host/sim_random.h"
+#include "params.h"
+
+// Does the gesture classifier (include/gesture.h) hear what was meant?
+// Plays a corpus of touches, each labelled with the gestures it should
+// give, through gestureSample() at the default timings:
+//
+//   .pio/build/gestures/program [--runs 200] [--seed 1]
+//
+// Every case is played --runs times, a little differently each time, the
+// way real fingers and a real loop would do it:
+//
+//  - each touch starts and ends up to GESTURES_JITTER_MS early or late;
+//  - the loop takes 10 to 16ms a pass, starting anywhere in the first one;
+//  - some touches drop out for a reading or two partway through, as the
+//    touched signal does when a finger sits right on the threshold.
+//
+// The cases are written well inside the timing windows, with gaps
+// between touches still well over GESTURE_RELEASE_MS after the jitter,
+// so every run should come out exactly as labelled.  It prints how often
+// each case did, what the wrong ones said instead, and a confusion table
+// of the gestures lined up one for one.  Anything wrong makes it exit 1,
+// so `pio run -e gestures -t exec` fails when a change to the classifier
+// or its defaults breaks one.
+
+#define GESTURES_JITTER_MS 30
+#define GESTURES_BOUNCE_CHANCE 0.3 // Of a touch dropping out once.
+#define GESTURES_MIN_LOOP_MS 10
+#define GESTURES_MAX_LOOP_MS 16
+#define GESTURES_QUIET_MS 3000 // Played after the last touch, for late taps.
+#define GESTURES_EXAMPLES 3    // Wrong answers printed per case.
+
+struct Touch
+{
+  int downMs, upMs;
+};
+
+struct Case
+{
+  const char *name;
+  std::vector<Touch> touches;
+  std::vector<Gesture> expected;
+};
+
+static std::vector<Case> corpus()
+{
+  const Gesture T = GESTURE_TAP, D = GESTURE_DOUBLE_TAP, L = GESTURE_LONG_PRESS, H = GESTURE_HOLD;
+  return {
+      {"tap", {{0, 120}}, {T}},
+      {"quick tap", {{0, 50}}, {T}},
+      {"slow tap", {{0, 190}}, {T}},
+      {"double tap", {{0, 100}, {250, 350}}, {D}},
+      {"lazy double tap", {{0, 150}, {360, 500}}, {D}},
+      {"two taps", {{0, 100}, {500, 600}}, {T, T}},
+      {"triple tap", {{0, 90}, {240, 330}, {480, 570}}, {D, T}},
+      {"two double taps", {{0, 90}, {240, 330}, {1000, 1090}, {1240, 1330}}, {D, D}},
+      {"long press", {{0, 1200}}, {L}},
+      {"long press, just", {{0, 900}}, {L}},
+      {"hold", {{0, 3000}}, {H}},
+      {"very long hold", {{0, 20000}}, {H}},
+      {"in between", {{0, 500}}, {}},
+      {"tap, long press", {{0, 100}, {250, 1400}}, {T, L}},
+      {"tap, hold", {{0, 100}, {250, 3000}}, {T, H}},
+      {"long press, tap", {{0, 1200}, {1400, 1500}}, {L, T}},
+      {"hold, double tap", {{0, 2500}, {3000, 3100}, {3250, 3350}}, {H, D}},
+  };
+}
+
+// How a case actually gets played: one run's touches, in milliseconds,
+// with any drop outs split off as touches of their own.
+static std::vector<Touch> perform(const Case &c, SimRandom &random)
+{
+  std::vector<Touch> played;
+  for (const Touch &touch : c.touches)
+  {
+    // Short touches can't move as far - a 50ms tap stays a tap.
+    int length = touch.upMs - touch.downMs;
+    int jitter = length / 3 < GESTURES_JITTER_MS ? length / 3 : GESTURES_JITTER_MS;
+    int down = touch.downMs + (int)random.uniform(-jitter, jitter);
+    int up = touch.upMs + (int)random.uniform(-jitter, jitter);
+    if (up - down > 80 && random.uniform() < GESTURES_BOUNCE_CHANCE)
+    {
+      int at = down + (int)random.uniform(20, up - down - 40);
+      int gap = (int)random.uniform(5, GESTURE_RELEASE_MS - 15);
+      played.push_back({down, at});
+      played.push_back({at + gap, up});
+    }
+    else
+      played.push_back({down, up});
+  }
+  return played;
+}
+
+static std::vector<Gesture> classify(const std::vector<Touch> &touches, SimRandom &random)
+{
+  GestureChannel channel;
+  gestureReset(channel);
+  GestureTiming timing = gestureTiming();
+  int loopMs = (int)random.uniform(GESTURES_MIN_LOOP_MS, GESTURES_MAX_LOOP_MS + 1);
+  int end = touches.back().upMs + GESTURES_QUIET_MS;
+  // Start well away from 0, so nothing is fooled by a clock that has only
+  // just started, and anywhere within one pass of the loop.
+  uint32_t origin = 100000 + (uint32_t)random.uniform(0, loopMs);
+
+  std::vector<Gesture> heard;
+  size_t next = 0;
+  for (int t = -loopMs; t < end; t += loopMs)
+  {
+    while (next < touches.size() && touches[next].upMs <= t)
+      next++;
+    bool touched = next < touches.size() && touches[next].downMs <= t;
+    Gesture g = gestureSample(channel, timing, origin + t, touched);
+    if (g != GESTURE_NONE)
+      heard.push_back(g);
+  }
+  return heard;
+}
+
+static std::string spell(const std::vector<Gesture> &gestures)
+{
+  if (gestures.empty())
+    return "nothing";
+  std::string text;
+  for (Gesture g : gestures)
+    text += (text.empty() ? "" : ", ") + std::string(gestureName(g));
+  return text;
+}
+
+int main(int argc, char **argv)
+{
+  int runs = 200;
+  uint64_t seed = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--runs") == 0)
+      runs = atoi(value), i++;
+    else if (strcmp(arg, "--seed") == 0)
+      seed = strtoull(value, nullptr, 0), i++;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  GestureTiming timing = gestureTiming();
+  printf("Timings: tap up to %ums, double tap gap %ums, long press from %ums, hold from %ums\n\n",
+         (unsigned)timing.tapMaxMs, (unsigned)timing.doubleGapMs, (unsigned)timing.longPressMs,
+         (unsigned)timing.holdMs);
+
+  // confusion[expected][heard], for runs that said the right number of
+  // gestures.
+  int confusion[GESTURE_HOLD + 1][GESTURE_HOLD + 1] = {};
+  int wrongCount = 0;
+  int totalWrong = 0;
+  SimRandom random(seed);
+
+  printf("%-20s %6s %6s\n", "case", "runs", "right");
+  for (const Case &c : corpus())
+  {
+    int right = 0;
+    std::vector<std::string> wrong;
+    for (int run = 0; run < runs; run++)
+    {
+      std::vector<Gesture> heard = classify(perform(c, random), random);
+      if (heard == c.expected)
+        right++;
+      else if ((int)wrong.size() < GESTURES_EXAMPLES)
+        wrong.push_back(spell(heard));
+      if (heard.size() == c.expected.size())
+      {
+        for (size_t i = 0; i < heard.size(); i++)
+          confusion[c.expected[i]][heard[i]]++;
+      }
+      else
+        wrongCount++;
+    }
+    totalWrong += runs - right;
+    printf("%-20s %6d %6d", c.name, runs, right);
+    if (right < runs)
+      printf("   wanted %s, heard %s", spell(c.expected).c_str(), wrong[0].c_str());
+    printf("\n");
+    for (size_t i = 1; i < wrong.size(); i++)
+      printf("%-20s %13s   heard %s\n", "", "", wrong[i].c_str());
+  }
+
+  printf("\nWanted \\ heard");
+  for (int h = GESTURE_TAP; h <= GESTURE_HOLD; h++)
+    printf(" %11s", gestureName((Gesture)h));
+  printf("\n");
+  for (int e = GESTURE_TAP; e <= GESTURE_HOLD; e++)
+  {
+    printf("%-14s", gestureName((Gesture)e));
+    for (int h = GESTURE_TAP; h <= GESTURE_HOLD; h++)
+      printf(" %11d", confusion[e][h]);
+    printf("\n");
+  }
+  printf("Runs with too many or too few gestures: %d\n", wrongCount);
+
+  if (totalWrong > 0)
+  {
+    printf("\nFAIL: %d runs heard wrong\n", totalWrong);
+    return 1;
+  }
+  printf("\nAll runs heard right\n");
+  return 0;
+}
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "detect.h"
+#include "host/corpus.h"
+#include "host/score.h"
+#include "host/sim.h"
+#include "params.h"
+
+// How good is the detection?  Runs the real firmware over a corpus of
+// traces where we know what the finger was doing, and scores it:
+//
+//  - touches: the share of real touches found, and false touches per hour
+//    (see score.h for exactly what counts).
+//  - latency: median and 95th percentile, from when the finger could
+//    first be seen over the true baseline to the touch (see score.h).
+//  - near: for a range of offsets over the baseline, the share of finger
+//    visits that showed up as "near" against false near onsets per hour -
+//    a ROC curve for the near threshold.  Each offset is debounced just
+//    as the firmware's own min_over is (detectNearDebounce()), so that
+//    point on the curve is what the firmware does.
+//  - baseline: how far the baseline strays from the true untouched level.
+//
+//   .pio/build/quality/program [traces...] [--hours 6] [--json q.json]
+//       [--compare old.json]
+//
+// With no traces it makes its own: quiet, noisy, drifting and spiky
+// rooms.  Trace files must carry ground truth (label and baseline
+// columns, see trace.h).  To see whether a change helped, save --json
+// before it and run again with --compare; every number is shown with how
+// it moved and whether that is better or worse.
+//
+// The firmware keeps its state in globals, so each trace runs in a
+// process of its own, all at once.
+
+extern DetectState detector;
+extern DetectReading detect_reading;
+
+#define QUALITY_NEAR_OFFSETS 10
+static const int NEAR_OFFSETS[QUALITY_NEAR_OFFSETS] = {1, 2, 3, 4, 5, 6, 8, 10, 15, 20};
+
+// What one trace's process sends back.  Followed by `latencies` int32s.
+struct TraceQuality
+{
+  double hours;
+  unsigned long touches, missed, falseTouches, falseGlows;
+  unsigned long visits;
+  unsigned long visitsNear[QUALITY_NEAR_OFFSETS];
+  unsigned long falseNear[QUALITY_NEAR_OFFSETS];
+  double baseAbs, baseSquares, baseWorst;
+  unsigned long baseReadings;
+  unsigned long latencies;
+};
+
+struct TraceSpec
+{
+  const char *name;
+  const char *path; // nullptr for synthetic.
+  SignalConfig config;
+  uint64_t seed;
+};
+
+static int qualityReading = HAL_SIM_IDLE_READING;
+
+static int qualitySource(uint64_t nowUs, void *context)
+{
+  return qualityReading;
+}
+
+static void runTrace(const TraceSpec &spec, double hours, TraceQuality &quality, std::vector<int32_t> &latencies)
+{
+  Corpus corpus;
+  if (spec.path != nullptr)
+  {
+    if (!corpusLoad(spec.path, corpus))
+    {
+      fprintf(stderr, "%s: can't read it, or it has no ground truth\n", spec.path);
+      exit(1);
+    }
+  }
+  else
+    corpusSynthetic(1, hours, spec.seed, spec.config, corpus);
+  const CorpusTrace &trace = corpus[0];
+
+  std::vector<SignalEvent> fingers;
+  for (const SignalEvent &event : trace.events)
+    if (event.kind == SIGNAL_FINGER)
+      fingers.push_back(event);
+  std::sort(fingers.begin(), fingers.end(),
+            [](const SignalEvent &a, const SignalEvent &b) { return a.startUs < b.startUs; });
+  std::vector<uint16_t> found(fingers.size(), 0); // One bit per offset.
+
+  SimOptions options;
+  options.source = qualitySource;
+  simBoot(options);
+  Scorer scorer(trace.events, trace.readings, trace.baseline);
+  memset(&quality, 0, sizeof(quality));
+
+  bool near[QUALITY_NEAR_OFFSETS] = {};
+  int nearRun[QUALITY_NEAR_OFFSETS] = {};
+  bool wasNear[QUALITY_NEAR_OFFSETS] = {};
+  size_t visit = 0;
+  for (size_t i = 0; i < trace.readings.size(); i++)
+  {
+    uint64_t t = trace.readings[i].tUs;
+    int raw = trace.readings[i].raw;
+    qualityReading = raw;
+    simLoopAt(t);
+    const DetectReading &reading = detect_reading;
+
+    PipelineOutput out = {};
+    out.tUs = t;
+    out.registered = reading.registered;
+    out.glowStart = reading.glowStart;
+    scorer.add(out);
+
+    if (t < SCORE_SETTLE_US)
+      continue;
+
+    double error = detector.base - trace.baseline[i];
+    if (!isnan(error))
+    {
+      quality.baseAbs += fabs(error);
+      quality.baseSquares += error * error;
+      quality.baseWorst = std::max(quality.baseWorst, fabs(error));
+      quality.baseReadings++;
+    }
+
+    while (visit < fingers.size() && fingers[visit].endUs + SCORE_GLOW_AFTER_US < t)
+      visit++;
+    bool inVisit = visit < fingers.size() && t >= fingers[visit].startUs && t <= fingers[visit].endUs;
+    bool nearVisit = visit < fingers.size() && t >= fingers[visit].startUs;
+    for (int m = 0; m < QUALITY_NEAR_OFFSETS; m++)
+    {
+      bool over = !reading.ignored && raw > detector.base + NEAR_OFFSETS[m];
+      bool isNear = detectNearDebounce(near[m], nearRun[m], over, reading.touched);
+      if (isNear && inVisit)
+        found[visit] |= 1 << m;
+      if (isNear && !wasNear[m] && !nearVisit)
+        quality.falseNear[m]++;
+      wasNear[m] = near[m];
+    }
+  }
+
+  Score score = scorer.finish(trace.endUs);
+  quality.hours = (trace.endUs - trace.readings[0].tUs) / 3600e6;
+  quality.touches = score.touches;
+  quality.missed = score.missed;
+  quality.falseTouches = score.falseTouches;
+  quality.falseGlows = score.falseGlows;
+  for (size_t v = 0; v < fingers.size(); v++)
+  {
+    if (fingers[v].startUs < SCORE_SETTLE_US || fingers[v].endUs > trace.endUs)
+      continue;
+    quality.visits++;
+    for (int m = 0; m < QUALITY_NEAR_OFFSETS; m++)
+      quality.visitsNear[m] += (found[v] >> m) & 1;
+  }
+  latencies = score.latencyUs;
+  quality.latencies = latencies.size();
+}
+
+// ---- Comparing with an earlier run ----
+
+struct Metric
+{
+  const char *name;
+  double value;
+  bool higherIsBetter;
+};
+
+static bool oldMetric(const char *path, const char *name, double &value)
+{
+  FILE *in = fopen(path, "r");
+  if (in == nullptr)
+    return false;
+  char line[256], key[96];
+  snprintf(key, sizeof(key), "\"%s\": ", name);
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), in))
+  {
+    const char *at = strstr(line, key);
+    if (at != nullptr)
+    {
+      value = atof(at + strlen(key));
+      found = true;
+    }
+  }
+  fclose(in);
+  return found;
+}
+
+static double percentile(std::vector<int32_t> &values, double fraction)
+{
+  if (values.empty())
+    return 0;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1) + 0.5)] / 1000.0;
+}
+
+static bool readAll(int fd, void *data, size_t length)
+{
+  char *at = (char *)data;
+  while (length > 0)
+  {
+    ssize_t got = read(fd, at, length);
+    if (got <= 0)
+      return false;
+    at += got;
+    length -= got;
+  }
+  return true;
+}
+
+static void writeAll(int fd, const void *data, size_t length)
+{
+  const char *at = (const char *)data;
+  while (length > 0)
+  {
+    ssize_t put = write(fd, at, length);
+    if (put <= 0)
+      _exit(1);
+    at += put;
+    length -= put;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  double hours = 6;
+  const char *jsonPath = nullptr;
+  const char *comparePath = nullptr;
+  std::vector<TraceSpec> specs;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--hours") == 0)
+      hours = atof(value), i++;
+    else if (strcmp(arg, "--json") == 0)
+      jsonPath = value, i++;
+    else if (strcmp(arg, "--compare") == 0)
+      comparePath = value, i++;
+    else if (arg[0] != '-')
+      specs.push_back({arg, arg, SignalConfig(), 0});
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (specs.empty())
+  {
+    SignalConfig quiet, noisy, drifting, spiky;
+    noisy.whiteNoise = 2.5;
+    noisy.pinkNoise = 1.5;
+    noisy.humCounts = 1.5;
+    drifting.driftPerDay = 30;
+    drifting.thermalCounts = 10;
+    drifting.humidityCounts = 8;
+    spiky.spikesPerHour = 6;
+    specs.push_back({"quiet", nullptr, quiet, 1});
+    specs.push_back({"noisy", nullptr, noisy, 2});
+    specs.push_back({"drifting", nullptr, drifting, 3});
+    specs.push_back({"spiky", nullptr, spiky, 4});
+  }
+
+  // One process per trace, all at once.
+  std::vector<int> pipes;
+  std::vector<pid_t> children;
+  for (const TraceSpec &spec : specs)
+  {
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+      perror("pipe");
+      return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(fds[0]);
+      TraceQuality quality;
+      std::vector<int32_t> latencies;
+      runTrace(spec, hours, quality, latencies);
+      writeAll(fds[1], &quality, sizeof(quality));
+      writeAll(fds[1], latencies.data(), latencies.size() * sizeof(int32_t));
+      _exit(0);
+    }
+    close(fds[1]);
+    pipes.push_back(fds[0]);
+    children.push_back(pid);
+  }
+
+  TraceQuality total = {};
+  std::vector<int32_t> allLatencies;
+  printf("%-10s %6s %7s %6s %8s %8s %8s %8s %8s %8s\n", "trace", "hours", "touches", "found", "false/h", "glows/h",
+         "lat_ms", "p95_ms", "base_mae", "base_max");
+  for (size_t i = 0; i < specs.size(); i++)
+  {
+    TraceQuality quality;
+    std::vector<int32_t> latencies;
+    bool ok = readAll(pipes[i], &quality, sizeof(quality));
+    if (ok)
+    {
+      latencies.resize(quality.latencies);
+      ok = readAll(pipes[i], latencies.data(), latencies.size() * sizeof(int32_t));
+    }
+    close(pipes[i]);
+    int status;
+    waitpid(children[i], &status, 0);
+    if (!ok)
+    {
+      fprintf(stderr, "%s: failed\n", specs[i].name);
+      return 1;
+    }
+
+    printf("%-10s %6.1f %7lu %5.1f%% %8.2f %8.2f %8.1f %8.1f %8.2f %8.1f\n", specs[i].name, quality.hours,
+           quality.touches, quality.touches ? 100.0 * (quality.touches - quality.missed) / quality.touches : 0,
+           quality.falseTouches / quality.hours, quality.falseGlows / quality.hours, percentile(latencies, 0.5),
+           percentile(latencies, 0.95), quality.baseReadings ? quality.baseAbs / quality.baseReadings : 0,
+           quality.baseWorst);
+
+    total.hours += quality.hours;
+    total.touches += quality.touches;
+    total.missed += quality.missed;
+    total.falseTouches += quality.falseTouches;
+    total.falseGlows += quality.falseGlows;
+    total.visits += quality.visits;
+    for (int m = 0; m < QUALITY_NEAR_OFFSETS; m++)
+    {
+      total.visitsNear[m] += quality.visitsNear[m];
+      total.falseNear[m] += quality.falseNear[m];
+    }
+    total.baseAbs += quality.baseAbs;
+    total.baseSquares += quality.baseSquares;
+    total.baseWorst = std::max(total.baseWorst, quality.baseWorst);
+    total.baseReadings += quality.baseReadings;
+    allLatencies.insert(allLatencies.end(), latencies.begin(), latencies.end());
+  }
+
+  printf("\nnear threshold ROC (%lu finger visits):\n%8s %10s %12s\n", total.visits, "offset", "visits", "false/h");
+  int current = -1;
+  for (int m = 0; m < QUALITY_NEAR_OFFSETS; m++)
+  {
+    if (NEAR_OFFSETS[m] == min_over_threshold)
+      current = m;
+    printf("%8d %9.1f%% %12.2f%s\n", NEAR_OFFSETS[m], total.visits ? 100.0 * total.visitsNear[m] / total.visits : 0,
+           total.falseNear[m] / total.hours, NEAR_OFFSETS[m] == min_over_threshold ? "  <- min_over" : "");
+  }
+
+  std::vector<Metric> metrics = {
+      {"touch_found_rate", total.touches ? (double)(total.touches - total.missed) / total.touches : 0, true},
+      {"false_touches_per_hour", total.falseTouches / total.hours, false},
+      {"false_glows_per_hour", total.falseGlows / total.hours, false},
+      {"latency_median_ms", percentile(allLatencies, 0.5), false},
+      {"latency_p95_ms", percentile(allLatencies, 0.95), false},
+      {"baseline_mae", total.baseReadings ? total.baseAbs / total.baseReadings : 0, false},
+      {"baseline_rms", total.baseReadings ? sqrt(total.baseSquares / total.baseReadings) : 0, false},
+      {"near_found_rate", current >= 0 && total.visits ? (double)total.visitsNear[current] / total.visits : 0, true},
+      {"near_false_per_hour", current >= 0 ? total.falseNear[current] / total.hours : 0, false},
+  };
+
+  printf("\n%-24s %10s", "overall", "value");
+  if (comparePath != nullptr)
+    printf(" %10s", "was");
+  printf("\n");
+  for (const Metric &metric : metrics)
+  {
+    printf("%-24s %10.3f", metric.name, metric.value);
+    double old;
+    if (comparePath != nullptr && oldMetric(comparePath, metric.name, old))
+    {
+      // Compare at the precision the file was written with.
+      char written[32];
+      snprintf(written, sizeof(written), "%.6f", metric.value);
+      double now = atof(written);
+      const char *verdict = "same";
+      if (now != old)
+        verdict = (now > old) == metric.higherIsBetter ? "better" : "WORSE";
+      printf(" %10.3f  %s", old, verdict);
+    }
+    printf("\n");
+  }
+
+  if (jsonPath != nullptr)
+  {
+    FILE *out = fopen(jsonPath, "w");
+    if (out == nullptr)
+    {
+      perror(jsonPath);
+      return 1;
+    }
+    fprintf(out, "{\n");
+    for (size_t i = 0; i < metrics.size(); i++)
+      fprintf(out, "  \"%s\": %.6f%s\n", metrics[i].name, metrics[i].value, i + 1 < metrics.size() ? "," : "");
+    fprintf(out, "}\n");
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,312 @@
+#include <chrono>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "host/sim.h"
+#include "host/signal_gen.h"
+#include "host/trace.h"
+#include "latency.h"
+#include "sensor_health.h"
+#include "stats.h"
+
+// Feed a trace of readings through the unchanged firmware - baseAvg(),
+// the thresholds, checkDebug(), lightAtNear() and lightAtStep() - and
+// write down what it did.
+//
+//   .pio/build/replay/program trace.csv [--pwm pwm.csv] [--events events.csv]
+//       [--compare old-events.csv] [--tolerance-ms 100] [--start-ms N]
+//   .pio/build/replay/program --synthetic hours [--seed 1] [...]
+//
+// Each reading runs loop() once, with the clock set to the reading's time
+// (see simLoopAt()).  Times in the outputs are in the trace's own time.
+//
+// --pwm writes every change of the LED as t_us,pwm.  --events writes
+// t_us,event for what the detection code decided:
+//
+//   touch, near, lonely   touch and near phases starting, and touches with
+//                         no near first (from the stats counters)
+//   lit, full, dark       the LED coming on, reaching full and going off
+//   fault                 the sensor health checks giving up on the
+//                         readings (see sensor_health.h)
+//
+// To see what a change to the filters does, replay a trace with --events
+// before the change, then again after it with --compare pointing at the
+// first file.  Events of the same kind within --tolerance-ms of each
+// other are paired up; the rest are listed.
+
+struct ReplayEvent
+{
+  uint64_t tUs;
+  const char *kind;
+};
+
+static const char *const EVENT_KINDS[] = {"touch", "near", "lonely", "lit", "full", "dark", "fault"};
+#define EVENT_KIND_COUNT (sizeof(EVENT_KINDS) / sizeof(EVENT_KINDS[0]))
+
+struct Replay
+{
+  int64_t offsetUs; // Virtual time minus trace time.
+  std::vector<ReplayEvent> events;
+  FILE *pwmOut = nullptr;
+  int pwm = 0;
+  uint64_t litUs = 0;
+  uint64_t litSince = 0;
+  unsigned long touches = 0;
+  unsigned long nears = 0;
+  unsigned long lonely = 0;
+  unsigned long faults = 0;
+};
+
+static int replayReading = HAL_SIM_IDLE_READING;
+
+static int traceSource(uint64_t nowUs, void *context)
+{
+  return replayReading;
+}
+
+static void watchLight(uint64_t nowUs, int pin, int value, void *context)
+{
+  Replay &replay = *(Replay *)context;
+  if (pin != HAL_SIM_LIGHT_PIN || value == replay.pwm)
+    return;
+  uint64_t t = nowUs - replay.offsetUs;
+  if (replay.pwmOut != nullptr)
+    fprintf(replay.pwmOut, "%" PRIu64 ",%d\n", t, value);
+  if (replay.pwm == 0)
+  {
+    replay.events.push_back({t, "lit"});
+    replay.litSince = t;
+  }
+  if (value == 255)
+    replay.events.push_back({t, "full"});
+  if (value == 0)
+  {
+    replay.events.push_back({t, "dark"});
+    replay.litUs += t - replay.litSince;
+  }
+  replay.pwm = value;
+}
+
+// The stats counters only ever go up, so any change since the last loop
+// is an edge the detection code saw on this reading.
+static void watchDetector(Replay &replay, uint64_t t)
+{
+  const StatsTotals &totals = statsTotals();
+  const StatsHour &hour = statsCurrentHour();
+  unsigned long touches = totals.touches + hour.touches;
+  unsigned long nears = totals.nears + hour.nears;
+  unsigned long lonely = totals.lonelyTouches + hour.lonelyTouches;
+  if (touches != replay.touches)
+    replay.events.push_back({t, "touch"});
+  if (nears != replay.nears)
+    replay.events.push_back({t, "near"});
+  if (lonely != replay.lonely)
+    replay.events.push_back({t, "lonely"});
+  replay.touches = touches;
+  replay.nears = nears;
+  replay.lonely = lonely;
+  if (sensorHealthFaults() != replay.faults)
+    replay.events.push_back({t, "fault"});
+  replay.faults = sensorHealthFaults();
+}
+
+static bool loadEvents(const char *path, std::vector<ReplayEvent> &events)
+{
+  FILE *in = fopen(path, "r");
+  if (in == nullptr)
+    return false;
+  char line[64];
+  while (fgets(line, sizeof(line), in))
+  {
+    char *comma = strchr(line, ',');
+    if (comma == nullptr || line[0] < '0' || line[0] > '9')
+      continue;
+    uint64_t t = strtoull(line, nullptr, 10);
+    for (const char *kind : EVENT_KINDS)
+      if (strncmp(comma + 1, kind, strlen(kind)) == 0 && comma[1 + strlen(kind)] <= ' ')
+        events.push_back({t, kind});
+  }
+  fclose(in);
+  return true;
+}
+
+// Pair up events of each kind in time order and report the differences.
+static void compareEvents(const std::vector<ReplayEvent> &before, const std::vector<ReplayEvent> &after,
+                          uint64_t toleranceUs)
+{
+  printf("%-7s %8s %8s %8s %8s %8s %10s\n", "event", "before", "after", "paired", "gone", "new", "mean_shift");
+  for (const char *kind : EVENT_KINDS)
+  {
+    std::vector<uint64_t> a, b;
+    for (const ReplayEvent &event : before)
+      if (event.kind == kind)
+        a.push_back(event.tUs);
+    for (const ReplayEvent &event : after)
+      if (event.kind == kind)
+        b.push_back(event.tUs);
+
+    size_t i = 0, j = 0, paired = 0;
+    int64_t shift = 0;
+    std::vector<uint64_t> gone, added;
+    while (i < a.size() || j < b.size())
+    {
+      if (i < a.size() && j < b.size() && (a[i] > b[j] ? a[i] - b[j] : b[j] - a[i]) <= toleranceUs)
+      {
+        shift += (int64_t)b[j] - (int64_t)a[i];
+        paired++, i++, j++;
+      }
+      else if (j >= b.size() || (i < a.size() && a[i] < b[j]))
+        gone.push_back(a[i++]);
+      else
+        added.push_back(b[j++]);
+    }
+    printf("%-7s %8zu %8zu %8zu %8zu %8zu %8.1fms\n", kind, a.size(), b.size(), paired, gone.size(), added.size(),
+           paired ? shift / 1000.0 / paired : 0.0);
+    for (size_t k = 0; k < gone.size() && k < 5; k++)
+      printf("        gone at %.3f s\n", gone[k] / 1e6);
+    for (size_t k = 0; k < added.size() && k < 5; k++)
+      printf("        new at %.3f s\n", added[k] / 1e6);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *tracePath = nullptr;
+  const char *pwmPath = nullptr;
+  const char *eventsPath = nullptr;
+  const char *comparePath = nullptr;
+  double syntheticHours = 0;
+  double toleranceMs = 100;
+  SimOptions options;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--pwm") == 0)
+      pwmPath = value, i++;
+    else if (strcmp(arg, "--events") == 0)
+      eventsPath = value, i++;
+    else if (strcmp(arg, "--compare") == 0)
+      comparePath = value, i++;
+    else if (strcmp(arg, "--tolerance-ms") == 0)
+      toleranceMs = atof(value), i++;
+    else if (strcmp(arg, "--start-ms") == 0)
+      options.startMs = strtoull(value, nullptr, 0), i++;
+    else if (strcmp(arg, "--synthetic") == 0)
+      syntheticHours = atof(value), i++;
+    else if (strcmp(arg, "--seed") == 0)
+      options.seed = strtoull(value, nullptr, 0), i++;
+    else if (arg[0] != '-' || strcmp(arg, "-") == 0)
+      tracePath = arg;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if ((tracePath == nullptr) == (syntheticHours <= 0))
+  {
+    fprintf(stderr, "give a trace file or --synthetic hours\n");
+    return 2;
+  }
+
+  TraceReader reader;
+  if (tracePath != nullptr && !reader.open(tracePath))
+  {
+    perror(tracePath);
+    return 1;
+  }
+  SignalConfig config;
+  SignalGenerator generator(config, options.seed);
+  uint64_t syntheticEndUs = (uint64_t)(syntheticHours * 3600e6);
+
+  Replay replay;
+  if (pwmPath != nullptr && (replay.pwmOut = fopen(pwmPath, "w")) == nullptr)
+  {
+    perror(pwmPath);
+    return 1;
+  }
+  if (replay.pwmOut != nullptr)
+    fputs("t_us,pwm\n", replay.pwmOut);
+
+  options.source = traceSource;
+  auto wallStart = std::chrono::steady_clock::now();
+  simBoot(options);
+  halSimSetPwmListener(watchLight, &replay);
+
+  uint64_t samples = 0;
+  uint64_t firstUs = 0;
+  uint64_t lastUs = 0;
+  TraceSample sample;
+  for (;;)
+  {
+    if (tracePath != nullptr)
+    {
+      if (!reader.next(sample))
+        break;
+    }
+    else
+    {
+      SignalSample synthetic = generator.next();
+      if (synthetic.tUs >= syntheticEndUs)
+        break;
+      sample.tUs = synthetic.tUs;
+      sample.raw = synthetic.raw;
+    }
+
+    if (samples == 0)
+    {
+      firstUs = sample.tUs;
+      replay.offsetUs = (int64_t)(options.startMs * 1000) - (int64_t)firstUs;
+    }
+    replayReading = sample.raw;
+    simLoopAt(sample.tUs + replay.offsetUs);
+    watchDetector(replay, sample.tUs);
+    lastUs = sample.tUs;
+    samples++;
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  if (replay.pwm > 0)
+    replay.litUs += lastUs - replay.litSince;
+
+  printf("replayed %llu readings, %.2f hours of trace, in %.2f s (%.1f M readings/s)\n", (unsigned long long)samples,
+         (lastUs - firstUs) / 3600e6, wall, samples / wall / 1e6);
+  if (reader.badLines > 0)
+    printf("skipped %lu lines that were not readings\n", reader.badLines);
+  printf("touches %lu (lonely %lu), nears %lu, lit %.1f minutes\n", replay.touches, replay.lonely, replay.nears,
+         replay.litUs / 60e6);
+  if (replay.faults > 0)
+    printf("sensor faults %lu, the last %s\n", replay.faults, sensorFaultName(sensorFault()));
+  halSimMuteSerial(false);
+  latencyReport();
+
+  if (replay.pwmOut != nullptr)
+    fclose(replay.pwmOut);
+  if (eventsPath != nullptr)
+  {
+    FILE *out = fopen(eventsPath, "w");
+    if (out == nullptr)
+    {
+      perror(eventsPath);
+      return 1;
+    }
+    fputs("t_us,event\n", out);
+    for (const ReplayEvent &event : replay.events)
+      fprintf(out, "%" PRIu64 ",%s\n", event.tUs, event.kind);
+    fclose(out);
+  }
+  if (comparePath != nullptr)
+  {
+    std::vector<ReplayEvent> before;
+    if (!loadEvents(comparePath, before))
+    {
+      perror(comparePath);
+      return 1;
+    }
+    compareEvents(before, replay.events, (uint64_t)(toleranceMs * 1000));
+  }
+  return 0;
+}
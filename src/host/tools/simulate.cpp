@@ -0,0 +1,130 @@
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "detect.h"
+#include "host/sim.h"
+#include "host/sim_random.h"
+#include "sensor_health.h"
+#include "stats.h"
+
+// Boot the firmware on simulated hardware and run it for days of virtual
+// time, then print what it did.
+//
+//   .pio/build/simulate/program [--days 30] [--seed 1] [--start-ms N]
+//       [--drift counts-per-day] [--noise counts] [--touch-every minutes]
+//       [--serial]
+//
+// --start-ms 4294900000 starts the clock a minute before millis() wraps.
+// --noise 0 gives a sensor that never moves.  It has never looked like a
+// working pad either, so the health checks leave it alone rather than
+// calling it flat (see sensor_health.h).
+
+extern DetectState detector;
+extern bool debugging;
+
+// A quiet sensor: a level that drifts slowly, some noise, and optionally
+// a short touch every so many minutes.
+struct QuietSensor
+{
+  SimRandom random;
+  uint64_t startUs;
+  double level;
+  double driftPerDay;
+  double noise;
+  uint64_t touchEveryUs;
+};
+
+static int quietSensor(uint64_t nowUs, void *context)
+{
+  QuietSensor &sensor = *(QuietSensor *)context;
+  double days = (nowUs - sensor.startUs) / 86400e6;
+  double reading = sensor.level + sensor.driftPerDay * days + sensor.noise * sensor.random.roughGaussian();
+  if (sensor.touchEveryUs > 0 && (nowUs - sensor.startUs) % sensor.touchEveryUs < 400000)
+    reading += 150; // A finger on the pad for 400ms.
+  return (int)lround(reading);
+}
+
+struct Watch
+{
+  int baseMin = 1 << 30;
+  int baseMax = -(1 << 30);
+  uint64_t lastUs = 0;
+  uint64_t litUs = 0;
+  bool lit = false;
+};
+
+static void watchLoop(uint64_t nowUs, void *context)
+{
+  Watch &watch = *(Watch *)context;
+  if (detector.base < watch.baseMin)
+    watch.baseMin = detector.base;
+  if (detector.base > watch.baseMax)
+    watch.baseMax = detector.base;
+  if (watch.lit)
+    watch.litUs += nowUs - watch.lastUs;
+  watch.lastUs = nowUs;
+}
+
+static void watchLight(uint64_t nowUs, int pin, int value, void *context)
+{
+  if (pin == HAL_SIM_LIGHT_PIN)
+    ((Watch *)context)->lit = value > 0;
+}
+
+int main(int argc, char **argv)
+{
+  double days = 30;
+  SimOptions options;
+  QuietSensor sensor = {SimRandom(1), 0, 725, 0, 1.0, 0};
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--days") == 0)
+      days = atof(value), i++;
+    else if (strcmp(arg, "--seed") == 0)
+      options.seed = strtoull(value, nullptr, 0), i++;
+    else if (strcmp(arg, "--start-ms") == 0)
+      options.startMs = strtoull(value, nullptr, 0), i++;
+    else if (strcmp(arg, "--drift") == 0)
+      sensor.driftPerDay = atof(value), i++;
+    else if (strcmp(arg, "--noise") == 0)
+      sensor.noise = atof(value), i++;
+    else if (strcmp(arg, "--touch-every") == 0)
+      sensor.touchEveryUs = (uint64_t)(atof(value) * 60e6), i++;
+    else if (strcmp(arg, "--serial") == 0)
+      options.echoSerial = true;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  sensor.random = SimRandom(options.seed);
+  sensor.startUs = options.startMs * 1000;
+  options.source = quietSensor;
+  options.sourceContext = &sensor;
+
+  Watch watch;
+  auto wallStart = std::chrono::steady_clock::now();
+  simBoot(options);
+  halSimSetPwmListener(watchLight, &watch);
+  watch.lastUs = halSimNow();
+  uint64_t loops = simRunFor((uint64_t)(days * 86400e3), watchLoop, &watch);
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  const StatsTotals &totals = statsTotals();
+  printf("simulated %.2f days, %llu loops in %.2f s (%.0fx real time)\n", simElapsedMs() / 86400e3,
+         (unsigned long long)loops, wall, simElapsedMs() / 1000.0 / wall);
+  printf("qt_base %d..%d, final %d\n", watch.baseMin, watch.baseMax, detector.base);
+  printf("lit %.1f minutes\n", watch.litUs / 60e6);
+  printf("saved totals: hours=%lu touches=%lu nears=%lu lonely=%lu\n", (unsigned long)totals.hours,
+         (unsigned long)totals.touches, (unsigned long)totals.nears, (unsigned long)totals.lonelyTouches);
+  printf("sensor faults %lu, now %s\n", sensorHealthFaults(), sensorFaultName(sensorFault()));
+  printf("debugging %s\n", debugging ? "on" : "off");
+  return 0;
+}
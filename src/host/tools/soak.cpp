@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "detect.h"
+#include "host/signal_gen.h"
+#include "host/sim.h"
+#include "sensor_health.h"
+#include "stats.h"
+
+// Weeks in the life of a box, in under a minute given a core per scenario.
+//
+//   .pio/build/soak/program [--only name] [--seed 1]
+//
+// Each scenario runs the real firmware against a synthetic room for days
+// of simulated time:
+//
+//   humidity     big, slow humidity swings for a week
+//   temperature  a 20 count day/night swing for a week
+//   shelf        moved between shelves: the baseline steps up and down
+//   hands        hands resting next to the box for hours at a time
+//   film         condensation forming on the pad and drying off, a few
+//                times a day
+//   idle         nobody comes near it for 50 days - past the point where
+//                a touch timer from power-on wraps round (49.7 days)
+//
+// Nobody touches the box in any of them, and each is checked for:
+//
+//   - the baseline staying within SOAK_TOLERANCE of the level it should have
+//     learned, except for SOAK_SETTLE_US after a step or a hand comes or
+//     goes or a film stops growing - and the slowest re-convergence after
+//     one of those;
+//   - no light cycles: the light is never held at full brightness, which
+//     it only is for 30 seconds after a touch;
+//   - no glow from water: while there is a film on the pad the light is
+//     never bright enough to see (SOAK_VISIBLE);
+//   - no sensor faults: nothing in any room looks like a broken sensor
+//     to the health checks (see sensor_health.h);
+//   - timers surviving wrap: every run starts a day and a half before
+//     millis() wraps and with the loop counter about to wrap.
+//     The light must never stop being driven for as long as the warm-up
+//     after power on (a few loops in a row can go by without a write
+//     while lightAtNear() waits for its average), the hourly stats must
+//     keep rolling over, and the baseline's running total must still
+//     match its readings at the end.
+//
+// The firmware keeps its state in globals, so each scenario runs in a
+// process of its own, all at once.  Exits non-zero if any check fails.
+
+extern DetectState detector;
+
+#define SOAK_START_MS (0x100000000ULL - 36 * 3600 * 1000ULL) // millis() wraps 36h in.
+#define SOAK_BASE_CT_START (0xFFFFFFFFu - 4000000u)          // detector.baseCount wraps about 11h in.
+#define SOAK_WARMUP_US 6000000ULL           // Past BASELINE_TIME, with a margin.
+#define SOAK_SETTLE_US 120000000ULL         // Two minutes to re-converge after a change.
+#define SOAK_TOLERANCE 6.0                  // Counts - a tenth of SPREAD.  The baseline
+                                            // averages the last 50 seconds, so
+                                            // while the room is moving it lags.
+#define SOAK_FULL_BRIGHTNESS 255
+#define SOAK_SILENT_LOOPS 100               // Longest the light may go unwritten.
+#define SOAK_VISIBLE 8                      // Dimmest glow anyone would notice.
+
+// A sudden lasting change to the untouched level, like moving the box.
+struct SoakStep
+{
+  double atHours;
+  double counts;
+};
+
+// A hand resting near the pad.  It takes a couple of seconds to settle.
+struct SoakHand
+{
+  double atHours;
+  double hours;
+  double counts;
+};
+
+// Water condensing on the pad: it builds up over a few minutes, stays a
+// while, then dries off more slowly.  The baseline should follow it.
+struct SoakFilm
+{
+  double atHours;
+  double riseMinutes;
+  double hours; // From the start until it has dried.
+  double counts;
+  double dryMinutes;
+};
+
+struct Scenario
+{
+  const char *name;
+  double days;
+  SignalConfig config;
+  std::vector<SoakStep> steps;
+  std::vector<SoakHand> hands;
+  bool plain; // A flat room with white noise and nothing else - much
+              // quicker to simulate, for the long runs.
+  std::vector<SoakFilm> films;
+};
+
+// ---- The room, as the sensor sees it ----
+
+struct Room
+{
+  const Scenario *scenario;
+  SignalGenerator *generator;
+  SimRandom random; // For plain rooms.
+  uint64_t startUs;
+  double target;         // What the baseline should settle on.
+  uint64_t lastChangeUs; // When target last jumped.
+  bool wet;              // There is a film on the pad.
+};
+
+static double roomShift(const Scenario &scenario, double hours, bool &changing, bool &wet)
+{
+  double shift = 0;
+  changing = false;
+  for (const SoakStep &step : scenario.steps)
+    if (hours >= step.atHours)
+      shift += step.counts;
+  for (const SoakHand &hand : scenario.hands)
+  {
+    double in = (hours - hand.atHours) * 3600;
+    double out = (hours - hand.atHours - hand.hours) * 3600;
+    if (in >= 0 && out < 0)
+      shift += hand.counts * std::min(1.0, in / 2); // Two seconds to put it down...
+    else if (out >= 0 && out < 2)
+      shift += hand.counts * (1 - out / 2); // ...and to take it away.
+    changing |= (in >= 0 && in < 2) || (out >= 0 && out < 2);
+  }
+  wet = false;
+  for (const SoakFilm &film : scenario.films)
+  {
+    double in = (hours - film.atHours) * 60;
+    double out = (film.atHours + film.hours - hours) * 60;
+    if (in >= 0 && out > 0)
+    {
+      shift += film.counts * std::min(1.0, std::min(in / film.riseMinutes, out / film.dryMinutes));
+      wet = true;
+      changing |= in < film.riseMinutes; // Only water once it settles.
+    }
+  }
+  return shift;
+}
+
+static int roomReading(uint64_t nowUs, void *context)
+{
+  Room &room = *(Room *)context;
+  SignalSample sample;
+  if (room.scenario->plain)
+  {
+    sample.baseline = (float)room.scenario->config.baseline;
+    sample.raw = (int)lround(sample.baseline + room.scenario->config.whiteNoise * room.random.roughGaussian());
+  }
+  else
+    sample = room.generator->sampleAt(nowUs);
+  bool changing;
+  double shift = roomShift(*room.scenario, (nowUs - room.startUs) / 3600e6, changing, room.wet);
+  double target = sample.baseline + shift;
+  if (changing || fabs(target - room.target) > 1.5) // A step or a hand, not the slow
+    room.lastChangeUs = nowUs;                        // wander the baseline follows anyway.
+  room.target = target;
+  return (int)lround(sample.raw + shift);
+}
+
+// ---- Watching the firmware ----
+
+struct SoakResult
+{
+  double days;
+  unsigned long long loops;
+  double worstError;      // Outside the settling windows.
+  double slowestSettleS;  // Longest from a change to back within tolerance.
+  unsigned long lightCycles;
+  unsigned long touches;
+  unsigned long silentLoops; // Most loops in a row after warm-up that never
+                             // drove the light.
+  double wetGlowS;           // Time the light was visibly on with a film on
+                             // the pad.
+  unsigned long faults;      // Sensor faults - all false alarms here.
+  unsigned long hours;
+  unsigned long expectedHours;
+  bool bookkeeping; // The baseline's total matches its readings.
+  bool passed;
+};
+
+struct Watch
+{
+  Room *room;
+  uint64_t bootUs;
+  unsigned long pwmWrites = 0;
+  unsigned long silentRun = 0;
+  unsigned long fullWrites = 0; // Full brightness writes in a row.
+  int pwm = 0;                  // The last value written.
+  uint64_t lastLoopUs = 0;
+  uint64_t pendingUs = 0; // When the change we are waiting to settle began, or 0.
+  SoakResult *result;
+};
+
+static void watchLight(uint64_t nowUs, int pin, int value, void *context)
+{
+  Watch &watch = *(Watch *)context;
+  if (pin != HAL_SIM_LIGHT_PIN)
+    return;
+  watch.pwmWrites++;
+  watch.pwm = value;
+  // The throb after power on touches full brightness for one write at the
+  // top of each sweep; a touch holds it there.
+  watch.fullWrites = value >= SOAK_FULL_BRIGHTNESS ? watch.fullWrites + 1 : 0;
+  if (watch.fullWrites == 2)
+    watch.result->lightCycles++;
+}
+
+static void watchLoop(uint64_t nowUs, void *context)
+{
+  Watch &watch = *(Watch *)context;
+  SoakResult &result = *watch.result;
+  result.loops++;
+  watch.silentRun = watch.pwmWrites == 0 ? watch.silentRun + 1 : 0;
+  if (nowUs - watch.bootUs > SOAK_WARMUP_US)
+    result.silentLoops = std::max(result.silentLoops, watch.silentRun);
+  watch.pwmWrites = 0;
+  if (watch.room->wet && watch.pwm >= SOAK_VISIBLE && watch.lastLoopUs != 0)
+    result.wetGlowS += (nowUs - watch.lastLoopUs) / 1e6;
+  watch.lastLoopUs = nowUs;
+
+  // A step, a hand or a film: wait for it to finish moving and the
+  // baseline to catch up, and note how long that took.
+  const Room &room = *watch.room;
+  double error = fabs(detector.base - room.target);
+  bool moving = nowUs - room.lastChangeUs < 100000;
+  if (room.lastChangeUs > watch.bootUs && moving)
+    watch.pendingUs = room.lastChangeUs; // Timed from when it stops.
+  if (watch.pendingUs != 0 && !moving && error <= SOAK_TOLERANCE)
+  {
+    result.slowestSettleS = std::max(result.slowestSettleS, (nowUs - watch.pendingUs) / 1e6);
+    watch.pendingUs = 0;
+  }
+
+  if (nowUs - watch.bootUs > SOAK_SETTLE_US && nowUs - room.lastChangeUs > SOAK_SETTLE_US)
+    result.worstError = std::max(result.worstError, error);
+}
+
+static void runScenario(const Scenario &scenario, uint64_t seed, SoakResult &result)
+{
+  memset(&result, 0, sizeof(result));
+  uint64_t startUs = SOAK_START_MS * 1000;
+  SignalGenerator generator(scenario.config, seed, startUs);
+  Room room = {&scenario, &generator, SimRandom(seed), startUs, scenario.config.baseline, 0, false};
+
+  SimOptions options;
+  options.seed = seed;
+  options.startMs = SOAK_START_MS;
+  options.source = roomReading;
+  options.sourceContext = &room;
+  simBoot(options);
+  detector.baseCount = SOAK_BASE_CT_START;
+
+  Watch watch;
+  watch.room = &room;
+  watch.bootUs = halSimNow();
+  watch.result = &result;
+  halSimSetPwmListener(watchLight, &watch);
+  simRunFor((uint64_t)(scenario.days * 86400e3), watchLoop, &watch);
+
+  result.days = simElapsedMs() / 86400e3;
+  result.touches = statsTotals().touches;
+  result.hours = statsTotals().hours;
+  result.faults = sensorHealthFaults();
+  result.expectedHours = (unsigned long)(simElapsedMs() / 3600000);
+  long sum = 0;
+  for (int i = 0; i < detector.numBaseline; i++)
+    sum += detector.baseReadings[i];
+  result.bookkeeping = sum == detector.baseSum;
+  if (watch.pendingUs != 0)
+    result.slowestSettleS = std::max(result.slowestSettleS, (halSimNow() - watch.pendingUs) / 1e6);
+  result.passed = result.worstError <= SOAK_TOLERANCE && result.slowestSettleS <= SOAK_SETTLE_US / 1e6 &&
+                  result.lightCycles == 0 && result.touches == 0 && result.silentLoops <= SOAK_SILENT_LOOPS &&
+                  result.wetGlowS == 0 && result.faults == 0 &&
+                  result.hours + 1 >= result.expectedHours && result.hours <= result.expectedHours &&
+                  result.bookkeeping;
+}
+
+static std::vector<Scenario> scenarios()
+{
+  // No fingers and no spikes anywhere: anything that lights the box up
+  // is a false alarm.
+  SignalConfig calm;
+  calm.fingersPerHour = 0;
+  calm.spikesPerHour = 0;
+
+  std::vector<Scenario> list;
+  Scenario humidity = {"humidity", 7, calm, {}, {}, false};
+  humidity.config.humidityCounts = 15;
+  humidity.config.humidityHours = 3;
+  list.push_back(humidity);
+
+  Scenario temperature = {"temperature", 7, calm, {}, {}, false};
+  temperature.config.thermalCounts = 20;
+  list.push_back(temperature);
+
+  // Onto a metal shelf, back, onto a wooden one, and back again.
+  Scenario shelf = {"shelf", 4, calm, {{9, 35}, {30, -35}, {51.5, -25}, {80, 25}}, {}, false};
+  list.push_back(shelf);
+
+  // A hand next to the box through the evening, and again the next
+  // morning, and one pressed a little closer for a short while.
+  Scenario hands = {"hands", 4, calm, {}, {{19, 3, 15}, {33, 2, 10}, {58, 0.5, 25}, {70, 4, 12}}, false};
+  list.push_back(hands);
+
+  // The kettle in the morning, a plant watered at lunchtime, steam from
+  // cooking in the evening; the next day the same, a little different.
+  // The fastest grows half a count a second.  Any faster is as fast as
+  // a finger a few centimetres off, and can't be told from one until it
+  // stops growing.
+  Scenario film = {"film", 2, calm, {}, {}, false};
+  film.films = {{7.5, 2, 0.75, 40, 20}, {12, 10, 3, 20, 60}, {19, 2, 1, 60, 30},
+                {31.5, 3, 2, 50, 40}, {36, 15, 2, 25, 60}, {43, 5, 1.5, 30, 30}};
+  list.push_back(film);
+
+  Scenario idle = {"idle", 50, calm, {}, {}, true};
+  list.push_back(idle);
+  return list;
+}
+
+static bool readAll(int fd, void *data, size_t length)
+{
+  char *at = (char *)data;
+  while (length > 0)
+  {
+    ssize_t got = read(fd, at, length);
+    if (got <= 0)
+      return false;
+    at += got;
+    length -= got;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  const char *only = nullptr;
+  uint64_t seed = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--only") == 0)
+      only = value, i++;
+    else if (strcmp(arg, "--seed") == 0)
+      seed = strtoull(value, nullptr, 0), i++;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+
+  std::vector<Scenario> list;
+  for (const Scenario &scenario : scenarios())
+    if (only == nullptr || strcmp(scenario.name, only) == 0)
+      list.push_back(scenario);
+  if (list.empty())
+  {
+    fprintf(stderr, "no scenario called %s\n", only);
+    return 2;
+  }
+
+  // One process per scenario, all at once.
+  auto wallStart = std::chrono::steady_clock::now();
+  std::vector<int> pipes;
+  std::vector<pid_t> children;
+  for (size_t i = 0; i < list.size(); i++)
+  {
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+      perror("pipe");
+      return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(fds[0]);
+      SoakResult result;
+      runScenario(list[i], seed + i, result);
+      ssize_t put = write(fds[1], &result, sizeof(result));
+      _exit(put == (ssize_t)sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    pipes.push_back(fds[0]);
+    children.push_back(pid);
+  }
+
+  printf("%-12s %6s %11s %8s %8s %7s %7s %7s %8s %6s %9s %6s  %s\n", "scenario", "days", "loops", "base_err",
+         "settle_s", "cycles", "touches", "silent", "wet_glow", "faults", "hours", "sums", "result");
+  bool allPassed = true;
+  for (size_t i = 0; i < list.size(); i++)
+  {
+    SoakResult result;
+    bool ok = readAll(pipes[i], &result, sizeof(result));
+    close(pipes[i]);
+    int status;
+    waitpid(children[i], &status, 0);
+    if (!ok)
+    {
+      printf("%-12s crashed\n", list[i].name);
+      allPassed = false;
+      continue;
+    }
+    allPassed &= result.passed;
+    printf("%-12s %6.1f %11llu %8.1f %8.1f %7lu %7lu %7lu %8.1f %6lu %4lu/%-4lu %6s  %s\n", list[i].name,
+           result.days, result.loops, result.worstError, result.slowestSettleS, result.lightCycles, result.touches,
+           result.silentLoops, result.wetGlowS, result.faults, result.hours, result.expectedHours,
+           result.bookkeeping ? "ok" : "BAD", result.passed ? "pass" : "FAIL");
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  printf("%s in %.1f s\n", allPassed ? "all passed" : "FAILED", wall);
+  return allPassed ? 0 : 1;
+}
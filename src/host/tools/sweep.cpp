@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "host/corpus.h"
+#include "host/pipeline_batch.h"
+#include "host/pipeline_model.h"
+#include "host/sim_random.h"
+#include "host/work_pool.h"
+
+// Search for better tunables.  Every parameter set is run over a corpus
+// of labelled traces and scored on missed touches, false touches, false
+// glows and touch latency (see score.h).  No one set is best at all four,
+// so what comes out is the Pareto front: the sets that nothing else beats
+// on every score at once.  Picking between them is a judgement call.
+// Sets that score exactly the same are shown once, with how many there
+// were.  Latency is the 95th percentile; a set that finds no touches at
+// all has no latency to speak of, and scores infinity rather than 0.
+//
+//   .pio/build/sweep/program [traces...] [--synthetic 4] [--hours 2]
+//       [--vary name=low:high[:step]]... [--random N] [--seed 1]
+//       [--threads N] [--scalar] [--out results.csv]
+//
+// Without traces, --synthetic of them are generated (see signal_gen.h).
+// Each --vary adds a parameter to search: spread, min_over, baseline,
+// meas, debounce, gestures, tracker or track_accel.  The rest stay at
+// their defaults.  With --random N, N sets are drawn at random from the
+// ranges; without it every point on the grid is tried.  With no --vary
+// at all, a random search over the first five is run.
+//
+// The runs use the model in pipeline_model.h, which is first checked
+// against the real firmware on the first trace - at the defaults, and
+// again with gestures and the tracker on.  Sets are run in batches that
+// share one pass over each trace (pipeline_batch.h); --scalar runs them
+// one at a time instead, to compare.  The batches only do the light the
+// way the box ships, so sets with gestures or the tracker on are run one
+// at a time either way.
+
+struct Dimension
+{
+  const char *name;
+  int PipelineParams::*field;
+  int low;
+  int high;
+  int step;
+};
+
+static Dimension DIMENSIONS[] = {
+    {"spread", &PipelineParams::spread, 20, 150, 5},
+    {"min_over", &PipelineParams::minOver, 1, 12, 1},
+    {"baseline", &PipelineParams::numBaseline, 500, 10000, 500},
+    {"meas", &PipelineParams::numMeas, 5, 200, 5},
+    {"debounce", &PipelineParams::debounceMs, 50, 800, 50},
+    {"gestures", &PipelineParams::gestures, 0, 1, 1},
+    {"tracker", &PipelineParams::tracker, 0, 1, 1},
+    {"track_accel", &PipelineParams::trackAccel, 100, 5000, 100},
+};
+#define DIMENSION_COUNT (sizeof(DIMENSIONS) / sizeof(DIMENSIONS[0]))
+#define DEFAULT_DIMENSIONS 5 // Searched with no --vary: the numbers, not the features.
+#define LATENCY_PERCENTILE 0.95
+
+struct Result
+{
+  PipelineParams params;
+  Score score;
+  double latencyMs; // LATENCY_PERCENTILE of them.
+};
+
+// Lower is better for everything.
+static void objectives(const Result &result, double *values)
+{
+  values[0] = result.score.missed;
+  values[1] = result.score.falseTouches;
+  values[2] = result.score.falseGlows;
+  values[3] = result.latencyMs;
+}
+
+static bool dominates(const Result &a, const Result &b)
+{
+  double x[4], y[4];
+  objectives(a, x);
+  objectives(b, y);
+  bool better = false;
+  for (int i = 0; i < 4; i++)
+  {
+    if (x[i] > y[i])
+      return false;
+    better |= x[i] < y[i];
+  }
+  return better;
+}
+
+static bool sameScores(const Result &a, const Result &b)
+{
+  double x[4], y[4];
+  objectives(a, x);
+  objectives(b, y);
+  for (int i = 0; i < 4; i++)
+    if (x[i] != y[i])
+      return false;
+  return true;
+}
+
+static bool parseVary(const char *text, std::vector<Dimension> &vary)
+{
+  for (const Dimension &dimension : DIMENSIONS)
+  {
+    size_t length = strlen(dimension.name);
+    if (strncmp(text, dimension.name, length) != 0 || text[length] != '=')
+      continue;
+    Dimension d = dimension;
+    d.step = 1;
+    if (sscanf(text + length + 1, "%d:%d:%d", &d.low, &d.high, &d.step) < 2 || d.step < 1 || d.high < d.low)
+      return false;
+    vary.push_back(d);
+    return true;
+  }
+  return false;
+}
+
+static void printParams(FILE *out, const PipelineParams &p)
+{
+  fprintf(out, "%d,%d,%d,%d,%d,%d,%d,%d", p.spread, p.minOver, p.numBaseline, p.numMeas, p.debounceMs, p.gestures,
+          p.tracker, p.trackAccel);
+}
+
+static void printResult(FILE *out, const Result &r)
+{
+  printParams(out, r.params);
+  fprintf(out, ",%lu,%lu,%lu,%lu,%.1f", r.score.touches, r.score.missed, r.score.falseTouches, r.score.falseGlows,
+          r.latencyMs);
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<const char *> paths;
+  std::vector<Dimension> vary;
+  int synthetic = 4;
+  double hours = 2;
+  long randomCount = -1;
+  uint64_t seed = 1;
+  unsigned threads = 0;
+  const char *outPath = nullptr;
+  bool scalar = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--synthetic") == 0)
+      synthetic = atoi(value), i++;
+    else if (strcmp(arg, "--hours") == 0)
+      hours = atof(value), i++;
+    else if (strcmp(arg, "--random") == 0)
+      randomCount = atol(value), i++;
+    else if (strcmp(arg, "--seed") == 0)
+      seed = strtoull(value, nullptr, 0), i++;
+    else if (strcmp(arg, "--threads") == 0)
+      threads = atoi(value), i++;
+    else if (strcmp(arg, "--scalar") == 0)
+      scalar = true;
+    else if (strcmp(arg, "--out") == 0)
+      outPath = value, i++;
+    else if (strcmp(arg, "--vary") == 0)
+    {
+      if (!parseVary(value, vary))
+      {
+        fprintf(stderr, "can't understand --vary %s\n", value);
+        return 2;
+      }
+      i++;
+    }
+    else if (arg[0] != '-')
+      paths.push_back(arg);
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (vary.empty())
+  {
+    vary.assign(DIMENSIONS, DIMENSIONS + DEFAULT_DIMENSIONS);
+    if (randomCount < 0)
+      randomCount = 500;
+  }
+
+  Corpus corpus;
+  for (const char *path : paths)
+  {
+    if (!corpusLoad(path, corpus))
+    {
+      fprintf(stderr, "%s: can't read it, or it has no ground truth\n", path);
+      return 1;
+    }
+  }
+  if (paths.empty())
+    corpusSynthetic(synthetic, hours, seed, SignalConfig(), corpus);
+
+  PipelineParams features = pipelineDefaults();
+  features.gestures = 1;
+  features.tracker = 1;
+  for (const PipelineParams &params : {pipelineDefaults(), features})
+  {
+    long mismatch = pipelineVerify(corpus[0].readings, params);
+    if (mismatch >= 0)
+    {
+      fprintf(stderr, "the model and the firmware disagree at reading %ld of the first trace%s\n", mismatch,
+              params.tracker ? ", with gestures and the tracker on" : "");
+      return 1;
+    }
+  }
+
+  // The firmware's own settings go first, to have something to compare
+  // against.
+  std::vector<PipelineParams> sets;
+  sets.push_back(pipelineDefaults());
+  if (randomCount >= 0)
+  {
+    SimRandom random(seed);
+    for (long n = 0; n < randomCount; n++)
+    {
+      PipelineParams params = pipelineDefaults();
+      for (const Dimension &d : vary)
+        params.*d.field = d.low + d.step * (int)(random.uniform() * ((d.high - d.low) / d.step + 1));
+      sets.push_back(params);
+    }
+  }
+  else
+  {
+    std::vector<int> at(vary.size());
+    for (size_t i = 0; i < vary.size(); i++)
+      at[i] = vary[i].low;
+    for (;;)
+    {
+      PipelineParams params = pipelineDefaults();
+      for (size_t i = 0; i < vary.size(); i++)
+        params.*vary[i].field = at[i];
+      sets.push_back(params);
+      size_t i = 0;
+      for (; i < vary.size(); i++)
+      {
+        at[i] += vary[i].step;
+        if (at[i] <= vary[i].high)
+          break;
+        at[i] = vary[i].low;
+      }
+      if (i == vary.size())
+        break;
+    }
+  }
+
+  printf("%zu parameter sets, %zu traces, %zu readings\n", sets.size(), corpus.size(), corpusReadings(corpus));
+  // The batch kernel must give exactly the one-at-a-time answers.
+  if (!scalar)
+  {
+    Corpus first(corpus.begin(), corpus.begin() + 1);
+    std::vector<PipelineParams> sample(sets.begin(), sets.begin() + std::min<size_t>(sets.size(), 64));
+    std::vector<Score> batched = pipelineBatchScore(first, sample, threads);
+    for (size_t i = 0; i < sample.size(); i++)
+    {
+      Score single = corpusScore(first, sample[i]);
+      if (single.missed != batched[i].missed || single.falseTouches != batched[i].falseTouches ||
+          single.falseGlows != batched[i].falseGlows || single.latencyUs != batched[i].latencyUs)
+      {
+        fprintf(stderr, "the batch kernel and the model disagree on set %zu\n", i);
+        return 1;
+      }
+    }
+  }
+
+  std::vector<Result> results(sets.size());
+  auto wallStart = std::chrono::steady_clock::now();
+  if (scalar)
+  {
+    workPoolRun(
+        sets.size(), [&](size_t i) { results[i].score = corpusScore(corpus, sets[i]); }, threads);
+  }
+  else
+  {
+    std::vector<Score> scores = pipelineBatchScore(corpus, sets, threads);
+    for (size_t i = 0; i < sets.size(); i++)
+      results[i].score = std::move(scores[i]);
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  for (size_t i = 0; i < sets.size(); i++)
+  {
+    results[i].params = sets[i];
+    Score &score = results[i].score;
+    results[i].latencyMs = score.latencyUs.empty() ? INFINITY : score.percentileLatencyMs(LATENCY_PERCENTILE);
+  }
+  printf("scored in %.1f s: %.1f sets/s, %.1f M set-readings/s\n", wall, sets.size() / wall,
+         sets.size() * corpusReadings(corpus) / wall / 1e6);
+
+  const char *header = "spread,min_over,baseline,meas,debounce,gestures,tracker,track_accel,touches,missed,false_touches,false_glows,latency_p95_ms";
+  if (outPath != nullptr)
+  {
+    FILE *out = fopen(outPath, "w");
+    if (out == nullptr)
+    {
+      perror(outPath);
+      return 1;
+    }
+    fprintf(out, "%s\n", header);
+    for (const Result &result : results)
+    {
+      printResult(out, result);
+      fputc('\n', out);
+    }
+    fclose(out);
+  }
+
+  printf("\nfirmware defaults:\n%s\n", header);
+  printResult(stdout, results[0]);
+  printf("\n");
+
+  // The front, each set of scores once: the first set with them (so the
+  // defaults, if they are on it), and how many sets share them.
+  struct FrontEntry
+  {
+    const Result *result;
+    size_t sets;
+  };
+  std::vector<FrontEntry> front;
+  size_t onFront = 0;
+  for (const Result &candidate : results)
+  {
+    bool beaten = false;
+    for (const Result &other : results)
+      if (dominates(other, candidate))
+      {
+        beaten = true;
+        break;
+      }
+    if (beaten)
+      continue;
+    onFront++;
+    auto same = std::find_if(front.begin(), front.end(),
+                             [&](const FrontEntry &entry) { return sameScores(*entry.result, candidate); });
+    if (same != front.end())
+      same->sets++;
+    else
+      front.push_back({&candidate, 1});
+  }
+  std::sort(front.begin(), front.end(), [](const FrontEntry &a, const FrontEntry &b) {
+    unsigned long x = a.result->score.missed + a.result->score.falseTouches;
+    unsigned long y = b.result->score.missed + b.result->score.falseTouches;
+    return x != y ? x < y : a.result->latencyMs < b.result->latencyMs;
+  });
+  printf("\nPareto front (%zu sets, %zu different scores):\n%s,sets\n", onFront, front.size(), header);
+  for (const FrontEntry &entry : front)
+  {
+    printResult(stdout, *entry.result);
+    printf(",%zu\n", entry.sets);
+  }
+  return 0;
+}
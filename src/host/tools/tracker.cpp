@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "host/corpus.h"
+#include "params.h"
+#include "proximity.h"
+
+// Does the proximity tracker (include/proximity.h) see a finger sooner
+// than lightAtNear()'s average, and does it wobble more or less?
+//
+//   .pio/build/tracker/program [traces...] [--hours 6] [--accel 500,2000]
+//
+// Each trace is replayed through the 50 reading average the way
+// addMeasurement() keeps it, and through the tracker at the firmware's
+// track_accel and at each --accel, and both are compared with where the
+// finger really was: the reading minus the true baseline, averaged over
+// TRACKER_REF_READINGS either side.  Looking both ways means that
+// reference has no lag, which no filter on the board can manage.
+//
+//   lag_ms    on each finger visit, how long after the reference passed
+//             TRACKER_LEVEL counts over the baseline the filter did
+//             (median and 95th percentile).  Negative is earlier - noise
+//             can push a filter over the line early.
+//   idle      RMS of the filter, in counts over the baseline, with nobody
+//             near: how much it wobbles on its own.
+//   near      RMS difference from the reference while a finger is about
+//             but not touching: how closely it follows.
+//   vel       RMS difference between the tracker's velocity and the
+//             reference's, in counts a second, and how often they agree
+//             on whether the finger is coming or going when it is clearly
+//             doing one or the other.  The average has no velocity.
+//
+// With no traces it makes its own: quiet, noisy, drifting and spiky
+// rooms, as quality does.  Trace files need the baseline column (see
+// trace.h).
+
+#define TRACKER_REF_READINGS 10  // Either side, for the reference.
+#define TRACKER_VEL_READINGS 5   // Either side, for its velocity.
+#define TRACKER_LEVEL 10         // Counts over the baseline, for lag_ms.
+#define TRACKER_MOVING 20        // Counts a second that is clearly moving.
+#define TRACKER_TOUCH_MARGIN_US 300000 // Left out either side of a touch.
+#define TRACKER_IDLE_MARGIN_US 1000000 // Left out either side of a visit.
+#define TRACKER_NUM_MEAS 50      // NUM_MEAS in main.cpp.
+
+struct Filter
+{
+  std::string name;
+  int accel; // 0 for the average.
+};
+
+struct Tally
+{
+  std::vector<double> lags;
+  double idleSquares = 0;
+  unsigned long idleCount = 0;
+  double nearSquares = 0;
+  unsigned long nearCount = 0;
+  double velSquares = 0;
+  unsigned long velCount = 0;
+  unsigned long moving = 0, agreed = 0;
+
+  void add(const Tally &other)
+  {
+    lags.insert(lags.end(), other.lags.begin(), other.lags.end());
+    idleSquares += other.idleSquares;
+    idleCount += other.idleCount;
+    nearSquares += other.nearSquares;
+    nearCount += other.nearCount;
+    velSquares += other.velSquares;
+    velCount += other.velCount;
+    moving += other.moving;
+    agreed += other.agreed;
+  }
+};
+
+// Where each reading stands: nobody about, a finger about, or too close
+// to a touch (or the edges of a visit) to say.
+enum Phase
+{
+  PHASE_IDLE,
+  PHASE_NEAR,
+  PHASE_SKIP,
+};
+
+static std::vector<uint8_t> phases(const CorpusTrace &trace)
+{
+  std::vector<uint8_t> phase(trace.readings.size(), PHASE_IDLE);
+  for (const SignalEvent &event : trace.events)
+  {
+    if (event.kind != SIGNAL_FINGER)
+      continue;
+    for (size_t i = 0; i < trace.readings.size(); i++)
+    {
+      uint64_t t = trace.readings[i].tUs;
+      if (t + TRACKER_IDLE_MARGIN_US < event.startUs || t > event.endUs + TRACKER_IDLE_MARGIN_US)
+        continue;
+      bool inside = t >= event.startUs && t <= event.endUs;
+      bool touching = event.touchStartUs != 0 && t + TRACKER_TOUCH_MARGIN_US >= event.touchStartUs &&
+                      t <= event.touchEndUs + TRACKER_TOUCH_MARGIN_US;
+      if (inside && !touching && phase[i] != PHASE_SKIP)
+        phase[i] = PHASE_NEAR;
+      else
+        phase[i] = PHASE_SKIP;
+    }
+  }
+  return phase;
+}
+
+// The lag-free reference, and its velocity in counts a second.
+static void reference(const CorpusTrace &trace, std::vector<double> &ref, std::vector<double> &vel)
+{
+  size_t n = trace.readings.size();
+  ref.assign(n, 0);
+  vel.assign(n, 0);
+  for (size_t i = 0; i < n; i++)
+  {
+    size_t from = i >= TRACKER_REF_READINGS ? i - TRACKER_REF_READINGS : 0;
+    size_t to = std::min(n - 1, i + TRACKER_REF_READINGS);
+    double sum = 0;
+    for (size_t j = from; j <= to; j++)
+      sum += trace.readings[j].raw - trace.baseline[j];
+    ref[i] = sum / (to - from + 1);
+  }
+  for (size_t i = TRACKER_VEL_READINGS; i + TRACKER_VEL_READINGS < n; i++)
+  {
+    size_t a = i - TRACKER_VEL_READINGS, b = i + TRACKER_VEL_READINGS;
+    vel[i] = (ref[b] - ref[a]) / ((trace.readings[b].tUs - trace.readings[a].tUs) / 1e6);
+  }
+}
+
+// Run one filter over one trace: what it said at each reading, in counts
+// over the true baseline, and its velocity.
+static void run(const CorpusTrace &trace, const Filter &filter, std::vector<double> &out, std::vector<double> &vel)
+{
+  size_t n = trace.readings.size();
+  out.assign(n, 0);
+  vel.assign(n, 0);
+  if (filter.accel == 0)
+  {
+    // addMeasurement(), fed every reading.
+    std::vector<int> set(TRACKER_NUM_MEAS, 0);
+    long sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      int raw = trace.readings[i].raw;
+      sum += raw - set[i % TRACKER_NUM_MEAS];
+      set[i % TRACKER_NUM_MEAS] = raw;
+      out[i] = (i + 1 < TRACKER_NUM_MEAS ? raw : sum / TRACKER_NUM_MEAS) - trace.baseline[i];
+    }
+    return;
+  }
+  ProximityTracker tracker = {};
+  for (size_t i = 0; i < n; i++)
+  {
+    int raw = trace.readings[i].raw;
+    bool quiet = raw <= (int)lround(trace.baseline[i]) + MIN_OVER_THRESHOLD;
+    proximitySample(tracker, (uint32_t)(trace.readings[i].tUs / 1000), raw, (int)lround(trace.baseline[i]), quiet,
+                    filter.accel);
+    out[i] = proximityLevel(tracker) - trace.baseline[i];
+    vel[i] = proximityVelocity(tracker);
+  }
+}
+
+static Tally score(const CorpusTrace &trace, const std::vector<uint8_t> &phase, const std::vector<double> &ref,
+                   const std::vector<double> &refVel, const std::vector<double> &out, const std::vector<double> &vel,
+                   bool hasVelocity)
+{
+  Tally tally;
+  size_t n = trace.readings.size();
+  for (size_t i = 0; i < n; i++)
+  {
+    if (phase[i] == PHASE_IDLE)
+    {
+      tally.idleSquares += out[i] * out[i];
+      tally.idleCount++;
+    }
+    else if (phase[i] == PHASE_NEAR)
+    {
+      tally.nearSquares += (out[i] - ref[i]) * (out[i] - ref[i]);
+      tally.nearCount++;
+      if (hasVelocity)
+      {
+        tally.velSquares += (vel[i] - refVel[i]) * (vel[i] - refVel[i]);
+        tally.velCount++;
+        if (fabs(refVel[i]) > TRACKER_MOVING)
+        {
+          tally.moving++;
+          tally.agreed += (vel[i] > 0) == (refVel[i] > 0);
+        }
+      }
+    }
+  }
+
+  for (const SignalEvent &event : trace.events)
+  {
+    if (event.kind != SIGNAL_FINGER || event.peakCounts < 2 * TRACKER_LEVEL)
+      continue;
+    uint64_t endUs = event.touchStartUs != 0 ? event.touchStartUs : event.endUs;
+    double refAt = -1, outAt = -1;
+    for (size_t i = 0; i < n && trace.readings[i].tUs <= endUs + TRACKER_TOUCH_MARGIN_US; i++)
+    {
+      uint64_t t = trace.readings[i].tUs;
+      if (t < event.startUs)
+        continue;
+      if (refAt < 0 && ref[i] >= TRACKER_LEVEL && t <= endUs)
+        refAt = t;
+      if (outAt < 0 && out[i] >= TRACKER_LEVEL)
+        outAt = t;
+    }
+    if (refAt >= 0 && outAt >= 0)
+      tally.lags.push_back((outAt - refAt) / 1000);
+  }
+  return tally;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+  if (values.empty())
+    return NAN;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+static void printRow(const char *trace, const Filter &filter, const Tally &tally)
+{
+  printf("%-10s %-14s %7.0f %7.0f %7.2f %7.2f", trace, filter.name.c_str(), percentile(tally.lags, 0.5),
+         percentile(tally.lags, 0.95), sqrt(tally.idleSquares / std::max(1ul, tally.idleCount)),
+         sqrt(tally.nearSquares / std::max(1ul, tally.nearCount)));
+  if (filter.accel == 0)
+    printf(" %7s %7s\n", "-", "-");
+  else
+    printf(" %7.1f %6.1f%%\n", sqrt(tally.velSquares / std::max(1ul, tally.velCount)),
+           100.0 * tally.agreed / std::max(1ul, tally.moving));
+}
+
+int main(int argc, char **argv)
+{
+  double hours = 6;
+  std::vector<Filter> filters = {{"average 50", 0}, {"tracker " + std::to_string(TRACK_ACCEL), TRACK_ACCEL}};
+  Corpus corpus;
+  std::vector<std::string> names;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : "0";
+    if (strcmp(arg, "--hours") == 0)
+      hours = atof(value), i++;
+    else if (strcmp(arg, "--accel") == 0)
+    {
+      for (const char *at = value; *at != '\0';)
+      {
+        char *end;
+        int accel = (int)strtol(at, &end, 10);
+        if (end == at || accel <= 0)
+        {
+          fprintf(stderr, "bad --accel %s\n", value);
+          return 2;
+        }
+        filters.push_back({"tracker " + std::to_string(accel), accel});
+        at = *end == ',' ? end + 1 : end;
+      }
+      i++;
+    }
+    else if (arg[0] != '-')
+    {
+      if (!corpusLoad(arg, corpus))
+      {
+        fprintf(stderr, "can't use %s - it needs a baseline column\n", arg);
+        return 1;
+      }
+      names.push_back(arg);
+    }
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (corpus.empty())
+  {
+    SignalConfig quiet, noisy, drifting, spiky;
+    noisy.whiteNoise = 2.5;
+    noisy.pinkNoise = 1.5;
+    noisy.humCounts = 1.5;
+    drifting.driftPerDay = 30;
+    drifting.thermalCounts = 10;
+    drifting.humidityCounts = 8;
+    spiky.spikesPerHour = 6;
+    corpusSynthetic(1, hours, 1, quiet, corpus);
+    corpusSynthetic(1, hours, 2, noisy, corpus);
+    corpusSynthetic(1, hours, 3, drifting, corpus);
+    corpusSynthetic(1, hours, 4, spiky, corpus);
+    names = {"quiet", "noisy", "drifting", "spiky"};
+  }
+
+  printf("%-10s %-14s %7s %7s %7s %7s %7s %7s\n", "trace", "filter", "lag_ms", "p95_ms", "idle", "near", "vel",
+         "sign");
+  std::vector<Tally> totals(filters.size());
+  for (size_t t = 0; t < corpus.size(); t++)
+  {
+    const CorpusTrace &trace = corpus[t];
+    std::vector<uint8_t> phase = phases(trace);
+    std::vector<double> ref, refVel, out, vel;
+    reference(trace, ref, refVel);
+    for (size_t f = 0; f < filters.size(); f++)
+    {
+      run(trace, filters[f], out, vel);
+      Tally tally = score(trace, phase, ref, refVel, out, vel, filters[f].accel != 0);
+      printRow(names[t].c_str(), filters[f], tally);
+      totals[f].add(tally);
+    }
+  }
+  printf("\n");
+  for (size_t f = 0; f < filters.size(); f++)
+    printRow("overall", filters[f], totals[f]);
+  return 0;
+}
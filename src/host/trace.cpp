@@ -0,0 +1,186 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host/trace.h"
+
+#define TRACE_BUFFER (1 << 20) // Read a megabyte at a time.
+#define TRACE_COLUMNS 8
+
+TraceReader::~TraceReader()
+{
+  if (file != nullptr && file != stdin)
+    fclose(file);
+  free(buffer);
+}
+
+bool TraceReader::open(const char *path)
+{
+  file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (file == nullptr)
+    return false;
+  buffer = (char *)malloc(TRACE_BUFFER + 1);
+  return buffer != nullptr;
+}
+
+// Hand back the next line, without its newline, straight out of the
+// buffer.  Much faster than fgets() and a copy.
+bool TraceReader::readLine(char *&line)
+{
+  for (;;)
+  {
+    char *newline = (char *)memchr(buffer + start, '\n', end - start);
+    if (newline != nullptr)
+    {
+      *newline = '\0';
+      line = buffer + start;
+      start = newline + 1 - buffer;
+      return true;
+    }
+    if (eof)
+    {
+      if (start == end)
+        return false;
+      buffer[end] = '\0'; // Last line with no newline.
+      line = buffer + start;
+      start = end;
+      return true;
+    }
+    // Slide what is left to the front and top up.
+    memmove(buffer, buffer + start, end - start);
+    end -= start;
+    start = 0;
+    if (end == TRACE_BUFFER)
+    {
+      end = 0; // A line longer than the whole buffer: drop it.
+      badLines++;
+    }
+    size_t got = fread(buffer + end, 1, TRACE_BUFFER - end, file);
+    end += got;
+    if (got == 0)
+      eof = true;
+  }
+}
+
+// Split `line` on commas in place.
+static int splitColumns(char *line, char **columns)
+{
+  int count = 0;
+  columns[count++] = line;
+  for (char *c = line; *c != '\0' && count < TRACE_COLUMNS; c++)
+  {
+    if (*c == ',')
+    {
+      *c = '\0';
+      columns[count++] = c + 1;
+    }
+  }
+  return count;
+}
+
+void TraceReader::parseHeader(char *line)
+{
+  char *columns[TRACE_COLUMNS];
+  int count = splitColumns(line, columns);
+  timeColumn = rawColumn = labelColumn = baselineColumn = -1;
+  for (int i = 0; i < count; i++)
+  {
+    const char *name = columns[i];
+    if (strcmp(name, "t_us") == 0 || strcmp(name, "t_ms") == 0)
+    {
+      timeColumn = i;
+      timeInMs = name[2] == 'm';
+    }
+    else if (strcmp(name, "raw") == 0 || strcmp(name, "qt1") == 0)
+      rawColumn = i;
+    else if (strcmp(name, "label") == 0)
+      labelColumn = i;
+    else if (strcmp(name, "baseline") == 0)
+      baselineColumn = i;
+  }
+}
+
+static SignalEvent parseEvent(char **columns)
+{
+  SignalEvent event;
+  event.kind = strcmp(columns[1], "spike") == 0 ? SIGNAL_SPIKE : SIGNAL_FINGER;
+  event.startUs = strtoull(columns[2], nullptr, 10);
+  event.endUs = strtoull(columns[3], nullptr, 10);
+  event.touchStartUs = strtoull(columns[4], nullptr, 10);
+  event.touchEndUs = strtoull(columns[5], nullptr, 10);
+  event.closestMm = atof(columns[6]);
+  event.peakCounts = atof(columns[7]);
+  return event;
+}
+
+// strtol() without the locale and error handling, which is most of its
+// cost.  Sets `ok` false on anything that is not a plain integer.
+static int64_t parseInteger(const char *text, bool &ok)
+{
+  bool negative = *text == '-';
+  if (negative)
+    text++;
+  if (*text < '0' || *text > '9')
+    ok = false;
+  int64_t value = 0;
+  while (*text >= '0' && *text <= '9')
+    value = value * 10 + (*text++ - '0');
+  if (*text != '\0' && *text != '\r')
+    ok = false;
+  return negative ? -value : value;
+}
+
+bool TraceReader::next(TraceSample &sample)
+{
+  char *line;
+  while (readLine(line))
+  {
+    if (line[0] == '#')
+    {
+      char *columns[TRACE_COLUMNS];
+      if (strncmp(line, "# event,", 8) == 0 && splitColumns(line, columns) == TRACE_COLUMNS)
+        events.push_back(parseEvent(columns));
+      continue;
+    }
+    if (line[0] == 't')
+    {
+      parseHeader(line);
+      continue;
+    }
+    if (line[0] == '\0' || line[0] == '\r')
+      continue;
+
+    char *columns[TRACE_COLUMNS];
+    int count = splitColumns(line, columns);
+    bool ok = timeColumn >= 0 && rawColumn >= 0 && timeColumn < count && rawColumn < count;
+    if (ok)
+    {
+      int64_t t = parseInteger(columns[timeColumn], ok);
+      sample.tUs = timeInMs ? t * 1000 : t;
+      sample.raw = (int)parseInteger(columns[rawColumn], ok);
+      sample.label = labelColumn >= 0 && labelColumn < count ? (int)parseInteger(columns[labelColumn], ok) : -1;
+      sample.baseline = baselineColumn >= 0 && baselineColumn < count ? strtof(columns[baselineColumn], nullptr) : NAN;
+    }
+    if (ok)
+      return true;
+    badLines++;
+  }
+  return false;
+}
+
+void traceWriteHeader(FILE *out)
+{
+  fputs("t_us,raw,label,baseline\n", out);
+}
+
+void traceWriteSample(FILE *out, const SignalSample &sample)
+{
+  fprintf(out, "%" PRIu64 ",%d,%u,%.2f\n", sample.tUs, sample.raw, sample.label, sample.baseline);
+}
+
+void traceWriteEvent(FILE *out, const SignalEvent &event)
+{
+  fprintf(out, "# event,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%.1f\n",
+          event.kind == SIGNAL_FINGER ? "finger" : "spike", event.startUs, event.endUs, event.touchStartUs,
+          event.touchEndUs, event.closestMm, event.peakCounts);
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "host/signal_gen.h"
+
+// Sensor traces on disk.
+//
+// A trace is a CSV file, one reading per line:
+//
+//   t_us,raw,label,baseline
+//   0,726,0,725.31
+//   11093,724,0,725.31
+//
+// `label` and `baseline` are the ground truth when the trace is synthetic
+// (label is a SignalLabel).  Lines starting with '#' are comments, and
+// the events behind the readings are recorded as comments too, so tools
+// that only want the readings can skip them:
+//
+//   # event,finger,start_us,end_us,touch_start_us,touch_end_us,closest_mm,peak_counts
+//   # event,spike,start_us,end_us,0,0,0,peak_counts
+//
+// The reader also takes the flight recorder's "dump" output as it is
+// (t_ms,qt1,qt_base,pwm), so traces caught on a real box replay the
+// same way.  Columns are found by name; `raw` may also be called `qt1`
+// and times may be in `t_us` or `t_ms`.
+
+// One reading from a trace.  Traces without ground truth have a label
+// of -1 and a NAN baseline.
+struct TraceSample
+{
+  uint64_t tUs;
+  int raw;
+  int label;
+  float baseline;
+};
+
+struct TraceReader
+{
+  TraceReader() {}
+  ~TraceReader();
+  TraceReader(const TraceReader &) = delete;
+  TraceReader &operator=(const TraceReader &) = delete;
+
+  bool open(const char *path); // "-" reads standard input.
+  bool next(TraceSample &sample);
+
+  bool hasTruth() const { return labelColumn >= 0; }
+
+  std::vector<SignalEvent> events; // From "# event" lines read so far.
+  unsigned long badLines = 0;
+
+private:
+  bool readLine(char *&line);
+  void parseHeader(char *line);
+
+  FILE *file = nullptr;
+  char *buffer = nullptr;
+  size_t start = 0; // Unread part of the buffer.
+  size_t end = 0;
+  bool eof = false;
+  int timeColumn = -1;
+  bool timeInMs = false;
+  int rawColumn = -1;
+  int labelColumn = -1;
+  int baselineColumn = -1;
+};
+
+void traceWriteHeader(FILE *out);
+void traceWriteSample(FILE *out, const SignalSample &sample);
+void traceWriteEvent(FILE *out, const SignalEvent &event);
+
+#endif
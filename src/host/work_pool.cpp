@@ -0,0 +1,95 @@
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "host/work_pool.h"
+
+// What is left of one thread's share: indices [next, end).
+struct WorkSlice
+{
+  std::mutex lock;
+  size_t next = 0;
+  size_t end = 0;
+};
+
+static bool takeOwn(WorkSlice &slice, size_t &index)
+{
+  std::lock_guard<std::mutex> guard(slice.lock);
+  if (slice.next >= slice.end)
+    return false;
+  index = slice.next++;
+  return true;
+}
+
+// Move the back half of the fullest other slice into `own`.
+static bool steal(std::vector<WorkSlice> &slices, WorkSlice &own)
+{
+  for (;;)
+  {
+    WorkSlice *victim = nullptr;
+    size_t most = 0;
+    for (WorkSlice &slice : slices)
+    {
+      if (&slice == &own)
+        continue;
+      std::lock_guard<std::mutex> guard(slice.lock);
+      if (slice.end - slice.next > most)
+      {
+        most = slice.end - slice.next;
+        victim = &slice;
+      }
+    }
+    if (victim == nullptr)
+      return false;
+
+    size_t begin, end;
+    {
+      std::lock_guard<std::mutex> guard(victim->lock);
+      size_t left = victim->end - victim->next;
+      if (left == 0)
+        continue; // Someone got there first; look again.
+      end = victim->end;
+      begin = end - (left + 1) / 2;
+      victim->end = begin;
+    }
+    std::lock_guard<std::mutex> guard(own.lock);
+    own.next = begin;
+    own.end = end;
+    return true;
+  }
+}
+
+void workPoolRun(size_t count, const std::function<void(size_t index)> &task, unsigned threads)
+{
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if (threads == 0)
+    threads = 1;
+  if (threads > count)
+    threads = count > 0 ? count : 1;
+
+  std::vector<WorkSlice> slices(threads);
+  for (unsigned i = 0; i < threads; i++)
+  {
+    slices[i].next = count * i / threads;
+    slices[i].end = count * (i + 1) / threads;
+  }
+
+  auto worker = [&](unsigned id) {
+    WorkSlice &own = slices[id];
+    size_t index;
+    for (;;)
+    {
+      if (takeOwn(own, index))
+        task(index);
+      else if (!steal(slices, own))
+        return;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; i++)
+    pool.emplace_back(worker, i);
+  worker(0);
+  for (std::thread &thread : pool)
+    thread.join();
+}
@@ -0,0 +1,18 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stddef.h>
+#include <functional>
+
+// Run task(i) for every i in [0, count) on all the cores of the machine.
+//
+// Each thread starts with an equal slice of the indices and works through
+// it from the front.  A thread that runs out steals the back half of the
+// biggest slice left, so a few slow tasks at the end of one slice don't
+// leave the other cores idle.  Returns when every task has finished.
+//
+// `threads` of 0 means one per core.  Tasks must not share anything they
+// write to without their own locking.
+void workPoolRun(size_t count, const std::function<void(size_t index)> &task, unsigned threads = 0);
+
+#endif
@@ -0,0 +1,105 @@
+#include "hal.h"
+#include "latency.h"
+
+static RunStats nearStats;
+static RunStats touchStats;
+static bool started = false;
+static unsigned long unanswered = 0;
+
+static bool wasNear = false;
+static bool wasTouch = false;
+static int lastPwm = 0;
+
+// Outstanding onsets waiting for the light to answer.
+static bool nearPending = false;
+static bool touchPending = false;
+static uint32_t nearStartUs = 0;
+static uint32_t touchStartUs = 0;
+static int nearStartPwm = 0;
+
+static void start()
+{
+  if (!started)
+    latencyReset();
+}
+
+void latencySample(uint32_t nowUs, bool near, bool touch)
+{
+  start();
+
+  if (!near && !touch)
+  {
+    // Finger gone.  Anything still waiting never got an answer.
+    unanswered += nearPending + touchPending;
+    nearPending = false;
+    touchPending = false;
+  }
+
+  // Nothing can answer a finger that comes near while the light is
+  // already full on, so that one isn't timed.
+  if (near && !wasNear && !wasTouch && !nearPending && lastPwm < LATENCY_FULL_PWM)
+  {
+    nearPending = true;
+    nearStartUs = nowUs;
+    nearStartPwm = lastPwm;
+  }
+  if (touch && !wasTouch && !touchPending)
+  {
+    touchPending = true;
+    touchStartUs = nowUs;
+  }
+
+  wasNear = near;
+  wasTouch = touch;
+}
+
+void latencyLight(uint32_t nowUs, int pwm)
+{
+  lastPwm = pwm;
+  if (nearPending && pwm > nearStartPwm)
+  {
+    runStatsAdd(nearStats, nowUs - nearStartUs);
+    nearPending = false;
+  }
+  if (touchPending && pwm >= LATENCY_FULL_PWM)
+  {
+    runStatsAdd(touchStats, nowUs - touchStartUs);
+    touchPending = false;
+  }
+}
+
+const RunStats &latencyNear()
+{
+  start();
+  return nearStats;
+}
+
+const RunStats &latencyTouch()
+{
+  start();
+  return touchStats;
+}
+
+unsigned long latencyUnanswered()
+{
+  return unanswered;
+}
+
+void latencyReset()
+{
+  runStatsReset(nearStats);
+  runStatsReset(touchStats);
+  unanswered = 0;
+  nearPending = false;
+  touchPending = false;
+  started = true;
+}
+
+void latencyReport()
+{
+  start();
+  runStatsPrint("near to light", nearStats, "us");
+  runStatsPrint("touch to full", touchStats, "us");
+  halPrint("unanswered: ");
+  halPrintln(unanswered);
+}
@@ -1,7 +1,19 @@
-#include <Arduino.h>
-#include "Adafruit_FreeTouch.h"  // If you don't know about Adafruit
-                                 // checkout https://adafruit.com
-                                 // it will be your new IOT addiction.
+#include "console.h"
+#include "detect.h"
+#include "distance.h"
+#include "flight_recorder.h"
+#include "gesture.h"
+#include "hal.h"
+#include "latency.h"
+#include "memory_monitor.h"
+#include "params.h"
+#include "profiler.h"
+#include "proximity.h"
+#include "sensor_health.h"
+#include "stats.h"
+#include "store.h"
+#include "tap_lock.h"
+#include "water_film.h"
 
 // Author: Matthew Amacker
 // Date: 2021-09-25
@@ -78,31 +90,12 @@
 
 // ----
 
-// This library does the pin assignment and sampling of the
-// capacitance between the pin and ground.  It takes advantage
-// of the analog to digital converter on the board to do the
-// sampling.  Generally it measures how long it takes for the
-// pin voltage to read HIGH as it fills the capacitance of the
-// pin + resitistor combination.  Turns out chips like these have
-// resistors you can dynamically attach to the pins.  So, you can
-// use the pins as capacitive sensors.  This is a very cool feature
-// of the chip.  It is also a very cool feature of the chip that
-// you can use the analog to digital converter to sample the
-// voltage on the pin.  This is what this library does.  It samples
-// the voltage on one of the pins as it turns that pin on and off
-// at a specific frequency.  Since it knows the frequency and what it
-// expects the voltage to be.  The time it takes to reach that voltage
-// is able to be repeatedly measured.  This is the basis of the
-// capacitive touch sensing.  The longer it takes to reach the voltage
-// the more capacitance there is between the pin and ground.  The
-// shorter the time, the less capacitance there is between the pin
-// and ground.  Human fingers modify the capacitance between the
-// pin and ground.  So, by measuring the time it takes to reach
-// the voltage, we can determine if a finger is touching the pin.
-// That A0 - means a specific ANALOG READ pin on the board.  There is a mapping
-// to real pins hidden away in the .h files attached to this code.  In this
-// case A0 is pin 2.  Only some pins have the fancy "analog read" capability.
-Adafruit_FreeTouch qt_1 = Adafruit_FreeTouch(A0, OVERSAMPLE_1, RESISTOR_100K, FREQ_MODE_NONE);
+// All the talking to hardware - the touch sensor on A0, the LED pin,
+// the serial port and the clock - goes through the small set of hal*
+// functions in hal.h.  On the board they call straight into the Arduino
+// API and the Adafruit FreeTouch library; have a look at hal_arduino.cpp
+// for how the capacitive sensing itself works.  On a PC they are
+// simulated, so this exact file can also be run and tested there.
 
 // Note - some functions/magic numbers have to be defined before 
 // they are used.
@@ -129,15 +122,16 @@ Adafruit_FreeTouch qt_1 = Adafruit_FreeTouch(A0, OVERSAMPLE_1, RESISTOR_100K, FR
 // pass to execute the code.  So, it is a little more like Javascript
 // than C/C++ in this regard... mostly to help out beginners.
 
-#define NUM_BASELINE 5000 // Number of samples to take for the baseline
 #define NOODLE_PIN 4 // Where the LED is attached.
-#define SPREAD 63 // The range of values between the base and the threshold
-                  // that seems to be the most stable for devices I've
-                  // tested.  This is a magic number that may need to be
-                  // adjusted for different devices.
-                  // Note how there is no '=' or ';'
-                  // That's because these are drop-in
-                  // replacements for the pre-processor.
+                     // Note how there is no '=' or ';'
+                     // That's because these are drop-in
+                     // replacements for the pre-processor.
+
+// The tunables - SPREAD, MIN_OVER_THRESHOLD and friends - live in
+// params.h.  The code below uses the lowercase variables that hold
+// their current values, so they can be changed over serial without
+// reflashing.  The detection code itself, and its own magic numbers,
+// are in detect.h, so the PC tools can run exactly the same thing.
 
 // Most IOT programs you find will always output their serial
 // messages because its easier to always see them.  This device
@@ -145,57 +139,110 @@ Adafruit_FreeTouch qt_1 = Adafruit_FreeTouch(A0, OVERSAMPLE_1, RESISTOR_100K, FR
 // which ruins the magic.  So, we have to go through the pain
 // of turning on and off debugging mode.  This is done by
 // touching the sensor a specific number of times. 
-boolean debugging = true;
+bool debugging = true;
 
 // Note - everytime a message is sent over the serial the TX light
 // on the board will blink.  This is a good way to know that the
 // board is in debug mode.  The trouble is the light blinking is
 // annoying when you don't want it.  Which is why we go through
 // the pain of going into debug mode.
-void checkDebug(int touchTime);
+void checkDebug();
 
 // This is the set of readings that we will use to determine the
 // base value of the sensor.  We will take the average of these
 // readings to determine the base value.  These are beeing constantly
 // updated through the loop function.
-int base_readings[NUM_BASELINE];
-int base_ct = 0;
+int base_readings[DETECT_NUM_BASELINE];
+
+// And the last few "near" readings, which are averaged to set how
+// bright the light glows as a finger comes close.
+int measSet[DETECT_NUM_MEAS];
+
+// Everything the detection code remembers from one reading to the next
+// (see detect.h).  detector.base is the baseline.
+DetectState detector(base_readings, DETECT_NUM_BASELINE, measSet, DETECT_NUM_MEAS, &proximity_tracker);
 
 // This is the threshold value that we will use to determine if
-// the sensor is being touched.  This is updated through the loop
-// avg function.
-int qt_base = 725;
-int qt_Threshold = qt_base + SPREAD;
-void lightAtStep(bool reset);
-void lightAtNear(int measurement);
-
-// This is the function that averages in a new base reading.
-// Readings will float based on a number of factors.  Moisture
-// in the air (a.k.a. the dialectric), temperature, and the
-// physical properties of the sensor and even radio energy
-// both emitted and absorbed by nearby metals.  So, we need
-// to constantly update the base value.
-// This is the heart of the "adaptive" or "learning" part.
-int baseAvg(int reading)
+// the sensor is being touched.  This is updated through the loop.
+int qt_Threshold = DETECT_START_BASE + SPREAD;
+
+// What the latest reading was judged to be.  Nothing on the board reads
+// this - it is here so the PC tools can score the detection against
+// traces where we know what the finger was really doing (see src/host).
+DetectReading detect_reading = {};
+
+// Every change to the LED goes through here, so we always know what
+// the light is doing.  The flight recorder uses this to log the
+// output alongside the readings that caused it, and the latency
+// tracker to see how long the light took to answer a finger.
+//
+// A double tap can dim the whole light a step (see "gestures" in
+// params.h).  That is done here, on the way out to the pin, so
+// everything else - light_pwm included - still works in full
+// brightness and doesn't need to know.
+#define NUM_LIGHT_LEVELS 3
+static const int LIGHT_LEVELS[NUM_LIGHT_LEVELS] = {255, 96, 24};
+int light_level = 0; // Index into LIGHT_LEVELS.
+int light_pwm = 0;
+void writeLight(int brightness)
 {
-  base_ct++;
+  light_pwm = brightness;
+  halPwmWrite(NOODLE_PIN, brightness * LIGHT_LEVELS[light_level] / 255);
+  latencyLight(halMicros(), brightness);
+}
 
-  // By using MODULO, we can keep the array index within the
-  // bounds of the array. Treating it as a circular buffer.
-  base_readings[base_ct % NUM_BASELINE] = reading;
+// The pieces of the detection code on their own, as the bench and cycles
+// tools time them.  loop() runs them all through detectSample() and
+// detectLight().
+int baseAvg(int reading)
+{
+  return detectBaseAvg(detector, reading);
+}
 
-  int sum = 0;
-  for (int i = 0; i < NUM_BASELINE; i++)
+// Every so often say what the near average is.
+static void printAverage()
+{
+  if (detector.measCount % DETECT_NUM_MEAS == 0 && debugging)
   {
-    sum += base_readings[i];
+    halPrint("Avg: ");
+    halPrintln(detector.avg);
   }
-  return sum / NUM_BASELINE;
+}
+
+int addMeasurement(int measurement)
+{
+  int avgMeasure = detectAddMeasurement(detector, measurement);
+  printAverage();
+  return avgMeasure;
+}
+
+void lightAtNear(int measurement)
+{
+  if (detectAtNear(detector, detectParams(), measurement))
+    writeLight(detector.pwm);
+}
+
+void lightAtStep(bool reset)
+{
+  if (detectAtStep(detector, detectParams(), reset))
+    writeLight(detector.pwm);
+}
+
+// Throw away everything the baseline has learned and start again from
+// `value`.  This happens at boot, and whenever something decides the
+// old readings no longer describe the sensor.
+void resetBaseline(int value)
+{
+  detectFillBaseline(detector, value);
+  statsBaselineReset();
 }
 
 // the setup function runs once when you press reset or power the board
 void setup()
 {
-  Serial.begin(115200); // Baud rate.  This is the speed at which the serial
+  memoryPaint(); // Before anything else uses the stack.  See memory_monitor.h.
+
+  halSerialBegin(115200); // Baud rate.  This is the speed at which the serial
                         // port will communicate.  Which boils down to how
                         // fast bit voltages will be toggled on the wires 
                         // used in the TX and RX pins.  This is a very 
@@ -204,7 +251,7 @@ void setup()
                         // is a property of the serial port.  So, you have
                         // to set it on both the board and the computer.
 
-  Serial.println("Booted"); // Gotta say something.  Note, a lot of times
+  halPrintln("Booted"); // Gotta say something.  Note, a lot of times
                             // the serial monitor will not show the first
                             // message.  So, I like to put a message in
                             // the setup function that I know will show
@@ -220,11 +267,11 @@ void setup()
   // that cause various transistors connected to the pins to be turned 
   // on and off - this is how the CPU controls the pins and other devices
   // linked to the pins (resitors for example).
-  pinMode(NOODLE_PIN, OUTPUT);
+  halPinOutput(NOODLE_PIN);
   // You might wonder why the LED pin is called "NOODLE" - check out:
   // https://www.adafruit.com/product/5503
   // this is what my fairy boxes use.
-  digitalWrite(NOODLE_PIN, 0); // Always good habit to set state. Sometimes
+  halDigitalWrite(NOODLE_PIN, false); // Always good habit to set state. Sometimes
                                // the board will boot with the pin in a
                                // weird state.  So, it is good to set it
                                // to a known state. This is another "value"
@@ -237,16 +284,24 @@ void setup()
   // tight measurements.  Timers are interrupts that happen at a very
   // specific time outside of code execution walking with the program
   // counter.
-  if (!qt_1.begin())
-    Serial.println("Failed to begin qt");
+  if (!halTouchBegin())
+    halPrintln("Failed to begin qt");
+
+  // Pick up any tunables that were saved on this particular box.  Each
+  // box is a little different, so they may have been tweaked over serial.
+  storeBegin();
+  if (loadParams())
+    halPrintln("Loaded saved settings");
+  if (loadDistance())
+    halPrintln("Loaded distance calibration");
+  if (tapLockBegin())
+    halPrintln("Loaded secret knocks");
+  statsBegin();
 
   // At the start of the program, we will init default readings
   // and use the average of these readings to determine the base
   // value of the sensor.
-  for (int i = 0; i < NUM_BASELINE; i++)
-  {
-    base_readings[i] = qt_base; // Magic start value...
-  }
+  resetBaseline(DETECT_START_BASE); // Magic start value...
 }
 
 // The loop function runs over and over again forever, this is
@@ -273,279 +328,212 @@ void setup()
 // wake the CPU up when you need it (based on time, or pin event).  
 // But, that is a more advanced topic.
 // 
-#define BASELINE_TIME 5000 // Number of milliseconds to take baseline readings
-                           // before starting to do anything.
-#define LIGHT_ON_TIME 40000 // Number of milliseconds to keep the light on
-                            // after the user touches the sensor.  Note, light
-                            // throb time is "in" this.
-#define LIGHT_THROB_TIME 10000 // Number of milliseconds to keep the throbbing
-                            // after the on-light period.
 #define DEBUG_LOOP_COUNT 51 // Number of times through the loop before
                             // printing out the readings.
 #define DEBUG_CLEAR_TIME 30000 // Number of milliseconds afterwhich state 
                             // should be reset.
-#define MAXIMUM_BRIGHTNESS 255 // The LEDs can be *very* bright.  This allows
-                               // some amount of max control.
 void loop() // Magic function that is called over and over again.
 {
-  static int touchTime = millis() - DEBUG_CLEAR_TIME; // Start in a "clearable" state.
+  PROFILE_BEGIN(PROFILE_LOOP); // These PROFILE_ lines time each part of
+                               // the loop in profiling builds and vanish
+                               // otherwise.  See profiler.h.
   int qt1 = 0;
-  qt1 = qt_1.measure();
-
-  // Stash a reading... always - this is averaged over the 5000 or so
-  // readings for maintaining the baseline in the loop.  Note - the speed
-  // these are pulled in a managed by the "delay" at the end of this loop.
-  qt_base = baseAvg(qt1);
-  qt_Threshold = qt_base + SPREAD; // This magic 63 is the observed range distance
-                                   // between the base and the threshold that seems
-                                   // to be the most stable for the few devices I've
-                                   // tested.  It is possible that this value will
-                                   // need to be adjusted for different devices.
-
-  // This is the check to see if the sensor is being touched.
-  // If the reading is above the threshold, then the the reading is above 
-  // the threshold we belive a finger was needed to get it there.
-  if (qt1 >= qt_Threshold)
+  uint32_t sampleUs = halMicros(); // When this reading was taken.
+  PROFILE_BEGIN(PROFILE_MEASURE);
+  qt1 = halTouchMeasure();
+  PROFILE_END(PROFILE_MEASURE);
+  uint32_t now = halMillis();
+  DetectParams params = detectParams(); // The tunables, as they are now.
+
+  // Is the sensor itself still working (see sensor_health.h)?  A broken
+  // wire or a shorted pad gives readings that mean nothing, so while it
+  // is faulty they are kept away from the detection code.
+  HealthVerdict health = sensorHealthSample(now, qt1, detector.base);
+  if (health == HEALTH_NEW_FAULT)
   {
-    if (debugging) 
-    {
-      Serial.print("Someone touched me!");
-      Serial.println(qt1);
-    }
-    checkDebug(touchTime);
-    touchTime = millis(); // Record the timestamp of the touch, and use it later.
+    halPrint("Sensor fault: "); // Always - this is worth the TX blink.
+    halPrintln(sensorFaultName(sensorFault()));
+    statsSensorFault();
+    recorderTrigger(FR_TRIGGER_SENSOR_FAULT);
   }
-
-  // For the first 5 seconds... just take readings and don't do anything.
-  // millis is a function that returns the number of milliseconds since
-  // the program/processor started.
-  if (millis() < BASELINE_TIME)
+  else if (health == HEALTH_RECOVERED)
   {
-    delay(10);
-    return;
+    halPrint("Sensor fine again, new base: ");
+    halPrintln(sensorHealthLevel());
+    resetBaseline(sensorHealthLevel());
+    waterFilmReset(detector.water);
   }
-
-  // Assuming a touch occurred in the last LIGHT_ON_TIME milliseconds...
-  // If we are the main LIGHT_ON_TIME interval the light will either be
-  // full on, or in the last LIGHT_THROB_TIME interval it will throb.
-  // Note - if no touch has occurred in the last LIGHT_ON_TIME milliseconds
-  // then we check to see if the user is NEAR and light based on that nearness.
-  if (millis() - touchTime < LIGHT_ON_TIME)
+  bool faulty = health == HEALTH_FAULTY || health == HEALTH_NEW_FAULT;
+
+  // The baseline, water on the pad, and whether this is a touch, a
+  // finger near, or nothing at all (see detect.h).  Note - the speed
+  // readings are pulled in a managed by the "delay" at the end of this
+  // loop.
+  PROFILE_BEGIN(PROFILE_DETECT);
+  DetectReading reading = detectSample(detector, params, now, qt1, faulty);
+  PROFILE_END(PROFILE_DETECT);
+  if (reading.water == WATER_REBASE && debugging)
   {
-    // Check to see if we are in the last LIGHT_THROB_TIME of the 
-    // touch.
-    if (millis() - touchTime > LIGHT_ON_TIME - LIGHT_THROB_TIME) {
-      // This is the last part of the "ON" time.  It lets the user
-      // know its about to shut off.
-      lightAtStep(false);
-    } else {
-      // We just turn it on if we are in the "main" "on" portion of the light
-      // touch cycle.
-      analogWrite(NOODLE_PIN, MAXIMUM_BRIGHTNESS);
-      lightAtStep(true);
-    }
+    halPrint("Water on the pad, new base: ");
+    halPrintln(detector.water.level);
   }
-  else
+
+  qt_Threshold = detector.base + spread; // This magic 63 is the observed range distance
+                                         // between the base and the threshold that seems
+                                         // to be the most stable for the few devices I've
+                                         // tested.  It is possible that this value will
+                                         // need to be adjusted for different devices.
+  latencySample(sampleUs, reading.near, reading.touched);
+  if (reading.touched)
   {
-    // This function causes the light to be bright based in proportion to how
-    // close the user's finger is to the sensor.
-    lightAtNear(qt1);
+    if (debugging) 
+    {
+      PROFILE_BEGIN(PROFILE_PRINT);
+      halPrint("Someone touched me!");
+      halPrintln(qt1);
+      PROFILE_END(PROFILE_PRINT);
+    }
   }
+  if (reading.registered)
+    checkDebug();
 
-  // This is just for debugging.  It prints out the readings every 50
-  // times through the loop.
-  if (base_ct % DEBUG_LOOP_COUNT == 0 && debugging)
+  // Listen for a secret knock (see tap_lock.h).  Unlocking is done in
+  // there; the other actions need things that live in here.
+  switch (tapLockSample(now, reading.touched))
   {
-    Serial.println("Reading: " + String(qt1));
-    Serial.print("Base: ");
-    Serial.print(qt_base);
-    Serial.print(" Threshold: ");
-    Serial.println(qt_Threshold);
+  case TAP_ACTION_DEBUG:
+    debugging = !debugging;
+    halPrintln(debugging ? "Debugging on." : "Debugging off.");
+    break;
+  case TAP_ACTION_EFFECT:
+    // Skip straight to the throb, so the knocker can see it worked.
+    detectSkipToThrob(detector, params, now);
+    break;
+  default:
+    break;
   }
 
-  // The side effect of this delay is that it modifies how fast the
-  // LED pulses as a results of light at step and light at near.
-  delay(10);
-}
-
-// Note - normally people like to move DEFINE statements to the top
-// of the file.  This is because the compiler does a pre-pass to
-// find all the defines and replace them with the value.  So, it
-// is a good idea to put them at the top of the file so you can
-// find them easily.  But, I like to put them near the code that
-// uses them - because it is easier to understand the code when
-// the magic numbers are close to the code that uses them.
-#define NUM_MEAS 50
-int measSet[NUM_MEAS];
-int addMeasurement(int measurement)
-{
-  static int measCount = 0;
-  static int avgMeasure = 0;
-  measCount++;
-  measSet[measCount % NUM_MEAS] = measurement;
-  avgMeasure = 0;
-  for (int i = 0; i < NUM_MEAS; i++)
+  // Gestures, and what the light should do about all that.
+  PROFILE_BEGIN(PROFILE_LIGHT);
+  detectLight(detector, params, now, qt1, reading);
+  PROFILE_END(PROFILE_LIGHT);
+  detect_reading = reading;
+  if (reading.gesture != GESTURE_NONE && debugging)
   {
-    avgMeasure += measSet[i];
+    halPrint("Gesture: ");
+    halPrintln(gestureName(reading.gesture));
   }
-  avgMeasure /= NUM_MEAS;
-  if (measCount % NUM_MEAS == 0 && debugging)
-    Serial.println("Avg: " + String(avgMeasure));
-  return avgMeasure;
-}
+  // A double tap dims the light a step - on the way out to the pin, in
+  // writeLight(), so the detection code doesn't need to know.
+  if (!gestures)
+    light_level = 0;
+  else if (reading.gesture == GESTURE_DOUBLE_TAP)
+    light_level = (light_level + 1) % NUM_LIGHT_LEVELS;
 
-// The purpose of this function is to set a light value to corresponds
-// to how "close" the user's finger is to the box.
-// The closer the finger, the higher the light value.  But, we have
-// to be careful because it needs to be within the range of the
-// detection threshold which is always shifting a little.
-#define MIN_OVER_THRESHOLD 3
-void lightAtNear(int measurement)
-{
-  static int lastLightMeasure = 0;
-
-  // This checks to see if we like the measurement for "near".
-  if (measurement > qt_base + MIN_OVER_THRESHOLD)
+  // For the first 5 seconds... just take readings and don't do anything.
+  // halMillis (millis on the board) returns the number of milliseconds since
+  // the program/processor started.
+  if (!reading.warmedUp)
   {
-    // We have a good measurement.  So, we want to set the light
-    // to the value that corresponds to how close the finger is.
-    int avgMeasure = addMeasurement(measurement);
-
-    // Slight adjustment to the light value to make it more
-    // visible.
-    lastLightMeasure = avgMeasure - qt_base;
-
-    // Check to make sure the light value is within the range "on average"
-    if (avgMeasure > qt_base + MIN_OVER_THRESHOLD)
-      analogWrite(NOODLE_PIN, lastLightMeasure);
+    halDelay(10);
+    return;
   }
-  else
-  {
-    // This is the case where the user's finger is not close enough
-    // to the sensor to be detected.  We want to semi-slowly fade the
-    // light down to zero.
-    int avgMeasure = addMeasurement(0);
 
-    int closingValue = avgMeasure - qt_base;
-    if (closingValue > lastLightMeasure)
-    {
-      closingValue = lastLightMeasure;
-    }
+  if (faulty)
+    writeLight(sensorHealthLight(now)); // Blink out what is wrong.
+  else if (reading.lightChanged)
+    writeLight(detector.pwm);
+  if (detector.measured >= 0)
+    printAverage();
 
-    // Without this check the light will go negative and the LED will
-    // turn on because the value is interpreted as a very large number.
-    if (closingValue < 0)
-    {
-      closingValue = 0;
-    }
+  // How far away the finger is, in millimetres, for anything that wants
+  // to do something at a real distance rather than at a number of counts
+  // (see distance.h).
+  distanceSample(reading.ignored ? 0 : qt1 - detector.base, reading.touched);
 
-    // Check to see if there is still enough value here to have it on.
-    // Otherwise, turn it off completely.
-    if (avgMeasure > qt_base - MIN_OVER_THRESHOLD)
-      analogWrite(NOODLE_PIN, closingValue);
-    else
-      analogWrite(NOODLE_PIN, 0);
+  // This is just for debugging.  It prints out the readings every 50
+  // times through the loop.
+  if (detector.baseCount % DEBUG_LOOP_COUNT == 0 && debugging)
+  {
+    PROFILE_BEGIN(PROFILE_PRINT);
+    halPrint("Reading: ");
+    halPrintln(qt1);
+    halPrint("Base: ");
+    halPrint(detector.base);
+    halPrint(" Threshold: ");
+    halPrintln(qt_Threshold);
+    PROFILE_END(PROFILE_PRINT);
   }
-}
 
-// Magic number that determins how many changes in the light
-// output there are.  The higher the number, the more gradual
-// and longer it will take to get to the minumum or maximum
-// brightness. When it reaches the minumum or maximum brightness
-// it will reverse direction.
-#define NUM_LIGHT_STEPS 150
-#define MINUMUM_BRIGHTNESS 10
-void lightAtStep(bool reset)
-{
-  static int steps = 0; // Static variables exist between function calls
-                        // and are initialized once.  This is a good
-                        // way to keep state between function calls.
-                        // An alternative is to use global variables.
-                        // But, static variables are better because
-                        // they are only visible to the function that
-                        // uses them.  Global variables are visible
-                        // to all functions.  So, it is easy to
-                        // accidentally change a global variable
-                        // and not know where it was changed.
-  static bool direction = 1;
-
-  // This may be a call to simply restart the throb.
-  if (reset) {
-    direction = 1;
-    steps = 0;
-    return;
-  }
+  // Keep a short history of what we saw and did, in case something
+  // strange happens and we need to look at it later.
+  PROFILE_BEGIN(PROFILE_RECORDER);
+  recorderSample(now, qt1, detector.base, light_pwm);
+  if (reading.touchStart)
+    recorderTrigger(FR_TRIGGER_ANY_TOUCH | (reading.lonelyTouch ? FR_TRIGGER_TOUCH_WITHOUT_NEAR : 0));
+  PROFILE_END(PROFILE_RECORDER);
 
-  if (steps >= NUM_LIGHT_STEPS)
-  {
-    direction = false;
-  }
+  // Count what happened, for the field health numbers (see stats.h).
+  statsSample(now, detector.base, reading.nearStart, reading.touchStart, reading.lonelyTouch, light_pwm > 0);
 
-  if (steps <= 0)
-  {
-    direction = true;
-  }
+  // Every so often check how close the stack has come to the heap.
+  if (detector.baseCount % MEMORY_CHECK_LOOPS == 0)
+    memoryCheck();
 
-  if (direction)
-  {
-    steps++;
-  }
-  else
-  {
-    steps--;
-  }
+  // Look for commands typed into the serial monitor (see console.h).
+  PROFILE_BEGIN(PROFILE_CONSOLE);
+  consolePoll();
+  PROFILE_END(PROFILE_CONSOLE);
+
+  PROFILE_END(PROFILE_LOOP);
 
-  analogWrite(NOODLE_PIN, (255 - MINUMUM_BRIGHTNESS) * steps / NUM_LIGHT_STEPS + MINUMUM_BRIGHTNESS);
+  // The side effect of this delay is that it modifies how fast the
+  // LED pulses as a results of light at step and light at near.
+  halDelay(10);
 }
 
 #define DEBUG_CHECK_THRESHOLD 5 
 #define DEBUG_CHECK_THRESHOLD_MAX 15
-#define TOUCH_TIME_DEBOUNCE 300 // Tunable.  How fast do we allow for registering
-                                // touches.  This is in milliseconds.
-void checkDebug(int touchTime)
+// Called for every touch that registers: one at most every
+// touch_time_debounce, so the user has pulled away between the touches
+// it counts (see DetectReading::registered).
+void checkDebug()
 {
   // This is used to determine if touch state should be 
   // "Forgotten".  So that debugging will auto age out.
-  static unsigned long firstTouch = 0;
+  static uint32_t firstTouch = 0;
   static int debugCheckCt = 0;
 
-  // This check ensures we only register a touch every 300ms.
-  // Sometimes we return so fast, a finger will still be present
-  // between touches - this ensures the user has pulled away between
-  // counting touches.
-  if (millis() - touchTime > TOUCH_TIME_DEBOUNCE)
+  bool resetMe = false;
+  if (firstTouch == 0 || halMillis() - firstTouch > DEBUG_CLEAR_TIME)
   {
-    bool resetMe = false;
-    if (firstTouch == 0 || millis() - firstTouch > DEBUG_CLEAR_TIME)
-    {
-      resetMe = true;
-      firstTouch = millis();
-    }
+    resetMe = true;
+    firstTouch = halMillis();
+  }
 
-    if (resetMe)
-    {
-      debugCheckCt = 0;
-    }
+  if (resetMe)
+  {
+    debugCheckCt = 0;
+  }
 
-    debugCheckCt++;
+  debugCheckCt++;
 
-    if (debugCheckCt >= DEBUG_CHECK_THRESHOLD)
-    {
-      Serial.println("Debugging on.");
-      debugging = true;
-      // Secret message here. Its between two debug thresholds.
-      // Provides one more layer of mystery - or perhaps you store
-      // the secret key for BITCOIN here. ;)
-      if (debugCheckCt > 10 && debugCheckCt < DEBUG_CHECK_THRESHOLD_MAX)
-      {
-        Serial.println("Secret message output here.");
-      }
-    }
-    else
+  if (debugCheckCt >= DEBUG_CHECK_THRESHOLD)
+  {
+    halPrintln("Debugging on.");
+    debugging = true;
+    // Secret message here. Its between two debug thresholds.
+    // Provides one more layer of mystery - or perhaps you store
+    // the secret key for BITCOIN here. ;)
+    if (debugCheckCt > 10 && debugCheckCt < DEBUG_CHECK_THRESHOLD_MAX)
     {
-      if (debugging)
-        Serial.println("Debugging off.");
-      debugging = false;
+      halPrintln("Secret message output here.");
     }
   }
+  else
+  {
+    if (debugging)
+      halPrintln("Debugging off.");
+    debugging = false;
+  }
 }
@@ -0,0 +1,77 @@
+#include <Arduino.h>
+#include "hal.h"
+#include <malloc.h>
+#include "memory_monitor.h"
+
+// Addresses provided by the linker script.
+extern "C" char __data_start__;
+extern "C" char __data_end__;
+extern "C" char __bss_start__;
+extern "C" char __bss_end__;
+extern "C" char __StackTop;
+extern "C" char *sbrk(int increment);
+
+static unsigned long headroom = 0xFFFFFFFF;
+static unsigned long stackPeak = 0;
+static unsigned long heapPeak = 0;
+
+static inline uint32_t *alignUp(char *address)
+{
+  return (uint32_t *)(((uintptr_t)address + 3) & ~(uintptr_t)3);
+}
+
+void memoryPaint()
+{
+  uint32_t *word = alignUp(sbrk(0));
+  uint32_t *end = (uint32_t *)(__get_MSP() - MEMORY_PAINT_MARGIN);
+  while (word < end)
+    *word++ = MEMORY_PAINT;
+}
+
+void memoryCheck()
+{
+  // Walk up from the top of the heap until the paint runs out.  That is
+  // the lowest address the stack has ever reached.
+  uint32_t *word = alignUp(sbrk(0));
+  uint32_t *stackTop = (uint32_t *)&__StackTop;
+  while (word < stackTop && *word == MEMORY_PAINT)
+    word++;
+
+  unsigned long gap = (char *)word - sbrk(0);
+  if (gap < headroom)
+    headroom = gap;
+
+  unsigned long stackUsed = (char *)stackTop - (char *)word;
+  if (stackUsed > stackPeak)
+    stackPeak = stackUsed;
+
+  struct mallinfo heap = mallinfo();
+  if ((unsigned long)heap.uordblks > heapPeak)
+    heapPeak = heap.uordblks;
+}
+
+unsigned long memoryHeadroom()
+{
+  return headroom;
+}
+
+static void printLine(const char *name, unsigned long bytes)
+{
+  halPrint(name);
+  halPrint(bytes);
+  halPrintln(" bytes");
+}
+
+void memoryReport()
+{
+  memoryCheck();
+  struct mallinfo heap = mallinfo();
+  printLine("data:          ", &__data_end__ - &__data_start__);
+  printLine("bss:           ", &__bss_end__ - &__bss_start__);
+  printLine("heap arena:    ", sbrk(0) - &__bss_end__);
+  printLine("heap in use:   ", heap.uordblks);
+  printLine("heap peak:     ", heapPeak);
+  printLine("stack peak:    ", stackPeak);
+  printLine("headroom now:  ", (unsigned long)(__get_MSP() - (uintptr_t)sbrk(0)));
+  printLine("headroom worst:", headroom);
+}
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "params.h"
+#include "store.h"
+
+// Version of the saved layout.  Saved values are simply the table below,
+// in order, as 32 bit numbers.  New parameters only ever go on the end
+// of the table, so a record from an older version just has fewer values
+// and the missing ones keep their defaults.  Bump the version only when
+// the meaning of an existing slot changes, and convert the old slot in
+// loadParams() when you do.
+#define PARAMS_VERSION 1
+
+int spread = SPREAD;
+int min_over_threshold = MIN_OVER_THRESHOLD;
+int light_on_time = LIGHT_ON_TIME;
+int num_light_steps = NUM_LIGHT_STEPS;
+int touch_time_debounce = TOUCH_TIME_DEBOUNCE;
+int gestures = GESTURES;
+int gesture_tap_max = TAP_MAX_TIME;
+int gesture_double_gap = DOUBLE_TAP_GAP;
+int gesture_long_press = LONG_PRESS_TIME;
+int gesture_hold = HOLD_TIME;
+int tracker = TRACKER;
+int track_accel = TRACK_ACCEL;
+
+// Only ever add rows at the end of this table - the order is the saved
+// layout (see PARAMS_VERSION).
+//
+// The table itself is constexpr, so it lives in flash and costs no RAM.
+// The bounds keep a typo from doing something silly like dividing by
+// zero in lightAtStep or making the light-on time shorter than the throb.
+static constexpr Param PARAMS[] = {
+    {"spread", &spread, SPREAD, 5, 500},
+    {"min_over", &min_over_threshold, MIN_OVER_THRESHOLD, 1, 100},
+    {"light_on", &light_on_time, LIGHT_ON_TIME, 10000, 600000}, // Must stay above LIGHT_THROB_TIME.
+    {"light_steps", &num_light_steps, NUM_LIGHT_STEPS, 1, 1000},
+    {"debounce", &touch_time_debounce, TOUCH_TIME_DEBOUNCE, 0, 5000},
+    {"gestures", &gestures, GESTURES, 0, 1},
+    {"tap_max", &gesture_tap_max, TAP_MAX_TIME, 50, 1000},
+    {"double_gap", &gesture_double_gap, DOUBLE_TAP_GAP, 50, 2000},
+    {"long_press", &gesture_long_press, LONG_PRESS_TIME, 100, 5000},
+    {"hold", &gesture_hold, HOLD_TIME, 200, 10000},
+    {"tracker", &tracker, TRACKER, 0, 1},
+    {"track_accel", &track_accel, TRACK_ACCEL, 10, 100000},
+};
+
+int paramCount()
+{
+  return sizeof(PARAMS) / sizeof(PARAMS[0]);
+}
+
+const Param &paramAt(int index)
+{
+  return PARAMS[index];
+}
+
+const Param *findParam(const char *name)
+{
+  for (int i = 0; i < paramCount(); i++)
+  {
+    if (strcmp(PARAMS[i].name, name) == 0)
+      return &PARAMS[i];
+  }
+  return nullptr;
+}
+
+// Tunables that only make sense together.  Each one's own bounds can't
+// catch these: a near threshold at or above the touch threshold means
+// nothing is ever "near", and gesture times out of order mean a press can
+// never be long or never be a hold.  Returns what is wrong, or nullptr.
+static const char *checkParams()
+{
+  if (min_over_threshold >= spread)
+    return "min_over must be below spread";
+  if (gesture_tap_max >= gesture_long_press)
+    return "tap_max must be below long_press";
+  if (gesture_long_press >= gesture_hold)
+    return "long_press must be below hold";
+  return nullptr;
+}
+
+const char *paramProblem(const Param &param, long value)
+{
+  if (value < param.min || value > param.max)
+    return "out of range";
+  // Try it, see whether the set still hangs together, and put it back.
+  int old = *param.value;
+  *param.value = value;
+  const char *problem = checkParams();
+  *param.value = old;
+  return problem;
+}
+
+bool setParam(const Param &param, long value)
+{
+  if (paramProblem(param, value) != nullptr)
+    return false;
+  *param.value = value;
+  return true;
+}
+
+void resetParams()
+{
+  for (int i = 0; i < paramCount(); i++)
+    *PARAMS[i].value = PARAMS[i].defaultValue;
+}
+
+bool loadParams()
+{
+  int32_t values[STORE_PAYLOAD_SIZE / 4];
+  uint8_t version;
+  int length = storeLoad(STORE_TYPE_PARAMS, values, sizeof(values), &version);
+  if (length < 0 || version > PARAMS_VERSION)
+    return false; // Nothing saved, or saved by newer firmware we don't understand.
+
+  int count = length / 4;
+  // Each value on its own first - they can only be checked against each
+  // other once they are all in.
+  for (int i = 0; i < count && i < paramCount(); i++)
+  {
+    if (values[i] >= PARAMS[i].min && values[i] <= PARAMS[i].max)
+      *PARAMS[i].value = values[i]; // Out of bounds values keep the default.
+  }
+  if (checkParams() != nullptr)
+  {
+    resetParams(); // A set that doesn't hang together isn't used at all.
+    return false;
+  }
+  return true;
+}
+
+bool saveParams()
+{
+  int32_t values[STORE_PAYLOAD_SIZE / 4];
+  static_assert(sizeof(PARAMS) / sizeof(PARAMS[0]) <= STORE_PAYLOAD_SIZE / 4, "too many parameters for one store record");
+  for (int i = 0; i < paramCount(); i++)
+    values[i] = *PARAMS[i].value;
+  return storeSave(STORE_TYPE_PARAMS, PARAMS_VERSION, values, paramCount() * 4);
+}
@@ -0,0 +1,64 @@
+#include "profiler.h"
+
+#ifdef FAIRY_PROFILE
+
+#include <Arduino.h>
+#include "hal.h"
+#include "run_stats.h"
+
+static RunStats stages[PROFILE_STAGES];
+static bool started = false;
+
+static const char *const STAGE_NAMES[PROFILE_STAGES] = {
+    "loop", "measure", "detect", "light", "print", "recorder", "console",
+};
+
+uint32_t profileNow()
+{
+  // Read the millisecond count and SysTick together.  If SysTick rolled
+  // over between the two reads the millisecond count may be one behind,
+  // so keep reading until two passes agree.  A pending SysTick interrupt
+  // means it has rolled over but millis() has not caught up yet.  This is
+  // the same dance the core's micros() does.
+  uint32_t ticks, ticks2, pending, pending2, ms, ms2;
+  ticks2 = SysTick->VAL;
+  pending2 = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+  ms2 = millis();
+  do
+  {
+    ticks = ticks2;
+    pending = pending2;
+    ms = ms2;
+    ticks2 = SysTick->VAL;
+    pending2 = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+    ms2 = millis();
+  } while (pending != pending2 || ms != ms2 || ticks < ticks2);
+
+  uint32_t reload = SysTick->LOAD;
+  return (ms + pending) * (reload + 1) + (reload - ticks);
+}
+
+void profileRecord(ProfileStage stage, uint32_t cycles)
+{
+  if (!started)
+    profileReset();
+  runStatsAdd(stages[stage], cycles);
+}
+
+void profileReset()
+{
+  for (int i = 0; i < PROFILE_STAGES; i++)
+    runStatsReset(stages[i]);
+  started = true;
+}
+
+void profileDump()
+{
+  halPrint("Profile in CPU cycles, ");
+  halPrint(SystemCoreClock / 1000000);
+  halPrintln(" per microsecond");
+  for (int i = 0; i < PROFILE_STAGES; i++)
+    runStatsPrint(STAGE_NAMES[i], stages[i], "cycles");
+}
+
+#endif
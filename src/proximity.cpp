@@ -0,0 +1,172 @@
+#include "hal.h"
+#include "proximity.h"
+
+ProximityTracker proximity_tracker = {};
+
+static uint32_t squareRoot(uint64_t value)
+{
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > value)
+    bit >>= 2;
+  while (bit != 0)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+// Work alpha and beta out from the noise, the loop time and how lively a
+// finger is.  The "tracking index" lambda is how far a finger's change of
+// speed moves the reading in one loop, measured in noise:
+//
+//   lambda = accel * T^2 / noise
+//   r      = (4 + lambda - sqrt(8 lambda + lambda^2)) / 4
+//   alpha  = 1 - r^2
+//   beta   = 2 (2 - alpha) - 4 r
+//
+// All in 65536ths, with 64 bit sums - this runs a few times a minute.
+static void updateGains(ProximityTracker &tracker, int accel)
+{
+  const uint64_t ONE = 1 << PROXIMITY_GAIN_SHIFT;
+  tracker.accel = accel;
+  // accel is per second squared; T is loopTime / 16 ms; noise is / 16.
+  uint64_t lambda = (uint64_t)accel * tracker.loopTime * tracker.loopTime * ONE / (16000000ULL * tracker.noise);
+  uint64_t root = squareRoot(8 * lambda * ONE + lambda * lambda);
+  uint64_t r = 4 * ONE + lambda > root ? (4 * ONE + lambda - root) / 4 : 0;
+  if (r > ONE)
+    r = ONE;
+  int64_t alpha = ONE - ((r * r) >> PROXIMITY_GAIN_SHIFT);
+  int64_t beta = 2 * (2 * (int64_t)ONE - alpha) - 4 * (int64_t)r;
+  tracker.alpha = alpha < 1 ? 1 : (int32_t)alpha;
+  tracker.beta = beta < 1 ? 1 : (int32_t)beta;
+}
+
+void proximityReset(ProximityTracker &tracker)
+{
+  tracker.started = false;
+  tracker.gated = false;
+  tracker.level = 0;
+  tracker.rate = 0;
+  tracker.alpha = 0;
+  tracker.beta = 0;
+  tracker.accel = 0;
+  tracker.noise = 0;
+  tracker.previous = 0;
+  tracker.previousQuiet = false;
+  tracker.noiseSum = 0;
+  tracker.noiseCount = 0;
+  tracker.lastMs = 0;
+  tracker.loopTime = 0;
+  tracker.base = 0;
+}
+
+// Average change between quiet readings, times 227/4096: the standard
+// deviation in 16ths of a count (16 * 0.886 / PROXIMITY_NOISE_WINDOW).
+static void measureNoise(ProximityTracker &tracker, int raw, bool quiet)
+{
+  if (quiet && tracker.previousQuiet)
+  {
+    int change = raw - tracker.previous;
+    if (change < 0)
+      change = -change;
+    tracker.noiseSum += change < PROXIMITY_NOISE_CLIP ? change : PROXIMITY_NOISE_CLIP;
+    if (++tracker.noiseCount >= PROXIMITY_NOISE_WINDOW)
+    {
+      int noise = (int)((tracker.noiseSum * 227) >> 12);
+      tracker.noise = noise < PROXIMITY_NOISE_MIN ? PROXIMITY_NOISE_MIN : noise;
+      tracker.noiseSum = 0;
+      tracker.noiseCount = 0;
+      tracker.accel = -1; // Gains are out of date.
+    }
+  }
+  tracker.previous = raw;
+  tracker.previousQuiet = quiet;
+}
+
+void proximitySample(ProximityTracker &tracker, uint32_t now, int raw, int base, bool quiet, int accel)
+{
+  if (!tracker.started)
+  {
+    // Nothing measured yet: a guess at the noise and the loop time will
+    // do to start with.
+    tracker.level = (int32_t)raw << PROXIMITY_SHIFT;
+    tracker.rate = 0;
+    tracker.noise = PROXIMITY_NOISE_START;
+    tracker.loopTime = PROXIMITY_LOOP_START << 4;
+    tracker.accel = -1;
+    tracker.lastMs = now;
+    tracker.started = true;
+  }
+  tracker.base = base;
+  // The loop time, smoothed by a sixteenth a reading.  Long stalls (a
+  // flash write, the serial port) are left out.
+  uint32_t dt = now - tracker.lastMs;
+  tracker.lastMs = now;
+  if (dt > 0 && dt < 100)
+    tracker.loopTime += ((int32_t)(dt << 4) - tracker.loopTime) >> 4;
+
+  measureNoise(tracker, raw, quiet);
+  if (accel != tracker.accel)
+    updateGains(tracker, accel);
+
+  // Predict, then see how far out the prediction was, in 16ths of a count.
+  int32_t predicted = tracker.level + tracker.rate;
+  int32_t miss = ((int32_t)raw << 4) - (predicted >> (PROXIMITY_SHIFT - 4));
+  if (miss > PROXIMITY_GATE << 4 || miss < -(PROXIMITY_GATE << 4))
+  {
+    if (!tracker.gated)
+    {
+      tracker.gated = true; // A spike?  Coast on the prediction.
+      tracker.level = predicted;
+      return;
+    }
+    tracker.level = (int32_t)raw << PROXIMITY_SHIFT; // No - a jump.
+    tracker.rate = 0;
+    tracker.gated = false;
+    return;
+  }
+  tracker.gated = false;
+  // miss is at most PROXIMITY_GATE * 16 here, so these can't overflow.
+  tracker.level = predicted + ((miss * tracker.alpha) >> (PROXIMITY_GAIN_SHIFT + 4 - PROXIMITY_SHIFT));
+  tracker.rate += (miss * tracker.beta) >> (PROXIMITY_GAIN_SHIFT + 4 - PROXIMITY_SHIFT);
+}
+
+int proximityLevel(const ProximityTracker &tracker)
+{
+  return (tracker.level + (1 << (PROXIMITY_SHIFT - 1))) >> PROXIMITY_SHIFT;
+}
+
+int proximityVelocity(const ProximityTracker &tracker)
+{
+  if (!tracker.started)
+    return 0;
+  // rate is per reading; a reading is loopTime / 16 ms.
+  int64_t perSecond = (int64_t)tracker.rate * 16000 / tracker.loopTime;
+  return (int)(perSecond >> PROXIMITY_SHIFT);
+}
+
+void proximityReport(const ProximityTracker &tracker)
+{
+  halPrint("Proximity: ");
+  halPrint(proximityLevel(tracker) - tracker.base);
+  halPrint(" counts over base, ");
+  halPrint(proximityVelocity(tracker));
+  halPrintln(" counts/s");
+  halPrint("noise=");
+  halPrint(tracker.noise);
+  halPrint("/16 loop=");
+  halPrint((int)tracker.loopTime);
+  halPrint("/16 ms alpha=");
+  halPrint((int)tracker.alpha);
+  halPrint(" beta=");
+  halPrint((int)tracker.beta);
+  halPrintln(" /65536");
+}
@@ -0,0 +1,53 @@
+#include "hal.h"
+#include <string.h>
+#include "run_stats.h"
+
+void runStatsReset(RunStats &stats)
+{
+  memset(&stats, 0, sizeof(stats));
+  stats.min = 0xFFFFFFFF;
+}
+
+void runStatsAdd(RunStats &stats, uint32_t value)
+{
+  stats.count++;
+  stats.sum += value;
+  if (value < stats.min)
+    stats.min = value;
+  if (value > stats.max)
+    stats.max = value;
+
+  // The bucket is the number of bits needed to hold the value.
+  int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+  stats.histogram[bucket]++;
+}
+
+void runStatsPrint(const char *name, const RunStats &stats, const char *unit)
+{
+  halPrint(name);
+  if (stats.count == 0)
+  {
+    halPrintln(": no samples");
+    return;
+  }
+  halPrint(": n=");
+  halPrint(stats.count);
+  halPrint(" min=");
+  halPrint(stats.min);
+  halPrint(" mean=");
+  halPrint((unsigned long)(stats.sum / stats.count));
+  halPrint(" max=");
+  halPrint(stats.max);
+  halPrint(" ");
+  halPrintln(unit);
+
+  for (int bucket = 0; bucket < RUN_STATS_BUCKETS; bucket++)
+  {
+    if (stats.histogram[bucket] == 0)
+      continue;
+    halPrint("  <");
+    halPrint(bucket == 32 ? 0xFFFFFFFFUL : (1UL << bucket));
+    halPrint(": ");
+    halPrintln(stats.histogram[bucket]);
+  }
+}
@@ -0,0 +1,229 @@
+#include "hal.h"
+#include "sensor_health.h"
+
+static uint8_t fault = SENSOR_OK;
+static unsigned long faults = 0;
+static uint32_t faultMs = 0;   // When it began, for the blinks.
+static bool cleared = false;   // By hand, since the last sample.
+
+static bool started = false;
+static int32_t smooth = 0;     // The reading, times 1 << HEALTH_SMOOTH_SHIFT.
+static int level = 0;
+
+// PINNED: on a rail since railedMs.
+static bool railed = false;
+static uint32_t railedMs = 0;
+
+// FLAT: how much the reading has moved this window, how many windows in a
+// row have been flat, and whether the last window that wasn't flat was
+// lively.
+static int previous = 0;
+static uint32_t activity = 0;
+static uint32_t lastActivity = HEALTH_MIN_ACTIVITY; // The last whole window.
+static uint16_t windowReadings = 0;
+static uint8_t flatWindows = 0;
+static bool lively = false;
+
+// OPEN and SHORT: -1 below the baseline, 1 above it, since stepMs.
+// stepBase is the baseline it left, which is what it has to come back to.
+static int8_t stepping = 0;
+static int stepBase = 0;
+static uint32_t stepMs = 0;
+
+// While there is a fault: whether it has looked right since fineMs.
+static bool fine = false;
+static uint32_t fineMs = 0;
+
+// Forget everything the checks have seen, but not the fault count.
+static void restart()
+{
+  fault = SENSOR_OK;
+  started = false;
+  railed = false;
+  activity = 0;
+  lastActivity = HEALTH_MIN_ACTIVITY;
+  windowReadings = 0;
+  flatWindows = 0;
+  lively = false;
+  stepping = 0;
+  fine = false;
+}
+
+HealthVerdict sensorHealthSample(uint32_t now, int raw, int base)
+{
+  if (!started)
+  {
+    smooth = raw << HEALTH_SMOOTH_SHIFT;
+    previous = raw;
+    started = true;
+  }
+  smooth += raw - (smooth >> HEALTH_SMOOTH_SHIFT);
+  level = smooth >> HEALTH_SMOOTH_SHIFT;
+  if (cleared)
+  {
+    // Start again from here.  Skip the checks for this one reading, so
+    // the steps are measured from the new baseline rather than the old.
+    cleared = false;
+    return HEALTH_RECOVERED;
+  }
+
+  bool onRail = raw <= HEALTH_RAIL_LOW || raw >= HEALTH_RAIL_HIGH;
+  if (onRail && !railed)
+    railedMs = now;
+  railed = onRail;
+
+  int change = raw - previous;
+  previous = raw;
+  activity += change < 0 ? -change : change;
+  if (++windowReadings >= HEALTH_WINDOW)
+  {
+    lastActivity = activity;
+    if (activity >= HEALTH_MIN_ACTIVITY)
+    {
+      flatWindows = 0;
+      lively = activity >= HEALTH_LIVELY_ACTIVITY;
+    }
+    else if (flatWindows < 255)
+      flatWindows++;
+    activity = 0;
+    windowReadings = 0;
+  }
+
+  if (stepping < 0 && raw >= stepBase - HEALTH_OPEN_STEP)
+    stepping = 0;
+  else if (stepping > 0 && raw <= stepBase + HEALTH_SHORT_STEP)
+    stepping = 0;
+  // During a fault the baseline can't be trusted to start a new step from.
+  if (fault == SENSOR_OK && stepping == 0 && (raw < base - HEALTH_OPEN_STEP || raw > base + HEALTH_SHORT_STEP))
+  {
+    stepping = raw < base ? -1 : 1;
+    stepBase = base;
+    stepMs = now;
+  }
+
+  if (fault == SENSOR_OK)
+  {
+    SensorFault found = SENSOR_OK;
+    if (railed && now - railedMs >= HEALTH_PINNED_MS)
+      found = SENSOR_PINNED;
+    else if (flatWindows >= HEALTH_FLAT_WINDOWS && lively)
+      found = SENSOR_FLAT;
+    else if (stepping < 0 && now - stepMs >= HEALTH_OPEN_MS)
+      found = SENSOR_OPEN;
+    else if (stepping > 0 && now - stepMs >= HEALTH_SHORT_MS)
+      found = SENSOR_SHORT;
+    else if (base < HEALTH_BASE_LOW || base > HEALTH_BASE_HIGH)
+      found = SENSOR_BASELINE;
+    if (found == SENSOR_OK)
+      return HEALTH_OK;
+    fault = found;
+    faults++;
+    faultMs = now;
+    fine = false;
+    return HEALTH_NEW_FAULT;
+  }
+
+  // Has whatever it was gone away?  The baseline is held still during a
+  // fault, so the BASELINE check looks at the reading instead.
+  bool right;
+  switch (fault)
+  {
+  case SENSOR_PINNED:
+    right = !railed;
+    break;
+  case SENSOR_FLAT:
+    right = flatWindows == 0;
+    break;
+  case SENSOR_BASELINE:
+    right = level >= HEALTH_BASE_LOW && level <= HEALTH_BASE_HIGH;
+    break;
+  default: // OPEN and SHORT: back by the baseline it left.
+    right = stepping == 0;
+    break;
+  }
+  if (!right)
+  {
+    fine = false;
+    return HEALTH_FAULTY;
+  }
+  if (!fine)
+  {
+    fine = true;
+    fineMs = now;
+  }
+  if (now - fineMs < HEALTH_RECOVER_MS)
+    return HEALTH_FAULTY;
+  restart();
+  return HEALTH_RECOVERED;
+}
+
+SensorFault sensorFault()
+{
+  return (SensorFault)fault;
+}
+
+int sensorHealthLevel()
+{
+  return level;
+}
+
+unsigned long sensorHealthFaults()
+{
+  return faults;
+}
+
+// `fault` blinks, then a pause, over and over.
+int sensorHealthLight(uint32_t now)
+{
+  uint32_t blinks = fault * (uint32_t)(HEALTH_BLINK_ON_MS + HEALTH_BLINK_OFF_MS);
+  uint32_t at = (now - faultMs) % (blinks + HEALTH_BLINK_PAUSE_MS);
+  if (at < blinks && at % (HEALTH_BLINK_ON_MS + HEALTH_BLINK_OFF_MS) < HEALTH_BLINK_ON_MS)
+    return HEALTH_BLINK_LEVEL;
+  return 0;
+}
+
+void sensorHealthClear()
+{
+  if (fault != SENSOR_OK)
+    cleared = true;
+  restart();
+}
+
+const char *sensorFaultName(SensorFault fault)
+{
+  static const char *const NAMES[] = {"ok", "pinned", "flat", "open", "short", "baseline"};
+  return fault <= SENSOR_BASELINE ? NAMES[fault] : "?";
+}
+
+void sensorHealthReport()
+{
+  halPrint("Sensor: ");
+  halPrint(sensorFaultName((SensorFault)fault));
+  if (fault != SENSOR_OK)
+  {
+    halPrint(" for ");
+    halPrint((unsigned long)((halMillis() - faultMs) / 1000));
+    halPrint(" s");
+    if (fine)
+      halPrint(", clearing");
+  }
+  halPrint(", faults=");
+  halPrintln(faults);
+  halPrint("level=");
+  halPrint(level);
+  halPrint(" activity=");
+  halPrint((unsigned long)lastActivity);
+  halPrint(" flat_windows=");
+  halPrint((int)flatWindows);
+  halPrint(lively ? " (was lively)" : "");
+  halPrint(" railed=");
+  halPrint(railed ? "yes" : "no");
+  halPrint(" step=");
+  if (stepping == 0)
+    halPrintln("none");
+  else
+  {
+    halPrint(stepping < 0 ? "down from " : "up from ");
+    halPrintln(stepBase);
+  }
+}
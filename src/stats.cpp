@@ -0,0 +1,158 @@
+#include "hal.h"
+#include <string.h>
+#include "stats.h"
+#include "store.h"
+
+#define STATS_VERSION 1
+
+static StatsHour hours[STATS_HOURS];
+static int currentHour = 0;
+static int hoursUsed = 1;
+static uint32_t hourStart = 0;
+static uint32_t lastSample = 0;
+static uint32_t litMs = 0; // Lit time not yet rolled into litSeconds.
+
+static StatsTotals totals;
+
+#define STATS_COUNT_MAX 0xFFFF
+
+// Add one to an hourly count, stopping at the top.
+static void countUp(uint16_t &count)
+{
+  if (count < STATS_COUNT_MAX)
+    count++;
+}
+
+static void clearHour(StatsHour &hour)
+{
+  memset(&hour, 0, sizeof(hour));
+  hour.baseMin = 0xFFFF;
+}
+
+void statsBegin()
+{
+  memset(&totals, 0, sizeof(totals));
+  totals.baseMin = 0xFFFF;
+  uint8_t version;
+  StatsTotals saved;
+  if (storeLoad(STORE_TYPE_STATS, &saved, sizeof(saved), &version) == sizeof(saved) && version == STATS_VERSION)
+    totals = saved;
+
+  clearHour(hours[0]);
+  hourStart = halMillis();
+  lastSample = hourStart;
+}
+
+// Close the current hour: fold it into the totals, save them, and start
+// a fresh bucket.
+static void rollHour()
+{
+  const StatsHour &hour = hours[currentHour];
+  totals.hours++;
+  totals.touches += hour.touches;
+  totals.nears += hour.nears;
+  totals.lonelyTouches += hour.lonelyTouches;
+  totals.baselineResets += hour.baselineResets;
+  totals.sensorFaults += hour.sensorFaults;
+  totals.litSeconds += hour.litSeconds;
+  if (hour.baseMin < totals.baseMin)
+    totals.baseMin = hour.baseMin;
+  if (hour.baseMax > totals.baseMax)
+    totals.baseMax = hour.baseMax;
+  storeSave(STORE_TYPE_STATS, STATS_VERSION, &totals, sizeof(totals));
+
+  currentHour = (currentHour + 1) % STATS_HOURS;
+  if (hoursUsed < STATS_HOURS)
+    hoursUsed++;
+  clearHour(hours[currentHour]);
+  hourStart += STATS_HOUR_MS;
+}
+
+void statsSample(uint32_t now, int base, bool nearStart, bool touchStart, bool lonelyTouch, bool lit)
+{
+  if (now - hourStart >= STATS_HOUR_MS)
+    rollHour();
+
+  StatsHour &hour = hours[currentHour];
+  if (nearStart)
+    countUp(hour.nears);
+  if (touchStart)
+    countUp(hour.touches);
+  if (lonelyTouch)
+    countUp(hour.lonelyTouches);
+
+  if (lit)
+  {
+    litMs += now - lastSample;
+    if (litMs >= 1000)
+    {
+      hour.litSeconds++;
+      litMs -= 1000;
+    }
+  }
+  lastSample = now;
+
+  if (base < hour.baseMin)
+    hour.baseMin = base;
+  if (base > hour.baseMax)
+    hour.baseMax = base;
+}
+
+void statsBaselineReset()
+{
+  countUp(hours[currentHour].baselineResets);
+}
+
+void statsSensorFault()
+{
+  countUp(hours[currentHour].sensorFaults);
+}
+
+const StatsTotals &statsTotals()
+{
+  return totals;
+}
+
+const StatsHour &statsCurrentHour()
+{
+  return hours[currentHour];
+}
+
+static void printCounts(unsigned long touches, unsigned long nears, unsigned long lonely, unsigned long resets,
+                        unsigned long faults, unsigned long lit, unsigned int baseMin, unsigned int baseMax)
+{
+  halPrint(" touches=");
+  halPrint(touches);
+  halPrint(" nears=");
+  halPrint(nears);
+  halPrint(" lonely=");
+  halPrint(lonely);
+  halPrint(" resets=");
+  halPrint(resets);
+  halPrint(" faults=");
+  halPrint(faults);
+  halPrint(" lit_s=");
+  halPrint(lit);
+  halPrint(" base=");
+  halPrint(baseMin);
+  halPrint("..");
+  halPrintln(baseMax);
+}
+
+void statsReport()
+{
+  halPrint("total hours=");
+  halPrint(totals.hours);
+  printCounts(totals.touches, totals.nears, totals.lonelyTouches, totals.baselineResets, totals.sensorFaults,
+              totals.litSeconds, totals.baseMin, totals.baseMax);
+
+  for (int age = 0; age < hoursUsed; age++)
+  {
+    const StatsHour &hour = hours[(currentHour - age + STATS_HOURS) % STATS_HOURS];
+    halPrint("-");
+    halPrint(age);
+    halPrint("h");
+    printCounts(hour.touches, hour.nears, hour.lonelyTouches, hour.baselineResets, hour.sensorFaults,
+                hour.litSeconds, hour.baseMin, hour.baseMax);
+  }
+}
@@ -0,0 +1,215 @@
+#include <string.h>
+#include "flash_region.h"
+#include "store.h"
+
+#define STORE_MAGIC 0xFA1F
+#define STORE_HALF_SIZE (FLASH_REGION_SIZE / 2)
+#define STORE_PAGES_PER_HALF (STORE_HALF_SIZE / FLASH_REGION_PAGE)
+
+// One record is exactly one flash page.
+struct StoreRecord
+{
+  uint16_t magic;
+  uint8_t type;
+  uint8_t version;
+  uint32_t sequence;
+  uint8_t length;
+  uint8_t reserved;
+  uint16_t crc; // Covers everything above plus the payload.
+  uint8_t payload[STORE_PAYLOAD_SIZE];
+};
+static_assert(sizeof(StoreRecord) == FLASH_REGION_PAGE, "a record must fill one flash page");
+
+// Where the newest record of each type lives, or -1.
+static int32_t newest[STORE_MAX_TYPES + 1];
+static uint32_t newestSequence[STORE_MAX_TYPES + 1];
+
+static uint32_t sequence = 0; // Highest sequence number seen.
+static int activeHalf = 0;
+static int nextPage = 0;      // Next blank page in the active half.
+static unsigned long swaps = 0;
+
+// CRC-16/CCITT.  Bit at a time is plenty fast for a handful of pages.
+static uint16_t crc16(const uint8_t *data, int length, uint16_t crc)
+{
+  for (int i = 0; i < length; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t recordCrc(const StoreRecord &record)
+{
+  StoreRecord copy = record;
+  copy.crc = 0;
+  return crc16((const uint8_t *)&copy, sizeof(copy), 0xFFFF);
+}
+
+static bool isBlank(const StoreRecord &record)
+{
+  const uint8_t *bytes = (const uint8_t *)&record;
+  for (unsigned i = 0; i < sizeof(record); i++)
+  {
+    if (bytes[i] != 0xFF)
+      return false;
+  }
+  return true;
+}
+
+static bool isValid(const StoreRecord &record)
+{
+  return record.magic == STORE_MAGIC && record.type >= 1 && record.type <= STORE_MAX_TYPES &&
+         record.length <= STORE_PAYLOAD_SIZE && record.crc == recordCrc(record);
+}
+
+static uint32_t pageOffset(int half, int page)
+{
+  return (uint32_t)half * STORE_HALF_SIZE + (uint32_t)page * FLASH_REGION_PAGE;
+}
+
+void storeBegin()
+{
+  for (int type = 0; type <= STORE_MAX_TYPES; type++)
+    newest[type] = -1;
+  sequence = 0;
+  activeHalf = 0;
+
+  // One pass over every page.  Along the way note the last used page in
+  // each half, so we know where the next write goes.
+  int lastUsed[2] = {-1, -1};
+  bool found = false;
+  StoreRecord record;
+  for (int half = 0; half < 2; half++)
+  {
+    for (int page = 0; page < STORE_PAGES_PER_HALF; page++)
+    {
+      uint32_t offset = pageOffset(half, page);
+      flashRead(offset, &record, sizeof(record));
+      if (isBlank(record))
+        continue;
+      lastUsed[half] = page;
+      if (!isValid(record))
+        continue;
+
+      if (newest[record.type] < 0 || record.sequence >= newestSequence[record.type])
+      {
+        newest[record.type] = offset;
+        newestSequence[record.type] = record.sequence;
+      }
+      // The half holding the highest sequence number is the one we were
+      // writing to last.  After a swap both halves can hold it, and then
+      // either will do (see swapHalves).
+      if (!found || record.sequence > sequence)
+      {
+        sequence = record.sequence;
+        activeHalf = half;
+        found = true;
+      }
+    }
+  }
+  nextPage = lastUsed[activeHalf] + 1;
+}
+
+int storeLoad(uint8_t type, void *payload, int maxLength, uint8_t *version)
+{
+  if (type < 1 || type > STORE_MAX_TYPES || newest[type] < 0)
+    return -1;
+
+  StoreRecord record;
+  flashRead(newest[type], &record, sizeof(record));
+  int length = record.length < maxLength ? record.length : maxLength;
+  memcpy(payload, record.payload, length);
+  *version = record.version;
+  return length;
+}
+
+static bool writeRecord(StoreRecord &record)
+{
+  uint32_t offset = pageOffset(activeHalf, nextPage);
+  nextPage++;
+  if (!flashProgramPage(offset, &record))
+    return false;
+  newest[record.type] = offset;
+  newestSequence[record.type] = record.sequence;
+  return true;
+}
+
+// Erase the other half, carry the newest record of every type over to
+// it, and make it the active half.
+//
+// Records are copied oldest first and keep their sequence numbers.  If
+// the power goes part way through, the half with the highest sequence
+// number is still the old, complete one, and the next save just starts
+// the swap again.  Once the highest numbered record has been copied
+// everything older has been too, so either half is a full set.
+static bool swapHalves()
+{
+  int order[STORE_MAX_TYPES];
+  int count = 0;
+  for (int type = 1; type <= STORE_MAX_TYPES; type++)
+  {
+    if (newest[type] < 0)
+      continue;
+    int i = count++;
+    while (i > 0 && newestSequence[order[i - 1]] > newestSequence[type])
+    {
+      order[i] = order[i - 1];
+      i--;
+    }
+    order[i] = type;
+  }
+
+  int other = 1 - activeHalf;
+  for (uint32_t row = 0; row < STORE_HALF_SIZE; row += FLASH_REGION_ROW)
+  {
+    if (!flashEraseRow(pageOffset(other, 0) + row))
+      return false;
+  }
+  swaps++;
+
+  activeHalf = other;
+  nextPage = 0;
+  StoreRecord record;
+  for (int i = 0; i < count; i++)
+  {
+    flashRead(newest[order[i]], &record, sizeof(record));
+    if (!writeRecord(record))
+      return false;
+  }
+  return true;
+}
+
+bool storeSave(uint8_t type, uint8_t version, const void *payload, int length)
+{
+  if (type < 1 || type > STORE_MAX_TYPES || length > STORE_PAYLOAD_SIZE)
+    return false;
+
+  StoreRecord record;
+  memset(&record, 0xFF, sizeof(record));
+  record.magic = STORE_MAGIC;
+  record.type = type;
+  record.version = version;
+  record.sequence = sequence + 1;
+  record.length = length;
+  record.reserved = 0xFF;
+  memcpy(record.payload, payload, length);
+  record.crc = recordCrc(record);
+
+  if (nextPage >= STORE_PAGES_PER_HALF && !swapHalves())
+    return false;
+
+  // Only bump the sequence once the record is really down.  A failed
+  // write leaves a page with a bad CRC which the next scan skips.
+  if (!writeRecord(record))
+    return false;
+  sequence++;
+  return true;
+}
+
+unsigned long storeSwaps()
+{
+  return swaps;
+}
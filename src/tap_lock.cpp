@@ -0,0 +1,272 @@
+#include "hal.h"
+#include <string.h>
+#include "store.h"
+#include "tap_lock.h"
+
+// Version of the saved layout: the TAP_PATTERNS patterns in order, as
+// they are in RAM.
+#define TAP_LOCK_VERSION 1
+#define TAP_INFINITY 255 // Costs saturate here - no match.
+
+static constexpr TapPattern DEFAULT_PATTERNS[TAP_PATTERNS] = {
+    {3, TAP_ACTION_UNLOCK, {TAP_SYMBOL(0, false), TAP_SYMBOL(2, false), TAP_SYMBOL(2, true)}},
+    // Shave . and-a hair . cut . . . two . bits, in eighth notes.
+    {7,
+     TAP_ACTION_DEBUG,
+     {TAP_SYMBOL(0, false), TAP_SYMBOL(2, false), TAP_SYMBOL(1, false), TAP_SYMBOL(1, false), TAP_SYMBOL(2, false),
+      TAP_SYMBOL(4, false), TAP_SYMBOL(2, false)}},
+    {0, TAP_ACTION_NONE, {}},
+};
+
+static TapPattern patterns[TAP_PATTERNS];
+
+// The warping, one row per touch of the knock: costs[p][j] is the
+// cheapest way to line the knock so far up with the first j + 1 symbols
+// of pattern p.
+static uint8_t costs[TAP_PATTERNS][TAP_MAX_SYMBOLS];
+
+// The knock in progress.
+static uint8_t knock[TAP_MAX_SYMBOLS];
+static int knockLength = 0; // Touches so far, even past TAP_MAX_SYMBOLS.
+static int lastKnockLength = 0; // Of the last knock to end, for tapLockReport().
+static uint32_t beatMs = 0;
+
+// The touch in progress.
+static bool touching = false;
+static bool releasing = false; // Let go, but not for TAP_RELEASE_MS yet.
+static uint32_t onsetMs = 0;
+static uint32_t lastOnsetMs = 0;
+static uint32_t releaseMs = 0;
+static uint32_t gapMs = 0; // From the touch before to this one.
+
+static int recordSlot = -1;
+static TapAction recordAction = TAP_ACTION_NONE;
+static uint32_t unlockMs = 0;
+static bool unlocked = false;
+
+static uint8_t costOf(uint8_t a, uint8_t b)
+{
+  int beats = (a >> 1) - (b >> 1);
+  int cost = (beats < 0 ? -beats : beats) + ((a ^ b) & 1 ? TAP_KIND_COST : 0);
+  return cost < TAP_INFINITY ? cost : TAP_INFINITY;
+}
+
+static uint8_t cheapest(uint8_t a, uint8_t b)
+{
+  return a < b ? a : b;
+}
+
+// Add one row to every pattern's warping for touch `i` of the knock.
+static void warp(int i, uint8_t symbol)
+{
+  for (int p = 0; p < TAP_PATTERNS; p++)
+  {
+    uint8_t *row = costs[p];
+    if (i == 0)
+      memset(row, TAP_INFINITY, sizeof(costs[p]));
+
+    int first = i - TAP_BAND < 0 ? 0 : i - TAP_BAND;
+    int last = i + TAP_BAND < patterns[p].length - 1 ? i + TAP_BAND : patterns[p].length - 1;
+    uint8_t diagonal = first > 0 ? row[first - 1] : TAP_INFINITY; // Last row's, before it is overwritten.
+    if (first > 0)
+      row[first - 1] = TAP_INFINITY; // This row's, left of the band.
+    for (int j = first; j <= last; j++)
+    {
+      uint8_t up = row[j]; // The knock has an extra touch.
+      uint8_t left = j > 0 ? row[j - 1] : TAP_INFINITY; // The knock skipped a symbol.
+      uint8_t best = i == 0 && j == 0 ? 0 : cheapest(cheapest(up, left), diagonal);
+      diagonal = up;
+      int cost = best + costOf(symbol, patterns[p].symbols[j]);
+      row[j] = cost < TAP_INFINITY ? cost : TAP_INFINITY;
+    }
+  }
+}
+
+// A touch has ended: turn it into a symbol and add it to the knock.
+static void endTouch()
+{
+  int halfBeats = 0;
+  if (knockLength == 1)
+    beatMs = gapMs;
+  if (knockLength > 0 && beatMs > 0)
+  {
+    halfBeats = (4 * gapMs + beatMs) / (2 * beatMs); // Rounded.
+    if (halfBeats > TAP_MAX_HALF_BEATS)
+      halfBeats = TAP_MAX_HALF_BEATS;
+  }
+  uint8_t symbol = TAP_SYMBOL(halfBeats, releaseMs - onsetMs >= TAP_HOLD_MS);
+  if (knockLength < TAP_MAX_SYMBOLS)
+    knock[knockLength] = symbol;
+  if (knockLength < TAP_MAX_SYMBOLS + TAP_BAND)
+    warp(knockLength, symbol);
+  knockLength++;
+}
+
+// Nobody has touched the box for TAP_END_MS: what was that?
+static TapAction endKnock()
+{
+  int length = knockLength;
+  knockLength = 0;
+  lastKnockLength = length;
+
+  if (recordSlot >= 0)
+  {
+    if (length >= 2 && length <= TAP_MAX_SYMBOLS)
+    {
+      TapPattern &pattern = patterns[recordSlot];
+      pattern.length = length;
+      pattern.action = recordAction;
+      memcpy(pattern.symbols, knock, length);
+      halPrint("Recorded pattern ");
+      halPrintln(recordSlot);
+    }
+    else
+      halPrintln("Knock too short or too long to record.");
+    recordSlot = -1;
+    return TAP_ACTION_NONE;
+  }
+
+  int best = -1;
+  int bestCost = TAP_MATCH_COST + 1;
+  for (int p = 0; p < TAP_PATTERNS; p++)
+  {
+    int n = patterns[p].length;
+    int apart = length - n;
+    if (n == 0 || apart > TAP_BAND || apart < -TAP_BAND)
+      continue;
+    if (costs[p][n - 1] < bestCost)
+    {
+      best = p;
+      bestCost = costs[p][n - 1];
+    }
+  }
+  return best < 0 ? TAP_ACTION_NONE : (TapAction)patterns[best].action;
+}
+
+bool tapLockBegin()
+{
+  halPinOutput(TAP_UNLOCK_PIN);
+  halDigitalWrite(TAP_UNLOCK_PIN, false);
+  memcpy(patterns, DEFAULT_PATTERNS, sizeof(patterns));
+
+  TapPattern saved[TAP_PATTERNS];
+  uint8_t version;
+  if (storeLoad(STORE_TYPE_LOCK, saved, sizeof(saved), &version) != sizeof(saved) || version != TAP_LOCK_VERSION)
+    return false;
+  for (int p = 0; p < TAP_PATTERNS; p++)
+  {
+    if (saved[p].length > TAP_MAX_SYMBOLS)
+      return false; // Not something we wrote.  Keep the defaults.
+  }
+  memcpy(patterns, saved, sizeof(patterns));
+  return true;
+}
+
+TapAction tapLockSample(uint32_t now, bool touched)
+{
+  TapAction action = TAP_ACTION_NONE;
+
+  if (touched && !touching)
+  {
+    if (!releasing)
+    {
+      // A new touch.
+      gapMs = knockLength > 0 ? now - lastOnsetMs : 0;
+      onsetMs = now;
+      lastOnsetMs = now;
+    }
+    touching = true;
+    releasing = false; // Too short a gap to count - still the same touch.
+  }
+  else if (!touched && touching)
+  {
+    touching = false;
+    releasing = true;
+    releaseMs = now;
+  }
+
+  if (releasing && now - releaseMs >= TAP_RELEASE_MS)
+  {
+    releasing = false;
+    endTouch();
+  }
+  if (!touching && !releasing && knockLength > 0 && now - releaseMs >= TAP_END_MS)
+  {
+    action = endKnock();
+    if (action == TAP_ACTION_UNLOCK)
+    {
+      halDigitalWrite(TAP_UNLOCK_PIN, true);
+      unlocked = true;
+      unlockMs = now;
+    }
+  }
+
+  if (unlocked && now - unlockMs >= TAP_UNLOCK_MS)
+  {
+    halDigitalWrite(TAP_UNLOCK_PIN, false);
+    unlocked = false;
+  }
+  return action;
+}
+
+void tapLockRecord(int slot, TapAction action)
+{
+  recordSlot = slot;
+  recordAction = action;
+}
+
+bool tapLockRecording()
+{
+  return recordSlot >= 0;
+}
+
+const TapPattern &tapLockPattern(int slot)
+{
+  return patterns[slot];
+}
+
+void tapLockClear(int slot)
+{
+  patterns[slot].length = 0;
+  patterns[slot].action = TAP_ACTION_NONE;
+}
+
+bool tapLockSave()
+{
+  static_assert(sizeof(patterns) <= STORE_PAYLOAD_SIZE, "too many tap patterns for one store record");
+  return storeSave(STORE_TYPE_LOCK, TAP_LOCK_VERSION, patterns, sizeof(patterns));
+}
+
+static void printSymbols(const uint8_t *symbols, int length)
+{
+  for (int i = 0; i < length; i++)
+  {
+    halPrint(" ");
+    halPrint(symbols[i] >> 1);
+    halPrint(symbols[i] & 1 ? "H" : "t");
+  }
+  halPrintln();
+}
+
+void tapLockReport()
+{
+  static const char *const ACTIONS[] = {"none", "unlock", "effect", "debug"};
+  for (int p = 0; p < TAP_PATTERNS; p++)
+  {
+    halPrint(p);
+    halPrint(": ");
+    halPrint(ACTIONS[patterns[p].action & 3]);
+    halPrint(",");
+    printSymbols(patterns[p].symbols, patterns[p].length);
+  }
+  if (lastKnockLength > 0)
+  {
+    halPrint("Last knock:");
+    printSymbols(knock, lastKnockLength < TAP_MAX_SYMBOLS ? lastKnockLength : TAP_MAX_SYMBOLS);
+  }
+  if (recordSlot >= 0)
+  {
+    halPrint("Knock now to record pattern ");
+    halPrintln(recordSlot);
+  }
+}
@@ -0,0 +1,79 @@
+#include "water_film.h"
+
+void waterFilmReset(WaterFilm &film)
+{
+  film.started = false;
+  film.ramped = false;
+  film.away = false;
+  film.smooth = 0;
+  film.level = 0;
+  film.steadyLevel = 0;
+  film.steadyMs = 0;
+  film.slowMilli = 0;
+  film.lastMs = 0;
+  film.awayMs = 0;
+}
+
+WaterVerdict waterFilmSample(WaterFilm &film, uint32_t now, int raw, int base)
+{
+  if (!film.started)
+  {
+    film.smooth = raw << WATER_SMOOTH_SHIFT;
+    film.slowMilli = raw * 1000;
+    film.steadyLevel = raw;
+    film.steadyMs = now;
+    film.lastMs = now;
+    film.started = true;
+  }
+  film.smooth += raw - (film.smooth >> WATER_SMOOTH_SHIFT);
+  film.level = film.smooth >> WATER_SMOOTH_SHIFT;
+  if (film.level > film.steadyLevel + WATER_STEADY_BAND || film.level < film.steadyLevel - WATER_STEADY_BAND)
+  {
+    film.steadyLevel = film.level; // On the move: start again from here.
+    film.steadyMs = now;
+  }
+
+  // Move the slow copy towards the reading, WATER_CREEP counts a second
+  // at most - which is WATER_CREEP thousandths a millisecond, so no
+  // divide.
+  int32_t most = (int32_t)(now - film.lastMs) * WATER_CREEP;
+  film.lastMs = now;
+  int32_t behind = film.level * 1000 - film.slowMilli;
+  film.slowMilli += behind > most ? most : behind < -most ? -most : behind;
+  behind = film.level * 1000 - film.slowMilli;
+  if (behind > WATER_RAMP * 1000 || behind < -WATER_RAMP * 1000)
+    film.ramped = true;
+
+  int excess = film.level - base;
+  if (excess <= WATER_MIN_EXCESS / 2)
+  {
+    // Back by the baseline, or below it: whatever it was is over.  A
+    // reading that falls away is left to the baseline to follow.
+    film.ramped = false;
+    film.away = false;
+    film.steadyLevel = film.level;
+    film.steadyMs = now;
+    return WATER_CLEAR;
+  }
+  if (film.ramped)
+    return WATER_CLEAR; // A finger, or something that went as fast as one.
+  if (!film.away)
+  {
+    if (excess <= WATER_MIN_EXCESS)
+    {
+      // Not far enough off to worry about yet.  Only time spent further
+      // up counts towards a plateau.
+      film.steadyLevel = film.level;
+      film.steadyMs = now;
+      return WATER_CLEAR;
+    }
+    if (now - film.steadyMs < WATER_STEADY_MS)
+      return WATER_CLEAR; // Still on its way up - as a finger would be.
+    film.away = true;
+    film.awayMs = now;
+  }
+  if (now - film.awayMs < WATER_CONFIRM_MS)
+    return WATER_SUSPECT;
+  film.away = false;
+  return WATER_REBASE;
+}
@@ -0,0 +1,233 @@
+#include <string.h>
+#include <unity.h>
+#include "console.h"
+#include "host/flash_sim.h"
+#include "host/hal_sim.h"
+#include "params.h"
+#include "store.h"
+
+// The serial console (console.h) and the tunables behind it (params.h):
+// lines typed in, split into words and run, and the checks that keep a
+// bad value - or a bad saved set - from reaching the detection code.
+//
+//   pio test -e native -f test_console
+
+// Type a line and give the console as many polls as it needs.
+static void type(const char *text)
+{
+  halSimSerialInput(text);
+  for (size_t i = 0; i <= strlen(text) / CONSOLE_BYTES_PER_POLL; i++)
+    consolePoll();
+}
+
+void setUp()
+{
+  halSimReset();
+  halSimMuteSerial(true);
+  flashSimReset(true);
+  storeBegin();
+  resetParams();
+}
+
+void tearDown()
+{
+}
+
+static void test_set_changes_a_tunable()
+{
+  type("set spread 80\n");
+  TEST_ASSERT_EQUAL_INT(80, spread);
+  type("set debounce 0\n");
+  TEST_ASSERT_EQUAL_INT(0, touch_time_debounce);
+}
+
+static void test_bad_values_change_nothing()
+{
+  type("set spread\n");
+  type("set spread 80x\n");
+  type("set spread eighty\n");
+  type("set spread 4\n");   // Below its bounds.
+  type("set spread 501\n"); // Above them.
+  type("set spraed 80\n");
+  TEST_ASSERT_EQUAL_INT(SPREAD, spread);
+}
+
+static void test_extra_spaces_and_crlf_are_fine()
+{
+  type("  set   spread    90  \r\n");
+  TEST_ASSERT_EQUAL_INT(90, spread);
+}
+
+static void test_unknown_commands_and_blank_lines_are_harmless()
+{
+  type("\n\r\nfrobnicate 1 2 3\n");
+  type("set spread 70\n");
+  TEST_ASSERT_EQUAL_INT(70, spread);
+}
+
+// A line longer than one poll's worth arrives over several loops, and
+// nothing runs until its end does.
+static void test_a_line_can_take_several_polls()
+{
+  halSimSerialInput("set light_steps 200\n");
+  consolePoll();
+  TEST_ASSERT_EQUAL_INT(NUM_LIGHT_STEPS, num_light_steps);
+  consolePoll();
+  TEST_ASSERT_EQUAL_INT(200, num_light_steps);
+}
+
+static void test_a_line_that_is_too_long_is_dropped()
+{
+  char line[CONSOLE_LINE_LENGTH + 16];
+  memset(line, ' ', sizeof(line));
+  memcpy(line, "set spread 80", 13);
+  line[sizeof(line) - 2] = '\n';
+  line[sizeof(line) - 1] = '\0';
+  type(line);
+  TEST_ASSERT_EQUAL_INT(SPREAD, spread);
+
+  // And the next one is read from its start.
+  type("set spread 81\n");
+  TEST_ASSERT_EQUAL_INT(81, spread);
+}
+
+// Past CONSOLE_MAX_ARGS words the line is refused, not run on the first
+// few with the rest of the line stuck to the last.
+static void test_too_many_words_runs_nothing()
+{
+  type("set spread 80 1 2\n");
+  TEST_ASSERT_EQUAL_INT(SPREAD, spread);
+  type("set spread 80\n");
+  TEST_ASSERT_EQUAL_INT(80, spread);
+}
+
+static void test_min_over_stays_below_spread()
+{
+  type("set min_over 63\n");
+  TEST_ASSERT_EQUAL_INT(MIN_OVER_THRESHOLD, min_over_threshold);
+  type("set spread 100\n");
+  type("set min_over 63\n");
+  TEST_ASSERT_EQUAL_INT(63, min_over_threshold);
+  type("set spread 63\n");
+  TEST_ASSERT_EQUAL_INT(100, spread);
+}
+
+static void test_gesture_times_stay_in_order()
+{
+  type("set hold 700\n");        // Below long_press.
+  type("set long_press 200\n");  // Below tap_max.
+  type("set tap_max 900\n");     // Above long_press.
+  TEST_ASSERT_EQUAL_INT(HOLD_TIME, gesture_hold);
+  TEST_ASSERT_EQUAL_INT(LONG_PRESS_TIME, gesture_long_press);
+  TEST_ASSERT_EQUAL_INT(TAP_MAX_TIME, gesture_tap_max);
+
+  // Moving them all up works one at a time, from the top.
+  type("set hold 5000\n");
+  type("set long_press 3000\n");
+  type("set tap_max 900\n");
+  TEST_ASSERT_EQUAL_INT(5000, gesture_hold);
+  TEST_ASSERT_EQUAL_INT(3000, gesture_long_press);
+  TEST_ASSERT_EQUAL_INT(900, gesture_tap_max);
+}
+
+static void test_param_problem_says_why()
+{
+  TEST_ASSERT_NULL(paramProblem(*findParam("spread"), 80));
+  TEST_ASSERT_EQUAL_STRING("out of range", paramProblem(*findParam("spread"), 1000));
+  TEST_ASSERT_EQUAL_STRING("min_over must be below spread", paramProblem(*findParam("min_over"), 63));
+  TEST_ASSERT_EQUAL_STRING("long_press must be below hold", paramProblem(*findParam("hold"), 800));
+  TEST_ASSERT_EQUAL_INT(HOLD_TIME, gesture_hold); // Asking doesn't change it.
+}
+
+static void test_defaults_puts_everything_back()
+{
+  type("set spread 80\n");
+  type("set gestures 1\n");
+  type("defaults\n");
+  TEST_ASSERT_EQUAL_INT(SPREAD, spread);
+  TEST_ASSERT_EQUAL_INT(GESTURES, gestures);
+}
+
+static void test_saved_tunables_come_back()
+{
+  type("set spread 90\n");
+  type("set track_accel 1234\n");
+  type("save\n");
+  resetParams();
+  storeBegin(); // As at the next boot.
+  TEST_ASSERT_TRUE(loadParams());
+  TEST_ASSERT_EQUAL_INT(90, spread);
+  TEST_ASSERT_EQUAL_INT(1234, track_accel);
+}
+
+static void test_nothing_saved_keeps_the_defaults()
+{
+  TEST_ASSERT_FALSE(loadParams());
+  TEST_ASSERT_EQUAL_INT(SPREAD, spread);
+}
+
+// Out of bounds on its own: that one value keeps its default.
+static void test_saved_value_out_of_bounds_keeps_its_default()
+{
+  num_light_steps = 5000; // Past "light_steps"' bounds, as a bad record might hold.
+  spread = 90;
+  TEST_ASSERT_TRUE(saveParams());
+  resetParams();
+  storeBegin();
+  TEST_ASSERT_TRUE(loadParams());
+  TEST_ASSERT_EQUAL_INT(NUM_LIGHT_STEPS, num_light_steps);
+  TEST_ASSERT_EQUAL_INT(90, spread);
+}
+
+// Fine one by one, but not together: the whole set is refused.
+static void test_saved_set_that_does_not_fit_is_refused()
+{
+  spread = 20;
+  min_over_threshold = 30;
+  gesture_long_press = 3000; // Above the default hold, fine with this one.
+  gesture_hold = 4000;
+  TEST_ASSERT_TRUE(saveParams());
+  resetParams();
+  storeBegin();
+  TEST_ASSERT_FALSE(loadParams());
+  TEST_ASSERT_EQUAL_INT(SPREAD, spread);
+  TEST_ASSERT_EQUAL_INT(MIN_OVER_THRESHOLD, min_over_threshold);
+  TEST_ASSERT_EQUAL_INT(LONG_PRESS_TIME, gesture_long_press);
+  TEST_ASSERT_EQUAL_INT(HOLD_TIME, gesture_hold);
+}
+
+// Values that only fit together once they are all in load fine, whatever
+// order the table has them in.
+static void test_saved_set_is_checked_as_a_whole()
+{
+  gesture_long_press = 3000;
+  gesture_hold = 4000;
+  TEST_ASSERT_TRUE(saveParams());
+  resetParams();
+  storeBegin();
+  TEST_ASSERT_TRUE(loadParams());
+  TEST_ASSERT_EQUAL_INT(3000, gesture_long_press);
+  TEST_ASSERT_EQUAL_INT(4000, gesture_hold);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_set_changes_a_tunable);
+  RUN_TEST(test_bad_values_change_nothing);
+  RUN_TEST(test_extra_spaces_and_crlf_are_fine);
+  RUN_TEST(test_unknown_commands_and_blank_lines_are_harmless);
+  RUN_TEST(test_a_line_can_take_several_polls);
+  RUN_TEST(test_a_line_that_is_too_long_is_dropped);
+  RUN_TEST(test_too_many_words_runs_nothing);
+  RUN_TEST(test_min_over_stays_below_spread);
+  RUN_TEST(test_gesture_times_stay_in_order);
+  RUN_TEST(test_param_problem_says_why);
+  RUN_TEST(test_defaults_puts_everything_back);
+  RUN_TEST(test_saved_tunables_come_back);
+  RUN_TEST(test_nothing_saved_keeps_the_defaults);
+  RUN_TEST(test_saved_value_out_of_bounds_keeps_its_default);
+  RUN_TEST(test_saved_set_that_does_not_fit_is_refused);
+  RUN_TEST(test_saved_set_is_checked_as_a_whole);
+  return UNITY_END();
+}
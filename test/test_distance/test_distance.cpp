@@ -0,0 +1,167 @@
+#include <unity.h>
+#include "distance.h"
+#include "host/flash_sim.h"
+#include "store.h"
+
+// The distance estimator (distance.h): the curve through its points and
+// between them, the bands, the smoothing, and calibrating, saving and
+// loading the curve.
+//
+//   pio test -e native -f test_distance
+
+// Smoothed readings settle to within a count after this many.
+#define SETTLE_SAMPLES 40
+
+static void settle(int counts, bool touched = false)
+{
+  for (int i = 0; i < SETTLE_SAMPLES; i++)
+    distanceSample(counts, touched);
+}
+
+void setUp()
+{
+  flashSimReset(true);
+  storeBegin();
+  distanceDefaults();
+  settle(0);
+}
+
+void tearDown()
+{
+}
+
+// On a point the line gives the point's distance.  The last one can be a
+// millimetre out, from the slope being rounded.
+static void test_points_are_on_the_curve()
+{
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+  {
+    const DistancePoint &point = distancePointAt(i);
+    TEST_ASSERT_INT_WITHIN(i == DISTANCE_POINTS - 1 ? 1 : 0, point.mm, distanceMm(point.counts));
+  }
+}
+
+static void test_closer_never_reads_further()
+{
+  int last = distanceMm(distancePointAt(0).counts);
+  for (int counts = distancePointAt(0).counts + 1; counts <= 400; counts++)
+  {
+    int mm = distanceMm(counts);
+    TEST_ASSERT_LESS_OR_EQUAL(last, mm);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, mm);
+    last = mm;
+  }
+}
+
+// Below the first point there's no telling; past the last it's as close
+// as the table goes.
+static void test_off_the_ends_of_the_table()
+{
+  TEST_ASSERT_EQUAL_INT(DISTANCE_FAR, distanceMm(distancePointAt(0).counts - 1));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_FAR, distanceMm(-20));
+  int closest = distanceMm(distancePointAt(DISTANCE_POINTS - 1).counts);
+  TEST_ASSERT_EQUAL_INT(closest, distanceMm(5000));
+}
+
+static void test_bands_change_at_their_edges()
+{
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_TOUCH, distanceBand(0));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_CLOSE, distanceBand(1));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_CLOSE, distanceBand(DISTANCE_CLOSE_MM - 1));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_NEAR, distanceBand(DISTANCE_CLOSE_MM));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_NEAR, distanceBand(DISTANCE_NEAR_MM - 1));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_APPROACH, distanceBand(DISTANCE_NEAR_MM));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_APPROACH, distanceBand(DISTANCE_FAR - 1));
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_FAR, distanceBand(DISTANCE_FAR));
+}
+
+// A steady reading is followed, a single noisy one only a quarter of the
+// way, and a touch is 0mm whatever the counts.
+static void test_sampling_smooths_and_touch_is_zero()
+{
+  settle(50);
+  TEST_ASSERT_INT_WITHIN(1, 50, distance_counts);
+  TEST_ASSERT_INT_WITHIN(1, distanceMm(50), distance_mm);
+  TEST_ASSERT_EQUAL_INT(distanceBand(distance_mm), distance_band);
+
+  distanceSample(90, false);
+  TEST_ASSERT_INT_WITHIN(1, 60, distance_counts);
+
+  distanceSample(200, true);
+  TEST_ASSERT_EQUAL_INT(0, distance_mm);
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_TOUCH, distance_band);
+
+  settle(0);
+  TEST_ASSERT_EQUAL_INT(DISTANCE_FAR, distance_mm);
+  TEST_ASSERT_EQUAL_INT(DISTANCE_BAND_FAR, distance_band);
+}
+
+// Calibrating replaces the point nearest in distance, and the curve goes
+// through the new one.
+static void test_calibrate_moves_the_nearest_point()
+{
+  TEST_ASSERT_TRUE(distanceCalibrate(12, 21));
+  TEST_ASSERT_EQUAL_INT(21, distanceMm(12));
+  bool found = false;
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+    found |= distancePointAt(i).counts == 12 && distancePointAt(i).mm == 21;
+  TEST_ASSERT_TRUE(found);
+}
+
+// More counts further away than the next point out makes no sense, and
+// is refused with the curve left alone.
+static void test_calibrate_refuses_out_of_order()
+{
+  DistancePoint before[DISTANCE_POINTS];
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+    before[i] = distancePointAt(i);
+  TEST_ASSERT_FALSE(distanceCalibrate(150, 20));
+  TEST_ASSERT_FALSE(distanceCalibrate(0, 36));
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+  {
+    TEST_ASSERT_EQUAL_INT(before[i].counts, distancePointAt(i).counts);
+    TEST_ASSERT_EQUAL_INT(before[i].mm, distancePointAt(i).mm);
+  }
+}
+
+static void test_saved_curve_comes_back()
+{
+  TEST_ASSERT_FALSE(loadDistance()); // Nothing saved yet.
+  TEST_ASSERT_TRUE(distanceCalibrate(12, 21));
+  TEST_ASSERT_TRUE(saveDistance());
+  distanceDefaults();
+  TEST_ASSERT_TRUE(distanceMm(12) != 21);
+
+  flashSimPowerOn();
+  storeBegin();
+  TEST_ASSERT_TRUE(loadDistance());
+  TEST_ASSERT_EQUAL_INT(21, distanceMm(12));
+}
+
+// A saved curve that is out of order keeps the defaults.
+static void test_saved_curve_out_of_order_is_refused()
+{
+  DistancePoint table[DISTANCE_POINTS];
+  for (int i = 0; i < DISTANCE_POINTS; i++)
+    table[i] = distancePointAt(i);
+  int defaultMm = distanceMm(table[3].counts);
+  table[3].counts = table[4].counts;
+  TEST_ASSERT_TRUE(storeSave(STORE_TYPE_DISTANCE, 1, table, sizeof(table)));
+  TEST_ASSERT_FALSE(loadDistance());
+  TEST_ASSERT_EQUAL_INT(defaultMm, distanceMm(distancePointAt(3).counts));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_points_are_on_the_curve);
+  RUN_TEST(test_closer_never_reads_further);
+  RUN_TEST(test_off_the_ends_of_the_table);
+  RUN_TEST(test_bands_change_at_their_edges);
+  RUN_TEST(test_sampling_smooths_and_touch_is_zero);
+  RUN_TEST(test_calibrate_moves_the_nearest_point);
+  RUN_TEST(test_calibrate_refuses_out_of_order);
+  RUN_TEST(test_saved_curve_comes_back);
+  RUN_TEST(test_saved_curve_out_of_order_is_refused);
+  return UNITY_END();
+}
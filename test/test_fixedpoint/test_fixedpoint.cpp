@@ -0,0 +1,49 @@
+#include <unity.h>
+#include "host/fixedpoint.h"
+
+// The firmware's fixed point filters against the double precision maths
+// (fixedpoint.h), over six hours of each of the fixedpoint tool's rooms:
+// every stage and every decision has to come in within its budget.
+//
+//   pio test -e native -f test_fixedpoint
+
+static Corpus corpus;
+static FixedpointReport report;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// Otherwise it's PipelineModel being measured, not the firmware.
+static void test_model_is_the_firmware()
+{
+  TEST_ASSERT_TRUE(pipelineVerify(corpus[0].readings) < 0);
+}
+
+static void test_stages_within_budget()
+{
+  for (const FixedpointStage &stage : report.stages)
+    TEST_ASSERT_TRUE_MESSAGE(stage.passed(), stage.name);
+}
+
+static void test_decisions_within_budget()
+{
+  for (const FixedpointDecision &decision : report.decisions)
+    TEST_ASSERT_TRUE_MESSAGE(report.passed(decision), decision.name);
+}
+
+int main(int argc, char **argv)
+{
+  fixedpointRooms(6, 1, corpus);
+  report = fixedpointCompare(corpus);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_model_is_the_firmware);
+  RUN_TEST(test_stages_within_budget);
+  RUN_TEST(test_decisions_within_budget);
+  return UNITY_END();
+}
@@ -0,0 +1,208 @@
+#include <unity.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+#include "flight_recorder.h"
+#include "host/hal_sim.h"
+
+// The flight recorder (flight_recorder.h): what goes in comes back out of
+// the dump exactly, through small changes, touches, baseline resets and
+// gaps, and it freezes when - and only when - it is asked to.
+//
+//   pio test -e native -f test_flight_recorder
+
+#define LOOP_MS 11
+
+struct Sample
+{
+  uint32_t ms;
+  int qt1, base, pwm;
+};
+
+static std::vector<Sample> recorded;
+static uint32_t now;
+
+static void record(int qt1, int base, int pwm, uint32_t gapMs = LOOP_MS)
+{
+  now += gapMs;
+  recorderSample(now, qt1, base, pwm);
+  recorded.push_back({now, qt1, base, pwm < 0 ? 0 : pwm > 255 ? 255 : pwm});
+}
+
+// The dump goes to the serial port, which is stdout here, so catch it in
+// a file and read it back.
+static std::vector<Sample> dump(int *frozen = nullptr, int *reason = nullptr)
+{
+  FILE *file = tmpfile();
+  TEST_ASSERT_NOT_NULL(file);
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  dup2(fileno(file), STDOUT_FILENO);
+  recorderDump();
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  rewind(file);
+  int isFrozen = -1, why = -1;
+  unsigned long triggerMs;
+  int fields = fscanf(file, "# flight recorder frozen=%d reason=%d trigger_ms=%lu\n", &isFrozen, &why, &triggerMs);
+  TEST_ASSERT_EQUAL_INT(3, fields);
+  char header[32];
+  TEST_ASSERT_NOT_NULL(fgets(header, sizeof(header), file));
+  TEST_ASSERT_EQUAL_STRING("t_ms,qt1,qt_base,pwm\n", header);
+  std::vector<Sample> rows;
+  Sample row;
+  unsigned long ms;
+  while (fscanf(file, "%lu,%d,%d,%d\n", &ms, &row.qt1, &row.base, &row.pwm) == 4)
+  {
+    row.ms = ms;
+    rows.push_back(row);
+  }
+  fclose(file);
+  if (frozen)
+    *frozen = isFrozen;
+  if (reason)
+    *reason = why;
+  return rows;
+}
+
+// The dump is the newest of what was recorded, in order and unchanged.
+static void assertDumpIsTheNewest(const std::vector<Sample> &rows)
+{
+  TEST_ASSERT_TRUE(rows.size() > 0 && rows.size() <= recorded.size());
+  size_t first = recorded.size() - rows.size();
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    const Sample &want = recorded[first + i];
+    TEST_ASSERT_EQUAL_UINT32(want.ms, rows[i].ms);
+    TEST_ASSERT_EQUAL_INT(want.qt1, rows[i].qt1);
+    TEST_ASSERT_EQUAL_INT(want.base, rows[i].base);
+    TEST_ASSERT_EQUAL_INT(want.pwm, rows[i].pwm);
+  }
+}
+
+void setUp()
+{
+  halSimReset();
+  halSimMuteSerial(false);
+  recorderSetTriggers(FLIGHT_RECORDER_TRIGGERS);
+  recorderArm();
+  recorded.clear();
+  now = 1000;
+}
+
+void tearDown()
+{
+}
+
+static void test_quiet_readings_come_back_exactly()
+{
+  for (int i = 0; i < 100; i++)
+    record(725 + i % 5 - 2, 725, 0);
+  std::vector<Sample> rows = dump();
+  TEST_ASSERT_EQUAL_INT(recorded.size(), rows.size());
+  assertDumpIsTheNewest(rows);
+}
+
+// A touch jumps qt1 and the light by more than a byte, in both
+// directions; a baseline reset and a long gap each start a new block.
+static void test_jumps_and_gaps_come_back_exactly()
+{
+  record(725, 725, 0);
+  record(780, 725, 10);
+  record(1000, 725, 255); // Touched: escaped.
+  record(1003, 725, 255);
+  record(726, 725, 0); // Let go: escaped the other way.
+  record(727, 900, 0); // Baseline reset.
+  record(728, 900, 0, 400); // A gap a byte can't hold.
+  record(40000, 900, 300); // More change than 16 bits hold, and clamped.
+  record(730, 900, -5);
+  std::vector<Sample> rows = dump();
+  TEST_ASSERT_EQUAL_INT(recorded.size(), rows.size());
+  assertDumpIsTheNewest(rows);
+}
+
+// Once the ring is full the oldest blocks go, and the rest still decode.
+static void test_full_ring_keeps_the_newest()
+{
+  int samples = FLIGHT_RECORDER_BLOCKS * (FLIGHT_RECORDER_BLOCK_SAMPLES + 1) * 3;
+  for (int i = 0; i < samples; i++)
+    record(725 + (i % 40 < 20 ? 300 : 0), 725, i % 40 < 20 ? 255 : 0);
+  std::vector<Sample> rows = dump();
+  TEST_ASSERT_LESS_OR_EQUAL(FLIGHT_RECORDER_BLOCKS * (FLIGHT_RECORDER_BLOCK_SAMPLES + 1), rows.size());
+  TEST_ASSERT_GREATER_THAN(FLIGHT_RECORDER_BLOCKS * FLIGHT_RECORDER_BLOCK_SAMPLES / 2, rows.size());
+  assertDumpIsTheNewest(rows);
+}
+
+static void test_trigger_freezes_after_the_post_trigger_samples()
+{
+  for (int i = 0; i < 50; i++)
+    record(725, 725, 0);
+  recorderTrigger(FR_TRIGGER_TOUCH_WITHOUT_NEAR);
+  for (int i = 0; i < FLIGHT_RECORDER_POST_TRIGGER - 1; i++)
+    record(1000, 725, 255);
+  TEST_ASSERT_FALSE(recorderFrozen());
+  record(1000, 725, 255);
+  TEST_ASSERT_TRUE(recorderFrozen());
+
+  // Nothing after the freeze gets in.
+  std::vector<Sample> before = dump();
+  now += LOOP_MS;
+  recorderSample(now, 725, 725, 0);
+  int frozen, reason;
+  std::vector<Sample> after = dump(&frozen, &reason);
+  TEST_ASSERT_EQUAL_INT(before.size(), after.size());
+  assertDumpIsTheNewest(after);
+  TEST_ASSERT_EQUAL_INT(1, frozen);
+  TEST_ASSERT_EQUAL_INT(FR_TRIGGER_TOUCH_WITHOUT_NEAR, reason);
+}
+
+static void test_reasons_outside_the_mask_are_ignored()
+{
+  recorderTrigger(FR_TRIGGER_ANY_TOUCH);
+  for (int i = 0; i < FLIGHT_RECORDER_POST_TRIGGER * 2; i++)
+    record(725, 725, 0);
+  TEST_ASSERT_FALSE(recorderFrozen());
+
+  recorderSetTriggers(0);
+  recorderTrigger(FR_TRIGGER_MANUAL); // Always honoured.
+  for (int i = 0; i < FLIGHT_RECORDER_POST_TRIGGER; i++)
+    record(725, 725, 0);
+  TEST_ASSERT_TRUE(recorderFrozen());
+}
+
+// A second trigger doesn't push the freeze back, and arming starts over.
+static void test_only_the_first_trigger_counts()
+{
+  recorderTrigger(FR_TRIGGER_SENSOR_FAULT);
+  for (int i = 0; i < FLIGHT_RECORDER_POST_TRIGGER / 2; i++)
+    record(725, 725, 0);
+  recorderTrigger(FR_TRIGGER_TOUCH_WITHOUT_NEAR);
+  for (int i = 0; i < FLIGHT_RECORDER_POST_TRIGGER / 2; i++)
+    record(725, 725, 0);
+  TEST_ASSERT_TRUE(recorderFrozen());
+  int reason;
+  dump(nullptr, &reason);
+  TEST_ASSERT_EQUAL_INT(FR_TRIGGER_SENSOR_FAULT, reason);
+
+  recorderArm();
+  recorded.clear();
+  TEST_ASSERT_FALSE(recorderFrozen());
+  record(725, 725, 0);
+  std::vector<Sample> rows = dump();
+  TEST_ASSERT_EQUAL_INT(1, rows.size());
+  assertDumpIsTheNewest(rows);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_quiet_readings_come_back_exactly);
+  RUN_TEST(test_jumps_and_gaps_come_back_exactly);
+  RUN_TEST(test_full_ring_keeps_the_newest);
+  RUN_TEST(test_trigger_freezes_after_the_post_trigger_samples);
+  RUN_TEST(test_reasons_outside_the_mask_are_ignored);
+  RUN_TEST(test_only_the_first_trigger_counts);
+  return UNITY_END();
+}
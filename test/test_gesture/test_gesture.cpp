@@ -0,0 +1,163 @@
+#include <unity.h>
+#include "gesture.h"
+
+// The gesture classifier (gesture.h), fed touches sampled every
+// SAMPLE_MS the way loop() feeds it.
+//
+//   pio test -e native -f test_gesture
+
+#define SAMPLE_MS 10
+
+static const GestureTiming TIMING = {250, 300, 800, 2000}; // The defaults in params.h.
+
+// One touch: when it starts and how long it lasts, in ms.
+struct Touch
+{
+  uint32_t startMs;
+  uint32_t lengthMs;
+};
+
+// What came out, in order, and when the last of them did.
+struct Heard
+{
+  Gesture gestures[8];
+  uint32_t atMs[8];
+  int count;
+};
+
+// Play `touches` from `startMs`, then nothing for a couple of seconds so
+// whatever is pending comes out.
+static Heard play(const Touch *touches, int count, uint32_t startMs = 1000)
+{
+  GestureChannel channel;
+  gestureReset(channel);
+  Heard heard = {};
+  uint32_t endMs = touches[count - 1].startMs + touches[count - 1].lengthMs + 3000;
+  for (uint32_t t = 0; t <= endMs; t += SAMPLE_MS)
+  {
+    bool touched = false;
+    for (int i = 0; i < count; i++)
+      touched |= t >= touches[i].startMs && t < touches[i].startMs + touches[i].lengthMs;
+    Gesture gesture = gestureSample(channel, TIMING, startMs + t, touched);
+    if (gesture != GESTURE_NONE && heard.count < 8)
+    {
+      heard.gestures[heard.count] = gesture;
+      heard.atMs[heard.count++] = t;
+    }
+  }
+  return heard;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_quick_touch_is_a_tap()
+{
+  Touch touches[] = {{100, 120}};
+  Heard heard = play(touches, 1);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_TAP, heard.gestures[0]);
+  // Only once double_gap has gone by without a second touch.
+  TEST_ASSERT_GREATER_THAN(220 + TIMING.doubleGapMs - SAMPLE_MS, heard.atMs[0]);
+}
+
+static void test_two_quick_touches_are_a_double_tap()
+{
+  Touch touches[] = {{100, 120}, {400, 100}};
+  Heard heard = play(touches, 2);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_DOUBLE_TAP, heard.gestures[0]);
+}
+
+static void test_taps_too_far_apart_are_two_taps()
+{
+  Touch touches[] = {{100, 120}, {800, 100}};
+  Heard heard = play(touches, 2);
+  TEST_ASSERT_EQUAL_INT(2, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_TAP, heard.gestures[0]);
+  TEST_ASSERT_EQUAL_INT(GESTURE_TAP, heard.gestures[1]);
+}
+
+// A second touch that goes on too long: the first was a tap, and the
+// second is a touch of its own - here a long press.
+static void test_long_second_touch_splits_a_double_tap()
+{
+  Touch touches[] = {{100, 120}, {400, 1000}};
+  Heard heard = play(touches, 2);
+  TEST_ASSERT_EQUAL_INT(2, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_TAP, heard.gestures[0]);
+  TEST_ASSERT_EQUAL_INT(GESTURE_LONG_PRESS, heard.gestures[1]);
+}
+
+static void test_long_press()
+{
+  Touch touches[] = {{100, 1200}};
+  Heard heard = play(touches, 1);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_LONG_PRESS, heard.gestures[0]);
+}
+
+// Said while the finger is still down, and nothing more when it lifts.
+static void test_hold_is_said_while_still_touching()
+{
+  Touch touches[] = {{100, 5000}};
+  Heard heard = play(touches, 1);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_HOLD, heard.gestures[0]);
+  TEST_ASSERT_LESS_OR_EQUAL(100 + TIMING.holdMs + SAMPLE_MS, heard.atMs[0]);
+}
+
+static void test_touch_between_tap_and_long_press_says_nothing()
+{
+  Touch touches[] = {{100, 500}};
+  Heard heard = play(touches, 1);
+  TEST_ASSERT_EQUAL_INT(0, heard.count);
+}
+
+// A reading or two of dropout doesn't end a touch...
+static void test_short_dropout_is_the_same_touch()
+{
+  Touch touches[] = {{100, 500}, {620, 500}}; // 20ms gap.
+  Heard heard = play(touches, 2);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_LONG_PRESS, heard.gestures[0]);
+}
+
+// ...but a longer gap does.
+static void test_gap_past_release_time_ends_a_touch()
+{
+  Touch touches[] = {{100, 100}, {200 + GESTURE_RELEASE_MS + 20, 100}};
+  Heard heard = play(touches, 2);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_DOUBLE_TAP, heard.gestures[0]);
+}
+
+// The same across millis() wrapping round.
+static void test_double_tap_across_the_clock_wrap()
+{
+  Touch touches[] = {{100, 120}, {400, 100}};
+  Heard heard = play(touches, 2, 0xFFFFFFFFu - 300);
+  TEST_ASSERT_EQUAL_INT(1, heard.count);
+  TEST_ASSERT_EQUAL_INT(GESTURE_DOUBLE_TAP, heard.gestures[0]);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_quick_touch_is_a_tap);
+  RUN_TEST(test_two_quick_touches_are_a_double_tap);
+  RUN_TEST(test_taps_too_far_apart_are_two_taps);
+  RUN_TEST(test_long_second_touch_splits_a_double_tap);
+  RUN_TEST(test_long_press);
+  RUN_TEST(test_hold_is_said_while_still_touching);
+  RUN_TEST(test_touch_between_tap_and_long_press_says_nothing);
+  RUN_TEST(test_short_dropout_is_the_same_touch);
+  RUN_TEST(test_gap_past_release_time_ends_a_touch);
+  RUN_TEST(test_double_tap_across_the_clock_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,198 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "host/m0_emu.h"
+
+// The Cortex-M0+ emulator (m0_emu.h) that the cycles tool counts with.
+// Hand-assembled Thumb, with the flags and the cycle counts the Cortex-M0+
+// Technical Reference Manual gives for it, so the "exact" counts are
+// checked against something other than the emulator itself.
+//
+//   pio test -e native -f test_m0_emu
+
+#define APSR_N 0x80000000u
+#define APSR_Z 0x40000000u
+#define APSR_C 0x20000000u
+#define APSR_V 0x10000000u
+
+// The instructions used below.
+#define MOVS_R0(imm) (0x2000 | (imm))
+#define MOVS_R1(imm) (0x2100 | (imm))
+#define MOVS_R4(imm) (0x2400 | (imm))
+#define CMP_R0(imm) (0x2800 | (imm))
+#define LSLS_R0_R0_31 0x07C0
+#define SUBS_R0_R0_1 0x1E40 // Three bit immediate form.
+#define ADDS_R0_R0_1 0x1C40
+#define SUBS_R0_1 0x3801 // Eight bit immediate form.
+#define ADDS_R0_R4_0 0x1C20
+#define MULS_R0_R1 0x4348
+#define LDR_R0_R0 0x6800
+#define LDR_R0_SP 0x9800
+#define ADD_SP_4 0xB001
+#define PUSH_R1 0xB402
+#define PUSH_LR 0xB500
+#define PUSH_R4_LR 0xB510
+#define POP_PC 0xBD00
+#define POP_R4_PC 0xBD10
+#define BNE(back) (0xD100 | (uint8_t)(back))
+#define MRS_R0_APSR 0xF3EF, 0x8000
+#define BX_LR 0x4770
+
+static M0Emulator emu;
+
+static void put16(uint8_t *at, uint32_t value)
+{
+  at[0] = value;
+  at[1] = value >> 8;
+}
+
+static void put32(uint8_t *at, uint32_t value)
+{
+  put16(at, value);
+  put16(at + 2, value >> 16);
+}
+
+// Load `code` at the bottom of flash, by way of the smallest ELF file
+// load() will take: a header and one loadable segment, no symbols.
+static void loadCode(const std::vector<uint16_t> &code)
+{
+  std::vector<uint8_t> elf(52 + 32 + code.size() * 2, 0);
+  memcpy(elf.data(), "\177ELF", 4);
+  elf[4] = 1; // 32 bit.
+  elf[5] = 1; // Little-endian.
+  elf[6] = 1;
+  put16(&elf[16], 2);  // An executable...
+  put16(&elf[18], 40); // ...for ARM.
+  put32(&elf[20], 1);
+  put32(&elf[28], 52); // Program headers straight after this one.
+  put16(&elf[40], 52);
+  put16(&elf[42], 32);
+  put16(&elf[44], 1);
+  put16(&elf[46], 40);
+  uint8_t *segment = &elf[52];
+  put32(segment, 1); // PT_LOAD, to address 0.
+  put32(segment + 4, 52 + 32);
+  put32(segment + 16, code.size() * 2);
+  put32(segment + 20, code.size() * 2);
+  put32(segment + 24, 5); // Read and execute.
+  for (size_t i = 0; i < code.size(); i++)
+    put16(&elf[52 + 32 + i * 2], code[i]);
+
+  char path[] = "/tmp/test_m0_emu_XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd >= 0);
+  TEST_ASSERT_EQUAL_INT((long)elf.size(), (long)write(fd, elf.data(), elf.size()));
+  close(fd);
+  bool loaded = emu.load(path);
+  unlink(path);
+  TEST_ASSERT_TRUE_MESSAGE(loaded, emu.error.c_str());
+}
+
+static uint32_t run(const std::vector<uint16_t> &code)
+{
+  loadCode(code);
+  uint32_t result = emu.call(0);
+  TEST_ASSERT_FALSE(emu.failed());
+  return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// 0x7FFFFFFF + 1: negative, signed overflow, no carry.
+static void test_adds_overflow_flags()
+{
+  uint32_t apsr = run({MOVS_R0(1), LSLS_R0_R0_31, SUBS_R0_R0_1, ADDS_R0_R0_1, MRS_R0_APSR, BX_LR});
+  TEST_ASSERT_EQUAL_UINT32(APSR_N | APSR_V, apsr);
+  TEST_ASSERT_EQUAL_INT(6, emu.count.instructions);
+  TEST_ASSERT_EQUAL_INT(1 + 1 + 1 + 1 + 3 + 2, emu.count.cycles); // ALU ops 1, MRS 3, BX 2.
+}
+
+// 0x80000000 - 1: the other way round, and no borrow is carry set.
+static void test_subs_overflow_flags()
+{
+  uint32_t apsr = run({MOVS_R0(1), LSLS_R0_R0_31, SUBS_R0_R0_1, MRS_R0_APSR, BX_LR});
+  TEST_ASSERT_EQUAL_UINT32(APSR_C | APSR_V, apsr);
+}
+
+static void test_compare_flags()
+{
+  TEST_ASSERT_EQUAL_UINT32(APSR_Z | APSR_C, run({MOVS_R0(5), CMP_R0(5), MRS_R0_APSR, BX_LR}));
+  TEST_ASSERT_EQUAL_UINT32(APSR_N, run({MOVS_R0(3), CMP_R0(5), MRS_R0_APSR, BX_LR}));
+  TEST_ASSERT_EQUAL_UINT32(APSR_C, run({MOVS_R0(7), CMP_R0(5), MRS_R0_APSR, BX_LR}));
+}
+
+// Count down from 3: the branch back is taken twice (2 cycles) and falls
+// through once (1 cycle).
+static void test_branch_cycles()
+{
+  uint32_t result = run({MOVS_R0(3), SUBS_R0_1, BNE(-3), BX_LR});
+  TEST_ASSERT_EQUAL_UINT32(0, result);
+  TEST_ASSERT_EQUAL_INT(1 + 3 + 3 + 1, emu.count.instructions);
+  TEST_ASSERT_EQUAL_INT(1 + 3 * 1 + 2 * 2 + 1 + 2, emu.count.cycles);
+}
+
+// PUSH is 1 + N for N registers, LR among them.  POP with the PC is
+// 3 + N, with N the registers other than the PC.
+static void test_push_pop_cycles()
+{
+  uint32_t result = run({PUSH_R4_LR, MOVS_R4(7), ADDS_R0_R4_0, POP_R4_PC});
+  TEST_ASSERT_EQUAL_UINT32(7, result);
+  TEST_ASSERT_EQUAL_INT((1 + 2) + 1 + 1 + (3 + 1), emu.count.cycles);
+  TEST_ASSERT_EQUAL_INT(8, emu.count.stack);
+}
+
+static void test_load_store_cycles()
+{
+  uint32_t result = run({MOVS_R1(42), PUSH_R1, LDR_R0_SP, ADD_SP_4, BX_LR});
+  TEST_ASSERT_EQUAL_UINT32(42, result);
+  TEST_ASSERT_EQUAL_INT(1 + (1 + 1) + 2 + 1 + 2, emu.count.cycles);
+  TEST_ASSERT_EQUAL_INT(4, emu.count.stack);
+}
+
+// The SAMD21 has the single cycle multiplier.
+static void test_multiply_cycles()
+{
+  TEST_ASSERT_EQUAL_UINT32(42, run({MOVS_R0(6), MOVS_R1(7), MULS_R0_R1, BX_LR}));
+  TEST_ASSERT_EQUAL_INT(1 + 1 + 1 + 2, emu.count.cycles);
+}
+
+// BL to a function two instructions on, which returns with BX LR.
+static void test_call_cycles()
+{
+  uint32_t result = run({PUSH_LR, 0xF000, 0xF801, POP_PC, MOVS_R0(9), BX_LR});
+  TEST_ASSERT_EQUAL_UINT32(9, result);
+  TEST_ASSERT_EQUAL_INT(5, emu.count.instructions);
+  TEST_ASSERT_EQUAL_INT((1 + 1) + 3 + 1 + 2 + 3, emu.count.cycles);
+}
+
+// The real core faults on an unaligned word load, and so does this.
+static void test_unaligned_load_faults()
+{
+  loadCode({MOVS_R0(1), LDR_R0_R0, BX_LR});
+  emu.call(0);
+  TEST_ASSERT_TRUE(emu.failed());
+  TEST_ASSERT_NOT_NULL(strstr(emu.error.c_str(), "unaligned"));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_adds_overflow_flags);
+  RUN_TEST(test_subs_overflow_flags);
+  RUN_TEST(test_compare_flags);
+  RUN_TEST(test_branch_cycles);
+  RUN_TEST(test_push_pop_cycles);
+  RUN_TEST(test_load_store_cycles);
+  RUN_TEST(test_multiply_cycles);
+  RUN_TEST(test_call_cycles);
+  RUN_TEST(test_unaligned_load_faults);
+  return UNITY_END();
+}
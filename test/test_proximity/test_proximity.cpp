@@ -0,0 +1,165 @@
+#include <unity.h>
+#include <math.h>
+#include "host/sim_random.h"
+#include "params.h"
+#include "proximity.h"
+
+// The proximity tracker (proximity.h): it sits on a steady reading,
+// follows a steady approach without the average's lag, measures the
+// noise and the loop time it is given, steps over a spike but follows a
+// jump, and smooths harder the noisier the readings are.
+//
+//   pio test -e native -f test_proximity
+
+#define LOOP_MS 10
+#define BASE 725
+
+static ProximityTracker prox;
+static uint32_t now;
+static SimRandom noise(1);
+
+static void sample(double level, bool quiet, double sd = 0, int accel = TRACK_ACCEL, uint32_t loopMs = LOOP_MS)
+{
+  double reading = level + sd * noise.gaussian();
+  now += loopMs;
+  proximitySample(prox, now, (int)lround(reading), BASE, quiet, accel);
+}
+
+// Long enough to measure the noise a few times over.
+static void quiet(double sd, int accel = TRACK_ACCEL)
+{
+  for (int i = 0; i < PROXIMITY_NOISE_WINDOW * 4; i++)
+    sample(BASE, true, sd, accel);
+}
+
+void setUp()
+{
+  proximityReset(prox);
+  now = 1000;
+}
+
+void tearDown()
+{
+}
+
+static void test_steady_reading_is_held()
+{
+  quiet(0);
+  TEST_ASSERT_EQUAL_INT(BASE, proximityLevel(prox));
+  TEST_ASSERT_EQUAL_INT(0, proximityVelocity(prox));
+}
+
+// 50 counts a second in: the tracker is within a count or two of the
+// reading and has the speed, where a 50 reading average would be 12
+// counts behind.
+static void test_steady_approach_is_followed_without_lag()
+{
+  quiet(1);
+  double level = BASE;
+  for (int i = 0; i < 150; i++)
+    sample(level += 0.5, false);
+  TEST_ASSERT_INT_WITHIN(2, (int)level, proximityLevel(prox));
+  TEST_ASSERT_INT_WITHIN(5, 50, proximityVelocity(prox));
+
+  // And going away again reads as negative.
+  for (int i = 0; i < 150; i++)
+    sample(level -= 0.5, false);
+  TEST_ASSERT_INT_WITHIN(2, (int)level, proximityLevel(prox));
+  TEST_ASSERT_INT_WITHIN(5, -50, proximityVelocity(prox));
+}
+
+// Noise measured in sixteenths of a count, only from quiet readings.
+static void test_noise_is_measured_while_quiet()
+{
+  quiet(3);
+  TEST_ASSERT_INT_WITHIN(6, 3 * 16, prox.noise);
+
+  // A finger coming and going doesn't count as noise.
+  int measured = prox.noise;
+  for (int i = 0; i < PROXIMITY_NOISE_WINDOW * 2; i++)
+    sample(BASE + (i / 20 % 2 ? 80 : 0), false, 3);
+  TEST_ASSERT_EQUAL_INT(measured, prox.noise);
+
+  // And a quiet pad never reads as quieter than the ADC rounds to.
+  quiet(0);
+  TEST_ASSERT_EQUAL_INT(PROXIMITY_NOISE_MIN, prox.noise);
+}
+
+// Smoothing by a sixteenth in whole sixteenths of a ms stops short by
+// up to a millisecond.
+static void test_loop_time_is_measured()
+{
+  for (int i = 0; i < 200; i++)
+    sample(BASE, true, 0, TRACK_ACCEL, 20);
+  TEST_ASSERT_INT_WITHIN(16, 20 * 16, prox.loopTime);
+  int32_t measured = prox.loopTime;
+
+  // A stall isn't a loop.
+  sample(BASE, true, 0, TRACK_ACCEL, 5000);
+  TEST_ASSERT_EQUAL_INT(measured, prox.loopTime);
+}
+
+// One reading far off is a spike and is coasted over; two in a row are a
+// jump, and the tracker goes straight there.
+static void test_spike_is_skipped_and_jump_is_followed()
+{
+  quiet(1);
+  sample(BASE + 200, false);
+  TEST_ASSERT_TRUE(prox.gated);
+  TEST_ASSERT_INT_WITHIN(2, BASE, proximityLevel(prox));
+  sample(BASE, false);
+  TEST_ASSERT_FALSE(prox.gated);
+  TEST_ASSERT_INT_WITHIN(2, BASE, proximityLevel(prox));
+
+  sample(BASE + 200, false);
+  sample(BASE + 200, false);
+  TEST_ASSERT_EQUAL_INT(BASE + 200, proximityLevel(prox));
+  TEST_ASSERT_EQUAL_INT(0, proximityVelocity(prox));
+}
+
+// Noisier readings or a lazier finger: smaller gains.
+static void test_gains_follow_noise_and_accel()
+{
+  quiet(1);
+  int32_t quietAlpha = prox.alpha, quietBeta = prox.beta;
+  proximityReset(prox);
+  quiet(4);
+  TEST_ASSERT_LESS_THAN(quietAlpha, prox.alpha);
+  TEST_ASSERT_LESS_THAN(quietBeta, prox.beta);
+
+  int32_t noisyAlpha = prox.alpha;
+  sample(BASE, true, 4, TRACK_ACCEL * 4);
+  TEST_ASSERT_GREATER_THAN(noisyAlpha, prox.alpha);
+  TEST_ASSERT_TRUE(prox.alpha > 0 && prox.alpha < 1 << PROXIMITY_GAIN_SHIFT);
+  TEST_ASSERT_TRUE(prox.beta > 0 && prox.beta < prox.alpha);
+}
+
+// Reset is the same as "= {}": both start over from the next reading.
+static void test_reset_starts_over()
+{
+  quiet(2);
+  sample(BASE + 30, false);
+  proximityReset(prox);
+  TEST_ASSERT_EQUAL_INT(0, proximityVelocity(prox));
+
+  ProximityTracker fresh = {};
+  sample(BASE + 10, false);
+  proximitySample(fresh, now, BASE + 10, BASE, false, TRACK_ACCEL);
+  TEST_ASSERT_EQUAL_INT(proximityLevel(fresh), proximityLevel(prox));
+  TEST_ASSERT_EQUAL_INT(fresh.noise, prox.noise);
+  TEST_ASSERT_EQUAL_INT(fresh.loopTime, prox.loopTime);
+  TEST_ASSERT_EQUAL_INT(fresh.alpha, prox.alpha);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_reading_is_held);
+  RUN_TEST(test_steady_approach_is_followed_without_lag);
+  RUN_TEST(test_noise_is_measured_while_quiet);
+  RUN_TEST(test_loop_time_is_measured);
+  RUN_TEST(test_spike_is_skipped_and_jump_is_followed);
+  RUN_TEST(test_gains_follow_noise_and_accel);
+  RUN_TEST(test_reset_starts_over);
+  return UNITY_END();
+}
@@ -0,0 +1,211 @@
+#include <unity.h>
+#include "host/sim_random.h"
+#include "sensor_health.h"
+
+// The sensor health checks (sensor_health.h): a working pad - quiet,
+// noisy, or with fingers on it - never faults, and each way a broken one
+// goes wrong is caught, blinked and cleared again once it is mended.
+//
+//   pio test -e native -f test_sensor_health
+
+#define SAMPLE_MS 10
+#define BASE 725
+
+// The checks keep their state in statics and only ever see the clock go
+// forward, so every test carries on from where the last one left off.
+static uint32_t now = 1000;
+
+// Readings around `level`, `noise` counts either way.
+struct Pad
+{
+  int level;
+  int noise;
+  SimRandom random;
+};
+
+static int reading(Pad &pad)
+{
+  return pad.level + (pad.noise > 0 ? (int)(pad.random.next() % (2 * pad.noise + 1)) - pad.noise : 0);
+}
+
+// Feed `ms` of readings.  Returns the first verdict that wasn't HEALTH_OK,
+// or HEALTH_OK.
+static HealthVerdict feed(Pad &pad, uint32_t ms)
+{
+  HealthVerdict first = HEALTH_OK;
+  for (uint32_t until = now + ms; now < until; now += SAMPLE_MS)
+  {
+    HealthVerdict verdict = sensorHealthSample(now, reading(pad), BASE);
+    if (first == HEALTH_OK && verdict != HEALTH_OK)
+      first = verdict;
+  }
+  return first;
+}
+
+// Feed until the verdict is `wanted`.  Returns how long that took, or
+// `limitMs` if it never came.
+static uint32_t feedUntil(Pad &pad, HealthVerdict wanted, uint32_t limitMs)
+{
+  for (uint32_t taken = 0; taken < limitMs; taken += SAMPLE_MS, now += SAMPLE_MS)
+  {
+    if (sensorHealthSample(now, reading(pad), BASE) == wanted)
+      return taken;
+  }
+  return limitMs;
+}
+
+void setUp()
+{
+  // Forget anything a failed test left behind, and take the one reading
+  // a clear skips.
+  sensorHealthClear();
+  sensorHealthSample(now, BASE, BASE);
+  now += SAMPLE_MS;
+}
+
+void tearDown()
+{
+}
+
+static void test_working_pad_never_faults()
+{
+  Pad quiet = {BASE, 1, SimRandom(1)};
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(quiet, 10 * 60 * 1000));
+  Pad noisy = {BASE, 8, SimRandom(2)};
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(noisy, 10 * 60 * 1000));
+  TEST_ASSERT_EQUAL_INT(SENSOR_OK, sensorFault());
+}
+
+// Fingers come and go, even a hand resting on the pad for half a minute.
+static void test_fingers_are_not_faults()
+{
+  Pad pad = {BASE, 2, SimRandom(3)};
+  for (int i = 0; i < 20; i++)
+  {
+    pad.level = BASE + 200;
+    TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, 1500));
+    pad.level = BASE;
+    TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, 3000));
+  }
+  pad.level = BASE + 250;
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, 30000));
+  pad.level = BASE;
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, 5000));
+}
+
+static void test_pinned_reading_is_caught_and_clears()
+{
+  unsigned long before = sensorHealthFaults();
+  Pad pad = {1023, 0, SimRandom(4)};
+  uint32_t taken = feedUntil(pad, HEALTH_NEW_FAULT, 5000);
+  TEST_ASSERT_LESS_OR_EQUAL(HEALTH_PINNED_MS + SAMPLE_MS, taken);
+  TEST_ASSERT_EQUAL_INT(SENSOR_PINNED, sensorFault());
+  TEST_ASSERT_EQUAL_INT(before + 1, sensorHealthFaults());
+
+  pad = {BASE, 2, SimRandom(5)};
+  taken = feedUntil(pad, HEALTH_RECOVERED, 20000);
+  TEST_ASSERT_LESS_OR_EQUAL(HEALTH_RECOVER_MS + SAMPLE_MS, taken);
+  TEST_ASSERT_EQUAL_INT(SENSOR_OK, sensorFault());
+}
+
+static void test_broken_wire_is_open()
+{
+  Pad pad = {BASE - 300, 2, SimRandom(6)};
+  uint32_t taken = feedUntil(pad, HEALTH_NEW_FAULT, 10000);
+  TEST_ASSERT_LESS_OR_EQUAL(HEALTH_OPEN_MS + SAMPLE_MS, taken);
+  TEST_ASSERT_EQUAL_INT(SENSOR_OPEN, sensorFault());
+
+  // Still broken: still faulty, however long.
+  TEST_ASSERT_EQUAL_INT(HEALTH_FAULTY, feed(pad, 30000));
+  TEST_ASSERT_EQUAL_INT(SENSOR_OPEN, sensorFault());
+
+  pad.level = BASE;
+  TEST_ASSERT_LESS_OR_EQUAL(HEALTH_RECOVER_MS + SAMPLE_MS, feedUntil(pad, HEALTH_RECOVERED, 20000));
+}
+
+static void test_pad_against_the_enclosure_is_short()
+{
+  Pad pad = {BASE + HEALTH_SHORT_STEP + 20, 2, SimRandom(7)};
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, HEALTH_SHORT_MS - 1000));
+  feedUntil(pad, HEALTH_NEW_FAULT, 5000);
+  TEST_ASSERT_EQUAL_INT(SENSOR_SHORT, sensorFault());
+  pad.level = BASE;
+  TEST_ASSERT_LESS_OR_EQUAL(HEALTH_RECOVER_MS + SAMPLE_MS, feedUntil(pad, HEALTH_RECOVERED, 20000));
+}
+
+static void test_reading_that_stops_moving_is_flat()
+{
+  Pad pad = {BASE, 2, SimRandom(8)};
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, 2 * HEALTH_WINDOW * SAMPLE_MS));
+  pad.noise = 0;
+  uint32_t taken = feedUntil(pad, HEALTH_NEW_FAULT, 60000);
+  TEST_ASSERT_LESS_OR_EQUAL((HEALTH_FLAT_WINDOWS + 1) * HEALTH_WINDOW * SAMPLE_MS, taken);
+  TEST_ASSERT_EQUAL_INT(SENSOR_FLAT, sensorFault());
+  // Moving again: a whole window with some life in it, then
+  // HEALTH_RECOVER_MS of that.
+  pad.noise = 2;
+  uint32_t limit = 2 * HEALTH_WINDOW * SAMPLE_MS + HEALTH_RECOVER_MS;
+  TEST_ASSERT_LESS_OR_EQUAL(limit - SAMPLE_MS, feedUntil(pad, HEALTH_RECOVERED, limit));
+}
+
+// Still from the start - the simulator's constant reading, or a very
+// steady board - isn't a fault: it never looked like a working pad to stop.
+static void test_reading_that_never_moved_is_not_flat()
+{
+  Pad pad = {BASE, 0, SimRandom(11)};
+  TEST_ASSERT_EQUAL_INT(HEALTH_OK, feed(pad, 60000));
+  TEST_ASSERT_EQUAL_INT(SENSOR_OK, sensorFault());
+}
+
+static void test_baseline_out_of_range()
+{
+  for (int i = 0; i < 10; i++)
+    TEST_ASSERT_EQUAL_INT(HEALTH_OK, sensorHealthSample(now += SAMPLE_MS, BASE, BASE));
+  HealthVerdict verdict = sensorHealthSample(now += SAMPLE_MS, 150, 150);
+  TEST_ASSERT_EQUAL_INT(HEALTH_NEW_FAULT, verdict);
+  TEST_ASSERT_EQUAL_INT(SENSOR_BASELINE, sensorFault());
+}
+
+// The fault's number, over and over: three blinks a round for OPEN.
+static void test_light_blinks_the_fault_number()
+{
+  Pad pad = {BASE - 300, 2, SimRandom(9)};
+  feedUntil(pad, HEALTH_NEW_FAULT, 10000);
+  TEST_ASSERT_EQUAL_INT(SENSOR_OPEN, sensorFault());
+  uint32_t round = SENSOR_OPEN * (HEALTH_BLINK_ON_MS + HEALTH_BLINK_OFF_MS) + HEALTH_BLINK_PAUSE_MS;
+  int rises = 0;
+  bool lit = false;
+  for (uint32_t t = 0; t < 2 * round; t += SAMPLE_MS)
+  {
+    bool on = sensorHealthLight(now + t) > 0;
+    rises += on && !lit;
+    lit = on;
+  }
+  TEST_ASSERT_EQUAL_INT(2 * SENSOR_OPEN, rises);
+}
+
+static void test_clear_by_hand()
+{
+  Pad pad = {BASE - 300, 2, SimRandom(10)};
+  feedUntil(pad, HEALTH_NEW_FAULT, 10000);
+  TEST_ASSERT_EQUAL_INT(SENSOR_OPEN, sensorFault());
+  sensorHealthClear();
+  TEST_ASSERT_EQUAL_INT(SENSOR_OK, sensorFault());
+  TEST_ASSERT_EQUAL_INT(HEALTH_RECOVERED, sensorHealthSample(now += SAMPLE_MS, pad.level, BASE));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_working_pad_never_faults);
+  RUN_TEST(test_fingers_are_not_faults);
+  RUN_TEST(test_pinned_reading_is_caught_and_clears);
+  RUN_TEST(test_broken_wire_is_open);
+  RUN_TEST(test_pad_against_the_enclosure_is_short);
+  RUN_TEST(test_reading_that_stops_moving_is_flat);
+  RUN_TEST(test_reading_that_never_moved_is_not_flat);
+  RUN_TEST(test_baseline_out_of_range);
+  RUN_TEST(test_light_blinks_the_fault_number);
+  RUN_TEST(test_clear_by_hand);
+  return UNITY_END();
+}
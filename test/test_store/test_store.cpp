@@ -0,0 +1,237 @@
+#include <unity.h>
+#include "flash_region.h"
+#include "host/flash_sim.h"
+#include "store.h"
+
+// The settings store (store.h) against the flash simulator, including
+// power cuts in the middle of a write and in the middle of a swap.
+//
+//   pio test -e native -f test_store
+
+#define PAGES_PER_HALF (FLASH_REGION_SIZE / 2 / FLASH_REGION_PAGE)
+
+// Every payload fills the record and carries its value all the way
+// through, so a record that comes back mangled - or half written by a
+// power cut - can't pass for a good one.
+#define WORDS (STORE_PAYLOAD_SIZE / 4)
+
+static bool save(uint8_t type, int32_t value)
+{
+  int32_t payload[WORDS];
+  for (int i = 0; i < WORDS; i++)
+    payload[i] = value ^ (i * 0x01010101);
+  return storeSave(type, 1, payload, sizeof(payload));
+}
+
+// The value of the newest `type` record, or -1 if there isn't one.
+static int32_t load(uint8_t type)
+{
+  int32_t payload[WORDS];
+  uint8_t version;
+  int length = storeLoad(type, payload, sizeof(payload), &version);
+  if (length < 0)
+    return -1;
+  TEST_ASSERT_EQUAL_INT(STORE_PAYLOAD_SIZE, length);
+  TEST_ASSERT_EQUAL_INT(1, version);
+  for (int i = 1; i < WORDS; i++)
+    TEST_ASSERT_EQUAL_INT(payload[0] ^ (i * 0x01010101), payload[i]);
+  return payload[0];
+}
+
+// Power back on and scan the flash, as setup() does.
+static void reboot()
+{
+  flashSimPowerOn();
+  storeBegin();
+}
+
+void setUp()
+{
+  flashSimReset(true);
+  storeBegin();
+}
+
+void tearDown()
+{
+}
+
+static void test_empty_store_has_nothing()
+{
+  for (uint8_t type = 1; type <= STORE_MAX_TYPES; type++)
+    TEST_ASSERT_EQUAL_INT(-1, load(type));
+}
+
+static void test_saved_record_survives_a_reboot()
+{
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 42));
+  reboot();
+  TEST_ASSERT_EQUAL_INT(42, load(STORE_TYPE_PARAMS));
+  TEST_ASSERT_EQUAL_INT(-1, load(STORE_TYPE_STATS));
+}
+
+static void test_newest_record_of_each_type_wins()
+{
+  for (int i = 0; i < 10; i++)
+  {
+    TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 100 + i));
+    TEST_ASSERT_TRUE(save(STORE_TYPE_STATS, 200 + i));
+  }
+  TEST_ASSERT_EQUAL_INT(109, load(STORE_TYPE_PARAMS));
+  reboot();
+  TEST_ASSERT_EQUAL_INT(109, load(STORE_TYPE_PARAMS));
+  TEST_ASSERT_EQUAL_INT(209, load(STORE_TYPE_STATS));
+}
+
+static void test_shorter_older_record_reports_its_length()
+{
+  int32_t payload[2] = {5, 6};
+  TEST_ASSERT_TRUE(storeSave(STORE_TYPE_DISTANCE, 0, payload, sizeof(payload)));
+  reboot();
+  int32_t loaded[STORE_PAYLOAD_SIZE / 4];
+  uint8_t version = 99;
+  TEST_ASSERT_EQUAL_INT(8, storeLoad(STORE_TYPE_DISTANCE, loaded, sizeof(loaded), &version));
+  TEST_ASSERT_EQUAL_INT(0, version);
+  TEST_ASSERT_EQUAL_MEMORY(payload, loaded, sizeof(payload));
+}
+
+static void test_bad_arguments_are_refused()
+{
+  int32_t payload[STORE_PAYLOAD_SIZE / 4 + 1] = {};
+  TEST_ASSERT_FALSE(storeSave(0, 1, payload, 4));
+  TEST_ASSERT_FALSE(storeSave(STORE_MAX_TYPES + 1, 1, payload, 4));
+  TEST_ASSERT_FALSE(storeSave(STORE_TYPE_PARAMS, 1, payload, STORE_PAYLOAD_SIZE + 1));
+  uint8_t version;
+  TEST_ASSERT_EQUAL_INT(-1, storeLoad(0, payload, 4, &version));
+}
+
+// A freshly flashed image has zeros where the store goes, not 0xFF.
+static void test_zeroed_flash_is_usable()
+{
+  flashSimReset(false);
+  storeBegin();
+  TEST_ASSERT_EQUAL_INT(-1, load(STORE_TYPE_PARAMS));
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 7));
+  reboot();
+  TEST_ASSERT_EQUAL_INT(7, load(STORE_TYPE_PARAMS));
+}
+
+static void test_corrupt_record_is_skipped()
+{
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 5));
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 6));
+  flashSimData()[FLASH_REGION_PAGE + 40] ^= 0x01; // In the second record's payload.
+  reboot();
+  TEST_ASSERT_EQUAL_INT(5, load(STORE_TYPE_PARAMS));
+}
+
+static void test_power_cut_mid_write_keeps_the_last_good_copy()
+{
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 1));
+  flashSimCutPowerAfter(1);
+  TEST_ASSERT_FALSE(save(STORE_TYPE_PARAMS, 2));
+  reboot();
+  TEST_ASSERT_EQUAL_INT(1, load(STORE_TYPE_PARAMS));
+
+  // The half written page is skipped, and the next save goes after it.
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 3));
+  reboot();
+  TEST_ASSERT_EQUAL_INT(3, load(STORE_TYPE_PARAMS));
+}
+
+// Fill the active half so that the next save has to swap: one record of
+// every type, then PARAMS until the last page.
+static void fillHalf()
+{
+  for (uint8_t type = 1; type <= STORE_MAX_TYPES; type++)
+    TEST_ASSERT_TRUE(save(type, 100 + type));
+  for (int i = STORE_MAX_TYPES; i < PAGES_PER_HALF; i++)
+    TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 1000 + i));
+}
+
+// A swap is an erase of every row in the other half, a copy of each
+// type's newest record and then the new record.  Cut the power at every
+// one of those steps in turn: every type must still load - the new value
+// only if the save said it worked - and the store must carry on working.
+static void test_power_cut_at_every_step_of_a_swap()
+{
+  const int steps = FLASH_REGION_SIZE / 2 / FLASH_REGION_ROW + STORE_MAX_TYPES + 1;
+  for (int cut = 1; cut <= steps + 1; cut++)
+  {
+    flashSimReset(true);
+    storeBegin();
+    fillHalf();
+    unsigned long swapsBefore = storeSwaps();
+
+    flashSimCutPowerAfter(cut);
+    bool saved = save(STORE_TYPE_STATS, 2000);
+    TEST_ASSERT_EQUAL_INT(cut > steps, saved);
+    TEST_ASSERT_EQUAL_INT(swapsBefore + (cut > FLASH_REGION_SIZE / 2 / FLASH_REGION_ROW), storeSwaps());
+    flashSimCutPowerAfter(0);
+    reboot();
+
+    TEST_ASSERT_EQUAL_INT(1000 + PAGES_PER_HALF - 1, load(STORE_TYPE_PARAMS));
+    TEST_ASSERT_EQUAL_INT(saved ? 2000 : 100 + STORE_TYPE_STATS, load(STORE_TYPE_STATS));
+    TEST_ASSERT_EQUAL_INT(100 + STORE_TYPE_DISTANCE, load(STORE_TYPE_DISTANCE));
+    TEST_ASSERT_EQUAL_INT(100 + STORE_TYPE_LOCK, load(STORE_TYPE_LOCK));
+
+    TEST_ASSERT_TRUE(save(STORE_TYPE_DISTANCE, 3000));
+    reboot();
+    TEST_ASSERT_EQUAL_INT(3000, load(STORE_TYPE_DISTANCE));
+    TEST_ASSERT_EQUAL_INT(1000 + PAGES_PER_HALF - 1, load(STORE_TYPE_PARAMS));
+    TEST_ASSERT_EQUAL_INT(saved ? 2000 : 100 + STORE_TYPE_STATS, load(STORE_TYPE_STATS));
+    TEST_ASSERT_EQUAL_INT(100 + STORE_TYPE_LOCK, load(STORE_TYPE_LOCK));
+  }
+}
+
+// A second cut while the first swap is being redone.
+static void test_power_cut_twice_in_a_row()
+{
+  fillHalf();
+  flashSimCutPowerAfter(3);
+  TEST_ASSERT_FALSE(save(STORE_TYPE_PARAMS, 1));
+  reboot();
+  flashSimCutPowerAfter(FLASH_REGION_SIZE / 2 / FLASH_REGION_ROW + 2);
+  TEST_ASSERT_FALSE(save(STORE_TYPE_PARAMS, 2));
+  flashSimCutPowerAfter(0);
+  reboot();
+  TEST_ASSERT_EQUAL_INT(1000 + PAGES_PER_HALF - 1, load(STORE_TYPE_PARAMS));
+  TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, 3));
+  reboot();
+  TEST_ASSERT_EQUAL_INT(3, load(STORE_TYPE_PARAMS));
+  TEST_ASSERT_EQUAL_INT(100 + STORE_TYPE_LOCK, load(STORE_TYPE_LOCK));
+}
+
+// Saving over and over wears every row about the same.
+static void test_wear_is_spread_over_every_row()
+{
+  for (int i = 0; i < 20 * PAGES_PER_HALF; i++)
+    TEST_ASSERT_TRUE(save(STORE_TYPE_PARAMS, i));
+  unsigned long least = flashSimEraseCount(0), most = least;
+  for (int row = 1; row < FLASH_SIM_ROWS; row++)
+  {
+    unsigned long count = flashSimEraseCount(row);
+    least = count < least ? count : least;
+    most = count > most ? count : most;
+  }
+  TEST_ASSERT_GREATER_THAN(0, least);
+  TEST_ASSERT_LESS_OR_EQUAL(least + 1, most);
+  reboot();
+  TEST_ASSERT_EQUAL_INT(20 * PAGES_PER_HALF - 1, load(STORE_TYPE_PARAMS));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_store_has_nothing);
+  RUN_TEST(test_saved_record_survives_a_reboot);
+  RUN_TEST(test_newest_record_of_each_type_wins);
+  RUN_TEST(test_shorter_older_record_reports_its_length);
+  RUN_TEST(test_bad_arguments_are_refused);
+  RUN_TEST(test_zeroed_flash_is_usable);
+  RUN_TEST(test_corrupt_record_is_skipped);
+  RUN_TEST(test_power_cut_mid_write_keeps_the_last_good_copy);
+  RUN_TEST(test_power_cut_at_every_step_of_a_swap);
+  RUN_TEST(test_power_cut_twice_in_a_row);
+  RUN_TEST(test_wear_is_spread_over_every_row);
+  return UNITY_END();
+}
@@ -0,0 +1,188 @@
+#include <unity.h>
+#include "host/flash_sim.h"
+#include "host/hal_sim.h"
+#include "store.h"
+#include "tap_lock.h"
+
+// The secret knock (tap_lock.h): rhythms played in at different speeds
+// and a little sloppily, matched against the patterns by the warping.
+//
+//   pio test -e native -f test_tap_lock
+
+#define SAMPLE_MS 10
+
+// The knocker keeps its state in statics and only ever sees the clock go
+// forward, so every test carries on from where the last one left off.
+static uint32_t now = 1000;
+
+// One touch of a knock: its start, in beats from the first touch, and
+// whether it is held.
+struct Knock
+{
+  float beat;
+  bool hold;
+};
+
+// Gaps between touches have to stay over TAP_RELEASE_MS, or two touches
+// run together into one - so no tempo below about 300ms a beat here.
+#define TAP_LENGTH_MS 80
+#define HOLD_LENGTH_MS 600
+
+// Knock out `knocks` at `beatMs` a beat, with each onset moved by up to
+// `sloppyMs`, and wait for the knock to end.  Returns the action heard.
+static TapAction play(const Knock *knocks, int count, uint32_t beatMs, int sloppyMs = 0)
+{
+  uint32_t startMs = now;
+  uint32_t onsets[16];
+  for (int i = 0; i < count; i++)
+  {
+    int nudge = sloppyMs * ((i * 7 % 5) - 2) / 2; // -1 .. +1 of sloppyMs, the same every run.
+    onsets[i] = startMs + (uint32_t)(knocks[i].beat * beatMs) + (i > 0 ? nudge : 0);
+  }
+  uint32_t endMs = onsets[count - 1] + HOLD_LENGTH_MS + TAP_END_MS + 500;
+  TapAction heard = TAP_ACTION_NONE;
+  for (; now <= endMs; now += SAMPLE_MS)
+  {
+    bool touched = false;
+    for (int i = 0; i < count; i++)
+      touched |= now >= onsets[i] && now < onsets[i] + (knocks[i].hold ? HOLD_LENGTH_MS : TAP_LENGTH_MS);
+    TapAction action = tapLockSample(now, touched);
+    if (action != TAP_ACTION_NONE)
+      heard = action;
+  }
+  // Past the unlock pulse too, so the next test starts with the pin low.
+  for (uint32_t until = now + TAP_UNLOCK_MS; now <= until; now += SAMPLE_MS)
+    tapLockSample(now, false);
+  return heard;
+}
+
+static const Knock TAP_TAP_HOLD[] = {{0, false}, {1, false}, {2, true}};
+static const Knock SHAVE_AND_A_HAIRCUT[] = {{0, false}, {1, false},   {1.5, false}, {2, false},
+                                            {3, false}, {5, false}, {6, false}};
+
+void setUp()
+{
+  halSimMuteSerial(true);
+  flashSimReset(true);
+  storeBegin();
+  tapLockBegin(); // The default patterns.
+}
+
+void tearDown()
+{
+}
+
+static void test_tap_tap_hold_unlocks()
+{
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_UNLOCK, play(TAP_TAP_HOLD, 3, 400));
+}
+
+static void test_unlock_pulses_the_pin()
+{
+  const Knock *knocks = TAP_TAP_HOLD;
+  uint32_t endMs = now + 2 * 400 + HOLD_LENGTH_MS + TAP_END_MS;
+  uint32_t startMs = now;
+  bool unlocked = false;
+  for (; now <= endMs + 100; now += SAMPLE_MS)
+  {
+    bool touched = false;
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t onset = startMs + (uint32_t)(knocks[i].beat * 400);
+      touched |= now >= onset && now < onset + (knocks[i].hold ? HOLD_LENGTH_MS : TAP_LENGTH_MS);
+    }
+    unlocked |= tapLockSample(now, touched) == TAP_ACTION_UNLOCK;
+  }
+  TEST_ASSERT_TRUE(unlocked);
+  TEST_ASSERT_EQUAL_INT(255, halSimPwm(TAP_UNLOCK_PIN));
+  for (uint32_t until = now + TAP_UNLOCK_MS; now <= until; now += SAMPLE_MS)
+    tapLockSample(now, false);
+  TEST_ASSERT_EQUAL_INT(0, halSimPwm(TAP_UNLOCK_PIN));
+}
+
+// The beat is the first gap, so the same rhythm faster or slower is the
+// same knock.
+static void test_tempo_does_not_matter()
+{
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_UNLOCK, play(TAP_TAP_HOLD, 3, 250));
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_UNLOCK, play(TAP_TAP_HOLD, 3, 900));
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_DEBUG, play(SHAVE_AND_A_HAIRCUT, 7, 350));
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_DEBUG, play(SHAVE_AND_A_HAIRCUT, 7, 700));
+}
+
+static void test_a_little_sloppiness_still_matches()
+{
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_DEBUG, play(SHAVE_AND_A_HAIRCUT, 7, 400, 40));
+}
+
+// Shave-and-a-haircut with the quick "and-a" run into one touch, or
+// with an extra touch in the rest, is still shave-and-a-haircut.
+static void test_one_touch_too_few_or_too_many_still_matches()
+{
+  const Knock missing[] = {{0, false}, {1, false}, {2, false}, {3, false}, {5, false}, {6, false}};
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_DEBUG, play(missing, 6, 400));
+  const Knock extra[] = {{0, false}, {1, false}, {1.5, false}, {2, false},
+                         {3, false}, {4, false}, {5, false}, {6, false}};
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_DEBUG, play(extra, 8, 400));
+}
+
+static void test_wrong_knocks_do_nothing()
+{
+  const Knock tapTapTap[] = {{0, false}, {1, false}, {2, false}}; // The last should be held.
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(tapTapTap, 3, 400));
+  const Knock uneven[] = {{0, false}, {1, false}, {4, true}};
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(uneven, 3, 400));
+  const Knock one[] = {{0, false}};
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(one, 1, 400));
+}
+
+// Far longer than any pattern: never matches, and the warping doesn't
+// run off the end of its rows.
+static void test_very_long_knock_does_nothing()
+{
+  Knock knocks[16];
+  for (int i = 0; i < 16; i++)
+    knocks[i] = {(float)i, false};
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(knocks, 16, 200));
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_UNLOCK, play(TAP_TAP_HOLD, 3, 400));
+}
+
+static void test_recorded_knock_becomes_a_pattern()
+{
+  const Knock waltz[] = {{0, false}, {1, true}, {3, false}, {4, true}};
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(waltz, 4, 500));
+  tapLockRecord(2, TAP_ACTION_EFFECT);
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(waltz, 4, 500)); // Recording, not matching.
+  TEST_ASSERT_FALSE(tapLockRecording());
+  TEST_ASSERT_EQUAL_INT(4, tapLockPattern(2).length);
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_EFFECT, play(waltz, 4, 700));
+}
+
+static void test_saved_patterns_come_back()
+{
+  const Knock waltz[] = {{0, false}, {1, true}, {3, false}, {4, true}};
+  tapLockRecord(2, TAP_ACTION_EFFECT);
+  play(waltz, 4, 500);
+  tapLockClear(0); // No more tap tap hold.
+  TEST_ASSERT_TRUE(tapLockSave());
+
+  TEST_ASSERT_TRUE(tapLockBegin()); // As at the next boot.
+  TEST_ASSERT_EQUAL_INT(0, tapLockPattern(0).length);
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_NONE, play(TAP_TAP_HOLD, 3, 400));
+  TEST_ASSERT_EQUAL_INT(TAP_ACTION_EFFECT, play(waltz, 4, 500));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_tap_tap_hold_unlocks);
+  RUN_TEST(test_unlock_pulses_the_pin);
+  RUN_TEST(test_tempo_does_not_matter);
+  RUN_TEST(test_a_little_sloppiness_still_matches);
+  RUN_TEST(test_one_touch_too_few_or_too_many_still_matches);
+  RUN_TEST(test_wrong_knocks_do_nothing);
+  RUN_TEST(test_very_long_knock_does_nothing);
+  RUN_TEST(test_recorded_knock_becomes_a_pattern);
+  RUN_TEST(test_saved_patterns_come_back);
+  return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <unity.h>
+#include "host/sim_random.h"
+#include "water_film.h"
+
+// The water detector (water_film.h): a film that creeps up and settles
+// is found and rebased onto, and a finger coming in - fast or slow - is
+// never taken for one.
+//
+//   pio test -e native -f test_water_film
+
+#define SAMPLE_MS 10
+#define BASE 725
+
+// The finger's counts fall off with distance as in the signal generator
+// (src/host/signal_gen.h): TOUCH_COUNTS * (FALL_OFF / (FALL_OFF + d))^2.
+#define TOUCH_COUNTS 200.0
+#define FALL_OFF_MM 6.0
+#define FAR_MM 150.0
+
+static WaterFilm film;
+static uint32_t now;
+static SimRandom noise(1);
+static int base;
+
+// What one pass over some readings was judged to be.
+struct Verdicts
+{
+  uint32_t suspectMs; // How long the readings were ignored for.
+  int rebases;
+};
+
+static int noisy(double level)
+{
+  double reading = level + noise.roughGaussian();
+  return (int)(reading + (reading < 0 ? -0.5 : 0.5));
+}
+
+// One reading, moving the baseline as detectBaseline() would.
+static void sample(double level, Verdicts &verdicts)
+{
+  WaterVerdict verdict = waterFilmSample(film, now, noisy(level), base);
+  if (verdict == WATER_SUSPECT)
+    verdicts.suspectMs += SAMPLE_MS;
+  else if (verdict == WATER_REBASE)
+  {
+    verdicts.rebases++;
+    base = film.level;
+  }
+  now += SAMPLE_MS;
+}
+
+static Verdicts settle(double level, uint32_t ms)
+{
+  Verdicts verdicts = {};
+  for (uint32_t until = now + ms; now < until;)
+    sample(level, verdicts);
+  return verdicts;
+}
+
+// A film growing from `from` to `to`, a count every two seconds.
+static Verdicts creep(double from, double to)
+{
+  Verdicts verdicts = {};
+  for (double level = from; level < to; level += 0.5 * SAMPLE_MS / 1000)
+    sample(level, verdicts);
+  return verdicts;
+}
+
+// A finger from FAR_MM in to the pad at `mmPerS`, over a pad at `pad`.
+static Verdicts approach(double pad, double mmPerS)
+{
+  Verdicts verdicts = {};
+  for (double d = FAR_MM; d > 0; d -= mmPerS * SAMPLE_MS / 1000)
+  {
+    double ratio = FALL_OFF_MM / (FALL_OFF_MM + d);
+    sample(pad + TOUCH_COUNTS * ratio * ratio, verdicts);
+  }
+  return verdicts;
+}
+
+void setUp()
+{
+  waterFilmReset(film);
+  now = 1000;
+  base = BASE;
+  settle(BASE, 5000);
+}
+
+void tearDown()
+{
+}
+
+static void test_fast_approach_is_never_ignored()
+{
+  Verdicts verdicts = approach(BASE, 100);
+  TEST_ASSERT_EQUAL_UINT32(0, verdicts.suspectMs);
+  TEST_ASSERT_EQUAL_INT(0, verdicts.rebases);
+}
+
+static void test_slow_approaches_are_never_ignored()
+{
+  const double speeds[] = {30, 15, 10, 5};
+  for (double mmPerS : speeds)
+  {
+    setUp();
+    Verdicts verdicts = approach(BASE, mmPerS);
+    TEST_ASSERT_EQUAL_UINT32(0, verdicts.suspectMs);
+    TEST_ASSERT_EQUAL_INT(0, verdicts.rebases);
+    TEST_ASSERT_EQUAL_INT(BASE, base);
+  }
+}
+
+// Condensation: 15 counts in half a minute, then it stays.  Each time it
+// settles it is ignored for WATER_CONFIRM_MS and then rebased on, and it
+// ends up with the baseline on the film.
+static void test_creeping_film_is_found_once_it_settles()
+{
+  Verdicts verdicts = creep(BASE, BASE + 15);
+  Verdicts after = settle(BASE + 15, 10000);
+  int rebases = verdicts.rebases + after.rebases;
+  TEST_ASSERT_GREATER_THAN(0, rebases);
+  TEST_ASSERT_EQUAL_UINT32(rebases * WATER_CONFIRM_MS, verdicts.suspectMs + after.suspectMs);
+  TEST_ASSERT_INT_WITHIN(WATER_STEADY_BAND, BASE + 15, base);
+  TEST_ASSERT_EQUAL_INT(0, settle(BASE + 15, 60000).rebases);
+}
+
+// A jump is no film, however long it stays.
+static void test_sudden_rise_is_not_water()
+{
+  Verdicts verdicts = settle(BASE + 15, 20000);
+  TEST_ASSERT_EQUAL_UINT32(0, verdicts.suspectMs);
+  TEST_ASSERT_EQUAL_INT(0, verdicts.rebases);
+}
+
+// Once rebased the box works on top of the film: a finger is a finger.
+static void test_finger_on_a_wet_pad_counts()
+{
+  creep(BASE, BASE + 15);
+  settle(BASE + 15, 10000);
+  TEST_ASSERT_INT_WITHIN(WATER_STEADY_BAND, BASE + 15, base);
+  Verdicts verdicts = approach(BASE + 15, 100);
+  TEST_ASSERT_EQUAL_UINT32(0, verdicts.suspectMs);
+  TEST_ASSERT_EQUAL_INT(0, verdicts.rebases);
+}
+
+// Water only ever adds: a reading falling away is the baseline's job.
+static void test_falling_reading_is_left_to_the_baseline()
+{
+  Verdicts verdicts = settle(BASE - 20, 20000);
+  TEST_ASSERT_EQUAL_UINT32(0, verdicts.suspectMs);
+  TEST_ASSERT_EQUAL_INT(0, verdicts.rebases);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fast_approach_is_never_ignored);
+  RUN_TEST(test_slow_approaches_are_never_ignored);
+  RUN_TEST(test_creeping_film_is_found_once_it_settles);
+  RUN_TEST(test_sudden_rise_is_not_water);
+  RUN_TEST(test_finger_on_a_wet_pad_counts);
+  RUN_TEST(test_falling_reading_is_left_to_the_baseline);
+  return UNITY_END();
+}